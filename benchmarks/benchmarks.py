@@ -31,7 +31,10 @@ try:
 except TypeError:
     stdpopsim_available = False
 
+import tskit
+
 import msprime
+from msprime import _msprime
 
 
 class LargeSimulationBenchmark:
@@ -200,3 +203,192 @@ class DTWF(LargeSimulationBenchmark):
 
     def peakmem_many_replicates(self):
         self._run_many_replicates()
+
+    def _run_many_populations(self, num_threads):
+        # With threads, the choices for each population in a generation are
+        # drawn concurrently from its own stream by the persistent workers.
+        num_populations = 64
+        sim = msprime.ancestry._parse_sim_ancestry(
+            samples=[
+                msprime.SampleSet(50, population=j) for j in range(num_populations)
+            ],
+            demography=msprime.Demography.island_model(
+                [10**4] * num_populations, migration_rate=1e-3
+            ),
+            sequence_length=1e7,
+            recombination_rate=1e-8,
+            model="dtwf",
+            end_time=2000,
+        )
+        sim = msprime.ancestry.Simulator(
+            **sim._config,
+            random_generator=msprime._msprime.RandomGenerator(42),
+            dtwf_num_threads=num_threads,
+        )
+        sim.run()
+
+    def time_many_populations(self):
+        self._run_many_populations(0)
+
+    def time_many_populations_1_thread(self):
+        self._run_many_populations(1)
+
+    def time_many_populations_4_threads(self):
+        self._run_many_populations(4)
+
+
+class Beta(LargeSimulationBenchmark):
+    # With alpha close to 1 most events are large mergers.
+    params = [1.01, 1.5, 1.9]
+    param_names = ["alpha"]
+
+    def setup(self, alpha):
+        super().setup()
+
+    def _run_large_sample_size(self, alpha):
+        msprime.sim_ancestry(
+            samples=10**4,
+            sequence_length=1e6,
+            population_size=10**4,
+            recombination_rate=1e-8,
+            model=msprime.BetaCoalescent(alpha=alpha),
+            random_seed=42,
+        )
+
+    def time_large_sample_size(self, alpha):
+        self._run_large_sample_size(alpha)
+
+    def peakmem_large_sample_size(self, alpha):
+        self._run_large_sample_size(alpha)
+
+
+class Mutations(LargeSimulationBenchmark):
+    params = [1, 2, 4, 8, 16, 32]
+    param_names = ["num_threads"]
+
+    def setup(self, num_threads):
+        super().setup()
+        self.ts = msprime.sim_ancestry(
+            samples=10**4,
+            sequence_length=1e7,
+            population_size=10**4,
+            recombination_rate=1e-8,
+            random_seed=42,
+        )
+
+    def time_sim_mutations(self, num_threads):
+        msprime.sim_mutations(
+            self.ts, rate=1e-8, random_seed=42, num_threads=num_threads
+        )
+
+    def peakmem_sim_mutations(self, num_threads):
+        msprime.sim_mutations(
+            self.ts, rate=1e-8, random_seed=42, num_threads=num_threads
+        )
+
+
+class MatrixMutations(LargeSimulationBenchmark):
+    # Matrix models with at least MSP_MATRIX_ALIAS_MIN_ALLELES alleles use
+    # alias tables, and smaller ones a linear scan.
+    params = [2, 4, 8, 20, 64]
+    param_names = ["num_alleles"]
+
+    def setup(self, num_alleles):
+        super().setup()
+        self.ts = msprime.sim_ancestry(
+            samples=10**3,
+            sequence_length=1e6,
+            population_size=10**4,
+            recombination_rate=1e-8,
+            random_seed=42,
+        )
+        alleles = [str(j) for j in range(num_alleles)]
+        off_diagonal = 1 / (num_alleles - 1)
+        self.model = msprime.MatrixMutationModel(
+            alleles=alleles,
+            root_distribution=[1 / num_alleles] * num_alleles,
+            transition_matrix=[
+                [0 if j == k else off_diagonal for k in range(num_alleles)]
+                for j in range(num_alleles)
+            ],
+        )
+
+    def time_sim_mutations(self, num_alleles):
+        msprime.sim_mutations(
+            self.ts, rate=1e-6, model=self.model, random_seed=42
+        )
+
+
+class InlineMutations(LargeSimulationBenchmark):
+    # Placing mutations as the edges are stored is only available through
+    # the low-level Simulator, so we compare it with running sim_mutations
+    # on the finished tables.
+    def setup(self):
+        super().setup()
+        self.num_samples = 2 * 10**3
+        self.sequence_length = 1e7
+        self.rate = 1e-8
+        self.model = msprime.BinaryMutationModel()
+
+    def _make_simulator(self, **kwargs):
+        tables = tskit.TableCollection(self.sequence_length)
+        for _ in range(self.num_samples):
+            tables.nodes.add_row(flags=tskit.NODE_IS_SAMPLE, time=0, population=0)
+        tables.populations.add_row()
+        ll_tables = _msprime.LightweightTableCollection(self.sequence_length)
+        ll_tables.fromdict(tables.asdict())
+        return _msprime.Simulator(
+            ll_tables,
+            _msprime.RandomGenerator(42),
+            recombination_map={
+                "position": [0, self.sequence_length],
+                "rate": [self.rate],
+            },
+            population_configuration=[
+                {"initial_size": 10**4, "growth_rate": 0, "initially_active": True}
+            ],
+            migration_matrix=[[0]],
+            discrete_genome=True,
+            **kwargs,
+        )
+
+    def _mutation_rate_map(self):
+        return {"position": [0, self.sequence_length], "rate": [self.rate]}
+
+    def time_inline_mutations(self):
+        sim = self._make_simulator(
+            mutation_rate_map=self._mutation_rate_map(),
+            mutation_model=self.model,
+            mutation_random_generator=_msprime.RandomGenerator(5),
+        )
+        sim.run()
+        sim.finalise_tables()
+
+    def time_sim_mutations_after(self):
+        sim = self._make_simulator()
+        sim.run()
+        sim.finalise_tables()
+        _msprime.sim_mutations(
+            sim.tables,
+            _msprime.RandomGenerator(5),
+            self._mutation_rate_map(),
+            self.model,
+            discrete_genome=True,
+        )
+
+
+class SweepTrajectories(LargeSimulationBenchmark):
+    # Generates trajectories in batches, as sim_ancestry does for replicate
+    # sweeps, so that changes to the batch generator can be timed.
+    params = [1, 64, 1024]
+    param_names = ["num_trajectories"]
+
+    def time_generate(self, num_trajectories):
+        store = _msprime.SweepTrajectoryStore(
+            start_frequency=1 / 20000,
+            end_frequency=0.99,
+            s=0.01,
+            dt=1e-6,
+            population_size=10**4,
+        )
+        store.generate(num_trajectories, _msprime.RandomGenerator(42))
@@ -46,81 +46,207 @@ get_total_material(tsk_treeseq_t *ts)
     return ret;
 }
 
+static inline bool
+tree_node_is_unary(const tsk_tree_t *tree, tsk_id_t u)
+{
+    return tree->left_child[u] != TSK_NULL
+           && tree->left_child[u] == tree->right_child[u];
+}
+
+/* Returns the length of the chain of unary nodes containing the edge above
+ * the specified node, on any part of which a mutation at the node could
+ * have arisen. The length is shared by all the nodes of the chain, so we
+ * store it for each of them, stamped with the index of the current tree. */
+static double
+mut_likelihood_chain_length(
+    const tsk_tree_t *tree, double *chain_length, tsk_id_t *chain_tree, tsk_id_t node)
+{
+    const tsk_id_t *parent = tree->parent;
+    const double *node_time = tree->tree_sequence->tables->nodes.time;
+    tsk_id_t top, u;
+    double length = 0;
+
+    if (chain_tree[node] == tree->index) {
+        return chain_length[node];
+    }
+    top = node;
+    while (parent[parent[top]] != TSK_NULL && tree_node_is_unary(tree, parent[top])) {
+        top = parent[top];
+    }
+    u = top;
+    while (true) {
+        length += node_time[parent[u]] - node_time[u];
+        if (!tree_node_is_unary(tree, u)) {
+            break;
+        }
+        u = tree->left_child[u];
+    }
+    u = top;
+    while (true) {
+        chain_length[u] = length;
+        chain_tree[u] = tree->index;
+        if (!tree_node_is_unary(tree, u)) {
+            break;
+        }
+        u = tree->left_child[u];
+    }
+    return length;
+}
+
 int
-msp_unnormalised_log_likelihood_mut(tsk_treeseq_t *ts, double mu, double *r_lik)
+msp_mut_likelihood_window_run(tsk_treeseq_t *ts, mut_likelihood_window_t *window)
 {
     int ret = 0;
     tsk_size_t j;
-    tsk_mutation_t mut;
-    double num_mutations = (double) tsk_treeseq_get_num_mutations(ts);
-    const double total_material = get_total_material(ts);
-    const double *node_time = ts->tables->nodes.time;
-    double branch_length, lik;
+    tsk_id_t node;
+    double length;
+    const tsk_size_t num_nodes = tsk_treeseq_get_num_nodes(ts);
+    double *chain_length = malloc(num_nodes * sizeof(*chain_length));
+    tsk_id_t *chain_tree = malloc(num_nodes * sizeof(*chain_tree));
     tsk_tree_t tree;
-    tsk_id_t parent, child, it;
 
+    window->log_branch_length = 0;
     ret = tsk_tree_init(&tree, ts, 0);
     if (ret != 0) {
         goto out;
     }
-    if (total_material > 0 && mu > 0) {
-        lik = num_mutations * log(total_material * mu) - total_material * mu;
-        for (it = tsk_tree_first(&tree); it == 1; it = tsk_tree_next(&tree)) {
-            for (j = 0; j < tree.sites_length; j++) {
-                if (tree.sites[j].mutations_length != 1) {
-                    ret = MSP_ERR_BAD_PARAM_VALUE;
-                    goto out;
-                }
-                mut = tree.sites[j].mutations[0];
-                child = mut.node;
-                parent = tree.parent[child];
-                branch_length = node_time[parent] - node_time[child];
-                child = parent;
-                parent = tree.parent[parent];
-                while (parent != TSK_NULL
-                       && tree.left_child[child] == tree.right_child[child]) {
-                    branch_length += node_time[parent] - node_time[child];
-                    child = parent;
-                    parent = tree.parent[parent];
-                }
-                child = mut.node;
-                while (tree.left_child[child] != TSK_NULL
-                       && tree.left_child[child] == tree.right_child[child]) {
-                    // unary nodes have left_child[node] == right_child[node]
-                    // so this measures the valid leafwards branch length on
-                    // which mutation mut could have taken place
-                    parent = child;
-                    child = tree.left_child[child];
-                    branch_length += node_time[parent] - node_time[child];
-                }
-                lik += log(branch_length / total_material);
+    if (chain_length == NULL || chain_tree == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    memset(chain_tree, 0xff, num_nodes * sizeof(*chain_tree));
+    ret = tsk_tree_seek(&tree, window->left, 0);
+    if (ret != 0) {
+        goto out;
+    }
+    do {
+        for (j = 0; j < tree.sites_length; j++) {
+            if (tree.sites[j].mutations_length != 1) {
+                ret = MSP_ERR_BAD_PARAM_VALUE;
+                goto out;
             }
+            node = tree.sites[j].mutations[0].node;
+            length = mut_likelihood_chain_length(&tree, chain_length, chain_tree, node);
+            window->log_branch_length += log(length);
         }
-        if (it < 0) {
-            ret = it;
+        ret = tsk_tree_next(&tree);
+    } while (ret == 1 && tree.interval.left < window->right);
+    if (ret < 0) {
+        goto out;
+    }
+    ret = 0;
+out:
+    tsk_tree_free(&tree);
+    msp_safe_free(chain_length);
+    msp_safe_free(chain_tree);
+    return ret;
+}
+
+static int
+mut_likelihood_run_windows_serially(tsk_treeseq_t *ts, mut_likelihood_window_t *windows,
+    size_t num_windows, void *MSP_UNUSED(arg))
+{
+    int ret = 0;
+    size_t j;
+
+    for (j = 0; j < num_windows; j++) {
+        ret = msp_mut_likelihood_window_run(ts, &windows[j]);
+        if (ret != 0) {
             goto out;
         }
-    } else if (num_mutations > 0) {
-        lik = -DBL_MAX;
-    } else {
-        lik = 0;
     }
-    *r_lik = lik;
 out:
-    tsk_tree_free(&tree);
     return ret;
 }
 
+/* Computes the unnormalised log-likelihood of the mutations for each of
+ * the num_params mutation rates in mu, with a single traversal of the
+ * trees. The trees are split into num_windows windows of contiguous trees,
+ * which the runner may process concurrently; if runner is NULL they are
+ * processed one after the other. */
 int
-msp_log_likelihood_arg(tsk_treeseq_t *ts, double r, double Ne, double *r_lik)
+msp_unnormalised_log_likelihood_mut_vector(tsk_treeseq_t *ts, size_t num_params,
+    const double *mu, double *lik, size_t num_windows,
+    mut_likelihood_window_runner_t runner, void *runner_arg)
+{
+    int ret = 0;
+    size_t j, k, first_tree;
+    const double num_mutations = (double) tsk_treeseq_get_num_mutations(ts);
+    const double total_material = get_total_material(ts);
+    const size_t num_trees = (size_t) tsk_treeseq_get_num_trees(ts);
+    const double *breakpoints = tsk_treeseq_get_breakpoints(ts);
+    double log_branch_length = 0;
+    bool traverse = false;
+    mut_likelihood_window_t *windows = NULL;
+
+    if (runner == NULL) {
+        runner = mut_likelihood_run_windows_serially;
+    }
+    for (k = 0; k < num_params; k++) {
+        traverse = traverse || mu[k] > 0;
+    }
+    traverse = traverse && total_material > 0;
+    if (traverse) {
+        num_windows = TSK_MAX(1, TSK_MIN(num_windows, num_trees));
+        windows = calloc(num_windows, sizeof(*windows));
+        if (windows == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        /* Each window gets the same number of trees, give or take one */
+        for (j = 0; j < num_windows; j++) {
+            first_tree = (j * num_trees) / num_windows;
+            windows[j].left = breakpoints[first_tree];
+            windows[j].right = breakpoints[((j + 1) * num_trees) / num_windows];
+        }
+        ret = runner(ts, windows, num_windows, runner_arg);
+        if (ret != 0) {
+            goto out;
+        }
+        for (j = 0; j < num_windows; j++) {
+            log_branch_length += windows[j].log_branch_length;
+        }
+    }
+    for (k = 0; k < num_params; k++) {
+        if (total_material > 0 && mu[k] > 0) {
+            /* The factors of total_material in the Poisson probability and
+             * in the probability of each mutation's branch cancel. */
+            lik[k] = num_mutations * log(mu[k]) - total_material * mu[k]
+                     + log_branch_length;
+        } else if (num_mutations > 0) {
+            lik[k] = -DBL_MAX;
+        } else {
+            lik[k] = 0;
+        }
+    }
+out:
+    msp_safe_free(windows);
+    return ret;
+}
+
+int
+msp_unnormalised_log_likelihood_mut(tsk_treeseq_t *ts, double mu, double *r_lik)
+{
+    return msp_unnormalised_log_likelihood_mut_vector(ts, 1, &mu, r_lik, 1, NULL, NULL);
+}
+
+static int arg_likelihood_append_event(arg_likelihood_t *self, double time,
+    bool recombination, double log_gap, double lineages, double material);
+
+/* Walks the events of the ARG in time order, accumulating the sufficient
+ * statistics and, if engine is not NULL, appending each event to it. */
+static int
+walk_arg_events(
+    tsk_treeseq_t *ts, arg_likelihood_stats_t *stats, arg_likelihood_t *engine)
 {
     int ret = 0;
     tsk_id_t i;
     double lineages = (double) tsk_treeseq_get_num_samples(ts);
     double sim_time = 0;
     double material = lineages * tsk_treeseq_get_sequence_length(ts);
-    double material_in_children, material_in_parent, rate, gap;
-    double lik = 0;
+    double material_in_children, material_in_parent, dt, gap, log_gap;
+    double lineages_before, material_before;
+    bool recombination;
     const tsk_edge_table_t *edges = &ts->tables->edges;
     const tsk_node_table_t *nodes = &ts->tables->nodes;
     tsk_id_t *first_parent_edge = NULL;
@@ -128,11 +254,7 @@ msp_log_likelihood_arg(tsk_treeseq_t *ts, double r, double Ne, double *r_lik)
     tsk_id_t edge = 0;
     tsk_id_t parent;
 
-    if (Ne <= 0) {
-        ret = MSP_ERR_BAD_POPULATION_SIZE;
-        goto out;
-    }
-
+    memset(stats, 0, sizeof(*stats));
     first_parent_edge = malloc(nodes->num_rows * sizeof(tsk_id_t));
     last_parent_edge = malloc(nodes->num_rows * sizeof(tsk_id_t));
     if (first_parent_edge == NULL || last_parent_edge == NULL) {
@@ -148,16 +270,16 @@ msp_log_likelihood_arg(tsk_treeseq_t *ts, double r, double Ne, double *r_lik)
         last_parent_edge[edges->child[i]] = i;
     }
     while (edge < (tsk_id_t) edges->num_rows && lineages > 0) {
-        rate = lineages * (lineages - 1) / (4 * Ne) + material * r;
         parent = edges->parent[edge];
-        lik -= rate * (nodes->time[parent] - sim_time);
+        dt = nodes->time[parent] - sim_time;
+        stats->coalescence_exposure += lineages * (lineages - 1) * dt;
+        stats->recombination_exposure += material * dt;
         sim_time = nodes->time[parent];
-        if (nodes->flags[parent] & MSP_NODE_IS_RE_EVENT) {
-            if (r <= 0) {
-                *r_lik = -DBL_MAX;
-                ret = 0;
-                goto out;
-            }
+        lineages_before = lineages;
+        material_before = material;
+        log_gap = 0;
+        recombination = nodes->flags[parent] & MSP_NODE_IS_RE_EVENT;
+        if (recombination) {
             while (edge < (tsk_id_t) edges->num_rows && edges->parent[edge] == parent) {
                 edge++;
             }
@@ -165,11 +287,12 @@ msp_log_likelihood_arg(tsk_treeseq_t *ts, double r, double Ne, double *r_lik)
             edge = last_parent_edge[edges->child[edge]];
             material -= gap;
             lineages++;
-            if (gap <= 0) {
-                // we evaluate the density rather than probability
-                gap = 1;
+            if (gap > 0) {
+                /* Otherwise we evaluate the density rather than probability */
+                log_gap = log(gap);
             }
-            lik += log(r * gap);
+            stats->log_gaps += log_gap;
+            stats->num_recombination_events++;
         } else {
             material_in_children = -edges->left[edge];
             edge = last_parent_edge[edges->child[edge]];
@@ -187,16 +310,613 @@ msp_log_likelihood_arg(tsk_treeseq_t *ts, double r, double Ne, double *r_lik)
                 lineages--;
                 material -= material_in_children - material_in_parent;
             }
-            lik -= log(2 * Ne);
+            stats->num_common_ancestor_events++;
+        }
+        if (engine != NULL) {
+            ret = arg_likelihood_append_event(engine, sim_time, recombination,
+                log_gap, lineages_before, material_before);
+            if (ret != 0) {
+                goto out;
+            }
         }
         if (lineages > 0) {
             edge++;
         }
     }
-    *r_lik = lik;
-    ret = 0;
+    if (engine != NULL) {
+        engine->final_lineages = lineages;
+        engine->final_material = material;
+    }
 out:
     msp_safe_free(first_parent_edge);
     msp_safe_free(last_parent_edge);
     return ret;
 }
+
+/* Computes the quantities that the Hudson ARG likelihood depends on,
+ * so that it can be evaluated for many parameter values without walking
+ * the edges again. */
+int
+msp_arg_likelihood_stats(tsk_treeseq_t *ts, arg_likelihood_stats_t *stats)
+{
+    return walk_arg_events(ts, stats, NULL);
+}
+
+/* Evaluates the log-likelihood of the ARG summarised by the specified stats
+ * for each of the num_params pairs (r[j], Ne[j]). If grad_r and grad_Ne are
+ * not NULL, the partial derivatives of the log-likelihood with respect to
+ * r and Ne are also stored. As for msp_log_likelihood_arg, the likelihood
+ * is -DBL_MAX when r is zero and there are recombination events; the
+ * gradients are NaN in this case. */
+int
+msp_log_likelihood_arg_stats(const arg_likelihood_stats_t *stats, size_t num_params,
+    const double *r, const double *Ne, double *lik, double *grad_r, double *grad_Ne)
+{
+    int ret = 0;
+    size_t j;
+    const double num_re = stats->num_recombination_events;
+    const double num_ca = stats->num_common_ancestor_events;
+    const bool impossible_at_zero = num_re > 0;
+
+    for (j = 0; j < num_params; j++) {
+        if (Ne[j] <= 0) {
+            ret = MSP_ERR_BAD_POPULATION_SIZE;
+            goto out;
+        }
+    }
+    for (j = 0; j < num_params; j++) {
+        if (impossible_at_zero && r[j] <= 0) {
+            lik[j] = -DBL_MAX;
+        } else {
+            lik[j] = -stats->coalescence_exposure / (4 * Ne[j])
+                     - stats->recombination_exposure * r[j] - num_ca * log(2 * Ne[j])
+                     + stats->log_gaps;
+            if (num_re > 0) {
+                lik[j] += num_re * log(r[j]);
+            }
+        }
+    }
+    if (grad_r != NULL) {
+        for (j = 0; j < num_params; j++) {
+            if (impossible_at_zero && r[j] <= 0) {
+                grad_r[j] = NAN;
+            } else {
+                grad_r[j] = -stats->recombination_exposure;
+                if (num_re > 0) {
+                    grad_r[j] += num_re / r[j];
+                }
+            }
+        }
+    }
+    if (grad_Ne != NULL) {
+        for (j = 0; j < num_params; j++) {
+            if (impossible_at_zero && r[j] <= 0) {
+                grad_Ne[j] = NAN;
+            } else {
+                grad_Ne[j] = stats->coalescence_exposure / (4 * Ne[j] * Ne[j])
+                             - num_ca / Ne[j];
+            }
+        }
+    }
+out:
+    return ret;
+}
+
+int
+msp_log_likelihood_arg(tsk_treeseq_t *ts, double r, double Ne, double *r_lik)
+{
+    int ret = 0;
+    arg_likelihood_stats_t stats;
+
+    if (Ne <= 0) {
+        ret = MSP_ERR_BAD_POPULATION_SIZE;
+        goto out;
+    }
+    ret = msp_arg_likelihood_stats(ts, &stats);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_log_likelihood_arg_stats(&stats, 1, &r, &Ne, r_lik, NULL, NULL);
+out:
+    return ret;
+}
+
+/* Incremental ARG likelihood.
+ *
+ * The events of the ARG are kept in an AVL tree in time order. Each event
+ * stores the number of lineages and the amount of ancestral material in
+ * the interval that ends at it, and the sufficient statistics are kept up
+ * to date as events are inserted, removed or have their intervals
+ * shifted, so that the likelihood of an edited ARG costs time proportional
+ * to the number of events the edit spans. Every change is recorded in an
+ * undo log until arg_likelihood_commit is called, so that a rejected MCMC
+ * proposal can be reverted exactly with arg_likelihood_rollback. */
+
+enum {
+    ARG_EDIT_INSERT,
+    ARG_EDIT_REMOVE,
+    ARG_EDIT_SHIFT,
+    ARG_EDIT_SHIFT_FINAL,
+};
+
+static int
+cmp_arg_event(const void *a, const void *b)
+{
+    const arg_event_t *ia = (const arg_event_t *) a;
+    const arg_event_t *ib = (const arg_event_t *) b;
+    int ret = (ia->time > ib->time) - (ia->time < ib->time);
+
+    if (ret == 0) {
+        ret = (ia->id > ib->id) - (ia->id < ib->id);
+    }
+    return ret;
+}
+
+static arg_event_t *
+arg_event_next(arg_event_t *event)
+{
+    avl_node_t *node = event->avl_node.next;
+
+    return node == NULL ? NULL : (arg_event_t *) node->item;
+}
+
+static double
+arg_event_prev_time(arg_event_t *event)
+{
+    avl_node_t *node = event->avl_node.prev;
+
+    return node == NULL ? 0 : ((arg_event_t *) node->item)->time;
+}
+
+static void
+arg_likelihood_add_interval(
+    arg_likelihood_t *self, double lineages, double material, double dt, double sign)
+{
+    self->stats.coalescence_exposure += sign * lineages * (lineages - 1) * dt;
+    self->stats.recombination_exposure += sign * material * dt;
+}
+
+static void
+arg_likelihood_add_event_term(arg_likelihood_t *self, arg_event_t *event, double sign)
+{
+    if (event->recombination) {
+        self->stats.num_recombination_events += sign;
+        self->stats.log_gaps += sign * event->log_gap;
+    } else {
+        self->stats.num_common_ancestor_events += sign;
+    }
+}
+
+static int MSP_WARN_UNUSED
+arg_likelihood_record_edit(arg_likelihood_t *self, int type, arg_event_t *event)
+{
+    int ret = 0;
+    arg_edit_t *tmp;
+    arg_edit_t *edit;
+
+    if (self->num_edits == self->max_edits) {
+        self->max_edits = TSK_MAX(64, 2 * self->max_edits);
+        tmp = realloc(self->edits, self->max_edits * sizeof(*self->edits));
+        if (tmp == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->edits = tmp;
+    }
+    edit = &self->edits[self->num_edits];
+    self->num_edits++;
+    edit->type = type;
+    edit->event = event;
+    if (type == ARG_EDIT_SHIFT_FINAL) {
+        edit->lineages = self->final_lineages;
+        edit->material = self->final_material;
+    } else {
+        edit->lineages = event->lineages;
+        edit->material = event->material;
+    }
+out:
+    return ret;
+}
+
+static arg_event_t *
+arg_likelihood_alloc_event(arg_likelihood_t *self, double time, bool recombination,
+    double log_gap, double lineages, double material)
+{
+    arg_event_t *event = NULL;
+
+    if (object_heap_empty(&self->event_heap)) {
+        if (object_heap_expand(&self->event_heap) != 0) {
+            goto out;
+        }
+    }
+    event = (arg_event_t *) object_heap_alloc_object(&self->event_heap);
+    event->time = time;
+    event->id = self->next_event_id;
+    self->next_event_id++;
+    event->recombination = recombination;
+    event->log_gap = log_gap;
+    event->lineages = lineages;
+    event->material = material;
+    avl_init_node(&event->avl_node, event);
+out:
+    return event;
+}
+
+static int
+arg_likelihood_append_event(arg_likelihood_t *self, double time, bool recombination,
+    double log_gap, double lineages, double material)
+{
+    int ret = 0;
+    arg_event_t *event = arg_likelihood_alloc_event(
+        self, time, recombination, log_gap, lineages, material);
+
+    if (event == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    if (avl_insert_node(&self->events, &event->avl_node) == NULL) {
+        ret = MSP_ERR_ASSERTION_FAILED;
+        goto out;
+    }
+out:
+    return ret;
+}
+
+int
+arg_likelihood_alloc(arg_likelihood_t *self, tsk_treeseq_t *ts, size_t block_size)
+{
+    int ret = 0;
+
+    memset(self, 0, sizeof(*self));
+    if (block_size == 0) {
+        block_size = 1024;
+    }
+    avl_init_tree(&self->events, cmp_arg_event, NULL);
+    ret = object_heap_init(&self->event_heap, sizeof(arg_event_t), block_size, NULL);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = walk_arg_events(ts, &self->stats, self);
+    if (ret != 0) {
+        goto out;
+    }
+    self->committed_stats = self->stats;
+out:
+    return ret;
+}
+
+int
+arg_likelihood_free(arg_likelihood_t *self)
+{
+    object_heap_free(&self->event_heap);
+    msp_safe_free(self->edits);
+    return 0;
+}
+
+void
+arg_likelihood_print_state(arg_likelihood_t *self, FILE *out)
+{
+    avl_node_t *node;
+    arg_event_t *event;
+
+    fprintf(out, "ARG likelihood state\n");
+    fprintf(out, "num_events = %d\n", (int) avl_count(&self->events));
+    fprintf(out, "num_edits = %d\n", (int) self->num_edits);
+    fprintf(out, "final_lineages = %f\n", self->final_lineages);
+    fprintf(out, "final_material = %f\n", self->final_material);
+    fprintf(out, "coalescence_exposure = %f\n", self->stats.coalescence_exposure);
+    fprintf(out, "recombination_exposure = %f\n", self->stats.recombination_exposure);
+    fprintf(out, "log_gaps = %f\n", self->stats.log_gaps);
+    fprintf(out, "num_recombination_events = %f\n",
+        self->stats.num_recombination_events);
+    fprintf(out, "num_common_ancestor_events = %f\n",
+        self->stats.num_common_ancestor_events);
+    for (node = self->events.head; node != NULL; node = node->next) {
+        event = (arg_event_t *) node->item;
+        fprintf(out, "\t%f\t%s\tlineages=%f\tmaterial=%f\n", event->time,
+            event->recombination ? "RE" : "CA", event->lineages, event->material);
+    }
+    object_heap_print_state(&self->event_heap, out);
+}
+
+int
+arg_likelihood_get_log_likelihood(
+    arg_likelihood_t *self, double r, double Ne, double *lik)
+{
+    return msp_log_likelihood_arg_stats(&self->stats, 1, &r, &Ne, lik, NULL, NULL);
+}
+
+/* Returns the first event at or after the specified time, or NULL if
+ * there is none. */
+arg_event_t *
+arg_likelihood_find_event(arg_likelihood_t *self, double time)
+{
+    arg_event_t search;
+    avl_node_t *node = NULL;
+    int cmp;
+
+    search.time = time;
+    search.id = 0;
+    cmp = avl_search_closest(&self->events, &search, &node);
+    /* search > node->item ==> cmp = 1, so the closest event is before time */
+    if (node != NULL && cmp > 0) {
+        node = node->next;
+    }
+    return node == NULL ? NULL : (arg_event_t *) node->item;
+}
+
+static int
+arg_likelihood_insert_event_log_gap(arg_likelihood_t *self, double time,
+    bool recombination, double log_gap, arg_event_t **r_event)
+{
+    int ret = 0;
+    arg_event_t *event = NULL;
+    arg_event_t *next;
+    double prev_time, lineages, material;
+
+    if (!isfinite(time) || time < 0) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    event = arg_likelihood_alloc_event(self, time, recombination, log_gap, 0, 0);
+    if (event == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    if (avl_insert_node(&self->events, &event->avl_node) == NULL) {
+        object_heap_free_object(&self->event_heap, event);
+        ret = MSP_ERR_ASSERTION_FAILED;
+        goto out;
+    }
+    ret = arg_likelihood_record_edit(self, ARG_EDIT_INSERT, event);
+    if (ret != 0) {
+        avl_unlink_node(&self->events, &event->avl_node);
+        object_heap_free_object(&self->event_heap, event);
+        goto out;
+    }
+    prev_time = arg_event_prev_time(event);
+    next = arg_event_next(event);
+    if (next != NULL) {
+        lineages = next->lineages;
+        material = next->material;
+        arg_likelihood_add_interval(
+            self, lineages, material, next->time - prev_time, -1);
+        arg_likelihood_add_interval(self, lineages, material, next->time - time, 1);
+    } else {
+        lineages = self->final_lineages;
+        material = self->final_material;
+    }
+    event->lineages = lineages;
+    event->material = material;
+    arg_likelihood_add_interval(self, lineages, material, time - prev_time, 1);
+    arg_likelihood_add_event_term(self, event, 1);
+    *r_event = event;
+out:
+    return ret;
+}
+
+/* Inserts an event at the specified time without changing the numbers of
+ * lineages or the ancestral material in any interval; the interval that
+ * the event falls in is split in two. Use arg_likelihood_shift to describe
+ * the effect of the event on the intervals that follow it. */
+int
+arg_likelihood_insert_event(arg_likelihood_t *self, double time, bool recombination,
+    double gap, arg_event_t **r_event)
+{
+    return arg_likelihood_insert_event_log_gap(
+        self, time, recombination, gap > 0 ? log(gap) : 0, r_event);
+}
+
+/* Removes an event that no longer changes the number of lineages, so that
+ * the intervals on either side of it are merged. */
+int
+arg_likelihood_remove_event(arg_likelihood_t *self, arg_event_t *event)
+{
+    int ret = 0;
+    arg_event_t *next = arg_event_next(event);
+    const double prev_time = arg_event_prev_time(event);
+    const double next_lineages = next == NULL ? self->final_lineages : next->lineages;
+
+    if (event->lineages != next_lineages) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    ret = arg_likelihood_record_edit(self, ARG_EDIT_REMOVE, event);
+    if (ret != 0) {
+        goto out;
+    }
+    arg_likelihood_add_interval(
+        self, event->lineages, event->material, event->time - prev_time, -1);
+    if (next != NULL) {
+        arg_likelihood_add_interval(
+            self, next->lineages, next->material, next->time - event->time, -1);
+        arg_likelihood_add_interval(
+            self, next->lineages, next->material, next->time - prev_time, 1);
+    }
+    arg_likelihood_add_event_term(self, event, -1);
+    /* The event is kept until the edit is committed, in case we roll back */
+    avl_unlink_node(&self->events, &event->avl_node);
+out:
+    return ret;
+}
+
+/* Adds the specified numbers of lineages and amount of material to the
+ * intervals ending at each event after from, up to and including to. If
+ * from is NULL, we start at the first event; if to is NULL we continue
+ * past the last event. */
+int
+arg_likelihood_shift(arg_likelihood_t *self, arg_event_t *from, arg_event_t *to,
+    double lineages, double material)
+{
+    int ret = 0;
+    avl_node_t *node;
+    arg_event_t *event;
+    double dt;
+
+    if (from != NULL && to != NULL && cmp_arg_event(from, to) >= 0) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    node = from == NULL ? self->events.head : from->avl_node.next;
+    for (; node != NULL; node = node->next) {
+        event = (arg_event_t *) node->item;
+        ret = arg_likelihood_record_edit(self, ARG_EDIT_SHIFT, event);
+        if (ret != 0) {
+            goto out;
+        }
+        dt = event->time - arg_event_prev_time(event);
+        arg_likelihood_add_interval(self, event->lineages, event->material, dt, -1);
+        event->lineages += lineages;
+        event->material += material;
+        arg_likelihood_add_interval(self, event->lineages, event->material, dt, 1);
+        if (event == to) {
+            break;
+        }
+    }
+    if (to == NULL) {
+        ret = arg_likelihood_record_edit(self, ARG_EDIT_SHIFT_FINAL, NULL);
+        if (ret != 0) {
+            goto out;
+        }
+        self->final_lineages += lineages;
+        self->final_material += material;
+    }
+out:
+    return ret;
+}
+
+/* Moves an event to a new time, keeping its effect on the number of
+ * lineages and the ancestral material. The moved event is a new object,
+ * returned in r_event; the old one must not be used after this. */
+int
+arg_likelihood_move_event(
+    arg_likelihood_t *self, arg_event_t *event, double time, arg_event_t **r_event)
+{
+    int ret = 0;
+    arg_event_t *next = arg_event_next(event);
+    const double lineages
+        = (next == NULL ? self->final_lineages : next->lineages) - event->lineages;
+    const double material
+        = (next == NULL ? self->final_material : next->material) - event->material;
+    arg_event_t *moved = NULL;
+
+    ret = arg_likelihood_insert_event_log_gap(
+        self, time, event->recombination, event->log_gap, &moved);
+    if (ret != 0) {
+        goto out;
+    }
+    if (cmp_arg_event(moved, event) > 0) {
+        /* The intervals between the old and new times no longer see the
+         * effect of the event */
+        ret = arg_likelihood_shift(self, event, moved, -lineages, -material);
+    } else {
+        ret = arg_likelihood_shift(self, moved, event, lineages, material);
+    }
+    if (ret != 0) {
+        goto out;
+    }
+    ret = arg_likelihood_remove_event(self, event);
+    if (ret != 0) {
+        goto out;
+    }
+    *r_event = moved;
+out:
+    return ret;
+}
+
+/* Prunes the lineage that joins the rest of the ARG at the common ancestor
+ * event prune and regrafts it with a new common ancestor event at
+ * regraft_time. Between the two times the pruned lineage is counted
+ * separately, adding material to the ancestral material; after both, the
+ * material changes by material_above, since the lineage now merges with a
+ * different one. The regrafting event is returned in r_event; prune must
+ * not be used after this. */
+int
+arg_likelihood_prune_regraft(arg_likelihood_t *self, arg_event_t *prune,
+    double regraft_time, double material, double material_above,
+    arg_event_t **r_event)
+{
+    int ret = 0;
+    arg_event_t *regraft = NULL;
+    arg_event_t *last;
+
+    if (prune->recombination) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    ret = arg_likelihood_insert_event(self, regraft_time, false, 0, &regraft);
+    if (ret != 0) {
+        goto out;
+    }
+    if (cmp_arg_event(regraft, prune) > 0) {
+        /* The pruned lineage stays separate until it's regrafted */
+        ret = arg_likelihood_shift(self, prune, regraft, 1, material);
+        last = regraft;
+    } else {
+        ret = arg_likelihood_shift(self, regraft, prune, -1, -material);
+        last = prune;
+    }
+    if (ret != 0) {
+        goto out;
+    }
+    if (material_above != 0) {
+        ret = arg_likelihood_shift(self, last, NULL, 0, material_above);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    ret = arg_likelihood_remove_event(self, prune);
+    if (ret != 0) {
+        goto out;
+    }
+    *r_event = regraft;
+out:
+    return ret;
+}
+
+/* Makes the edits since the last commit permanent. */
+void
+arg_likelihood_commit(arg_likelihood_t *self)
+{
+    size_t j;
+
+    for (j = 0; j < self->num_edits; j++) {
+        if (self->edits[j].type == ARG_EDIT_REMOVE) {
+            object_heap_free_object(&self->event_heap, self->edits[j].event);
+        }
+    }
+    self->num_edits = 0;
+    self->committed_stats = self->stats;
+}
+
+/* Reverts all edits since the last commit. */
+void
+arg_likelihood_rollback(arg_likelihood_t *self)
+{
+    size_t j;
+    arg_edit_t *edit;
+
+    for (j = self->num_edits; j > 0; j--) {
+        edit = &self->edits[j - 1];
+        switch (edit->type) {
+            case ARG_EDIT_INSERT:
+                avl_unlink_node(&self->events, &edit->event->avl_node);
+                object_heap_free_object(&self->event_heap, edit->event);
+                break;
+            case ARG_EDIT_REMOVE:
+                avl_insert_node(&self->events, &edit->event->avl_node);
+                break;
+            case ARG_EDIT_SHIFT:
+                edit->event->lineages = edit->lineages;
+                edit->event->material = edit->material;
+                break;
+            case ARG_EDIT_SHIFT_FINAL:
+                self->final_lineages = edit->lineages;
+                self->final_material = edit->material;
+                break;
+        }
+    }
+    self->num_edits = 0;
+    /* Restoring the statistics avoids any rounding in undoing the updates */
+    self->stats = self->committed_stats;
+}
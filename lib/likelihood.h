@@ -20,9 +20,101 @@
 #ifndef __LIKELIHOOD_H__
 #define __LIKELIHOOD_H__
 
+#include <stdbool.h>
+#include <stdio.h>
 #include <tskit.h>
 
+#include "avl.h"
+#include "object_heap.h"
+
+/* The sufficient statistics of an ARG for the Hudson likelihood. */
+typedef struct {
+    /* Integral over time of k(k - 1), for k lineages */
+    double coalescence_exposure;
+    /* Integral over time of the ancestral material that can recombine */
+    double recombination_exposure;
+    /* Sum of the log lengths of the gaps at recombination breakpoints */
+    double log_gaps;
+    double num_recombination_events;
+    double num_common_ancestor_events;
+} arg_likelihood_stats_t;
+
+/* An event in the incremental ARG likelihood, with the state of the
+ * interval that ends at it. */
+typedef struct {
+    double time;
+    /* Breaks ties between events at the same time */
+    size_t id;
+    bool recombination;
+    double log_gap;
+    double lineages;
+    double material;
+    avl_node_t avl_node;
+} arg_event_t;
+
+typedef struct {
+    int type;
+    arg_event_t *event;
+    /* The state before the edit */
+    double lineages;
+    double material;
+} arg_edit_t;
+
+typedef struct {
+    avl_tree_t events;
+    object_heap_t event_heap;
+    size_t next_event_id;
+    /* The state after the last event */
+    double final_lineages;
+    double final_material;
+    arg_likelihood_stats_t stats;
+    arg_likelihood_stats_t committed_stats;
+    /* Undo log of the edits since the last commit */
+    arg_edit_t *edits;
+    size_t num_edits;
+    size_t max_edits;
+} arg_likelihood_t;
+
+/* A window of contiguous trees for the mutation likelihood. */
+typedef struct {
+    double left;
+    double right;
+    /* Output: sum of the log branch lengths available to each mutation */
+    double log_branch_length;
+} mut_likelihood_window_t;
+
+/* Calls msp_mut_likelihood_window_run for each of the windows, possibly
+ * concurrently, and returns the first error encountered. */
+typedef int (*mut_likelihood_window_runner_t)(
+    tsk_treeseq_t *ts, mut_likelihood_window_t *windows, size_t num_windows, void *arg);
+
 int msp_unnormalised_log_likelihood_mut(tsk_treeseq_t *ts, double mu, double *lik);
+int msp_unnormalised_log_likelihood_mut_vector(tsk_treeseq_t *ts, size_t num_params,
+    const double *mu, double *lik, size_t num_windows,
+    mut_likelihood_window_runner_t runner, void *runner_arg);
+int msp_mut_likelihood_window_run(tsk_treeseq_t *ts, mut_likelihood_window_t *window);
 int msp_log_likelihood_arg(tsk_treeseq_t *ts, double r, double Ne, double *lik);
+int msp_arg_likelihood_stats(tsk_treeseq_t *ts, arg_likelihood_stats_t *stats);
+int msp_log_likelihood_arg_stats(const arg_likelihood_stats_t *stats, size_t num_params,
+    const double *r, const double *Ne, double *lik, double *grad_r, double *grad_Ne);
+
+int arg_likelihood_alloc(arg_likelihood_t *self, tsk_treeseq_t *ts, size_t block_size);
+int arg_likelihood_free(arg_likelihood_t *self);
+void arg_likelihood_print_state(arg_likelihood_t *self, FILE *out);
+int arg_likelihood_get_log_likelihood(
+    arg_likelihood_t *self, double r, double Ne, double *lik);
+arg_event_t *arg_likelihood_find_event(arg_likelihood_t *self, double time);
+int arg_likelihood_insert_event(arg_likelihood_t *self, double time, bool recombination,
+    double gap, arg_event_t **event);
+int arg_likelihood_remove_event(arg_likelihood_t *self, arg_event_t *event);
+int arg_likelihood_shift(arg_likelihood_t *self, arg_event_t *from, arg_event_t *to,
+    double lineages, double material);
+int arg_likelihood_move_event(
+    arg_likelihood_t *self, arg_event_t *event, double time, arg_event_t **moved);
+int arg_likelihood_prune_regraft(arg_likelihood_t *self, arg_event_t *prune,
+    double regraft_time, double material, double material_above,
+    arg_event_t **regraft);
+void arg_likelihood_commit(arg_likelihood_t *self);
+void arg_likelihood_rollback(arg_likelihood_t *self);
 
 #endif /*__LIKELIHOOD_H__*/
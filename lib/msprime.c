@@ -36,6 +36,10 @@
 #define MSP_STATE_SIMULATING 2
 #define MSP_STATE_DEBUGGING 3
 
+/* The largest reservation msp_estimate_table_capacity makes, as a multiple
+ * of the number of rows in the input tables */
+#define MSP_TABLE_CAPACITY_MAX_FACTOR 1024
+
 /* Draw a random variable from a truncated Beta(a, b) distribution,
  * by rejecting draws above the truncation point x.
  */
@@ -82,6 +86,43 @@ ran_inc_beta(gsl_rng *r, double a, double b, double x)
     }
 }
 
+static void
+beta_merger_cache_free(beta_merger_cache_t *self)
+{
+    size_t j;
+
+    if (self->tables != NULL) {
+        for (j = 0; j <= self->max_lineages; j++) {
+            msp_safe_free(self->tables[j].cumulative_rate);
+        }
+    }
+    msp_safe_free(self->tables);
+    memset(self, 0, sizeof(*self));
+}
+
+/* Clears the memoised multiple-merger rates for the specified population,
+ * whose parameters have changed */
+static void
+population_invalidate_merger_rates(population_t *self)
+{
+    memset(&self->merger_rates, 0, sizeof(self->merger_rates));
+}
+
+/* Clears all memoised multiple-merger rates, after a change to the model
+ * parameters or anything else they depend on */
+static void
+msp_invalidate_merger_rates(msp_t *self)
+{
+    size_t j;
+
+    if (self->populations != NULL) {
+        for (j = 0; j < self->num_populations; j++) {
+            population_invalidate_merger_rates(&self->populations[j]);
+        }
+    }
+    beta_merger_cache_free(&self->beta_merger_cache);
+}
+
 /* Returns the size of the specified population at the specified time */
 static double
 get_population_size(population_t *pop, double t)
@@ -190,6 +231,23 @@ cmp_hullend(const void *a, const void *b)
     return ret;
 }
 
+/* Orders edges with the same parent time as tsk_table_collection_sort does */
+static int
+cmp_edge(const void *a, const void *b)
+{
+    const tsk_edge_t *ia = (const tsk_edge_t *) a;
+    const tsk_edge_t *ib = (const tsk_edge_t *) b;
+    int ret = (ia->parent > ib->parent) - (ia->parent < ib->parent);
+
+    if (ret == 0) {
+        ret = (ia->child > ib->child) - (ia->child < ib->child);
+    }
+    if (ret == 0) {
+        ret = (ia->left > ib->left) - (ia->left < ib->left);
+    }
+    return ret;
+}
+
 static inline hull_t *
 segment_get_hull(segment_t *seg)
 {
@@ -285,6 +343,12 @@ msp_get_sum_internal_gc_tract_lengths(msp_t *self)
     return self->sum_internal_gc_tract_lengths;
 }
 
+double
+msp_get_dtwf_switch_time(msp_t *self)
+{
+    return self->dtwf_switch_time;
+}
+
 int
 msp_set_start_time(msp_t *self, double start_time)
 {
@@ -340,6 +404,7 @@ msp_set_ploidy(msp_t *self, int ploidy)
         goto out;
     }
     self->ploidy = (uint32_t) ploidy;
+    msp_invalidate_merger_rates(self);
 out:
     return ret;
 }
@@ -836,190 +901,919 @@ out:
     return ret;
 }
 
-static segment_t *MSP_WARN_UNUSED
-msp_alloc_segment(msp_t *self, double left, double right, tsk_id_t value,
-    population_id_t TSK_UNUSED(population), label_id_t label, segment_t *prev,
-    segment_t *next)
+/* If presize_tables is true, msp_initialise reserves capacity in the output
+ * tables based on msp_estimate_table_capacity, replacing any reservation
+ * made with msp_reserve_table_capacity. */
+int
+msp_set_presize_tables(msp_t *self, bool presize_tables)
 {
-    segment_t *seg = NULL;
+    self->presize_tables = presize_tables;
+    return 0;
+}
 
-    if (object_heap_empty(&self->segment_heap[label])) {
-        if (object_heap_expand(&self->segment_heap[label]) != 0) {
-            goto out;
-        }
-        if (self->recomb_mass_index != NULL) {
-            if (fenwick_expand(&self->recomb_mass_index[label], self->segment_block_size)
-                != 0) {
-                goto out;
-            }
-        }
-        if (self->gc_mass_index != NULL) {
-            if (fenwick_expand(&self->gc_mass_index[label], self->segment_block_size)
-                != 0) {
-                goto out;
-            }
-        }
-    }
-    seg = (segment_t *) object_heap_alloc_object(&self->segment_heap[label]);
-    if (seg == NULL) {
+int
+msp_set_finalise_mode(msp_t *self, int mode)
+{
+    int ret = 0;
+
+    if (mode != MSP_FINALISE_SORT && mode != MSP_FINALISE_MERGE) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
         goto out;
     }
-    tsk_bug_assert(left < right);
-    if (self->recomb_mass_index != NULL) {
-        tsk_bug_assert(fenwick_get_value(&self->recomb_mass_index[label], seg->id) == 0);
-    }
-    if (self->gc_mass_index != NULL) {
-        tsk_bug_assert(fenwick_get_value(&self->gc_mass_index[label], seg->id) == 0);
-    }
-    seg->prev = prev;
-    seg->next = next;
-    seg->left = left;
-    seg->right = right;
-    seg->value = value;
+    self->finalise_mode = mode;
 out:
-    return seg;
+    return ret;
 }
 
-static void
-lineage_reset_segments(lineage_t *self)
+/* Returns the increment needed for a table with the specified number of
+ * rows and current maximum number of rows to hold capacity extra rows
+ * in its next expansion. An increment of zero restores tskit's default
+ * growth policy. */
+static tsk_size_t
+msp_get_max_rows_increment(tsk_size_t num_rows, tsk_size_t max_rows, tsk_size_t capacity)
 {
-    segment_t *x;
-    for (x = self->head; x != NULL; x = x->next) {
-        x->lineage = self;
-        self->tail = x;
+    tsk_size_t increment = 0;
+
+    if (capacity > 0 && num_rows + capacity > max_rows) {
+        increment = num_rows + capacity - max_rows;
     }
+    return increment;
 }
 
-static lineage_t *MSP_WARN_UNUSED
-msp_alloc_lineage(msp_t *self, segment_t *head, segment_t *tail,
-    population_id_t population, label_id_t label)
+static int MSP_WARN_UNUSED
+msp_apply_table_capacity(msp_t *self)
 {
-    lineage_t *lin = NULL;
+    int ret = 0;
+    tsk_node_table_t *nodes = &self->tables->nodes;
+    tsk_edge_table_t *edges = &self->tables->edges;
+    tsk_migration_table_t *migrations = &self->tables->migrations;
+    tsk_size_t node_capacity = self->table_capacity.num_nodes;
+    tsk_size_t edge_capacity = self->table_capacity.num_edges;
+    tsk_size_t migration_capacity = self->table_capacity.num_migrations;
+    tsk_size_t node_increment, edge_increment, migration_increment;
+
+    if (self->spill.block_size > 0) {
+        /* Spilled tables never hold much more than a block in memory */
+        node_capacity = TSK_MIN(node_capacity, (tsk_size_t) self->spill.block_size);
+        edge_capacity = TSK_MIN(edge_capacity, (tsk_size_t) self->spill.block_size);
+        migration_capacity
+            = TSK_MIN(migration_capacity, (tsk_size_t) self->spill.block_size);
+    }
+    node_increment
+        = msp_get_max_rows_increment(nodes->num_rows, nodes->max_rows, node_capacity);
+    edge_increment
+        = msp_get_max_rows_increment(edges->num_rows, edges->max_rows, edge_capacity);
+    migration_increment = msp_get_max_rows_increment(
+        migrations->num_rows, migrations->max_rows, migration_capacity);
+    self->reserved_max_rows.num_nodes = nodes->max_rows + node_increment;
+    self->reserved_max_rows.num_edges = edges->max_rows + edge_increment;
+    self->reserved_max_rows.num_migrations
+        = migrations->max_rows + migration_increment;
+
+    ret = tsk_node_table_set_max_rows_increment(nodes, node_increment);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    ret = tsk_edge_table_set_max_rows_increment(edges, edge_increment);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    ret = tsk_migration_table_set_max_rows_increment(migrations, migration_increment);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+out:
+    return ret;
+}
 
-    if (object_heap_empty(&self->lineage_heap)) {
-        if (object_heap_expand(&self->lineage_heap) != 0) {
+/* Once a table has been expanded to hold its reservation, the fixed increment
+ * is dropped so that any later expansions double the table as usual. Keeping
+ * it would make each expansion past a low estimate add the same number of
+ * rows, giving quadratic copying. */
+static int MSP_WARN_UNUSED
+msp_release_table_capacity(msp_t *self)
+{
+    int ret = 0;
+    tsk_node_table_t *nodes = &self->tables->nodes;
+    tsk_edge_table_t *edges = &self->tables->edges;
+    tsk_migration_table_t *migrations = &self->tables->migrations;
+
+    if (nodes->max_rows_increment != 0
+        && nodes->max_rows >= self->reserved_max_rows.num_nodes) {
+        ret = tsk_node_table_set_max_rows_increment(nodes, 0);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
             goto out;
         }
     }
-    lin = (lineage_t *) object_heap_alloc_object(&self->lineage_heap);
-    if (lin == NULL) {
-        goto out;
+    if (edges->max_rows_increment != 0
+        && edges->max_rows >= self->reserved_max_rows.num_edges) {
+        ret = tsk_edge_table_set_max_rows_increment(edges, 0);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+    }
+    if (migrations->max_rows_increment != 0
+        && migrations->max_rows >= self->reserved_max_rows.num_migrations) {
+        ret = tsk_migration_table_set_max_rows_increment(migrations, 0);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
     }
-    lin->head = head;
-    lin->tail = tail;
-    lin->population = population;
-    lin->label = label;
-    /* If we are creating a new lineage with a given head segment, we have
-     * no choice but to iterate. If the lineage is empty, or has a single
-     * segment this does no harm. */
-    lineage_reset_segments(lin);
 out:
-    return lin;
+    return ret;
 }
 
-static segment_t *MSP_WARN_UNUSED
-msp_copy_segment(msp_t *self, label_id_t label, const segment_t *seg)
+/* Reserve space for the specified numbers of rows to be added to the
+ * node, edge and migration tables by the simulation, so that the
+ * tables are expanded at most once to hold them. The reservation is
+ * made relative to the current number of rows and is reapplied for
+ * each replicate in msp_reset. A value of zero leaves the default
+ * growth policy in place for that table. */
+int
+msp_reserve_table_capacity(msp_t *self, tsk_size_t num_nodes, tsk_size_t num_edges,
+    tsk_size_t num_migrations)
 {
-    segment_t *new_seg = msp_alloc_segment(
-        self, seg->left, seg->right, seg->value, -1, label, seg->prev, seg->next);
-    // FIXME check for NULL return value
-    new_seg->lineage = seg->lineage;
-    return new_seg;
+    self->table_capacity.num_nodes = num_nodes;
+    self->table_capacity.num_edges = num_edges;
+    self->table_capacity.num_migrations = num_migrations;
+    return msp_apply_table_capacity(self);
 }
 
-static hull_t *MSP_WARN_UNUSED
-msp_alloc_hull(msp_t *self, double left, double right, lineage_t *lineage)
+/* When the RNG buffer size is nonzero, the uniform and exponential
+ * variates used in the main event loop are drawn from blocks of this
+ * many pre-generated values rather than one at a time from the generator.
+ * The output is deterministic for a given seed and buffer size, but
+ * differs from the unbuffered output. The buffer is discarded on reset,
+ * so that reseeding the generator between replicates takes effect. */
+int
+msp_set_rng_buffer_size(msp_t *self, size_t size)
 {
-    hull_t *hull = NULL;
-    label_id_t label;
-    uint32_t j;
+    rng_buffer_free(&self->rng_buffer);
+    return rng_buffer_alloc(&self->rng_buffer, self->rng, size);
+}
 
-    tsk_bug_assert(lineage != NULL);
-    label = lineage->label;
+/* Places mutations on each edge as it is stored, using the rate map and
+ * mutation model of the specified mutation generator, which must use the
+ * same tables. The alleles are chosen and the sites and mutations written
+ * out when the tables are finalised. The input tables must not contain any
+ * sites or mutations. This is only reachable from Python through the
+ * low-level Simulator; sim_ancestry does not take a mutation rate, and
+ * sim_mutations still places mutations in a separate pass. */
+int
+msp_set_mutation_generator(msp_t *self, mutgen_t *mutgen, int flags)
+{
+    int ret = 0;
 
-    if (object_heap_empty(&self->hull_heap[label])) {
-        if (object_heap_expand(&self->hull_heap[label]) != 0) {
+    if (mutgen != NULL) {
+        /* Inline mutations need the times of all the nodes */
+        if (self->spill.num_nodes > 0) {
+            ret = MSP_ERR_BAD_STATE;
             goto out;
         }
-        /* check pointer logic here */
-        for (j = 0; j < self->num_populations; j++) {
-            if (self->populations[j].coal_mass_index != NULL) {
-                if (fenwick_expand(&self->populations[j].coal_mass_index[label],
-                        self->hull_block_size)
-                    != 0) {
-                    goto out;
-                }
-            }
+        if (mutgen->tables != self->tables
+            || (flags & ~MSP_DISCRETE_SITES) != 0
+            || self->tables->sites.num_rows > 0
+            || self->tables->mutations.num_rows > 0) {
+            ret = MSP_ERR_BAD_PARAM_VALUE;
+            goto out;
         }
     }
-    hull = (hull_t *) object_heap_alloc_object(&self->hull_heap[label]);
-    if (hull == NULL) {
-        goto out;
-    }
-    tsk_bug_assert(left < right);
-    /* this is the limit of the number of hulls in the avl_tree */
-    tsk_bug_assert(hull->id < UINT_MAX * self->num_populations);
-
-    hull->left = left;
-    tsk_bug_assert(right <= self->sequence_length);
-    hull->right = right;
-    hull->lineage = lineage;
-    hull->count = 0;
-    hull->insertion_order = UINT64_MAX;
-    tsk_bug_assert(lineage->head->prev == NULL);
-    lineage->hull = hull;
+    self->mutgen = mutgen;
+    self->mutgen_flags = flags;
 out:
-    return hull;
+    return ret;
 }
 
-static hullend_t *MSP_WARN_UNUSED
-msp_alloc_hullend(msp_t *self, double position, label_id_t label)
+/* Random variates for the event loop, drawn from the RNG buffer if it is
+ * enabled. Otherwise the values are exactly those of the GSL functions. */
+static inline double
+msp_ran_uniform(msp_t *self)
 {
-    hullend_t *hullend = NULL;
-
-    if (object_heap_empty(&self->hullend_heap[label])) {
-        if (object_heap_expand(&self->hullend_heap[label]) != 0) {
-            goto out;
-        }
+    if (self->rng_buffer.size > 0) {
+        return rng_buffer_uniform(&self->rng_buffer);
     }
-    hullend = (hullend_t *) object_heap_alloc_object(&self->hullend_heap[label]);
-    if (hullend == NULL) {
-        goto out;
+    return gsl_rng_uniform(self->rng);
+}
+
+static inline double
+msp_ran_exponential(msp_t *self, double mu)
+{
+    if (self->rng_buffer.size > 0) {
+        return rng_buffer_exponential(&self->rng_buffer, mu);
     }
+    return gsl_ran_exponential(self->rng, mu);
+}
 
-    hullend->position = position;
-    hullend->insertion_order = UINT64_MAX;
-out:
-    return hullend;
+static inline double
+msp_ran_flat(msp_t *self, double a, double b)
+{
+    double u;
+
+    if (self->rng_buffer.size > 0) {
+        u = rng_buffer_uniform(&self->rng_buffer);
+        /* Same transformation as gsl_ran_flat */
+        return a * (1 - u) + b * u;
+    }
+    return gsl_ran_flat(self->rng, a, b);
 }
 
-/* Top level allocators and initialisation */
+static inline unsigned long
+msp_ran_uniform_int(msp_t *self, unsigned long n)
+{
+    if (self->rng_buffer.size > 0) {
+        tsk_bug_assert(n > 0 && n <= UINT32_MAX);
+        return rng_buffer_uniform_int(&self->rng_buffer, n);
+    }
+    return gsl_rng_uniform_int(self->rng, n);
+}
 
+/* When a spill block size is set, the simulated rows of the node, edge and
+ * migration tables are written out to temporary column files each time
+ * block_size of them have built up, so that these tables hold at most
+ * about a block of rows while the simulation runs. Nodes and edges at the
+ * current time are kept in memory, since their times and flags can still be
+ * looked up and changed; segments may still refer to older spilled nodes,
+ * but only need to know that these are older. msp_finalise_tables streams the
+ * spilled rows back a block at a time into tables grown once to their
+ * final size, and msp_finalise_spill leaves the finished rows in the files.
+ * Each file holds the raw values of one column, laid out as in a kastore
+ * array. Nodes are not spilled while a mutation generator is attached,
+ * since it looks up the times of arbitrary nodes. */
 int
-msp_alloc(msp_t *self, tsk_table_collection_t *tables, gsl_rng *rng)
+msp_set_spill_block_size(msp_t *self, size_t block_size)
 {
-    int ret = -1;
+    int ret = 0;
 
-    memset(self, 0, sizeof(msp_t));
-    if (rng == NULL || tables == NULL) {
-        ret = MSP_ERR_BAD_PARAM_VALUE;
+    /* The spill files are opened in msp_initialise */
+    if (self->state != MSP_STATE_NEW) {
+        ret = MSP_ERR_BAD_STATE;
         goto out;
     }
+    self->spill.block_size = block_size;
+out:
+    return ret;
+}
 
-    /* Use the standard coalescent by default. */
-    self->model.type = -1;
-    ret = msp_set_simulation_model_hudson(self);
-    tsk_bug_assert(ret == 0);
-    self->rng = rng;
-    self->discrete_genome = true;
+static bool
+msp_spill_enabled(msp_t *self)
+{
+    return self->spill.block_size > 0;
+}
 
-    self->tables = tables;
-    self->sequence_length = tables->sequence_length;
-    if (self->sequence_length <= 0) {
-        ret = MSP_ERR_BAD_SEQUENCE_LENGTH;
-        goto out;
+static int MSP_WARN_UNUSED
+msp_spill_open(msp_t *self)
+{
+    int ret = 0;
+    int j;
+
+    for (j = 0; j < MSP_NUM_SPILL_COLUMNS; j++) {
+        if (self->spill.files[j] == NULL) {
+            self->spill.files[j] = tmpfile();
+            if (self->spill.files[j] == NULL) {
+                ret = MSP_ERR_IO;
+                goto out;
+            }
+        }
     }
-    self->num_populations = (uint32_t) self->tables->populations.num_rows;
+out:
+    return ret;
+}
+
+static void
+msp_spill_close(msp_t *self)
+{
+    int j;
+
+    for (j = 0; j < MSP_NUM_SPILL_COLUMNS; j++) {
+        if (self->spill.files[j] != NULL) {
+            fclose(self->spill.files[j]);
+            self->spill.files[j] = NULL;
+        }
+    }
+}
+
+/* Moves back to the start of the spill files, discarding their contents */
+static int MSP_WARN_UNUSED
+msp_spill_rewind(msp_t *self)
+{
+    int ret = 0;
+    int j;
+
+    for (j = 0; j < MSP_NUM_SPILL_COLUMNS; j++) {
+        if (self->spill.files[j] != NULL
+            && fseek(self->spill.files[j], 0, SEEK_SET) != 0) {
+            ret = MSP_ERR_IO;
+            goto out;
+        }
+    }
+    self->spill.num_nodes = 0;
+    self->spill.num_edges = 0;
+    self->spill.num_migrations = 0;
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+msp_spill_write(msp_t *self, int column, const void *data, size_t size, size_t n)
+{
+    int ret = 0;
+
+    if (fwrite(data, size, n, self->spill.files[column]) != n) {
+        ret = MSP_ERR_IO;
+    }
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+msp_spill_read(msp_t *self, int column, void *data, size_t size, size_t n)
+{
+    int ret = 0;
+
+    if (fread(data, size, n, self->spill.files[column]) != n) {
+        ret = MSP_ERR_IO;
+    }
+    return ret;
+}
+
+/* Returns the row of the node table holding the specified node, or TSK_NULL
+ * if it has been spilled. The simulated nodes are spilled from the start,
+ * so the rows that are still in memory are shifted down. */
+static inline tsk_id_t
+msp_get_node_row(msp_t *self, tsk_id_t u)
+{
+    const tsk_id_t start = (tsk_id_t) self->input_position.nodes;
+    const tsk_id_t num_spilled = (tsk_id_t) self->spill.num_nodes;
+
+    if (u < start) {
+        return u;
+    }
+    if (u < start + num_spilled) {
+        return TSK_NULL;
+    }
+    return u - num_spilled;
+}
+
+/* Returns true if the specified node is in memory and has the current time. */
+static bool
+msp_node_is_current(msp_t *self, tsk_id_t u)
+{
+    const tsk_id_t row = msp_get_node_row(self, u);
+
+    return row != TSK_NULL && self->tables->nodes.time[row] == self->time;
+}
+
+/* Writes the simulated nodes older than the current time out to the spill
+ * files, or all of them if all is true, leaving the input nodes in the
+ * table. */
+static int MSP_WARN_UNUSED
+msp_spill_nodes(msp_t *self, bool all)
+{
+    int ret = 0;
+    tsk_node_table_t *nodes = &self->tables->nodes;
+    const tsk_size_t start = self->input_position.nodes;
+    tsk_size_t end = all ? nodes->num_rows : start;
+    size_t n, num_kept;
+
+    while (end < nodes->num_rows && nodes->time[end] < self->time) {
+        end++;
+    }
+    n = (size_t)(end - start);
+    num_kept = (size_t)(nodes->num_rows - end);
+    if (n == 0) {
+        goto out;
+    }
+    ret = msp_spill_write(
+        self, MSP_SPILL_NODES_FLAGS, nodes->flags + start, sizeof(tsk_flags_t), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(
+        self, MSP_SPILL_NODES_TIME, nodes->time + start, sizeof(double), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(self, MSP_SPILL_NODES_POPULATION, nodes->population + start,
+        sizeof(tsk_id_t), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(self, MSP_SPILL_NODES_INDIVIDUAL, nodes->individual + start,
+        sizeof(tsk_id_t), n);
+    if (ret != 0) {
+        goto out;
+    }
+    /* The simulated nodes have no metadata, so their metadata offsets are
+     * all the same and only the other columns need to be moved. */
+    memmove(nodes->flags + start, nodes->flags + end, num_kept * sizeof(tsk_flags_t));
+    memmove(nodes->time + start, nodes->time + end, num_kept * sizeof(double));
+    memmove(nodes->population + start, nodes->population + end,
+        num_kept * sizeof(tsk_id_t));
+    memmove(nodes->individual + start, nodes->individual + end,
+        num_kept * sizeof(tsk_id_t));
+    ret = tsk_node_table_truncate(nodes, start + (tsk_size_t) num_kept);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    self->spill.num_nodes += (tsk_size_t) n;
+out:
+    return ret;
+}
+
+/* Writes the simulated edges whose parents are older than the current time
+ * out to the spill files, or all of them if all is true, leaving the input
+ * edges in the table. */
+static int MSP_WARN_UNUSED
+msp_spill_edges(msp_t *self, bool all)
+{
+    int ret = 0;
+    tsk_edge_table_t *edges = &self->tables->edges;
+    const tsk_size_t start = self->input_position.edges;
+    tsk_size_t end = all ? edges->num_rows : start;
+    size_t n, num_kept;
+
+    while (end < edges->num_rows && !msp_node_is_current(self, edges->parent[end])) {
+        end++;
+    }
+    n = (size_t)(end - start);
+    num_kept = (size_t)(edges->num_rows - end);
+    if (n == 0) {
+        goto out;
+    }
+    ret = msp_spill_write(
+        self, MSP_SPILL_EDGES_LEFT, edges->left + start, sizeof(double), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(
+        self, MSP_SPILL_EDGES_RIGHT, edges->right + start, sizeof(double), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(
+        self, MSP_SPILL_EDGES_PARENT, edges->parent + start, sizeof(tsk_id_t), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(
+        self, MSP_SPILL_EDGES_CHILD, edges->child + start, sizeof(tsk_id_t), n);
+    if (ret != 0) {
+        goto out;
+    }
+    memmove(edges->left + start, edges->left + end, num_kept * sizeof(double));
+    memmove(edges->right + start, edges->right + end, num_kept * sizeof(double));
+    memmove(edges->parent + start, edges->parent + end, num_kept * sizeof(tsk_id_t));
+    memmove(edges->child + start, edges->child + end, num_kept * sizeof(tsk_id_t));
+    ret = tsk_edge_table_truncate(edges, start + (tsk_size_t) num_kept);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    self->spill.num_edges += (tsk_size_t) n;
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+msp_spill_migrations(msp_t *self)
+{
+    int ret = 0;
+    tsk_migration_table_t *migrations = &self->tables->migrations;
+    const tsk_size_t start = self->input_position.migrations;
+    const size_t n = (size_t)(migrations->num_rows - start);
+
+    ret = msp_spill_write(self, MSP_SPILL_MIGRATIONS_LEFT, migrations->left + start,
+        sizeof(double), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(self, MSP_SPILL_MIGRATIONS_RIGHT, migrations->right + start,
+        sizeof(double), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(self, MSP_SPILL_MIGRATIONS_NODE, migrations->node + start,
+        sizeof(tsk_id_t), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(self, MSP_SPILL_MIGRATIONS_SOURCE,
+        migrations->source + start, sizeof(tsk_id_t), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(self, MSP_SPILL_MIGRATIONS_DEST, migrations->dest + start,
+        sizeof(tsk_id_t), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_write(self, MSP_SPILL_MIGRATIONS_TIME, migrations->time + start,
+        sizeof(double), n);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = tsk_migration_table_truncate(migrations, start);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    self->spill.num_migrations += (tsk_size_t) n;
+out:
+    return ret;
+}
+
+/* Writes all the simulated rows still in memory out to the spill files. */
+static int MSP_WARN_UNUSED
+msp_spill_tables(msp_t *self)
+{
+    int ret = 0;
+
+    ret = msp_spill_nodes(self, true);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_edges(self, true);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_migrations(self);
+out:
+    return ret;
+}
+
+/* Streams the spilled rows back into the output tables in blocks of
+ * block_size rows. The rows still in memory are written out first so that
+ * the row order is kept. The node and edge tables are grown once, to hold
+ * the spilled rows and num_extra_rows more, so that the only memory used
+ * beyond the final tables is the block buffers. */
+static int MSP_WARN_UNUSED
+msp_unspill_tables(msp_t *self, tsk_size_t num_extra_rows)
+{
+    int ret = 0;
+    tsk_node_table_t *nodes = &self->tables->nodes;
+    tsk_edge_table_t *edges = &self->tables->edges;
+    tsk_migration_table_t *migrations = &self->tables->migrations;
+    const size_t block_size = self->spill.block_size;
+    double *left = NULL;
+    double *right = NULL;
+    double *time = NULL;
+    tsk_flags_t *flags = NULL;
+    tsk_id_t *node = NULL;
+    tsk_id_t *source = NULL;
+    tsk_id_t *dest = NULL;
+    tsk_size_t j, num_nodes, num_edges, num_migrations;
+    size_t n;
+
+    if (!msp_spill_enabled(self)) {
+        goto out;
+    }
+    ret = msp_spill_tables(self);
+    if (ret != 0) {
+        goto out;
+    }
+    num_nodes = self->spill.num_nodes;
+    num_edges = self->spill.num_edges;
+    num_migrations = self->spill.num_migrations;
+    ret = msp_spill_rewind(self);
+    if (ret != 0) {
+        goto out;
+    }
+
+    left = malloc(block_size * sizeof(*left));
+    right = malloc(block_size * sizeof(*right));
+    time = malloc(block_size * sizeof(*time));
+    flags = malloc(block_size * sizeof(*flags));
+    node = malloc(block_size * sizeof(*node));
+    source = malloc(block_size * sizeof(*source));
+    dest = malloc(block_size * sizeof(*dest));
+    if (left == NULL || right == NULL || time == NULL || flags == NULL || node == NULL
+        || source == NULL || dest == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    /* Grow each table once, to exactly the size needed */
+    ret = tsk_node_table_set_max_rows_increment(nodes,
+        msp_get_max_rows_increment(
+            nodes->num_rows, nodes->max_rows, num_nodes + num_extra_rows));
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    for (j = 0; j < num_nodes; j += (tsk_size_t) n) {
+        n = (size_t) TSK_MIN((tsk_size_t) block_size, num_nodes - j);
+        /* Nodes use the node and source buffers for population and individual */
+        ret = msp_spill_read(
+            self, MSP_SPILL_NODES_FLAGS, flags, sizeof(tsk_flags_t), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(self, MSP_SPILL_NODES_TIME, time, sizeof(double), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(
+            self, MSP_SPILL_NODES_POPULATION, node, sizeof(tsk_id_t), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(
+            self, MSP_SPILL_NODES_INDIVIDUAL, source, sizeof(tsk_id_t), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = tsk_node_table_append_columns(
+            nodes, (tsk_size_t) n, flags, time, node, source, NULL, NULL);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+    }
+    ret = tsk_edge_table_set_max_rows_increment(edges,
+        msp_get_max_rows_increment(
+            edges->num_rows, edges->max_rows, num_edges + num_extra_rows));
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    for (j = 0; j < num_edges; j += (tsk_size_t) n) {
+        n = (size_t) TSK_MIN((tsk_size_t) block_size, num_edges - j);
+        /* Edges use the node and source buffers for parent and child */
+        ret = msp_spill_read(self, MSP_SPILL_EDGES_LEFT, left, sizeof(double), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(self, MSP_SPILL_EDGES_RIGHT, right, sizeof(double), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(self, MSP_SPILL_EDGES_PARENT, node, sizeof(tsk_id_t), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(
+            self, MSP_SPILL_EDGES_CHILD, source, sizeof(tsk_id_t), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = tsk_edge_table_append_columns(
+            edges, (tsk_size_t) n, left, right, node, source, NULL, NULL);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+    }
+    ret = tsk_migration_table_set_max_rows_increment(migrations,
+        msp_get_max_rows_increment(
+            migrations->num_rows, migrations->max_rows, num_migrations));
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    for (j = 0; j < num_migrations; j += (tsk_size_t) n) {
+        n = (size_t) TSK_MIN((tsk_size_t) block_size, num_migrations - j);
+        ret = msp_spill_read(
+            self, MSP_SPILL_MIGRATIONS_LEFT, left, sizeof(double), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(
+            self, MSP_SPILL_MIGRATIONS_RIGHT, right, sizeof(double), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(
+            self, MSP_SPILL_MIGRATIONS_NODE, node, sizeof(tsk_id_t), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(
+            self, MSP_SPILL_MIGRATIONS_SOURCE, source, sizeof(tsk_id_t), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(
+            self, MSP_SPILL_MIGRATIONS_DEST, dest, sizeof(tsk_id_t), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_spill_read(
+            self, MSP_SPILL_MIGRATIONS_TIME, time, sizeof(double), n);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = tsk_migration_table_append_columns(migrations, (tsk_size_t) n, left,
+            right, node, source, dest, time, NULL, NULL);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+    }
+    ret = msp_spill_rewind(self);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_apply_table_capacity(self);
+out:
+    msp_safe_free(left);
+    msp_safe_free(right);
+    msp_safe_free(time);
+    msp_safe_free(flags);
+    msp_safe_free(node);
+    msp_safe_free(source);
+    msp_safe_free(dest);
+    return ret;
+}
+
+static segment_t *MSP_WARN_UNUSED
+msp_alloc_segment(msp_t *self, double left, double right, tsk_id_t value,
+    population_id_t TSK_UNUSED(population), label_id_t label, segment_t *prev,
+    segment_t *next)
+{
+    segment_t *seg = NULL;
+
+    if (object_heap_empty(&self->segment_heap[label])) {
+        if (object_heap_expand(&self->segment_heap[label]) != 0) {
+            goto out;
+        }
+        if (self->recomb_mass_index != NULL) {
+            if (fenwick_expand(&self->recomb_mass_index[label], self->segment_block_size)
+                != 0) {
+                goto out;
+            }
+        }
+        if (self->gc_mass_index != NULL) {
+            if (fenwick_expand(&self->gc_mass_index[label], self->segment_block_size)
+                != 0) {
+                goto out;
+            }
+        }
+    }
+    seg = (segment_t *) object_heap_alloc_object(&self->segment_heap[label]);
+    if (seg == NULL) {
+        goto out;
+    }
+    tsk_bug_assert(left < right);
+    if (self->recomb_mass_index != NULL) {
+        tsk_bug_assert(fenwick_get_value(&self->recomb_mass_index[label], seg->id) == 0);
+    }
+    if (self->gc_mass_index != NULL) {
+        tsk_bug_assert(fenwick_get_value(&self->gc_mass_index[label], seg->id) == 0);
+    }
+    seg->prev = prev;
+    seg->next = next;
+    seg->left = left;
+    seg->right = right;
+    seg->value = value;
+out:
+    return seg;
+}
+
+static void
+lineage_reset_segments(lineage_t *self)
+{
+    segment_t *x;
+    for (x = self->head; x != NULL; x = x->next) {
+        x->lineage = self;
+        self->tail = x;
+    }
+}
+
+static lineage_t *MSP_WARN_UNUSED
+msp_alloc_lineage(msp_t *self, segment_t *head, segment_t *tail,
+    population_id_t population, label_id_t label)
+{
+    lineage_t *lin = NULL;
+
+    if (object_heap_empty(&self->lineage_heap)) {
+        if (object_heap_expand(&self->lineage_heap) != 0) {
+            goto out;
+        }
+    }
+    lin = (lineage_t *) object_heap_alloc_object(&self->lineage_heap);
+    if (lin == NULL) {
+        goto out;
+    }
+    lin->head = head;
+    lin->tail = tail;
+    lin->population = population;
+    lin->label = label;
+    /* If we are creating a new lineage with a given head segment, we have
+     * no choice but to iterate. If the lineage is empty, or has a single
+     * segment this does no harm. */
+    lineage_reset_segments(lin);
+out:
+    return lin;
+}
+
+static segment_t *MSP_WARN_UNUSED
+msp_copy_segment(msp_t *self, label_id_t label, const segment_t *seg)
+{
+    segment_t *new_seg = msp_alloc_segment(
+        self, seg->left, seg->right, seg->value, -1, label, seg->prev, seg->next);
+    // FIXME check for NULL return value
+    new_seg->lineage = seg->lineage;
+    return new_seg;
+}
+
+static hull_t *MSP_WARN_UNUSED
+msp_alloc_hull(msp_t *self, double left, double right, lineage_t *lineage)
+{
+    hull_t *hull = NULL;
+    label_id_t label;
+    uint32_t j;
+
+    tsk_bug_assert(lineage != NULL);
+    label = lineage->label;
+
+    if (object_heap_empty(&self->hull_heap[label])) {
+        if (object_heap_expand(&self->hull_heap[label]) != 0) {
+            goto out;
+        }
+        /* check pointer logic here */
+        for (j = 0; j < self->num_populations; j++) {
+            if (self->populations[j].coal_mass_index != NULL) {
+                if (fenwick_expand(&self->populations[j].coal_mass_index[label],
+                        self->hull_block_size)
+                    != 0) {
+                    goto out;
+                }
+            }
+        }
+    }
+    hull = (hull_t *) object_heap_alloc_object(&self->hull_heap[label]);
+    if (hull == NULL) {
+        goto out;
+    }
+    tsk_bug_assert(left < right);
+    /* this is the limit of the number of hulls in the avl_tree */
+    tsk_bug_assert(hull->id < UINT_MAX * self->num_populations);
+
+    hull->left = left;
+    tsk_bug_assert(right <= self->sequence_length);
+    hull->right = right;
+    hull->lineage = lineage;
+    hull->count = 0;
+    hull->insertion_order = UINT64_MAX;
+    tsk_bug_assert(lineage->head->prev == NULL);
+    lineage->hull = hull;
+out:
+    return hull;
+}
+
+static hullend_t *MSP_WARN_UNUSED
+msp_alloc_hullend(msp_t *self, double position, label_id_t label)
+{
+    hullend_t *hullend = NULL;
+
+    if (object_heap_empty(&self->hullend_heap[label])) {
+        if (object_heap_expand(&self->hullend_heap[label]) != 0) {
+            goto out;
+        }
+    }
+    hullend = (hullend_t *) object_heap_alloc_object(&self->hullend_heap[label]);
+    if (hullend == NULL) {
+        goto out;
+    }
+
+    hullend->position = position;
+    hullend->insertion_order = UINT64_MAX;
+out:
+    return hullend;
+}
+
+/* Top level allocators and initialisation */
+
+int
+msp_alloc(msp_t *self, tsk_table_collection_t *tables, gsl_rng *rng)
+{
+    int ret = -1;
+
+    memset(self, 0, sizeof(msp_t));
+    if (rng == NULL || tables == NULL) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+
+    /* Use the standard coalescent by default. */
+    self->model.type = -1;
+    ret = msp_set_simulation_model_hudson(self);
+    tsk_bug_assert(ret == 0);
+    self->rng = rng;
+    self->discrete_genome = true;
+
+    self->tables = tables;
+    self->sequence_length = tables->sequence_length;
+    if (self->sequence_length <= 0) {
+        ret = MSP_ERR_BAD_SEQUENCE_LENGTH;
+        goto out;
+    }
+    self->num_populations = (uint32_t) self->tables->populations.num_rows;
     if (self->num_populations == 0) {
         ret = MSP_ERR_ZERO_POPULATIONS;
         goto out;
@@ -1051,6 +1845,7 @@ msp_alloc(msp_t *self, tsk_table_collection_t *tables, gsl_rng *rng)
     self->node_mapping_block_size = 1024;
     self->segment_block_size = 1024;
     self->hull_block_size = 1024;
+    self->finalise_mode = MSP_FINALISE_MERGE;
     /* set up the AVL trees */
     avl_init_tree(&self->breakpoints, cmp_node_mapping, NULL);
     avl_init_tree(&self->overlap_counts, cmp_node_mapping, NULL);
@@ -1062,6 +1857,7 @@ msp_alloc(msp_t *self, tsk_table_collection_t *tables, gsl_rng *rng)
     self->state = MSP_STATE_NEW;
     /* Set default to diploid */
     self->ploidy = 2;
+    self->dtwf_switch_time = -DBL_MAX;
 out:
     return ret;
 }
@@ -1126,6 +1922,24 @@ msp_is_completed(msp_t *self)
     return self->state == MSP_STATE_SIMULATING && n == 0;
 }
 
+static void
+msp_dtwf_draws_free(msp_t *self)
+{
+    size_t j;
+
+    if (self->dtwf_draws != NULL) {
+        for (j = 0; j < self->num_populations; j++) {
+            if (self->dtwf_draws[j].rng != NULL) {
+                gsl_rng_free(self->dtwf_draws[j].rng);
+            }
+            msp_safe_free(self->dtwf_draws[j].offspring);
+            msp_safe_free(self->dtwf_draws[j].draws);
+            msp_safe_free(self->dtwf_draws[j].reserved);
+        }
+        msp_safe_free(self->dtwf_draws);
+    }
+}
+
 int
 msp_free(msp_t *self)
 {
@@ -1185,6 +1999,15 @@ msp_free(msp_t *self)
     msp_safe_free(self->initial_overlaps);
     msp_safe_free(self->pedigree.individuals);
     msp_safe_free(self->pedigree.visit_order);
+    msp_spill_close(self);
+    rng_buffer_free(&self->rng_buffer);
+    beta_merger_cache_free(&self->beta_merger_cache);
+    msp_safe_free(self->merger_indexes);
+    msp_safe_free(self->merger_pot_size);
+    msp_dtwf_draws_free(self);
+    msp_safe_free(self->sweep_trajectory.time);
+    msp_safe_free(self->sweep_trajectory.allele_frequency);
+    msp_safe_free(self->sweep_state.time);
     /* free the object heaps */
     object_heap_free(&self->avl_node_heap);
     object_heap_free(&self->node_mapping_heap);
@@ -2222,18 +3045,40 @@ msp_print_state(msp_t *self, FILE *out)
         fprintf(out, "\tdirac coalescent parameters: psi = %f, c = %f\n",
             self->model.params.dirac_coalescent.psi,
             self->model.params.dirac_coalescent.c);
+    } else if (self->model.type == MSP_MODEL_DTWF) {
+        fprintf(out, "\tdtwf parameters: switch_threshold = %f\n",
+            self->model.params.dtwf.switch_threshold);
     } else if (self->model.type == MSP_MODEL_SWEEP) {
         fprintf(out, "\tsweep @ locus = %f\n", self->model.params.sweep.position);
         self->model.params.sweep.print_state(&self->model.params.sweep, out);
+        fprintf(out, "\tsweep active = %d curr_step = %d num_steps = %d fixed = %d\n",
+            self->sweep_state.active, (int) self->sweep_state.curr_step,
+            (int) self->sweep_state.num_steps, self->sweep_trajectory_fixed);
+        fprintf(out, "\tsweep trajectory store = %p next = %d\n",
+            (void *) self->sweep_trajectory_store, (int) self->next_sweep_trajectory);
     }
     fprintf(out, "L = %.14g\n", self->sequence_length);
     fprintf(out, "discrete_genome = %d\n", self->discrete_genome);
     fprintf(out, "start_time = %f\n", self->start_time);
+    fprintf(out, "dtwf_switch_time = %f\n", self->dtwf_switch_time);
     fprintf(out, "recombination map:\n");
     rate_map_print_state(&self->recomb_map, out);
     fprintf(out, "gene_conversion_tract_length = %f\n", self->gc_tract_length);
     fprintf(out, "gene conversion map:\n");
     rate_map_print_state(&self->gc_map, out);
+    fprintf(out, "presize_tables = %d\n", self->presize_tables);
+    fprintf(out, "finalise_mode = %d\n", self->finalise_mode);
+    fprintf(out, "spill: block_size = %d nodes = %d edges = %d migrations = %d\n",
+        (int) self->spill.block_size, (int) self->spill.num_nodes,
+        (int) self->spill.num_edges, (int) self->spill.num_migrations);
+    fprintf(out, "rng_buffer_size = %d\n", (int) self->rng_buffer.size);
+    fprintf(out, "mutation_generator = %d (flags = %d)\n", self->mutgen != NULL,
+        self->mutgen_flags);
+    fprintf(out, "table_capacity: nodes = %d/%d edges = %d/%d migrations = %d/%d\n",
+        (int) self->table_capacity.num_nodes, (int) self->tables->nodes.max_rows,
+        (int) self->table_capacity.num_edges, (int) self->tables->edges.max_rows,
+        (int) self->table_capacity.num_migrations,
+        (int) self->tables->migrations.max_rows);
     msp_pedigree_print_state(self, out);
     msp_print_root_segments(self, out);
     msp_print_initial_overlaps(self, out);
@@ -2391,7 +3236,15 @@ msp_record_migration(msp_t *self, double left, double right, tsk_id_t node,
         ret = msp_set_tsk_error(ret);
         goto out;
     }
-    ret = 0;
+    ret = msp_release_table_capacity(self);
+    if (ret != 0) {
+        goto out;
+    }
+    if (msp_spill_enabled(self)
+        && self->tables->migrations.num_rows - self->input_position.migrations
+               >= self->spill.block_size) {
+        ret = msp_spill_migrations(self);
+    }
 out:
     return ret;
 }
@@ -2402,6 +3255,7 @@ msp_flush_edges(msp_t *self)
     int ret = 0;
     tsk_size_t j, num_edges;
     tsk_edge_t edge;
+    const tsk_size_t edge_start = self->tables->edges.num_rows;
 
     if (self->num_buffered_edges > 0) {
         ret = tsk_squash_edges(
@@ -2420,27 +3274,81 @@ msp_flush_edges(msp_t *self)
             }
         }
         self->num_buffered_edges = 0;
+        ret = msp_release_table_capacity(self);
+        if (ret != 0) {
+            goto out;
+        }
+        if (self->mutgen != NULL) {
+            /* This must happen before the edges are spilled */
+            ret = mutgen_place_edges(
+                self->mutgen, edge_start, self->tables->edges.num_rows);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+        if (msp_spill_enabled(self)
+            && self->tables->edges.num_rows - self->input_position.edges
+                   >= self->spill.block_size) {
+            ret = msp_spill_edges(self, false);
+            if (ret != 0) {
+                goto out;
+            }
+        }
     }
     ret = 0;
 out:
     return ret;
 }
 
+/* Adds a row to the node table and returns the ID of the new node, which
+ * is offset from its row by the number of spilled nodes. */
+static tsk_id_t MSP_WARN_UNUSED
+msp_add_node(msp_t *self, uint32_t flags, double time, population_id_t population_id,
+    tsk_id_t individual)
+{
+    tsk_id_t ret = 0;
+    tsk_id_t row;
+
+    row = tsk_node_table_add_row(
+        &self->tables->nodes, flags, time, population_id, individual, NULL, 0);
+    if (row < 0) {
+        ret = msp_set_tsk_error(row);
+        goto out;
+    }
+    ret = msp_release_table_capacity(self);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = row + (tsk_id_t) self->spill.num_nodes;
+out:
+    return ret;
+}
+
 static int MSP_WARN_UNUSED
 msp_store_node(msp_t *self, uint32_t flags, double time, population_id_t population_id,
     tsk_id_t individual)
 {
     int ret = 0;
+    tsk_id_t node;
 
     ret = msp_flush_edges(self);
     if (ret != 0) {
         goto out;
     }
-    ret = tsk_node_table_add_row(
-        &self->tables->nodes, flags, time, population_id, individual, NULL, 0);
-    if (ret < 0) {
+    node = msp_add_node(self, flags, time, population_id, individual);
+    if (node < 0) {
+        ret = (int) node;
         goto out;
     }
+    if (msp_spill_enabled(self) && self->mutgen == NULL
+        && self->tables->nodes.num_rows - self->input_position.nodes
+               >= self->spill.block_size) {
+        ret = msp_spill_nodes(self, false);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    ret = (int) node;
 out:
     return ret;
 }
@@ -2452,8 +3360,11 @@ msp_store_edge(msp_t *self, double left, double right, tsk_id_t parent, tsk_id_t
     tsk_edge_t *edge;
     tsk_edge_t last_edge;
     const double *node_time = self->tables->nodes.time;
+    const tsk_id_t parent_row = msp_get_node_row(self, parent);
+    const tsk_id_t child_row = msp_get_node_row(self, child);
 
-    tsk_bug_assert(parent < (tsk_id_t) self->tables->nodes.num_rows);
+    tsk_bug_assert(parent_row != TSK_NULL);
+    tsk_bug_assert(parent_row < (tsk_id_t) self->tables->nodes.num_rows);
     if (self->num_buffered_edges > 0) {
         last_edge = self->buffered_edges[self->num_buffered_edges - 1];
         if (last_edge.parent != parent) {
@@ -2474,7 +3385,8 @@ msp_store_edge(msp_t *self, double left, double right, tsk_id_t parent, tsk_id_t
         }
         self->buffered_edges = edge;
     }
-    if (node_time[child] >= node_time[parent]) {
+    /* Spilled nodes are older than the current time */
+    if (child_row != TSK_NULL && node_time[child_row] >= node_time[parent_row]) {
         ret = MSP_ERR_TIME_TRAVEL;
         goto out;
     }
@@ -2558,6 +3470,7 @@ msp_store_additional_nodes_edges(msp_t *self, segment_t *z, tsk_id_t u, uint32_t
 {
 
     int ret = 0;
+    tsk_id_t row;
 
     if (self->additional_nodes & flag) {
         if (u == TSK_NULL) {
@@ -2568,9 +3481,11 @@ msp_store_additional_nodes_edges(msp_t *self, segment_t *z, tsk_id_t u, uint32_t
             *new_node_id = ret;
         } else {
             // don't mark sample nodes as PASS_THROUGH
-            if (!(self->tables->nodes.flags[u] == TSK_NODE_IS_SAMPLE
+            row = msp_get_node_row(self, u);
+            tsk_bug_assert(row != TSK_NULL);
+            if (!(self->tables->nodes.flags[row] == TSK_NODE_IS_SAMPLE
                     && flag == MSP_NODE_IS_PASS_THROUGH)) {
-                self->tables->nodes.flags[u] |= flag;
+                self->tables->nodes.flags[row] |= flag;
             }
             *new_node_id = u;
         }
@@ -2850,13 +3765,13 @@ msp_defrag_segment_chain(msp_t *self, lineage_t *lin)
 }
 
 static double
-msp_dtwf_generate_breakpoint(msp_t *self, double start)
+msp_dtwf_generate_breakpoint(msp_t *self, gsl_rng *rng, double start)
 {
     double left_bound, mass_to_next_recomb, breakpoint;
 
     left_bound = self->discrete_genome ? start + 1 : start;
     do {
-        mass_to_next_recomb = gsl_ran_exponential(self->rng, 1.0);
+        mass_to_next_recomb = gsl_ran_exponential(rng, 1.0);
     } while (mass_to_next_recomb == 0.0);
 
     breakpoint
@@ -3013,27 +3928,36 @@ out:
     return ret;
 }
 
+/* Splits the segments of an ancestor into the heads u and v of its two
+ * parental copies at the recombination breakpoints, counting the
+ * recombination events in num_re_events. If the choices have been drawn in
+ * advance by msp_dtwf_draw_population, drawn[0] is the parental copy of the
+ * first segment and the breakpoints follow in order. New segments are taken
+ * from the specified reserve if it is not NULL, and from the heap otherwise.
+ * The segments of the new copy still refer to the ancestor's lineage. */
 static int MSP_WARN_UNUSED
-msp_dtwf_recombine(
-    msp_t *self, segment_t *x_head, segment_t **u, segment_t **v, tsk_id_t *ind_nodes)
+msp_dtwf_split_segments(msp_t *self, segment_t *x_head, segment_t **u, segment_t **v,
+    const double *drawn, dtwf_population_draws_t *reserve, size_t *num_re_events)
 {
     int ret = 0;
     int ix;
-    int j;
     double k;
-    lineage_t *lin;
     segment_t *x, *y, *z, *tail;
     segment_t s1, s2;
     segment_t *seg_tails[] = { &s1, &s2 };
-    segment_t **rec_heads[MSP_MAX_PED_PLOIDY] = { u, v };
     const label_id_t label = 0;
-    const population_id_t population = x_head->lineage->population;
 
     x = x_head;
-    k = msp_dtwf_generate_breakpoint(self, x->left);
+    if (drawn == NULL) {
+        k = msp_dtwf_generate_breakpoint(self, self->rng, x->left);
+        ix = (int) gsl_rng_uniform_int(self->rng, 2);
+    } else {
+        ix = (int) drawn[0];
+        drawn++;
+        k = *drawn++;
+    }
     s1.next = NULL;
     s2.next = NULL;
-    ix = (int) gsl_rng_uniform_int(self->rng, 2);
     seg_tails[ix]->next = x;
     tsk_bug_assert(x->prev == NULL);
 
@@ -3044,7 +3968,7 @@ msp_dtwf_recombine(
         if (x->right > k) {
             // Make new segment
             tsk_bug_assert(x->left < k);
-            self->num_re_events++;
+            (*num_re_events)++;
             ix = (ix + 1) % 2;
 
             if (seg_tails[ix] == &s1 || seg_tails[ix] == &s2) {
@@ -3052,10 +3976,22 @@ msp_dtwf_recombine(
             } else {
                 tail = seg_tails[ix];
             }
-            z = msp_alloc_segment(self, k, x->right, x->value, -1, label, tail, x->next);
-            if (z == NULL) {
-                ret = MSP_ERR_NO_MEMORY;
-                goto out;
+            if (reserve == NULL) {
+                z = msp_alloc_segment(
+                    self, k, x->right, x->value, -1, label, tail, x->next);
+                if (z == NULL) {
+                    ret = MSP_ERR_NO_MEMORY;
+                    goto out;
+                }
+            } else {
+                tsk_bug_assert(reserve->num_reserved > 0);
+                reserve->num_reserved--;
+                z = reserve->reserved[reserve->num_reserved];
+                z->prev = tail;
+                z->next = x->next;
+                z->left = k;
+                z->right = x->right;
+                z->value = x->value;
             }
             z->lineage = x->lineage;
             msp_set_segment_mass(self, z);
@@ -3070,15 +4006,17 @@ msp_dtwf_recombine(
             msp_set_segment_mass(self, x);
             tsk_bug_assert(x->left < x->right);
             x = z;
-            k = msp_dtwf_generate_breakpoint(self, k);
+            k = drawn == NULL ? msp_dtwf_generate_breakpoint(self, self->rng, k)
+                              : *drawn++;
         } else if (x->right <= k && y != NULL && y->left >= k) {
             // Recombine in gap between segment and the next
             x->next = NULL;
             y->prev = NULL;
             while (y->left >= k) {
-                self->num_re_events++;
+                (*num_re_events)++;
                 ix = (ix + 1) % 2;
-                k = msp_dtwf_generate_breakpoint(self, k);
+                k = drawn == NULL ? msp_dtwf_generate_breakpoint(self, self->rng, k)
+                                  : *drawn++;
             }
             seg_tails[ix]->next = y;
             if (seg_tails[ix] == &s1 || seg_tails[ix] == &s2) {
@@ -3098,6 +4036,24 @@ msp_dtwf_recombine(
     // Remove sentinel segments
     *u = s1.next;
     *v = s2.next;
+out:
+    return ret;
+}
+
+/* Sets the lineages of the parental copies u and v of an ancestor whose
+ * segments have been split by msp_dtwf_split_segments, and stores the
+ * recombination nodes and edges if required. */
+static int MSP_WARN_UNUSED
+msp_dtwf_store_recombination(
+    msp_t *self, segment_t *x_head, segment_t **u, segment_t **v, tsk_id_t *ind_nodes)
+{
+    int ret = 0;
+    int j;
+    lineage_t *lin;
+    segment_t *y;
+    segment_t **rec_heads[MSP_MAX_PED_PLOIDY] = { u, v };
+    const label_id_t label = 0;
+    const population_id_t population = x_head->lineage->population;
 
     for (j = 0; j < MSP_MAX_PED_PLOIDY; j++) {
         y = *rec_heads[j];
@@ -3127,6 +4083,22 @@ out:
     return ret;
 }
 
+static int MSP_WARN_UNUSED
+msp_dtwf_recombine(msp_t *self, segment_t *x_head, segment_t **u, segment_t **v,
+    tsk_id_t *ind_nodes, const double *drawn)
+{
+    int ret = 0;
+
+    ret = msp_dtwf_split_segments(
+        self, x_head, u, v, drawn, NULL, &self->num_re_events);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_dtwf_store_recombination(self, x_head, u, v, ind_nodes);
+out:
+    return ret;
+}
+
 static int MSP_WARN_UNUSED
 msp_store_arg_recombination(msp_t *self, segment_t *lhs_tail, segment_t *rhs)
 {
@@ -3265,7 +4237,7 @@ msp_choose_uniform_breakpoint(msp_t *self, int label, rate_map_t *rate_map,
     do {
         /* Choose a recombination mass uniformly from the total and find the
          * segment y that is associated with this *cumulative* value. */
-        random_mass = gsl_ran_flat(self->rng, 0, fenwick_get_total(tree));
+        random_mass = msp_ran_flat(self, 0, fenwick_get_total(tree));
         segment_id = fenwick_find(tree, random_mass);
         y = msp_get_segment(self, segment_id, label);
         tsk_bug_assert(fenwick_get_value(tree, y->id) > 0);
@@ -4241,7 +5213,7 @@ msp_migration_event(msp_t *self, population_id_t source_pop, population_id_t des
     size_t index = ((size_t) source_pop) * self->num_populations + (size_t) dest_pop;
 
     self->num_migration_events[index]++;
-    j = (uint32_t) gsl_rng_uniform_int(self->rng, avl_count(source));
+    j = (uint32_t) msp_ran_uniform_int(self, avl_count(source));
     node = avl_at(source, j);
     tsk_bug_assert(node != NULL);
     ret = msp_move_individual(self, node, source, dest_pop, label);
@@ -4757,6 +5729,108 @@ out:
     return ret;
 }
 
+/* Converts an estimated number of rows to a table size, clamping to the
+ * maximum number of rows a tskit table can index. */
+static tsk_size_t
+msp_estimate_to_num_rows(double estimate, double max_rows)
+{
+    tsk_size_t ret = 0;
+
+    if (isfinite(estimate) && estimate > 0) {
+        ret = (tsk_size_t) GSL_MIN(ceil(estimate), max_rows);
+    } else if (!isfinite(estimate)) {
+        ret = (tsk_size_t) max_rows;
+    }
+    return ret;
+}
+
+/* Estimates the numbers of nodes, edges and migrations that the simulation
+ * will add to the tables. The estimate is based on the expected number of
+ * recombination events in the standard coalescent with n lineages,
+ * rho * H_{n - 1}, where H is the harmonic number and rho = 2 * ploidy * N * R
+ * for a population size N equal to the mean initial size of the active
+ * populations and total recombination and gene conversion mass R. Each
+ * event is assumed to contribute one node and three edges (the subtree
+ * prune and regraft picture), and the full-ARG node types add the nodes
+ * and edges they record on top of this. Growth rates and demographic
+ * events are ignored, so this is only ever a rough guide for pre-sizing
+ * the tables; the numbers of rows in the finished tables give the truth.
+ */
+int
+msp_estimate_table_capacity(msp_t *self, table_capacity_t *estimate)
+{
+    int ret = 0;
+    const size_t N = self->num_populations;
+    double n = (double) self->num_sampling_events;
+    double harmonic = 0;
+    double pop_size = 0;
+    double migration_rate = 0;
+    double num_active = 0;
+    double mass, branch_length, num_events, num_migrants;
+    double num_nodes, num_edges, num_migrations, max_rows;
+    population_t *pop;
+    size_t j, k;
+
+    if (self->state == MSP_STATE_NEW) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    for (j = 1; j < self->num_sampling_events; j++) {
+        harmonic += 1.0 / (double) j;
+    }
+    for (j = 0; j < N; j++) {
+        pop = &self->initial_populations[j];
+        if (pop->state == MSP_POP_STATE_ACTIVE) {
+            pop_size += pop->initial_size;
+            for (k = 0; k < N; k++) {
+                migration_rate += self->initial_migration_matrix[j * N + k];
+            }
+            num_active++;
+        }
+    }
+    if (num_active > 0) {
+        pop_size /= num_active;
+        migration_rate /= num_active;
+    }
+    mass = rate_map_get_total_mass(&self->recomb_map)
+           + 2 * rate_map_get_total_mass(&self->gc_map);
+    branch_length = 2 * self->ploidy * pop_size * harmonic;
+    num_events = mass * branch_length;
+
+    num_nodes = GSL_MAX(n - 1, 0) + num_events;
+    num_edges = 2 * GSL_MAX(n - 1, 0) + 3 * num_events;
+    if (self->additional_nodes & (MSP_NODE_IS_RE_EVENT | MSP_NODE_IS_GC_EVENT)) {
+        num_nodes += 2 * num_events;
+        num_edges += 2 * num_events;
+    }
+    if (self->additional_nodes & MSP_NODE_IS_CA_EVENT) {
+        num_nodes += num_events;
+        num_edges += num_events;
+    }
+    num_migrations = 0;
+    num_migrants = migration_rate * branch_length;
+    if (self->store_migrations) {
+        /* Each migration records one row per segment of the lineage */
+        num_migrations = num_migrants * (1 + (n > 0 ? num_events / n : 0));
+    }
+    if (self->additional_nodes & MSP_NODE_IS_MIG_EVENT) {
+        num_nodes += num_migrants;
+        num_edges += num_migrants * (1 + (n > 0 ? num_events / n : 0));
+    }
+    /* The estimate can be wildly high for extreme parameters, so we never
+     * reserve more than a fixed multiple of the rows already in the tables.
+     * The tables grow as usual beyond this. */
+    max_rows = (double) (self->tables->nodes.num_rows + self->tables->edges.num_rows
+                         + self->tables->migrations.num_rows);
+    max_rows = GSL_MIN(
+        MSP_TABLE_CAPACITY_MAX_FACTOR * GSL_MAX(max_rows, 1), (double) INT32_MAX);
+    estimate->num_nodes = msp_estimate_to_num_rows(num_nodes, max_rows);
+    estimate->num_edges = msp_estimate_to_num_rows(num_edges, max_rows);
+    estimate->num_migrations = msp_estimate_to_num_rows(num_migrations, max_rows);
+out:
+    return ret;
+}
+
 int
 msp_reset(msp_t *self)
 {
@@ -4765,6 +5839,7 @@ msp_reset(msp_t *self)
     double event_time;
     population_id_t population_id;
     population_t *pop, *initial_pop;
+    const int model_type = self->model.type;
 
     memcpy(&self->model, &self->initial_model, sizeof(self->model));
     ret = msp_reset_pedigree(self);
@@ -4775,6 +5850,14 @@ msp_reset(msp_t *self)
     if (ret != 0) {
         goto out;
     }
+    if (self->model.type != model_type) {
+        /* The model changed during the simulation, e.g. by a hybrid DTWF
+         * switching to the coalescent, and the mass indexes depend on it. */
+        ret = msp_setup_mass_indexes(self);
+        if (ret != 0) {
+            goto out;
+        }
+    }
     /* Set up the initial segments and algorithm state */
     for (population_id = 0; population_id < (population_id_t) N; population_id++) {
         pop = self->populations + population_id;
@@ -4784,6 +5867,7 @@ msp_reset(msp_t *self)
         pop->initial_size = initial_pop->initial_size;
         pop->start_time = 0;
         pop->state = initial_pop->state;
+        population_invalidate_merger_rates(pop);
     }
     /* Reset the tables to their correct position for replication */
     ret = tsk_table_collection_truncate(self->tables, &self->input_position);
@@ -4792,6 +5876,15 @@ msp_reset(msp_t *self)
         goto out;
     }
     tsk_bug_assert(self->tables->populations.num_rows == self->num_populations);
+    ret = msp_apply_table_capacity(self);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = msp_spill_rewind(self);
+    if (ret != 0) {
+        goto out;
+    }
+    rng_buffer_clear(&self->rng_buffer);
 
     ret = msp_reset_population_state(self);
     if (ret != 0) {
@@ -4812,6 +5905,10 @@ msp_reset(msp_t *self)
     self->num_trapped_re_events = 0;
     self->num_multiple_re_events = 0;
     self->num_buffered_edges = 0;
+    self->dtwf_switch_time = -DBL_MAX;
+    self->dtwf_streams_set = false;
+    self->sweep_state.active = false;
+    self->sweep_state.event_pending = false;
     memset(self->num_migration_events, 0, N * N * sizeof(size_t));
 
     if (self->start_time < DBL_MAX) {
@@ -4822,6 +5919,16 @@ msp_reset(msp_t *self)
             }
         }
     }
+    if (self->mutgen != NULL) {
+        ret = mutgen_begin(self->mutgen, self->mutgen_flags);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = mutgen_place_edges(self->mutgen, 0, self->input_position.edges);
+        if (ret != 0) {
+            goto out;
+        }
+    }
     self->time = self->start_time;
     self->state = MSP_STATE_INITIALISED;
 out:
@@ -4936,10 +6043,26 @@ msp_initialise(msp_t *self)
     }
     /* Copy the state of the simulation model into the initial model */
     memcpy(&self->initial_model, &self->model, sizeof(self->model));
+    if (msp_spill_enabled(self)) {
+        ret = msp_spill_open(self);
+        if (ret != 0) {
+            goto out;
+        }
+    }
     ret = msp_reset(self);
     if (ret != 0) {
         goto out;
     }
+    if (self->presize_tables) {
+        ret = msp_estimate_table_capacity(self, &self->table_capacity);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = msp_apply_table_capacity(self);
+        if (ret != 0) {
+            goto out;
+        }
+    }
     /* SMC_K logic */
     if (self->model.type == MSP_MODEL_SMC_K) {
         ret = msp_setup_smc_k(self);
@@ -4982,7 +6105,7 @@ msp_get_common_ancestor_waiting_time_from_rate(
     double u, dt, z;
 
     if (lambda > 0.0) {
-        u = gsl_ran_exponential(self->rng, 1.0 / lambda);
+        u = msp_ran_exponential(self, 1.0 / lambda);
         if (alpha == 0.0) {
             ret = self->ploidy * pop->initial_size * u;
         } else {
@@ -5079,7 +6202,7 @@ msp_sample_waiting_time(
         lambda = total_mass;
         t_wait = DBL_MAX;
         if (lambda > 0.0) {
-            t_wait = gsl_ran_exponential(self->rng, 1.0 / lambda);
+            t_wait = msp_ran_exponential(self, 1.0 / lambda);
         }
 
         *ret_t_wait = t_wait;
@@ -5147,7 +6270,7 @@ msp_sample_gc_left_waiting_time(msp_t *self, double *ret_t_wait)
     double t_wait = DBL_MAX;
 
     if (lambda > 0.0) {
-        t_wait = gsl_ran_exponential(self->rng, 1.0 / lambda);
+        t_wait = msp_ran_exponential(self, 1.0 / lambda);
     }
     *ret_t_wait = t_wait;
     return ret;
@@ -5158,7 +6281,7 @@ msp_gene_conversion_left_event(msp_t *self, label_id_t label)
 {
     int ret = 0;
     const double gc_left_total = msp_get_total_gc_left(self);
-    double h = gsl_rng_uniform(self->rng) * gc_left_total;
+    double h = msp_ran_uniform(self) * gc_left_total;
     double tl, bp, lhs_old_right, lhs_new_right;
     population_id_t population;
     lineage_t *lineage, *new_lineage;
@@ -5384,7 +6507,7 @@ msp_run_coalescent(msp_t *self, double max_time, unsigned long max_events)
                 pop_id_k = pop->potential_destinations[i];
                 lambda = n * self->migration_matrix[pop_id_j * N + pop_id_k];
                 tsk_bug_assert(lambda > 0);
-                t_temp = gsl_ran_exponential(self->rng, 1.0 / lambda);
+                t_temp = msp_ran_exponential(self, 1.0 / lambda);
                 if (t_temp < mig_t_wait) {
                     mig_t_wait = t_temp;
                     /* m[j, k] is the rate at which migrants move from
@@ -5527,7 +6650,7 @@ msp_pedigree_process_common_ancestors(msp_t *self, individual_t *ind, tsk_size_t
             if (rate_map_get_total_mass(&self->recomb_map) > 0) {
                 parent_nodes = self->pedigree.individuals[parent].nodes;
                 ret = msp_dtwf_recombine(self, genome, &parent_ancestry[0],
-                    &parent_ancestry[1], parent_nodes);
+                    &parent_ancestry[1], parent_nodes, NULL);
                 if (ret != 0) {
                     goto out;
                 }
@@ -5580,83 +6703,473 @@ static int
 msp_run_pedigree(msp_t *self, double max_time, unsigned long max_events)
 {
     int ret = 0;
-    tsk_size_t ploid;
-    individual_t *ind = NULL;
-    pedigree_t *pedigree = &self->pedigree;
-    const tsk_id_t num_individuals = (tsk_id_t) pedigree->num_individuals;
-    unsigned long num_events = 0;
+    tsk_size_t ploid;
+    individual_t *ind = NULL;
+    pedigree_t *pedigree = &self->pedigree;
+    const tsk_id_t num_individuals = (tsk_id_t) pedigree->num_individuals;
+    unsigned long num_events = 0;
+
+    tsk_bug_assert(pedigree != NULL);
+    if (pedigree->next_individual == PEDIGREE_UNINITIALISED) {
+        ret = msp_pedigree_initialise(self);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    /* Visit the individuals in time-increasing order. */
+    while (pedigree->next_individual < num_individuals) {
+        ind = pedigree->visit_order[pedigree->next_individual];
+        /* To keep the semantics as close as possible to DTWF we simulate until
+         * the *end* of generation max_time. So, we stop just before processing
+         * the first individual in generation max_time + 1. */
+        if (ind->time > max_time) {
+            ret = MSP_EXIT_MAX_TIME;
+            break;
+        }
+        if (num_events >= max_events) {
+            ret = MSP_EXIT_MAX_EVENTS;
+            break;
+        }
+        tsk_bug_assert(ind->time >= self->time);
+        self->time = ind->time;
+        for (ploid = 0; ploid < ind->ploidy; ploid++) {
+            ret = msp_pedigree_process_common_ancestors(self, ind, ploid);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+        pedigree->next_individual++;
+        num_events++;
+    }
+    if (msp_get_num_ancestors(self) == 0) {
+        ret = MSP_EXIT_COALESCENCE;
+    } else if (pedigree->next_individual == num_individuals) {
+        ret = MSP_EXIT_MODEL_COMPLETE;
+    } else {
+        tsk_bug_assert(ret == MSP_EXIT_MAX_TIME || ret == MSP_EXIT_MAX_EVENTS);
+    }
+out:
+    return ret;
+}
+
+/* Sorts offspring by parent, and within a parent in reverse order of
+ * drawing, which is the order in which the original linked lists of
+ * offspring per parent were traversed. */
+static int
+cmp_dtwf_offspring(const void *a, const void *b)
+{
+    const dtwf_offspring_t *ia = (const dtwf_offspring_t *) a;
+    const dtwf_offspring_t *ib = (const dtwf_offspring_t *) b;
+    int ret = (ia->parent > ib->parent) - (ia->parent < ib->parent);
+    if (ret == 0) {
+        ret = (ia->order < ib->order) - (ia->order > ib->order);
+    }
+    return ret;
+}
+
+/* Recombines the offspring of each parent in the specified population, which
+ * are sorted by parent, into the parent's two genome copies and merges them.
+ * The choices are either drawn as we go from the simulation's stream or were
+ * made in advance by msp_dtwf_draw_population, in which case the segments of
+ * the first num_recombined offspring have already been split. */
+static int MSP_WARN_UNUSED
+msp_dtwf_merge_population(msp_t *self, population_id_t population,
+    const dtwf_offspring_t *offspring, size_t num_offspring, size_t num_recombined,
+    const double *draws)
+{
+    int ret = 0;
+    int ix;
+    size_t i, k, l;
+    segment_t *x, *u[2];
+    lineage_t *lin;
+    avl_tree_t Q[2];
+    const double *drawn = NULL;
+    /* Only support single structured coalescent label for now. */
+    label_id_t label = 0;
+    tsk_id_t parent_nodes[MSP_MAX_PED_PLOIDY];
+
+    for (i = 0; i < 2; i++) {
+        avl_init_tree(&Q[i], cmp_segment_queue, NULL);
+    }
+    // Iterate through the offspring of each parent, adding to avl_tree
+    for (k = 0; k < num_offspring; k = l) {
+        for (i = 0; i < 2; i++) {
+            parent_nodes[i] = TSK_NULL;
+        }
+        for (l = k; l < num_offspring && offspring[l].parent == offspring[k].parent;
+             l++) {
+            lin = (lineage_t *) offspring[l].node->item;
+            x = lin->head;
+            if (draws != NULL) {
+                drawn = draws + offspring[l].draws;
+            }
+            // Recombine ancestor
+            // TODO Should this be the recombination rate going foward from x.left?
+            if (rate_map_get_total_mass(&self->recomb_map) > 0) {
+                if (l < num_recombined) {
+                    u[0] = offspring[l].heads[0];
+                    u[1] = offspring[l].heads[1];
+                    ret = msp_dtwf_store_recombination(
+                        self, x, &u[0], &u[1], parent_nodes);
+                } else {
+                    ret = msp_dtwf_recombine(
+                        self, x, &u[0], &u[1], parent_nodes, drawn);
+                }
+                if (ret != 0) {
+                    goto out;
+                }
+                for (i = 0; i < 2; i++) {
+                    if (u[i] != NULL && u[i] != x) {
+                        ret = msp_insert_individual(self, u[i]->lineage);
+                        if (ret != 0) {
+                            goto out;
+                        }
+                    }
+                }
+            } else {
+                if (drawn == NULL) {
+                    ix = (int) gsl_rng_uniform_int(self->rng, 2);
+                } else {
+                    ix = (int) drawn[0];
+                }
+                u[0] = NULL;
+                u[1] = NULL;
+                u[ix] = x;
+            }
+            // Add to AVLTree for each parental chromosome
+            for (i = 0; i < 2; i++) {
+                if (u[i] != NULL) {
+                    ret = msp_priority_queue_insert(self, &Q[i], u[i]);
+                    if (ret != 0) {
+                        goto out;
+                    }
+                }
+            }
+        }
+        // Merge segments in each parental chromosome
+        for (i = 0; i < 2; i++) {
+            ret = msp_merge_n_ancestors(
+                self, &Q[i], population, label, parent_nodes[i], NULL);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+    }
+out:
+    return ret;
+}
+
+/* For the DTWF, N for each population is the reference population size
+ * from the model multiplied by the current population size, rounded to
+ * the nearest integer. Thus, the population's size is always relative
+ * to the reference model population size (which is also true for the
+ * coalescent models. */
+static uint32_t
+msp_dtwf_get_population_size(msp_t *self, population_t *pop)
+{
+    return (uint32_t) round(get_population_size(pop, self->time));
+}
+
+static int MSP_WARN_UNUSED
+msp_dtwf_draws_alloc(msp_t *self)
+{
+    int ret = 0;
+    size_t j;
+
+    self->dtwf_draws = calloc(self->num_populations, sizeof(*self->dtwf_draws));
+    if (self->dtwf_draws == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < self->num_populations; j++) {
+        self->dtwf_draws[j].rng = gsl_rng_alloc(msp_rng_philox);
+        if (self->dtwf_draws[j].rng == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+dtwf_population_draws_push(dtwf_population_draws_t *self, double value)
+{
+    int ret = 0;
+    double *tmp;
+
+    if (self->num_draws == self->max_draws) {
+        self->max_draws = GSL_MAX(2 * self->max_draws, 1024);
+        tmp = realloc(self->draws, self->max_draws * sizeof(*self->draws));
+        if (tmp == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->draws = tmp;
+    }
+    self->draws[self->num_draws] = value;
+    self->num_draws++;
+out:
+    return ret;
+}
+
+/* Makes all the random choices for the specified population in the current
+ * DTWF generation from the population's own stream: the parent of each
+ * ancestor, and the parental copy and recombination breakpoints of each
+ * offspring in the order msp_dtwf_merge_population will process them. The
+ * segments of the offspring are then split into their parental copies in
+ * the same order, for as long as the reserved segments are sure to suffice.
+ * This only changes the segments of the population's ancestors and reads
+ * the rest of the simulation state, so different populations can be drawn
+ * concurrently. */
+int
+msp_dtwf_draw_population(msp_t *self, size_t population_id)
+{
+    int ret = 0;
+    dtwf_population_draws_t *draws;
+    dtwf_offspring_t *offspring;
+    population_t *pop;
+    avl_node_t *a;
+    segment_t *x;
+    uint32_t N;
+    size_t j, n, end;
+    double k, right;
+    const bool recombination = rate_map_get_total_mass(&self->recomb_map) > 0;
+    /* Only support single structured coalescent label for now. */
+    label_id_t label = 0;
+
+    if (self->dtwf_draws == NULL || population_id >= self->num_populations) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    draws = &self->dtwf_draws[population_id];
+    pop = &self->populations[population_id];
+    draws->num_offspring = 0;
+    draws->num_draws = 0;
+    draws->num_recombined = 0;
+    draws->num_re_events = 0;
+    n = avl_count(&pop->ancestors[label]);
+    if (n == 0) {
+        goto out;
+    }
+    N = msp_dtwf_get_population_size(self, pop);
+    if (N == 0) {
+        ret = MSP_ERR_DTWF_ZERO_POPULATION_SIZE;
+        goto out;
+    }
+    if (n > draws->max_offspring) {
+        msp_safe_free(draws->offspring);
+        draws->max_offspring = n;
+        draws->offspring = malloc(n * sizeof(*draws->offspring));
+        if (draws->offspring == NULL) {
+            draws->max_offspring = 0;
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+    offspring = draws->offspring;
+    for (a = pop->ancestors[label].head; a != NULL; a = a->next) {
+        offspring[draws->num_offspring].parent
+            = (uint32_t) gsl_rng_uniform_int(draws->rng, N);
+        offspring[draws->num_offspring].order = (uint32_t) draws->num_offspring;
+        offspring[draws->num_offspring].node = a;
+        draws->num_offspring++;
+    }
+    qsort(offspring, n, sizeof(*offspring), cmp_dtwf_offspring);
+
+    for (j = 0; j < n; j++) {
+        offspring[j].draws = draws->num_draws;
+        ret = dtwf_population_draws_push(
+            draws, (double) gsl_rng_uniform_int(draws->rng, 2));
+        if (ret != 0) {
+            goto out;
+        }
+        if (recombination) {
+            /* msp_dtwf_recombine uses every breakpoint up to and including
+             * the first that is past the end of the ancestor's material */
+            x = ((lineage_t *) offspring[j].node->item)->head;
+            k = x->left;
+            while (x->next != NULL) {
+                x = x->next;
+            }
+            right = x->right;
+            do {
+                k = msp_dtwf_generate_breakpoint(self, draws->rng, k);
+                ret = dtwf_population_draws_push(draws, k);
+                if (ret != 0) {
+                    goto out;
+                }
+            } while (k < right);
+        }
+    }
+    if (recombination) {
+        for (j = 0; j < n; j++) {
+            /* Each breakpoint but the last, which is past the end of the
+             * ancestor's material, makes at most one new segment. */
+            end = j + 1 < n ? offspring[j + 1].draws : draws->num_draws;
+            if (end - offspring[j].draws - 2 > draws->num_reserved) {
+                break;
+            }
+            x = ((lineage_t *) offspring[j].node->item)->head;
+            ret = msp_dtwf_split_segments(self, x, &offspring[j].heads[0],
+                &offspring[j].heads[1], draws->draws + offspring[j].draws, draws,
+                &draws->num_re_events);
+            if (ret != 0) {
+                goto out;
+            }
+            draws->num_recombined++;
+        }
+    }
+out:
+    return ret;
+}
+
+void
+msp_set_dtwf_population_runner(msp_t *self, dtwf_population_runner_t runner, void *arg)
+{
+    self->dtwf_population_runner = runner;
+    self->dtwf_population_runner_arg = arg;
+}
+
+/* Takes segments from the heap so that the specified population has its
+ * reserve size available for msp_dtwf_draw_population. */
+static int MSP_WARN_UNUSED
+msp_dtwf_reserve_segments(msp_t *self, dtwf_population_draws_t *draws)
+{
+    int ret = 0;
+    segment_t **tmp;
+    object_heap_t *heap = &self->segment_heap[0];
+
+    if (draws->reserve_size > draws->max_reserved) {
+        tmp = realloc(draws->reserved, draws->reserve_size * sizeof(*draws->reserved));
+        if (tmp == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        draws->reserved = tmp;
+        draws->max_reserved = draws->reserve_size;
+    }
+    while (draws->num_reserved < draws->reserve_size) {
+        if (object_heap_empty(heap)) {
+            ret = object_heap_expand(heap);
+            if (ret != 0) {
+                ret = MSP_ERR_NO_MEMORY;
+                goto out;
+            }
+        }
+        draws->reserved[draws->num_reserved] = object_heap_alloc_object(heap);
+        draws->num_reserved++;
+    }
+out:
+    return ret;
+}
+
+/* Returns the unused reserved segments to the heap, and sizes the next
+ * reserve from the number of breakpoints drawn in this generation. */
+static void
+msp_dtwf_release_segments(msp_t *self, dtwf_population_draws_t *draws)
+{
+    size_t bound;
+
+    while (draws->num_reserved > 0) {
+        draws->num_reserved--;
+        object_heap_free_object(
+            &self->segment_heap[0], draws->reserved[draws->num_reserved]);
+    }
+    bound = draws->num_draws - GSL_MIN(draws->num_draws, 2 * draws->num_offspring);
+    draws->reserve_size = bound + bound / 4;
+}
+
+/* Performs a single generation with the random choices for each population
+ * drawn in advance from its own stream. The streams are the counter-based
+ * streams for a single seed taken from the simulation's generator at the
+ * first drawn generation of each replicate, indexed by population, and
+ * carry on from one generation to the next. The draws, and the splitting
+ * of segments at the recombination breakpoints, may be made concurrently by
+ * the runner using segments reserved for each population beforehand. The
+ * coalescences write to the tables and the shared breakpoint and overlap
+ * indexes, so the populations are then merged one after another, and the
+ * nodes and edges are always stored in the same order. */
+static int MSP_WARN_UNUSED
+msp_dtwf_generation_drawn(msp_t *self)
+{
+    int ret = 0;
+    size_t j;
+    unsigned long seed;
+    dtwf_population_draws_t *draws;
 
-    tsk_bug_assert(pedigree != NULL);
-    if (pedigree->next_individual == PEDIGREE_UNINITIALISED) {
-        ret = msp_pedigree_initialise(self);
+    /* Segments are taken from the heap without the mass indexes */
+    tsk_bug_assert(self->recomb_mass_index == NULL);
+    tsk_bug_assert(self->gc_mass_index == NULL);
+
+    if (self->dtwf_draws == NULL) {
+        ret = msp_dtwf_draws_alloc(self);
         if (ret != 0) {
             goto out;
         }
     }
-    /* Visit the individuals in time-increasing order. */
-    while (pedigree->next_individual < num_individuals) {
-        ind = pedigree->visit_order[pedigree->next_individual];
-        /* To keep the semantics as close as possible to DTWF we simulate until
-         * the *end* of generation max_time. So, we stop just before processing
-         * the first individual in generation max_time + 1. */
-        if (ind->time > max_time) {
-            ret = MSP_EXIT_MAX_TIME;
-            break;
-        }
-        if (num_events >= max_events) {
-            ret = MSP_EXIT_MAX_EVENTS;
-            break;
-        }
-        tsk_bug_assert(ind->time >= self->time);
-        self->time = ind->time;
-        for (ploid = 0; ploid < ind->ploidy; ploid++) {
-            ret = msp_pedigree_process_common_ancestors(self, ind, ploid);
+    if (!self->dtwf_streams_set) {
+        seed = gsl_rng_get(self->rng);
+        for (j = 0; j < self->num_populations; j++) {
+            ret = msp_rng_set_stream(self->dtwf_draws[j].rng, seed, j);
             if (ret != 0) {
                 goto out;
             }
         }
-        pedigree->next_individual++;
-        num_events++;
+        self->dtwf_streams_set = true;
     }
-    if (msp_get_num_ancestors(self) == 0) {
-        ret = MSP_EXIT_COALESCENCE;
-    } else if (pedigree->next_individual == num_individuals) {
-        ret = MSP_EXIT_MODEL_COMPLETE;
-    } else {
-        tsk_bug_assert(ret == MSP_EXIT_MAX_TIME || ret == MSP_EXIT_MAX_EVENTS);
+    for (j = 0; j < self->num_populations; j++) {
+        ret = msp_dtwf_reserve_segments(self, &self->dtwf_draws[j]);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    ret = self->dtwf_population_runner(
+        self, self->num_populations, self->dtwf_population_runner_arg);
+    if (ret != 0) {
+        goto out;
+    }
+    for (j = 0; j < self->num_populations; j++) {
+        draws = &self->dtwf_draws[j];
+        self->num_re_events += draws->num_re_events;
+        ret = msp_dtwf_merge_population(self, (population_id_t) j, draws->offspring,
+            draws->num_offspring, draws->num_recombined, draws->draws);
+        if (ret != 0) {
+            goto out;
+        }
     }
 out:
+    if (self->dtwf_draws != NULL) {
+        for (j = 0; j < self->num_populations; j++) {
+            msp_dtwf_release_segments(self, &self->dtwf_draws[j]);
+        }
+    }
     return ret;
 }
 
-/* List structure for collecting segments by parent */
-typedef struct _segment_list_t {
-    avl_node_t *node;
-    struct _segment_list_t *next;
-} segment_list_t;
-
 /* Performs a single generation under the Wright Fisher model */
 static int MSP_WARN_UNUSED
 msp_dtwf_generation(msp_t *self)
 {
     int ret = 0;
-    int ix;
-    uint32_t N, i, j, k, p;
-    size_t segment_mem_offset;
+    uint32_t N, j, num_offspring;
+    const size_t max_offspring = msp_get_num_ancestors(self);
     population_t *pop;
-    segment_t *x, *u[2];
-    segment_list_t **parents = NULL;
-    segment_list_t *segment_mem = NULL;
-    segment_list_t *s;
-    lineage_t *lin;
-    avl_node_t *a, *node;
-    avl_tree_t Q[2];
+    dtwf_offspring_t *offspring = NULL;
+    avl_node_t *a;
     /* Only support single structured coalescent label for now. */
     label_id_t label = 0;
-    tsk_id_t parent_nodes[MSP_MAX_PED_PLOIDY];
 
-    for (i = 0; i < 2; i++) {
-        avl_init_tree(&Q[i], cmp_segment_queue, NULL);
+    if (self->dtwf_population_runner != NULL) {
+        ret = msp_dtwf_generation_drawn(self);
+        goto out;
+    }
+    /* Parents are only represented through the ancestors that choose them,
+     * so the work per generation does not depend on the population size. */
+    offspring = malloc(GSL_MAX(max_offspring, 1) * sizeof(*offspring));
+    if (offspring == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
     }
 
     for (j = 0; j < self->num_populations; j++) {
@@ -5665,96 +7178,31 @@ msp_dtwf_generation(msp_t *self)
         if (avl_count(&pop->ancestors[label]) == 0) {
             continue;
         }
-        /* For the DTWF, N for each population is the reference population size
-         * from the model multiplied by the current population size, rounded to
-         * the nearest integer. Thus, the population's size is always relative
-         * to the reference model population size (which is also true for the
-         * coalescent models. */
-        N = (uint32_t) round(get_population_size(pop, self->time));
+        N = msp_dtwf_get_population_size(self, pop);
         if (N == 0) {
             ret = MSP_ERR_DTWF_ZERO_POPULATION_SIZE;
             goto out;
         }
 
-        // Allocate memory for linked list of offspring per parent
-        parents = calloc(N, sizeof(segment_list_t *));
-        segment_mem = malloc(msp_get_num_ancestors(self) * sizeof(segment_list_t));
-        if (parents == NULL || segment_mem == NULL) {
-            ret = MSP_ERR_NO_MEMORY;
-            goto out;
-        }
         // Iterate through ancestors and draw parents
-        segment_mem_offset = 0;
+        num_offspring = 0;
         for (a = pop->ancestors[label].head; a != NULL; a = a->next) {
-            s = segment_mem + segment_mem_offset;
-            segment_mem_offset++;
-            p = (uint32_t) gsl_rng_uniform_int(self->rng, N);
-            // note: this also counts pass_through events
-            // if (parents[p] != NULL) {
-            //    self->num_ca_events++;
-            //}
-            s->next = parents[p];
-            s->node = a;
-            parents[p] = s;
-        }
-
-        // Iterate through offspring of parent k, adding to avl_tree
-        for (k = 0; k < N; k++) {
-            for (i = 0; i < 2; i++) {
-                parent_nodes[i] = TSK_NULL;
-            }
-            for (s = parents[k]; s != NULL; s = s->next) {
-                node = s->node;
-                lin = (lineage_t *) node->item;
-                x = lin->head;
-                // Recombine ancestor
-                // TODO Should this be the recombination rate going foward from x.left?
-                if (rate_map_get_total_mass(&self->recomb_map) > 0) {
-                    ret = msp_dtwf_recombine(self, x, &u[0], &u[1], parent_nodes);
-                    if (ret != 0) {
-                        goto out;
-                    }
-                    for (i = 0; i < 2; i++) {
-                        if (u[i] != NULL && u[i] != x) {
-                            ret = msp_insert_individual(self, u[i]->lineage);
-                            if (ret != 0) {
-                                goto out;
-                            }
-                        }
-                    }
-                } else {
-                    ix = (int) gsl_rng_uniform_int(self->rng, 2);
-                    u[0] = NULL;
-                    u[1] = NULL;
-                    u[ix] = x;
-                }
-                // Add to AVLTree for each parental chromosome
-                for (i = 0; i < 2; i++) {
-                    if (u[i] != NULL) {
-                        ret = msp_priority_queue_insert(self, &Q[i], u[i]);
-                        if (ret != 0) {
-                            goto out;
-                        }
-                    }
-                }
-            }
-            // Merge segments in each parental chromosome
-            for (i = 0; i < 2; i++) {
-                ret = msp_merge_n_ancestors(
-                    self, &Q[i], (population_id_t) j, label, parent_nodes[i], NULL);
-                if (ret != 0) {
-                    goto out;
-                }
-            }
+            tsk_bug_assert(num_offspring < max_offspring);
+            offspring[num_offspring].parent
+                = (uint32_t) gsl_rng_uniform_int(self->rng, N);
+            offspring[num_offspring].order = num_offspring;
+            offspring[num_offspring].node = a;
+            num_offspring++;
+        }
+        qsort(offspring, num_offspring, sizeof(*offspring), cmp_dtwf_offspring);
+        ret = msp_dtwf_merge_population(
+            self, (population_id_t) j, offspring, num_offspring, 0, NULL);
+        if (ret != 0) {
+            goto out;
         }
-        free(parents);
-        free(segment_mem);
-        segment_mem = NULL;
-        parents = NULL;
     }
 out:
-    msp_safe_free(parents);
-    msp_safe_free(segment_mem);
+    msp_safe_free(offspring);
     return ret;
 }
 
@@ -5806,6 +7254,33 @@ out:
     return ret;
 }
 
+/* Returns true if the number of lineages in every population is less than
+ * the specified fraction of its size, so that multiple and simultaneous
+ * mergers in the DTWF have become rare enough to be ignored. */
+static bool
+msp_dtwf_lineages_are_sparse(msp_t *self, double threshold)
+{
+    bool ret = true;
+    uint32_t j;
+    double N, n;
+    population_t *pop;
+    /* Only support a single structured coalescent label at the moment */
+    label_id_t label = 0;
+
+    for (j = 0; j < self->num_populations; j++) {
+        pop = &self->populations[j];
+        n = (double) avl_count(&pop->ancestors[label]);
+        if (n > 0) {
+            N = round(get_population_size(pop, self->time));
+            if (N <= 0 || n >= threshold * N) {
+                ret = false;
+                break;
+            }
+        }
+    }
+    return ret;
+}
+
 /* The main event loop for the Wright Fisher model.
  *
  * Returns:
@@ -5814,10 +7289,13 @@ out:
  *    of events was reached.
  * MSP_EXIT_MAX_TIME if the simulation stopped because the maximum time would
  *    have been exceeded by an event.
+ * MSP_EXIT_MODEL_COMPLETE if the hybrid model switched to the coalescent.
  * A negative value if an error occured.
+ * The number of generations run is stored in num_events.
  */
 static int MSP_WARN_UNUSED
-msp_run_dtwf(msp_t *self, double max_time, unsigned long max_events)
+msp_run_dtwf(
+    msp_t *self, double max_time, unsigned long max_events, unsigned long *num_events)
 {
     int ret = 0;
     unsigned long events = 0;
@@ -5852,6 +7330,18 @@ msp_run_dtwf(msp_t *self, double max_time, unsigned long max_events)
     }
 
     while (msp_get_num_ancestors(self) > 0) {
+        if (self->model.params.dtwf.switch_threshold > 0
+            && msp_dtwf_lineages_are_sparse(
+                self, self->model.params.dtwf.switch_threshold)) {
+            /* The caller carries on with the coalescent */
+            ret = msp_set_simulation_model_hudson(self);
+            if (ret != 0) {
+                goto out;
+            }
+            self->dtwf_switch_time = self->time;
+            ret = MSP_EXIT_MODEL_COMPLETE;
+            break;
+        }
         if (events == max_events) {
             ret = MSP_EXIT_MAX_EVENTS;
             break;
@@ -5973,6 +7463,7 @@ msp_run_dtwf(msp_t *self, double max_time, unsigned long max_events)
         }
     }
 out:
+    *num_events = events;
     msp_safe_free(node_trees);
     msp_safe_free(n);
     msp_safe_free(mig_tmp);
@@ -6099,15 +7590,114 @@ out:
     return ret;
 }
 
+/* Starts a sweep at the current time, and computes the absolute time of each
+ * step in its trajectory. The trajectory is the one set by the caller, the
+ * next one from the trajectory store, or a newly generated one. The
+ * population size is taken to be constant during the sweep. */
+static int
+msp_sweep_start(msp_t *self)
+{
+    int ret = 0;
+    sweep_t *sweep = &self->model.params.sweep;
+    genic_selection_trajectory_t *params
+        = &sweep->trajectory_params.genic_selection_trajectory;
+    sweep_trajectory_t *trajectory = &self->sweep_trajectory;
+    sweep_trajectory_store_t *store = self->sweep_trajectory_store;
+    sweep_state_t *state = &self->sweep_state;
+    size_t j, num_steps;
+    const double *time, *allele_frequency;
+    double *generated_time = NULL;
+    double *generated_allele_frequency = NULL;
+    double *tmp;
+    bool from_store = false;
+    const double pop_size = get_population_size(&self->populations[0], self->time);
+
+    if (rate_map_get_total_mass(&self->gc_map) != 0.0) {
+        /* Could be, we just haven't implemented it */
+        ret = MSP_ERR_SWEEPS_GC_NOT_SUPPORTED;
+        goto out;
+    }
+    if (self->sweep_trajectory_fixed) {
+        num_steps = trajectory->num_steps;
+        time = trajectory->time;
+        allele_frequency = trajectory->allele_frequency;
+    } else if (store != NULL) {
+        if (store->params.start_frequency != params->start_frequency
+            || store->params.end_frequency != params->end_frequency
+            || store->params.s != params->s || store->params.dt != params->dt
+            || store->population_size != pop_size) {
+            ret = MSP_ERR_SWEEP_TRAJECTORY_STORE_MISMATCH;
+            goto out;
+        }
+        if (self->next_sweep_trajectory >= store->num_trajectories) {
+            ret = MSP_ERR_SWEEP_TRAJECTORIES_EXHAUSTED;
+            goto out;
+        }
+        ret = sweep_trajectory_store_get(store, self->next_sweep_trajectory,
+            &num_steps, &time, &allele_frequency);
+        if (ret != 0) {
+            goto out;
+        }
+        from_store = true;
+    } else {
+        ret = sweep->generate_trajectory(
+            sweep, self, &num_steps, &generated_time, &generated_allele_frequency);
+        if (ret != 0) {
+            goto out;
+        }
+        msp_safe_free(trajectory->time);
+        msp_safe_free(trajectory->allele_frequency);
+        trajectory->num_steps = num_steps;
+        trajectory->time = generated_time;
+        trajectory->allele_frequency = generated_allele_frequency;
+        generated_time = NULL;
+        generated_allele_frequency = NULL;
+        time = trajectory->time;
+        allele_frequency = trajectory->allele_frequency;
+    }
+    tsk_bug_assert(num_steps > 0);
+    if (num_steps > state->max_steps) {
+        tmp = realloc(state->time, num_steps * sizeof(*state->time));
+        if (tmp == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        state->time = tmp;
+        state->max_steps = num_steps;
+    }
+    for (j = 0; j < num_steps; j++) {
+        state->time[j] = self->time + time[j] * self->ploidy * pop_size;
+    }
+    state->num_steps = num_steps;
+    state->trajectory_time = time;
+    state->allele_frequency = allele_frequency;
+    ret = msp_sweep_initialise(self, allele_frequency[0]);
+    if (ret != 0) {
+        goto out;
+    }
+    /* Only use up the stored trajectory once the sweep has started */
+    if (from_store) {
+        self->next_sweep_trajectory++;
+    }
+    state->active = true;
+    state->curr_step = 1;
+    state->event_pending = false;
+out:
+    msp_safe_free(generated_time);
+    msp_safe_free(generated_allele_frequency);
+    return ret;
+}
+
 static int
-msp_run_sweep(msp_t *self)
+msp_run_sweep(msp_t *self, double max_time, unsigned long max_events)
 {
     int ret = 0;
     simulation_model_t *model = &self->model;
+    sweep_state_t *state = &self->sweep_state;
     size_t curr_step = 1;
     size_t num_steps;
-    double *allele_frequency = NULL;
-    double *time = NULL;
+    const double *allele_frequency;
+    const double *time;
     double sweep_locus = model->params.sweep.position;
     double sweep_dt;
     size_t j = 0;
@@ -6116,51 +7706,40 @@ msp_run_sweep(msp_t *self)
     label_id_t label;
     double rec_rates[] = { 0.0, 0.0 };
     double sweep_pop_sizes[] = { 0.0, 0.0 };
-    double event_prob, event_rand, tmp_rand, e_sum, pop_size;
+    double tmp_rand, e_sum, pop_size;
     double p_coal_b, p_coal_B, total_rate, sweep_pop_tot_rate;
     double p_rec_b, p_rec_B;
-    double t_start, t_unscaled;
     bool sweep_over;
 
-    if (rate_map_get_total_mass(&self->gc_map) != 0.0) {
-        /* Could be, we just haven't implemented it */
-        ret = MSP_ERR_SWEEPS_GC_NOT_SUPPORTED;
-        goto out;
-    }
-
     /* Keep the compiler happy */
     sweep_pop_tot_rate = 0;
     p_coal_b = 0;
     p_coal_B = 0;
     p_rec_b = 0;
     p_rec_B = 0;
-    /* JK: I've removed the time and event limits on this function to simplify
-     * things as function is currently 'non-rentrant'; we can't stop in the middle
-     * of the sweep and pick it up again from where we left off later. This is
-     * different to all the other model runners. Probably the simplest thing to
-     * do here is to make the trajectory times absolute wrt to the simulation, and
-     * to then increment curr_step accordingly. We can then probably reason about
-     * when the call msp_sweep_initialise and msp_sweep_finalise
-     * depending on the value of curr_step, and hopefully reintroduce the max_time
-     * and max_steps parameters. */
-
-    ret = model->params.sweep.generate_trajectory(
-        &model->params.sweep, self, &num_steps, &time, &allele_frequency);
-
-    t_start = self->time;
+
+    /* The trajectory times are absolute, so when we're interrupted by the
+     * time or event limits we can pick up the sweep again from curr_step.
+     * msp_sweep_initialise and msp_sweep_finalise are called at the start
+     * and end of the whole sweep. */
+    if (!state->active) {
+        ret = msp_sweep_start(self);
+        if (ret != 0) {
+            goto out;
+        }
+    }
     sweep_dt = model->params.sweep.trajectory_params.genic_selection_trajectory.dt;
     tsk_bug_assert(sweep_dt > 0);
-    if (ret != 0) {
-        goto out;
-    }
-    ret = msp_sweep_initialise(self, allele_frequency[0]);
-    if (ret != 0) {
-        goto out;
-    }
+    num_steps = state->num_steps;
+    allele_frequency = state->allele_frequency;
+    time = state->time;
+    curr_step = state->curr_step;
 
-    curr_step = 1;
     while (msp_get_num_ancestors(self) > 0 && curr_step < num_steps) {
-        events++;
+        if (events == max_events) {
+            ret = MSP_EXIT_MAX_EVENTS;
+            goto out;
+        }
         /* Set pop sizes & rec_rates */
         for (j = 0; j < self->num_labels; j++) {
             label = (label_id_t) j;
@@ -6175,10 +7754,18 @@ msp_run_sweep(msp_t *self)
             rec_rates[j] = TSK_MAX(0, recomb_mass);
         }
 
-        event_prob = 1.0;
-        event_rand = gsl_rng_uniform(self->rng);
+        if (!state->event_pending) {
+            state->event_prob = 1.0;
+            state->event_rand = gsl_rng_uniform(self->rng);
+            state->event_pending = true;
+        }
         sweep_over = false;
-        while (event_prob > event_rand && curr_step < num_steps && !sweep_over) {
+        while (state->event_prob > state->event_rand && curr_step < num_steps
+               && !sweep_over) {
+            if (time[curr_step] > max_time) {
+                ret = MSP_EXIT_MAX_TIME;
+                goto out;
+            }
             pop_size = get_population_size(&self->populations[0], self->time);
             p_coal_B = 0;
             if (avl_count(&self->populations[0].ancestors[1]) > 1) {
@@ -6196,34 +7783,21 @@ msp_run_sweep(msp_t *self)
             /* doing this to build in generality if we want >1 pop */
 
             total_rate = sweep_pop_tot_rate;
-            /* DEBUG
-            printf("pop_size: %g sweep_dt: %g sweep_pop_sizes[1]: %g "
-                   "sweep_pop_sizes[1]: %g\n",
-                pop_size, sweep_dt, sweep_pop_sizes[0], sweep_pop_sizes[1]);
-            printf("x: %g p_rec_b: %g p_rec_B: %g p_coal_b: %g p_coal_B: %g\n",
-                allele_frequency[curr_step], p_rec_b, p_rec_B, p_coal_b, p_coal_B);
-            printf("rec_rates[0]: %g rec_rates[1]: %g ploidy: %d\n", rec_rates[0],
-                rec_rates[1], self->ploidy);
-            printf("event_prob: %g rand: %g\n", event_prob, event_rand);
-            */
-
-            event_prob *= 1.0 - total_rate;
+            state->event_prob *= 1.0 - total_rate;
             curr_step++;
 
             sweep_over = total_rate == 0;
         }
+        state->event_pending = false;
         if (sweep_over) {
             break;
         }
+        events++;
 
         tmp_rand = gsl_rng_uniform(self->rng);
 
         e_sum = p_coal_b;
-        /* convert time scale */
-        pop_size = get_population_size(&self->populations[0], self->time);
-        t_unscaled = time[curr_step - 1] * self->ploidy * pop_size;
-        tsk_bug_assert(t_unscaled > 0);
-        self->time = t_start + t_unscaled;
+        self->time = time[curr_step - 1];
         if (tmp_rand < e_sum / sweep_pop_tot_rate) {
             /* coalescent in b background */
             ret = self->common_ancestor_event(self, 0, 0);
@@ -6274,10 +7848,10 @@ msp_run_sweep(msp_t *self)
     if (ret != 0) {
         goto out;
     }
+    state->active = false;
     ret = MSP_EXIT_MODEL_COMPLETE;
 out:
-    msp_safe_free(time);
-    msp_safe_free(allele_frequency);
+    state->curr_step = curr_step;
     return ret;
 }
 
@@ -6289,50 +7863,177 @@ int MSP_WARN_UNUSED
 msp_run(msp_t *self, double max_time, unsigned long max_events)
 {
     int ret = 0;
-    int err;
+    int err;
+    unsigned long num_events = 0;
+
+    if (self->state == MSP_STATE_INITIALISED) {
+        self->state = MSP_STATE_SIMULATING;
+    }
+    if (self->state != MSP_STATE_SIMULATING) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+
+    if (msp_is_completed(self)) {
+        /* If the simulation is completed, run() is a no-op for
+         * all models. */
+        ret = 0;
+    } else if (self->model.type == MSP_MODEL_DTWF) {
+        ret = msp_run_dtwf(self, max_time, max_events, &num_events);
+        if (ret == MSP_EXIT_MODEL_COMPLETE && self->model.type == MSP_MODEL_HUDSON) {
+            /* The hybrid DTWF has switched to the coalescent, which gets
+             * whatever is left of the event budget */
+            ret = msp_run_coalescent(self, max_time, max_events - num_events);
+        }
+    } else if (self->model.type == MSP_MODEL_WF_PED) {
+        ret = msp_run_pedigree(self, max_time, max_events);
+    } else if (self->model.type == MSP_MODEL_SWEEP) {
+        ret = msp_run_sweep(self, max_time, max_events);
+    } else {
+        ret = msp_run_coalescent(self, max_time, max_events);
+    }
+
+    if (ret < 0) {
+        goto out;
+    }
+    if (ret == MSP_EXIT_MAX_TIME) {
+        /* Set the time to the max_time specified. If the tables are finalised
+         * after this we will get unary edges on the end of each extant node
+         * to this point so that the simulation can be resumed accurately.
+         */
+        self->time = max_time;
+    }
+    err = msp_flush_edges(self);
+    if (err != 0) {
+        ret = err;
+        goto out;
+    }
+out:
+    return ret;
+}
+
+static inline void
+msp_get_edge(const tsk_edge_table_t *edges, tsk_size_t j, tsk_edge_t *edge)
+{
+    edge->left = edges->left[j];
+    edge->right = edges->right[j];
+    edge->parent = edges->parent[j];
+    edge->child = edges->child[j];
+}
+
+static inline void
+msp_set_edge(tsk_edge_table_t *edges, tsk_size_t j, const tsk_edge_t *edge)
+{
+    edges->left[j] = edge->left;
+    edges->right[j] = edge->right;
+    edges->parent[j] = edge->parent;
+    edges->child[j] = edge->child;
+}
+
+/* Returns true if the edges can be put in order by merging their sorted
+ * runs. The merge moves the edge columns directly, so tables with edge
+ * metadata are left to tsk_table_collection_sort. */
+static bool
+msp_merge_edges_enabled(msp_t *self)
+{
+    return self->finalise_mode == MSP_FINALISE_MERGE
+           && self->tables->edges.metadata_length == 0;
+}
+
+/* Compares edges by the time of the parent, which must be in memory, and
+ * then as in cmp_edge. */
+static int
+msp_cmp_edge_time(msp_t *self, const tsk_edge_t *a, const tsk_edge_t *b)
+{
+    const double *node_time = self->tables->nodes.time;
+    const tsk_id_t row_a = msp_get_node_row(self, a->parent);
+    const tsk_id_t row_b = msp_get_node_row(self, b->parent);
+    double ta, tb;
+    int ret;
+
+    tsk_bug_assert(row_a != TSK_NULL && row_b != TSK_NULL);
+    ta = node_time[row_a];
+    tb = node_time[row_b];
+    ret = (ta > tb) - (ta < tb);
+    if (ret == 0) {
+        ret = cmp_edge(a, b);
+    }
+    return ret;
+}
+
+/* Merges the sorted runs of edges [start, mid) and [mid, num_rows) in the
+ * output edge table in linear time. Only the rows of the first run that
+ * sort after the head of the second run are copied out. */
+static int MSP_WARN_UNUSED
+msp_merge_edge_runs(msp_t *self, tsk_size_t start, tsk_size_t mid)
+{
+    int ret = 0;
+    tsk_edge_table_t *edges = &self->tables->edges;
+    const tsk_size_t num_edges = edges->num_rows;
+    tsk_edge_t *buffer = NULL;
+    tsk_edge_t edge, head;
+    tsk_size_t i, j, k, n;
 
-    if (self->state == MSP_STATE_INITIALISED) {
-        self->state = MSP_STATE_SIMULATING;
-    }
-    if (self->state != MSP_STATE_SIMULATING) {
-        ret = MSP_ERR_BAD_STATE;
+    if (start >= mid || mid >= num_edges) {
         goto out;
     }
-
-    if (msp_is_completed(self)) {
-        /* If the simulation is completed, run() is a no-op for
-         * all models. */
-        ret = 0;
-    } else if (self->model.type == MSP_MODEL_DTWF) {
-        ret = msp_run_dtwf(self, max_time, max_events);
-    } else if (self->model.type == MSP_MODEL_WF_PED) {
-        ret = msp_run_pedigree(self, max_time, max_events);
-    } else if (self->model.type == MSP_MODEL_SWEEP) {
-        /* FIXME making sweep atomic for now as it's non-rentrant */
-        ret = msp_run_sweep(self);
-    } else {
-        ret = msp_run_coalescent(self, max_time, max_events);
+    msp_get_edge(edges, mid, &head);
+    k = mid;
+    while (k > start) {
+        msp_get_edge(edges, k - 1, &edge);
+        if (msp_cmp_edge_time(self, &edge, &head) <= 0) {
+            break;
+        }
+        k--;
     }
-
-    if (ret < 0) {
+    n = mid - k;
+    if (n == 0) {
         goto out;
     }
-    if (ret == MSP_EXIT_MAX_TIME) {
-        /* Set the time to the max_time specified. If the tables are finalised
-         * after this we will get unary edges on the end of each extant node
-         * to this point so that the simulation can be resumed accurately.
-         */
-        self->time = max_time;
-    }
-    err = msp_flush_edges(self);
-    if (err != 0) {
-        ret = err;
+    buffer = malloc(n * sizeof(*buffer));
+    if (buffer == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
+    for (i = 0; i < n; i++) {
+        msp_get_edge(edges, k + i, buffer + i);
+    }
+    /* The output row k never overtakes the input row j of the second run,
+     * so we can merge forwards in place. Ties go to the first run. */
+    i = 0;
+    j = mid;
+    while (i < n) {
+        if (j < num_edges) {
+            msp_get_edge(edges, j, &edge);
+        }
+        if (j < num_edges && msp_cmp_edge_time(self, &edge, buffer + i) < 0) {
+            j++;
+        } else {
+            edge = buffer[i];
+            i++;
+        }
+        msp_set_edge(edges, k, &edge);
+        k++;
+    }
 out:
+    msp_safe_free(buffer);
     return ret;
 }
 
+/* Returns the number of segments in use, which bounds the number of edges
+ * msp_insert_uncoalesced_edges can add. */
+static tsk_size_t
+msp_get_num_allocated_segments(msp_t *self)
+{
+    tsk_size_t total = 0;
+    label_id_t label;
+
+    for (label = 0; label < (label_id_t) self->num_labels; label++) {
+        total += (tsk_size_t) object_heap_get_num_allocated(&self->segment_heap[label]);
+    }
+    return total;
+}
+
 /* Add in nodes and edges for the remaining segments to the output table. */
 static int MSP_WARN_UNUSED
 msp_insert_uncoalesced_edges(msp_t *self)
@@ -6344,11 +8045,31 @@ msp_insert_uncoalesced_edges(msp_t *self)
     segment_t *seg;
     lineage_t *lin;
     tsk_id_t node;
-    int64_t edge_start;
-    tsk_node_table_t *nodes = &self->tables->nodes;
+    tsk_size_t j, edge_start, num_new_edges, max_new_edges, num_edges;
+    tsk_edge_t *new_edges = NULL;
+    tsk_edge_table_t *edges = &self->tables->edges;
     const double current_time = self->time;
     tsk_bookmark_t bookmark;
 
+    max_new_edges = 0;
+    for (pop = 0; pop < (population_id_t) self->num_populations; pop++) {
+        for (label = 0; label < (label_id_t) self->num_labels; label++) {
+            for (a = self->populations[pop].ancestors[label].head; a != NULL;
+                 a = a->next) {
+                lin = (lineage_t *) a->item;
+                for (seg = lin->head; seg != NULL; seg = seg->next) {
+                    max_new_edges++;
+                }
+            }
+        }
+    }
+    new_edges = malloc((max_new_edges + 1) * sizeof(*new_edges));
+    if (new_edges == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+
+    num_new_edges = 0;
     for (pop = 0; pop < (population_id_t) self->num_populations; pop++) {
         for (label = 0; label < (label_id_t) self->num_labels; label++) {
             for (a = self->populations[pop].ancestors[label].head; a != NULL;
@@ -6362,17 +8083,16 @@ msp_insert_uncoalesced_edges(msp_t *self)
                 node = TSK_NULL;
                 lin = (lineage_t *) a->item;
                 for (seg = lin->head; seg != NULL; seg = seg->next) {
-                    if (nodes->time[seg->value] == current_time) {
+                    if (msp_node_is_current(self, seg->value)) {
                         node = seg->value;
                         break;
                     }
                 }
                 if (node == TSK_NULL) {
                     /* Add a node for this ancestor */
-                    node = tsk_node_table_add_row(
-                        nodes, 0, current_time, pop, TSK_NULL, NULL, 0);
+                    node = msp_add_node(self, 0, current_time, pop, TSK_NULL);
                     if (node < 0) {
-                        ret = msp_set_tsk_error(node);
+                        ret = (int) node;
                         goto out;
                     }
                 }
@@ -6380,39 +8100,179 @@ msp_insert_uncoalesced_edges(msp_t *self)
                 /* For every segment add an edge pointing to this new node */
                 for (seg = lin->head; seg != NULL; seg = seg->next) {
                     if (seg->value != node) {
-                        tsk_bug_assert(nodes->time[node] > nodes->time[seg->value]);
-                        ret = tsk_edge_table_add_row(&self->tables->edges, seg->left,
-                            seg->right, node, seg->value, NULL, 0);
-                        if (ret < 0) {
-                            ret = msp_set_tsk_error(ret);
-                            goto out;
-                        }
+                        tsk_bug_assert(!msp_node_is_current(self, seg->value));
+                        new_edges[num_new_edges].left = seg->left;
+                        new_edges[num_new_edges].right = seg->right;
+                        new_edges[num_new_edges].parent = node;
+                        new_edges[num_new_edges].child = seg->value;
+                        num_new_edges++;
                     }
                 }
             }
         }
     }
+    /* All the new edges have the same parent time, so sorting them among
+     * themselves leaves a single run to combine with the existing edges. */
+    qsort(new_edges, (size_t) num_new_edges, sizeof(*new_edges), cmp_edge);
 
     /* Find the first edge with parent == current time */
-    edge_start = ((int64_t) self->tables->edges.num_rows) - 1;
-    while (edge_start >= 0
-           && nodes->time[self->tables->edges.parent[edge_start]] == current_time) {
+    num_edges = edges->num_rows;
+    edge_start = num_edges;
+    while (edge_start > 0 && msp_node_is_current(self, edges->parent[edge_start - 1])) {
         edge_start--;
     }
-    memset(&bookmark, 0, sizeof(bookmark));
-    if (edge_start > 0) {
-        bookmark.edges = (tsk_size_t) edge_start;
+    for (j = 0; j < num_new_edges; j++) {
+        ret = tsk_edge_table_add_row(edges, new_edges[j].left, new_edges[j].right,
+            new_edges[j].parent, new_edges[j].child, NULL, 0);
+        if (ret < 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+    }
+    if (self->mutgen != NULL) {
+        ret = mutgen_place_edges(self->mutgen, num_edges, edges->num_rows);
+        if (ret != 0) {
+            goto out;
+        }
     }
-    /* We know migrations are sorted already */
-    bookmark.migrations = self->tables->migrations.num_rows;
-    /* Don't sort individuals */
-    bookmark.individuals = self->tables->individuals.num_rows;
-    ret = tsk_table_collection_sort(self->tables, &bookmark, 0);
-    if (ret != 0) {
-        ret = msp_set_tsk_error(ret);
+    if (msp_merge_edges_enabled(self)) {
+        ret = msp_merge_edge_runs(self, edge_start, num_edges);
+        if (ret != 0) {
+            goto out;
+        }
+    } else {
+        memset(&bookmark, 0, sizeof(bookmark));
+        bookmark.edges = edge_start;
+        /* We know migrations are sorted already */
+        bookmark.migrations = self->tables->migrations.num_rows;
+        /* Don't sort individuals */
+        bookmark.individuals = self->tables->individuals.num_rows;
+        ret = tsk_table_collection_sort(self->tables, &bookmark, 0);
+        if (ret != 0) {
+            ret = msp_set_tsk_error(ret);
+            goto out;
+        }
+    }
+    ret = 0;
+out:
+    msp_safe_free(new_edges);
+    return ret;
+}
+
+/* Coordinates are nonnegative, so the IEEE bit patterns of the doubles
+ * are in the same order as their values. */
+static inline uint64_t
+msp_coordinate_key(double x)
+{
+    uint64_t key;
+
+    memcpy(&key, &x, sizeof(key));
+    /* Map -0.0 to 0 */
+    if (key >> 63) {
+        key = 0;
+    }
+    return key;
+}
+
+/* Stable LSD radix sort of the edge IDs in order by their coordinate keys,
+ * skipping the passes where every key has the same digit. */
+static void
+msp_radix_sort_edge_ids(
+    tsk_size_t n, uint64_t *keys, tsk_id_t *ids, uint64_t *keys_buff, tsk_id_t *ids_buff)
+{
+    tsk_size_t counts[256];
+    tsk_size_t j, total, count;
+    unsigned int shift, digit;
+    uint64_t *src_keys = keys;
+    uint64_t *dest_keys = keys_buff;
+    tsk_id_t *src_ids = ids;
+    tsk_id_t *dest_ids = ids_buff;
+    uint64_t *tmp_keys;
+    tsk_id_t *tmp_ids;
+
+    if (n == 0) {
+        return;
+    }
+    for (shift = 0; shift < 64; shift += 8) {
+        memset(counts, 0, sizeof(counts));
+        for (j = 0; j < n; j++) {
+            counts[(src_keys[j] >> shift) & 0xff]++;
+        }
+        if (counts[(src_keys[0] >> shift) & 0xff] == n) {
+            continue;
+        }
+        total = 0;
+        for (digit = 0; digit < 256; digit++) {
+            count = counts[digit];
+            counts[digit] = total;
+            total += count;
+        }
+        for (j = 0; j < n; j++) {
+            digit = (unsigned int) ((src_keys[j] >> shift) & 0xff);
+            dest_keys[counts[digit]] = src_keys[j];
+            dest_ids[counts[digit]] = src_ids[j];
+            counts[digit]++;
+        }
+        tmp_keys = src_keys;
+        src_keys = dest_keys;
+        dest_keys = tmp_keys;
+        tmp_ids = src_ids;
+        src_ids = dest_ids;
+        dest_ids = tmp_ids;
+    }
+    if (src_ids != ids) {
+        memcpy(ids, src_ids, n * sizeof(*ids));
+    }
+}
+
+/* Builds the edge indexes for the output tables. The edges are in
+ * (parent time, parent, child, left) order, so a stable sort of the rows
+ * by left coordinate gives the insertion order and a stable sort of the
+ * reversed rows by right coordinate gives the removal order, in linear
+ * time. For fully sorted tables these are the same indexes as made by
+ * tsk_table_collection_build_index. As there, the tskit error is returned
+ * if the edges are not in a valid order. */
+static int MSP_WARN_UNUSED
+msp_build_edge_index(msp_t *self)
+{
+    int ret = 0;
+    tsk_id_t err;
+    const tsk_edge_table_t *edges = &self->tables->edges;
+    const tsk_size_t n = edges->num_rows;
+    uint64_t *keys = malloc((n + 1) * sizeof(*keys));
+    uint64_t *keys_buff = malloc((n + 1) * sizeof(*keys_buff));
+    tsk_id_t *insertion_order = malloc((n + 1) * sizeof(*insertion_order));
+    tsk_id_t *removal_order = malloc((n + 1) * sizeof(*removal_order));
+    tsk_id_t *ids_buff = malloc((n + 1) * sizeof(*ids_buff));
+    tsk_size_t j;
+
+    if (keys == NULL || keys_buff == NULL || insertion_order == NULL
+        || removal_order == NULL || ids_buff == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
+    err = tsk_table_collection_check_integrity(self->tables, TSK_CHECK_EDGE_ORDERING);
+    if (err < 0) {
+        ret = (int) err;
+        goto out;
+    }
+    for (j = 0; j < n; j++) {
+        keys[j] = msp_coordinate_key(edges->left[j]);
+        insertion_order[j] = (tsk_id_t) j;
+    }
+    msp_radix_sort_edge_ids(n, keys, insertion_order, keys_buff, ids_buff);
+    for (j = 0; j < n; j++) {
+        keys[j] = msp_coordinate_key(edges->right[n - j - 1]);
+        removal_order[j] = (tsk_id_t)(n - j - 1);
+    }
+    msp_radix_sort_edge_ids(n, keys, removal_order, keys_buff, ids_buff);
+    ret = tsk_table_collection_set_indexes(self->tables, insertion_order, removal_order);
 out:
+    msp_safe_free(keys);
+    msp_safe_free(keys_buff);
+    msp_safe_free(insertion_order);
+    msp_safe_free(removal_order);
+    msp_safe_free(ids_buff);
     return ret;
 }
 
@@ -6421,18 +8281,36 @@ msp_finalise_tables(msp_t *self)
 {
     int ret = 0;
     tsk_bookmark_t bookmark;
-
     /* We don't want to add unary edges for the pedigree simulation model */
-    if (!msp_is_completed(self) && self->model.type != MSP_MODEL_WF_PED) {
+    bool insert_uncoalesced
+        = !msp_is_completed(self) && self->model.type != MSP_MODEL_WF_PED;
+
+    /* Leave room for the uncoalesced nodes and edges, so that the tables
+     * aren't expanded again once they hold all the spilled rows. */
+    ret = msp_unspill_tables(
+        self, insert_uncoalesced ? msp_get_num_allocated_segments(self) : 0);
+    if (ret != 0) {
+        goto out;
+    }
+    if (insert_uncoalesced) {
         ret = msp_insert_uncoalesced_edges(self);
         if (ret != 0) {
             goto out;
         }
     }
-    ret = tsk_table_collection_build_index(self->tables, 0);
+    if (msp_merge_edges_enabled(self)) {
+        /* The input edges are sorted, and usually all precede the edges
+         * from the simulation. */
+        ret = msp_merge_edge_runs(self, 0, self->input_position.edges);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    ret = msp_build_edge_index(self);
     if (ret == TSK_ERR_EDGES_NOT_SORTED_PARENT_TIME
         || ret == TSK_ERR_EDGES_NONCONTIGUOUS_PARENTS
-        || ret == TSK_ERR_EDGES_NOT_SORTED_CHILD) {
+        || ret == TSK_ERR_EDGES_NOT_SORTED_CHILD
+        || ret == TSK_ERR_EDGES_NOT_SORTED_LEFT) {
         /* There are rare cases when we are simulating from awkward initial
          * states where the tables we produce in the simulation are not
          * correctly sorted. The simplest course of action here to just let it
@@ -6446,11 +8324,61 @@ msp_finalise_tables(msp_t *self)
         if (ret != 0) {
             goto out;
         }
-        ret = tsk_table_collection_build_index(self->tables, 0);
+        ret = msp_build_edge_index(self);
+    }
+    if (ret != 0) {
+        goto out;
+    }
+    if (self->mutgen != NULL) {
+        ret = mutgen_finish(self->mutgen);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+/* Finishes the output like msp_finalise_tables, but leaves the simulated
+ * node, edge and migration rows in the spill files rather than reading them
+ * back, so that no more than about a block of simulated rows is held in
+ * memory at any point. The tables keep only the input rows, and the files
+ * are rewound so that the columns can be read from the start, in the order
+ * given by the MSP_SPILL_* constants; the files and the numbers of rows in
+ * the spill struct stay valid until the simulator is reset or freed.
+ *
+ * The edge index is not built, and the input edges are assumed to precede
+ * the simulated edges. Mutations can't be placed inline, since that needs
+ * the full tables, and the merge finalise mode is required so that the
+ * uncoalesced edges can be ordered without looking up spilled nodes. */
+int MSP_WARN_UNUSED
+msp_finalise_spill(msp_t *self)
+{
+    int ret = 0;
+    int j;
+
+    if (!msp_spill_enabled(self) || self->mutgen != NULL
+        || !msp_merge_edges_enabled(self)) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    if (!msp_is_completed(self) && self->model.type != MSP_MODEL_WF_PED) {
+        ret = msp_insert_uncoalesced_edges(self);
+        if (ret != 0) {
+            goto out;
+        }
     }
+    ret = msp_spill_tables(self);
     if (ret != 0) {
         goto out;
     }
+    for (j = 0; j < MSP_NUM_SPILL_COLUMNS; j++) {
+        if (fflush(self->spill.files[j]) != 0
+            || fseek(self->spill.files[j], 0, SEEK_SET) != 0) {
+            ret = MSP_ERR_IO;
+            goto out;
+        }
+    }
 out:
     return ret;
 }
@@ -6621,19 +8549,26 @@ msp_get_num_breakpoints(msp_t *self)
 size_t
 msp_get_num_nodes(msp_t *self)
 {
-    return (size_t) self->tables->nodes.num_rows;
+    return (size_t)(self->tables->nodes.num_rows + self->spill.num_nodes);
 }
 
 size_t
 msp_get_num_edges(msp_t *self)
 {
-    return (size_t) self->tables->edges.num_rows;
+    return (size_t)(self->tables->edges.num_rows + self->spill.num_edges);
 }
 
 size_t
 msp_get_num_migrations(msp_t *self)
 {
-    return (size_t) self->tables->migrations.num_rows;
+    return (size_t)(self->tables->migrations.num_rows + self->spill.num_migrations);
+}
+
+int
+msp_get_table_capacity(msp_t *self, table_capacity_t *capacity)
+{
+    *capacity = self->table_capacity;
+    return 0;
 }
 
 int MSP_WARN_UNUSED
@@ -6795,6 +8730,7 @@ msp_change_single_population_parameters(msp_t *self, size_t population_id, doubl
         pop->growth_rate = growth_rate;
     }
     pop->start_time = time;
+    population_invalidate_merger_rates(pop);
 out:
     return ret;
 }
@@ -7080,6 +9016,7 @@ msp_deactivate_population(msp_t *self, int population_id)
     /* Set these to zero for tidyness sake */
     pop->initial_size = 0;
     pop->growth_rate = 0;
+    population_invalidate_merger_rates(pop);
 out:
     return ret;
 }
@@ -7641,8 +9578,8 @@ msp_census_event(msp_t *self, demographic_event_t *event)
                 seg = lin->head;
                 while (seg != NULL) {
                     // Add an edge to the edge table.
-                    ret = tsk_node_table_add_row(&self->tables->nodes,
-                        MSP_NODE_IS_CEN_EVENT, event->time, i, TSK_NULL, NULL, 0);
+                    ret = msp_add_node(
+                        self, MSP_NODE_IS_CEN_EVENT, event->time, i, TSK_NULL);
                     if (ret < 0) {
                         goto out;
                     }
@@ -7808,13 +9745,13 @@ msp_std_common_ancestor_event(
     ancestors = &self->populations[population_id].ancestors[label];
     /* Choose x and y */
     n = avl_count(ancestors);
-    j = (uint32_t) gsl_rng_uniform_int(self->rng, n);
+    j = (uint32_t) msp_ran_uniform_int(self, n);
     x_node = avl_at(ancestors, j);
     tsk_bug_assert(x_node != NULL);
     x_lin = (lineage_t *) x_node->item;
     x = x_lin->head;
     avl_unlink_node(ancestors, x_node);
-    j = (uint32_t) gsl_rng_uniform_int(self->rng, n - 1);
+    j = (uint32_t) msp_ran_uniform_int(self, n - 1);
     y_node = avl_at(ancestors, j);
     tsk_bug_assert(y_node != NULL);
     y_lin = (lineage_t *) y_node->item;
@@ -7950,15 +9887,19 @@ msp_dirac_get_common_ancestor_waiting_time_from_rate(
     double alpha = 2.0 * pop->growth_rate;
     double t = self->time;
     double u, dt, z;
-    double pop_size = pop->initial_size;
+    merger_rate_cache_t *cache = &pop->merger_rates;
 
+    if (!cache->timescale_valid) {
+        cache->timescale = pop->initial_size * pop->initial_size;
+        cache->timescale_valid = true;
+    }
     if (lambda > 0.0) {
         u = gsl_ran_exponential(self->rng, 1.0 / lambda);
         if (alpha == 0.0) {
-            ret = pop_size * pop_size * u;
+            ret = cache->timescale * u;
         } else {
             dt = t - pop->start_time;
-            z = 1 + alpha * pop_size * pop_size * exp(-alpha * dt) * u;
+            z = 1 + alpha * cache->timescale * exp(-alpha * dt) * u;
             /* if z is <= 0 no coancestry can occur */
             if (z > 0) {
                 ret = log(z) / alpha;
@@ -7977,9 +9918,14 @@ msp_dirac_get_common_ancestor_waiting_time(
 {
     population_t *pop = &self->populations[pop_id];
     unsigned int n = (unsigned int) avl_count(&pop->ancestors[label]);
-    double lambda = gsl_sf_choose(n, 2) + self->model.params.dirac_coalescent.c;
+    merger_rate_cache_t *cache = &pop->merger_rates;
 
-    return msp_dirac_get_common_ancestor_waiting_time_from_rate(self, pop, lambda);
+    if (!cache->rate_valid || cache->num_lineages != n) {
+        cache->rate = gsl_sf_choose(n, 2) + self->model.params.dirac_coalescent.c;
+        cache->num_lineages = n;
+        cache->rate_valid = true;
+    }
+    return msp_dirac_get_common_ancestor_waiting_time_from_rate(self, pop, cache->rate);
 }
 
 static int MSP_WARN_UNUSED
@@ -8091,11 +10037,26 @@ beta_compute_truncation(msp_t *self)
     return truncation_point;
 }
 
+/* Returns the truncation point of the current Beta model, which is
+ * computed once per model. */
+static double
+msp_beta_get_truncation(msp_t *self)
+{
+    beta_merger_cache_t *cache = &self->beta_merger_cache;
+
+    if (!cache->valid) {
+        cache->alpha = self->model.params.beta_coalescent.alpha;
+        cache->truncation_point = beta_compute_truncation(self);
+        cache->valid = true;
+    }
+    return cache->truncation_point;
+}
+
 static double
 beta_compute_timescale(msp_t *self, population_t *pop)
 {
     double alpha = self->model.params.beta_coalescent.alpha;
-    double truncation_point = beta_compute_truncation(self);
+    double truncation_point = msp_beta_get_truncation(self);
     double m = beta_compute_juvenile_mean(self);
     double pop_size = pop->initial_size;
     double timescale;
@@ -8111,6 +10072,112 @@ beta_compute_timescale(msp_t *self, population_t *pop)
     return timescale;
 }
 
+/* Merger tables are kept for up to this many lineages; with more lineages
+ * we fall back to rejection sampling the merger size. */
+#define MSP_BETA_MERGER_TABLE_MAX_LINEAGES 1024
+
+/* Fills in the rates of k-mergers among n lineages for the Beta(2 - alpha,
+ * alpha) measure truncated at x. A given set of k lineages merges at rate
+ *     int_0^x y^(k - 2) (1 - y)^(n - k) f(y) dy
+ *         = B(k - alpha, n - k + alpha) I_x(k - alpha, n - k + alpha)
+ *           / (B(2 - alpha, alpha) I_x(2 - alpha, alpha)),
+ * where f is the truncated Beta density, in units of the timescale. This
+ * is the rate with which msp_beta_common_ancestor_event's rejection
+ * sampler produces k-mergers, so the total rate over k replaces the
+ * proposal rate of n choose 2. */
+static int MSP_WARN_UNUSED
+beta_merger_table_init(beta_merger_table_t *self, uint32_t n, double alpha, double x)
+{
+    int ret = 0;
+    uint32_t k;
+    double rate;
+    double total = 0;
+    const double ln_norm = gsl_sf_lnbeta(2 - alpha, alpha);
+    const double inc_norm = x < 1 ? gsl_sf_beta_inc(2 - alpha, alpha, x) : 1;
+
+    self->cumulative_rate = malloc((n - 1) * sizeof(*self->cumulative_rate));
+    if (self->cumulative_rate == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (k = 2; k <= n; k++) {
+        rate = exp(gsl_sf_lnchoose(n, k) + gsl_sf_lnbeta(k - alpha, n - k + alpha)
+                   - ln_norm);
+        if (x < 1) {
+            rate *= gsl_sf_beta_inc(k - alpha, n - k + alpha, x) / inc_norm;
+        }
+        total += rate;
+        self->cumulative_rate[k - 2] = total;
+    }
+    self->total_rate = total;
+out:
+    return ret;
+}
+
+/* Returns the merger table for n lineages under the current Beta model,
+ * computing it if needed, or NULL if n is too large or the table can't
+ * be allocated; callers then fall back to rejection sampling. */
+static beta_merger_table_t *
+msp_get_beta_merger_table(msp_t *self, uint32_t n)
+{
+    beta_merger_cache_t *cache = &self->beta_merger_cache;
+    beta_merger_table_t *table = NULL;
+    const double truncation_point = msp_beta_get_truncation(self);
+
+    if (n < 2 || n > MSP_BETA_MERGER_TABLE_MAX_LINEAGES) {
+        goto out;
+    }
+    if (cache->tables == NULL) {
+        cache->max_lineages = MSP_BETA_MERGER_TABLE_MAX_LINEAGES;
+        cache->tables = calloc(cache->max_lineages + 1, sizeof(*cache->tables));
+        if (cache->tables == NULL) {
+            goto out;
+        }
+    }
+    table = &cache->tables[n];
+    if (table->cumulative_rate == NULL) {
+        if (beta_merger_table_init(table, n, cache->alpha, truncation_point) != 0) {
+            table = NULL;
+        }
+    }
+out:
+    return table;
+}
+
+/* Returns the size of a merger drawn from the specified table */
+static uint32_t
+beta_merger_table_sample(beta_merger_table_t *self, uint32_t n, double u)
+{
+    const double target = u * self->total_rate;
+    uint32_t lo = 0;
+    uint32_t hi = n - 2;
+    uint32_t mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (self->cumulative_rate[mid] <= target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo + 2;
+}
+
+/* Draws the size of a merger among n lineages from the merger table, or
+ * returns 0 if there is no table for n lineages. */
+uint32_t
+msp_beta_sample_table_merger_size(msp_t *self, uint32_t n)
+{
+    beta_merger_table_t *table = msp_get_beta_merger_table(self, n);
+    uint32_t ret = 0;
+
+    if (table != NULL) {
+        ret = beta_merger_table_sample(table, n, gsl_rng_uniform(self->rng));
+    }
+    return ret;
+}
+
 /* Given the specified rate, return the waiting time until the next common ancestor
  * event for the specified population */
 static double
@@ -8122,77 +10189,207 @@ msp_beta_get_common_ancestor_waiting_time_from_rate(
     double gamma = pop->growth_rate * (alpha - 1);
     double t = self->time;
     double u, dt, z;
+    merger_rate_cache_t *cache = &pop->merger_rates;
 
+    if (!cache->timescale_valid) {
+        cache->timescale = beta_compute_timescale(self, pop);
+        cache->timescale_valid = true;
+    }
     if (lambda > 0.0) {
         u = gsl_ran_exponential(self->rng, 1.0 / lambda);
         if (gamma == 0.0) {
-            ret = beta_compute_timescale(self, pop) * u;
+            ret = cache->timescale * u;
         } else {
             dt = t - pop->start_time;
-            z = 1 + gamma * beta_compute_timescale(self, pop) * exp(-gamma * dt) * u;
+            z = 1 + gamma * cache->timescale * exp(-gamma * dt) * u;
             /* if z is <= 0 no coancestry can occur */
             if (z > 0) {
                 ret = log(z) / gamma;
             }
         }
-        if (u == 0) {
-            ret = handle_zero_waiting_time(t);
+        if (u == 0) {
+            ret = handle_zero_waiting_time(t);
+        }
+    }
+    return ret;
+}
+
+static double
+msp_beta_get_common_ancestor_waiting_time(
+    msp_t *self, population_id_t pop_id, label_id_t label)
+{
+    population_t *pop = &self->populations[pop_id];
+    unsigned int n = (unsigned int) avl_count(&pop->ancestors[label]);
+    merger_rate_cache_t *cache = &pop->merger_rates;
+    beta_merger_table_t *table;
+
+    if (!cache->rate_valid || cache->num_lineages != n) {
+        table = msp_get_beta_merger_table(self, n);
+        cache->rate = table != NULL ? table->total_rate : n * (n - 1.0) / 2.0;
+        cache->num_lineages = n;
+        cache->rate_valid = true;
+    }
+    return msp_beta_get_common_ancestor_waiting_time_from_rate(self, pop, cache->rate);
+}
+
+typedef struct {
+    uint32_t index;
+    uint32_t pot;
+} merger_participant_t;
+
+static int
+cmp_merger_participant(const void *a, const void *b)
+{
+    const merger_participant_t *ia = (const merger_participant_t *) a;
+    const merger_participant_t *ib = (const merger_participant_t *) b;
+    return (ia->index > ib->index) - (ia->index < ib->index);
+}
+
+static int MSP_WARN_UNUSED
+msp_move_ancestor_to_pot(
+    msp_t *self, avl_tree_t *ancestors, avl_node_t *node, avl_tree_t *pot)
+{
+    int ret = 0;
+    lineage_t *lin = (lineage_t *) node->item;
+    segment_t *u = lin->head;
+    avl_node_t *q_node;
+
+    avl_unlink_node(ancestors, node);
+    msp_free_avl_node(self, node);
+    msp_free_lineage(self, lin);
+
+    q_node = msp_alloc_avl_node(self);
+    if (q_node == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    avl_init_node(q_node, u);
+    q_node = avl_insert_node(pot, q_node);
+    tsk_bug_assert(q_node != NULL);
+out:
+    return ret;
+}
+
+/* Chooses the lineages for large mergers with a partial Fisher-Yates
+ * shuffle of the ancestor indexes, and then moves them into their pots in a
+ * single pass along the ancestors, rather than finding each one with
+ * avl_at. */
+static int MSP_WARN_UNUSED
+msp_multi_merger_assign_dense(msp_t *self, avl_tree_t *ancestors, avl_tree_t *Q,
+    uint32_t *pot_size, uint32_t num_pots, uint32_t num_chosen)
+{
+    int ret = 0;
+    uint32_t n = avl_count(ancestors);
+    uint32_t i, j, l, tmp, index;
+    uint32_t *indexes;
+    merger_participant_t *chosen = malloc(num_chosen * sizeof(*chosen));
+    avl_node_t *node, *next;
+
+    if (chosen == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    if (self->max_merger_indexes < n) {
+        msp_safe_free(self->merger_indexes);
+        self->max_merger_indexes = n;
+        self->merger_indexes = malloc(n * sizeof(*self->merger_indexes));
+        if (self->merger_indexes == NULL) {
+            self->max_merger_indexes = 0;
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+    indexes = self->merger_indexes;
+    for (j = 0; j < n; j++) {
+        indexes[j] = j;
+    }
+    j = 0;
+    for (i = 0; i < num_pots; i++) {
+        if (pot_size[i] > 1) {
+            for (l = 0; l < pot_size[i]; l++) {
+                index = j + (uint32_t) gsl_rng_uniform_int(self->rng, n - j);
+                tmp = indexes[j];
+                indexes[j] = indexes[index];
+                indexes[index] = tmp;
+                chosen[j].index = indexes[j];
+                chosen[j].pot = i;
+                j++;
+            }
+        }
+    }
+    qsort(chosen, num_chosen, sizeof(*chosen), cmp_merger_participant);
+    index = 0;
+    j = 0;
+    for (node = ancestors->head; node != NULL && j < num_chosen; node = next) {
+        next = node->next;
+        if (index == chosen[j].index) {
+            ret = msp_move_ancestor_to_pot(self, ancestors, node, &Q[chosen[j].pot]);
+            if (ret != 0) {
+                goto out;
+            }
+            j++;
         }
+        index++;
     }
+    tsk_bug_assert(j == num_chosen);
+out:
+    msp_safe_free(chosen);
     return ret;
 }
 
-static double
-msp_beta_get_common_ancestor_waiting_time(
-    msp_t *self, population_id_t pop_id, label_id_t label)
-{
-    population_t *pop = &self->populations[pop_id];
-    unsigned int n = (unsigned int) avl_count(&pop->ancestors[label]);
-    double lambda = n * (n - 1.0) / 2.0;
-    double result
-        = msp_beta_get_common_ancestor_waiting_time_from_rate(self, pop, lambda);
-    return result;
-}
-
 int MSP_WARN_UNUSED
 msp_multi_merger_common_ancestor_event(
     msp_t *self, avl_tree_t *ancestors, avl_tree_t *Q, uint32_t k, uint32_t num_pots)
 {
     int ret = 0;
     uint32_t j, i, l;
-    avl_node_t *node, *q_node;
-    segment_t *u;
-    lineage_t *lin;
-    uint32_t pot_size;
+    avl_node_t *node;
+    uint32_t *pot_size;
     uint32_t cumul_pot_size = 0;
+    uint32_t num_chosen = 0;
+    const uint32_t n = avl_count(ancestors);
 
     /* In the multiple merger regime we have four different 'pots' that
      * lineages get assigned to, where all lineages in a given pot are merged into
      * a common ancestor.
      */
+    if (self->max_merger_pots < num_pots) {
+        msp_safe_free(self->merger_pot_size);
+        self->max_merger_pots = num_pots;
+        self->merger_pot_size = malloc(num_pots * sizeof(*self->merger_pot_size));
+        if (self->merger_pot_size == NULL) {
+            self->max_merger_pots = 0;
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+    pot_size = self->merger_pot_size;
+    for (i = 0; i < num_pots; i++) {
+        pot_size[i]
+            = gsl_ran_binomial(self->rng, 1.0 / (num_pots - i), k - cumul_pot_size);
+        cumul_pot_size += pot_size[i];
+        if (pot_size[i] > 1) {
+            num_chosen += pot_size[i];
+        }
+    }
+
+    /* Picking each lineage with avl_at costs O(log n), so when a large
+     * fraction of the lineages take part a pass along the list is cheaper. */
+    if ((double) num_chosen * log2((double) n) > n) {
+        ret = msp_multi_merger_assign_dense(
+            self, ancestors, Q, pot_size, num_pots, num_chosen);
+        goto out;
+    }
     for (i = 0; i < num_pots; i++) {
-        pot_size = gsl_ran_binomial(self->rng, 1.0 / (num_pots - i), k - cumul_pot_size);
-        cumul_pot_size += pot_size;
-        if (pot_size > 1) {
-            for (l = 0; l < pot_size; l++) {
+        if (pot_size[i] > 1) {
+            for (l = 0; l < pot_size[i]; l++) {
                 j = (uint32_t) gsl_rng_uniform_int(self->rng, avl_count(ancestors));
                 node = avl_at(ancestors, j);
                 tsk_bug_assert(node != NULL);
-
-                lin = (lineage_t *) node->item;
-                u = lin->head;
-                avl_unlink_node(ancestors, node);
-                msp_free_avl_node(self, node);
-                msp_free_lineage(self, lin);
-
-                q_node = msp_alloc_avl_node(self);
-                if (q_node == NULL) {
-                    ret = MSP_ERR_NO_MEMORY;
+                ret = msp_move_ancestor_to_pot(self, ancestors, node, &Q[i]);
+                if (ret != 0) {
                     goto out;
                 }
-                avl_init_node(q_node, u);
-                q_node = avl_insert_node(&Q[i], q_node);
-                tsk_bug_assert(q_node != NULL);
             }
         }
     }
@@ -8201,19 +10398,15 @@ out:
     return ret;
 }
 
-static int MSP_WARN_UNUSED
-msp_beta_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t label)
+/* Draws the size of a merger among n lineages by proposing mergers at rate
+ * n choose 2 and rejecting them. Returns 0 if the proposal is rejected. */
+uint32_t
+msp_beta_sample_merger_size(
+    msp_t *self, uint32_t n, double alpha, double truncation_point)
 {
-    int ret = 0;
-    uint32_t j, n, num_participants, num_parental_copies;
-    avl_tree_t *ancestors;
-    avl_tree_t *Q = NULL;
-    double alpha = self->model.params.beta_coalescent.alpha;
-    double truncation_point = beta_compute_truncation(self);
+    uint32_t j, num_participants;
     double beta_x, u, increment;
 
-    ancestors = &self->populations[pop_id].ancestors[label];
-    n = avl_count(ancestors);
     beta_x = ran_inc_beta(self->rng, 2.0 - alpha, alpha, truncation_point);
 
     /* We calculate the probability of accepting the event */
@@ -8243,12 +10436,36 @@ msp_beta_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t l
         u /= gsl_sf_choose(n, 2);
     }
 
+    num_participants = 0;
     if (gsl_rng_uniform(self->rng) < u) {
         do {
             /* Rejection sampling for the number of participants */
             num_participants = 2 + gsl_ran_binomial(self->rng, beta_x, n - 2);
         } while (gsl_rng_uniform(self->rng) > 1 / gsl_sf_choose(num_participants, 2));
+    }
+    return num_participants;
+}
+
+static int MSP_WARN_UNUSED
+msp_beta_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t label)
+{
+    int ret = 0;
+    uint32_t j, n, num_participants, num_parental_copies;
+    avl_tree_t *ancestors;
+    avl_tree_t *Q = NULL;
+    double alpha = self->model.params.beta_coalescent.alpha;
+    double truncation_point = msp_beta_get_truncation(self);
+
+    ancestors = &self->populations[pop_id].ancestors[label];
+    n = avl_count(ancestors);
+    /* When there is a table the waiting time was drawn with the total rate
+     * of mergers, so every event is a merger */
+    num_participants = msp_beta_sample_table_merger_size(self, n);
+    if (num_participants == 0) {
+        num_participants = msp_beta_sample_merger_size(self, n, alpha, truncation_point);
+    }
 
+    if (num_participants > 0) {
         /* We assume haploid reproduction is single-parent, while all other ploidies
          * are two-parent */
         if (self->ploidy == 1) {
@@ -8392,6 +10609,283 @@ genic_selection_print_state(sweep_t *self, FILE *out)
     fprintf(out, "\t\tdt = %f\n", trajectory->dt);
 }
 
+/**************************************************************
+ * Sweep trajectory store
+ **************************************************************/
+
+/* The number of trajectories that are stepped together */
+#define MSP_SWEEP_TRAJECTORY_BATCH_SIZE 64
+/* The number of steps between removing finished trajectories from a batch */
+#define MSP_SWEEP_TRAJECTORY_COMPACT_STEPS 16
+
+int
+sweep_trajectory_store_alloc(sweep_trajectory_store_t *self, double start_frequency,
+    double end_frequency, double s, double dt, double population_size)
+{
+    int ret = 0;
+
+    memset(self, 0, sizeof(*self));
+    if (start_frequency <= 0.0 || start_frequency >= 1.0 || end_frequency <= 0.0
+        || end_frequency >= 1.0) {
+        ret = MSP_ERR_BAD_ALLELE_FREQUENCY;
+        goto out;
+    }
+    if (start_frequency >= end_frequency) {
+        ret = MSP_ERR_BAD_TRAJECTORY_START_END;
+        goto out;
+    }
+    if (dt <= 0) {
+        ret = MSP_ERR_BAD_TIME_DELTA;
+        goto out;
+    }
+    if (s <= 0) {
+        ret = MSP_ERR_BAD_SWEEP_GENIC_SELECTION_S;
+        goto out;
+    }
+    if (!isfinite(population_size) || population_size <= 0) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->params.start_frequency = start_frequency;
+    self->params.end_frequency = end_frequency;
+    self->params.s = s;
+    self->params.dt = dt;
+    self->population_size = population_size;
+    self->offset = malloc(sizeof(*self->offset));
+    if (self->offset == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    self->offset[0] = 0;
+out:
+    return ret;
+}
+
+int
+sweep_trajectory_store_free(sweep_trajectory_store_t *self)
+{
+    msp_safe_free(self->offset);
+    msp_safe_free(self->time);
+    msp_safe_free(self->allele_frequency);
+    return 0;
+}
+
+void
+sweep_trajectory_store_print_state(sweep_trajectory_store_t *self, FILE *out)
+{
+    size_t j;
+
+    fprintf(out, "Sweep trajectory store:\n");
+    fprintf(out, "\tstart_frequency = %f\n", self->params.start_frequency);
+    fprintf(out, "\tend_frequency = %f\n", self->params.end_frequency);
+    fprintf(out, "\ts = %f\n", self->params.s);
+    fprintf(out, "\tdt = %f\n", self->params.dt);
+    fprintf(out, "\tpopulation_size = %f\n", self->population_size);
+    fprintf(out, "\tnum_trajectories = %d\n", (int) self->num_trajectories);
+    fprintf(out, "\tnum_steps = %d\n", (int) self->num_steps);
+    for (j = 0; j < self->num_trajectories; j++) {
+        fprintf(out, "\t\t%d\t%d\n", (int) j,
+            (int) (self->offset[j + 1] - self->offset[j]));
+    }
+}
+
+static int MSP_WARN_UNUSED
+sweep_trajectory_store_expand(
+    sweep_trajectory_store_t *self, size_t num_trajectories, size_t num_steps)
+{
+    int ret = 0;
+    void *tmp;
+
+    if (self->num_trajectories + num_trajectories > self->max_trajectories) {
+        self->max_trajectories = GSL_MAX(
+            2 * self->max_trajectories, self->num_trajectories + num_trajectories);
+        tmp = realloc(
+            self->offset, (self->max_trajectories + 1) * sizeof(*self->offset));
+        if (tmp == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->offset = tmp;
+    }
+    if (self->num_steps + num_steps > self->max_steps) {
+        self->max_steps = GSL_MAX(2 * self->max_steps, self->num_steps + num_steps);
+        tmp = realloc(self->time, self->max_steps * sizeof(*self->time));
+        if (tmp == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->time = tmp;
+        tmp = realloc(
+            self->allele_frequency, self->max_steps * sizeof(*self->allele_frequency));
+        if (tmp == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->allele_frequency = tmp;
+    }
+out:
+    return ret;
+}
+
+/* Generates a batch of trajectories in the same way as
+ * genic_selection_generate_trajectory, but stepping them all together. The
+ * active trajectories are kept in flat arrays and advanced for
+ * MSP_SWEEP_TRAJECTORY_COMPACT_STEPS steps at a time without branching on
+ * whether each one has finished: a finished trajectory keeps its last
+ * frequency, and every step is written to a step-major block. After each
+ * block the steps are copied out to the buffers of their trajectories and
+ * the finished trajectories are removed from the arrays. Finished
+ * trajectories draw uniforms until they are removed, so the trajectories
+ * differ from those generated one at a time. The population size is fixed
+ * for the whole store. */
+static int MSP_WARN_UNUSED
+sweep_trajectory_store_generate_batch(sweep_trajectory_store_t *self,
+    size_t batch_size, gsl_rng *rng, double **buffer, size_t *max_buffer_steps)
+{
+    int ret = 0;
+    const double dt = self->params.dt;
+    const double start_frequency = self->params.start_frequency;
+    const double alpha = 2 * self->population_size * self->params.s;
+    double x[MSP_SWEEP_TRAJECTORY_BATCH_SIZE];
+    double u[MSP_SWEEP_TRAJECTORY_BATCH_SIZE];
+    double block[MSP_SWEEP_TRAJECTORY_COMPACT_STEPS][MSP_SWEEP_TRAJECTORY_BATCH_SIZE];
+    int done[MSP_SWEEP_TRAJECTORY_BATCH_SIZE];
+    size_t id[MSP_SWEEP_TRAJECTORY_BATCH_SIZE];
+    size_t length[MSP_SWEEP_TRAJECTORY_BATCH_SIZE];
+    size_t num_steps[MSP_SWEEP_TRAJECTORY_BATCH_SIZE];
+    size_t j, k, l, step, end, num_active, total_steps;
+    double x_next, t, *tmp;
+
+    tsk_bug_assert(batch_size <= MSP_SWEEP_TRAJECTORY_BATCH_SIZE);
+    for (j = 0; j < batch_size; j++) {
+        x[j] = self->params.end_frequency;
+        id[j] = j;
+        length[j] = 1;
+        done[j] = 0;
+        buffer[j][0] = x[j];
+    }
+    num_active = batch_size;
+    for (step = 1; num_active > 0; step += MSP_SWEEP_TRAJECTORY_COMPACT_STEPS) {
+        if (step + MSP_SWEEP_TRAJECTORY_COMPACT_STEPS > *max_buffer_steps) {
+            *max_buffer_steps *= 2;
+            for (j = 0; j < batch_size; j++) {
+                tmp = realloc(buffer[j], *max_buffer_steps * sizeof(*tmp));
+                if (tmp == NULL) {
+                    ret = MSP_ERR_NO_MEMORY;
+                    goto out;
+                }
+                buffer[j] = tmp;
+            }
+        }
+        for (l = 0; l < MSP_SWEEP_TRAJECTORY_COMPACT_STEPS; l++) {
+            for (j = 0; j < num_active; j++) {
+                u[j] = gsl_rng_uniform(rng);
+            }
+            for (j = 0; j < num_active; j++) {
+                x_next = 1.0
+                         - genic_selection_stochastic_forwards(
+                             dt, 1.0 - x[j], alpha, u[j]);
+                x[j] = done[j] ? x[j] : x_next;
+                length[j] += (size_t) !done[j];
+                done[j] |= x[j] <= start_frequency;
+                block[l][j] = GSL_MAX(x[j], start_frequency);
+            }
+        }
+        /* Copy out the steps up to the end of each trajectory, and keep the
+         * unfinished trajectories in order at the start of the arrays. */
+        k = 0;
+        for (j = 0; j < num_active; j++) {
+            end = GSL_MIN(length[j], step + MSP_SWEEP_TRAJECTORY_COMPACT_STEPS);
+            for (l = step; l < end; l++) {
+                buffer[id[j]][l] = block[l - step][j];
+            }
+            if (done[j]) {
+                num_steps[id[j]] = length[j];
+            } else {
+                x[k] = x[j];
+                id[k] = id[j];
+                length[k] = length[j];
+                done[k] = 0;
+                k++;
+            }
+        }
+        num_active = k;
+    }
+
+    total_steps = 0;
+    for (j = 0; j < batch_size; j++) {
+        total_steps += num_steps[j];
+    }
+    ret = sweep_trajectory_store_expand(self, batch_size, total_steps);
+    if (ret != 0) {
+        goto out;
+    }
+    for (j = 0; j < batch_size; j++) {
+        memcpy(self->allele_frequency + self->num_steps, buffer[j],
+            num_steps[j] * sizeof(*self->allele_frequency));
+        t = 0;
+        for (k = 0; k < num_steps[j]; k++) {
+            self->time[self->num_steps + k] = t;
+            t += dt;
+        }
+        self->num_steps += num_steps[j];
+        self->num_trajectories++;
+        self->offset[self->num_trajectories] = self->num_steps;
+    }
+out:
+    return ret;
+}
+
+/* Appends the specified number of independent trajectories to the store */
+int
+sweep_trajectory_store_generate(
+    sweep_trajectory_store_t *self, size_t num_trajectories, gsl_rng *rng)
+{
+    int ret = 0;
+    size_t j, batch_size;
+    size_t max_buffer_steps = 1024;
+    double *buffer[MSP_SWEEP_TRAJECTORY_BATCH_SIZE];
+
+    memset(buffer, 0, sizeof(buffer));
+    for (j = 0; j < MSP_SWEEP_TRAJECTORY_BATCH_SIZE; j++) {
+        buffer[j] = malloc(max_buffer_steps * sizeof(*buffer[j]));
+        if (buffer[j] == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+    for (j = 0; j < num_trajectories; j += batch_size) {
+        batch_size = GSL_MIN(num_trajectories - j, MSP_SWEEP_TRAJECTORY_BATCH_SIZE);
+        ret = sweep_trajectory_store_generate_batch(
+            self, batch_size, rng, buffer, &max_buffer_steps);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    for (j = 0; j < MSP_SWEEP_TRAJECTORY_BATCH_SIZE; j++) {
+        msp_safe_free(buffer[j]);
+    }
+    return ret;
+}
+
+int
+sweep_trajectory_store_get(sweep_trajectory_store_t *self, size_t index,
+    size_t *num_steps, const double **time, const double **allele_frequency)
+{
+    int ret = 0;
+
+    if (index >= self->num_trajectories) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    *num_steps = self->offset[index + 1] - self->offset[index];
+    *time = self->time + self->offset[index];
+    *allele_frequency = self->allele_frequency + self->offset[index];
+out:
+    return ret;
+}
+
 /**************************************************************
  * Public API for setting simulation models.
  **************************************************************/
@@ -8412,6 +10906,14 @@ msp_set_simulation_model(msp_t *self, int model)
         ret = MSP_ERR_OTHER_MODELS_WITH_PED;
         goto out;
     }
+    if (self->sweep_state.active) {
+        /* A sweep was interrupted, so put all lineages back in label 0 */
+        ret = msp_sweep_finalise(self);
+        if (ret != 0) {
+            goto out;
+        }
+        self->sweep_state.active = false;
+    }
     if (self->model.free != NULL) {
         self->model.free(&self->model);
     }
@@ -8485,7 +10987,31 @@ out:
 int
 msp_set_simulation_model_dtwf(msp_t *self)
 {
-    return msp_set_simulation_model(self, MSP_MODEL_DTWF);
+    return msp_set_simulation_model_dtwf_hybrid(self, 0);
+}
+
+/* The DTWF is accurate when lineages are dense relative to the population
+ * size, but the coalescent is much faster once they are sparse. This model
+ * runs the DTWF until there are fewer than switch_threshold lineages per
+ * individual in all populations, and then changes to the Hudson model
+ * within msp_run. */
+int
+msp_set_simulation_model_dtwf_hybrid(msp_t *self, double switch_threshold)
+{
+    int ret = 0;
+
+    if (switch_threshold < 0 || !isfinite(switch_threshold)) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    ret = msp_set_simulation_model(self, MSP_MODEL_DTWF);
+    if (ret != 0) {
+        goto out;
+    }
+    self->model.params.dtwf.switch_threshold = switch_threshold;
+    self->dtwf_switch_time = -DBL_MAX;
+out:
+    return ret;
 }
 
 int
@@ -8617,6 +11143,7 @@ msp_set_simulation_model_dirac(msp_t *self, double psi, double c)
     }
     self->model.params.dirac_coalescent.psi = psi;
     self->model.params.dirac_coalescent.c = c;
+    msp_invalidate_merger_rates(self);
     self->get_common_ancestor_waiting_time = msp_dirac_get_common_ancestor_waiting_time;
     self->common_ancestor_event = msp_dirac_common_ancestor_event;
 out:
@@ -8645,6 +11172,7 @@ msp_set_simulation_model_beta(msp_t *self, double alpha, double truncation_point
 
     self->model.params.beta_coalescent.alpha = alpha;
     self->model.params.beta_coalescent.truncation_point = truncation_point;
+    msp_invalidate_merger_rates(self);
     self->get_common_ancestor_waiting_time = msp_beta_get_common_ancestor_waiting_time;
     self->common_ancestor_event = msp_beta_common_ancestor_event;
 out:
@@ -8698,3 +11226,121 @@ msp_set_simulation_model_sweep_genic_selection(msp_t *self, double position,
 out:
     return ret;
 }
+
+/* Sets the trajectory used by all subsequent sweeps, so that it doesn't need
+ * to be regenerated for replicates that share the sweep parameters. Times are
+ * in coalescent units going backwards from the end of the sweep. If num_steps
+ * is zero, sweeps go back to generating their own trajectories. */
+int
+msp_set_sweep_trajectory(msp_t *self, size_t num_steps, const double *time,
+    const double *allele_frequency)
+{
+    int ret = 0;
+    sweep_trajectory_t *trajectory = &self->sweep_trajectory;
+    double *new_time = NULL;
+    double *new_allele_frequency = NULL;
+    size_t j;
+
+    if (self->sweep_state.active) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    for (j = 0; j < num_steps; j++) {
+        if (!isfinite(time[j]) || time[j] < 0 || (j > 0 && time[j] < time[j - 1])) {
+            ret = MSP_ERR_BAD_TIME_DELTA;
+            goto out;
+        }
+        if (!(allele_frequency[j] > 0.0 && allele_frequency[j] < 1.0)) {
+            ret = MSP_ERR_BAD_ALLELE_FREQUENCY;
+            goto out;
+        }
+    }
+    if (num_steps > 0) {
+        new_time = malloc(num_steps * sizeof(*new_time));
+        new_allele_frequency = malloc(num_steps * sizeof(*new_allele_frequency));
+        if (new_time == NULL || new_allele_frequency == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        memcpy(new_time, time, num_steps * sizeof(*new_time));
+        memcpy(new_allele_frequency, allele_frequency,
+            num_steps * sizeof(*new_allele_frequency));
+    }
+    msp_safe_free(trajectory->time);
+    msp_safe_free(trajectory->allele_frequency);
+    trajectory->num_steps = num_steps;
+    trajectory->time = new_time;
+    trajectory->allele_frequency = new_allele_frequency;
+    self->sweep_trajectory_fixed = num_steps > 0;
+    self->sweep_state.num_steps = 0;
+    self->sweep_state.trajectory_time = NULL;
+    self->sweep_state.allele_frequency = NULL;
+    new_time = NULL;
+    new_allele_frequency = NULL;
+out:
+    msp_safe_free(new_time);
+    msp_safe_free(new_allele_frequency);
+    return ret;
+}
+
+/* Returns the trajectory set by msp_set_sweep_trajectory, or the one used by
+ * the current or most recent sweep. A trajectory from a store is only valid
+ * while the store is. */
+void
+msp_get_sweep_trajectory(msp_t *self, size_t *num_steps, const double **time,
+    const double **allele_frequency)
+{
+    if (self->sweep_trajectory_fixed || self->sweep_state.trajectory_time == NULL) {
+        *num_steps = self->sweep_trajectory.num_steps;
+        *time = self->sweep_trajectory.time;
+        *allele_frequency = self->sweep_trajectory.allele_frequency;
+    } else {
+        *num_steps = self->sweep_state.num_steps;
+        *time = self->sweep_state.trajectory_time;
+        *allele_frequency = self->sweep_state.allele_frequency;
+    }
+}
+
+/* Sets a store of trajectories for subsequent sweeps to use in turn, rather
+ * than generating their own. The store must have been generated for the sweep
+ * parameters and population size, and must outlive its use here. Replicates
+ * take successive trajectories, so the store should hold one per replicate.
+ * If store is NULL, sweeps go back to generating their own trajectories. */
+int
+msp_set_sweep_trajectory_store(msp_t *self, sweep_trajectory_store_t *store)
+{
+    int ret = 0;
+
+    if (self->sweep_state.active) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    self->sweep_trajectory_store = store;
+    self->next_sweep_trajectory = 0;
+    self->sweep_state.num_steps = 0;
+    self->sweep_state.trajectory_time = NULL;
+    self->sweep_state.allele_frequency = NULL;
+out:
+    return ret;
+}
+
+/* Sets the index of the trajectory in the store that the next sweep uses.
+ * This lets replicates run on different simulators take the trajectory for
+ * their own index. */
+int
+msp_set_next_sweep_trajectory(msp_t *self, size_t index)
+{
+    int ret = 0;
+
+    if (self->sweep_trajectory_store == NULL) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    if (self->sweep_state.active) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    self->next_sweep_trajectory = index;
+out:
+    return ret;
+}
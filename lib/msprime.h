@@ -63,9 +63,18 @@
 /* Flags for verify */
 #define MSP_VERIFY_BREAKPOINTS (1 << 1)
 
+/* Ways of restoring the edge order in msp_finalise_tables */
+#define MSP_FINALISE_SORT 0
+#define MSP_FINALISE_MERGE 1
+
 /* Flags for mutgen */
 #define MSP_KEEP_SITES (1 << 0)
 #define MSP_DISCRETE_SITES (1 << 1)
+#define MSP_SORT_SITES (1 << 2)
+
+/* Formats for streaming genotypes from mutgen */
+#define MSP_GENOTYPES_VCF 1
+#define MSP_GENOTYPES_PACKED 2
 
 /* Pedigree states */
 #define MSP_PED_STATE_UNCLIMBED 0
@@ -117,6 +126,17 @@ typedef struct {
 #define MSP_POP_STATE_ACTIVE 1
 #define MSP_POP_STATE_PREVIOUSLY_ACTIVE 2
 
+/* The parts of the multiple-merger waiting times that depend only on the
+ * population parameters and the number of lineages, memoised for the
+ * current epoch. */
+typedef struct {
+    bool timescale_valid;
+    double timescale;
+    bool rate_valid;
+    uint32_t num_lineages;
+    double rate;
+} merger_rate_cache_t;
+
 typedef struct {
     /* The starting size and time for the current epoch for this population. */
     double initial_size;
@@ -131,6 +151,8 @@ typedef struct {
     avl_tree_t *hulls_left;
     avl_tree_t *hulls_right;
     fenwick_t *coal_mass_index;
+    /* Cleared whenever the population or model parameters change */
+    merger_rate_cache_t merger_rates;
 } population_t;
 
 #define MSP_MAX_PED_PLOIDY 2
@@ -172,6 +194,12 @@ typedef struct {
     double hull_offset;
 } smc_k_coalescent_t;
 
+typedef struct {
+    /* Switch to the coalescent once there are fewer than this many lineages
+     * per individual in every population; 0 never switches. */
+    double switch_threshold;
+} dtwf_t;
+
 typedef struct {
     double alpha;
     double truncation_point;
@@ -182,8 +210,63 @@ typedef struct {
     double c;
 } dirac_coalescent_t;
 
+/* The rates of mergers of each size among n lineages in the Beta coalescent */
+typedef struct {
+    double total_rate;
+    /* Cumulative rates of mergers of 2, ..., n lineages */
+    double *cumulative_rate;
+} beta_merger_table_t;
+
+/* Merger tables computed as they are needed, indexed by the number of
+ * lineages, for the alpha and truncation point they were computed with */
+typedef struct {
+    bool valid;
+    double alpha;
+    double truncation_point;
+    size_t max_lineages;
+    beta_merger_table_t *tables;
+} beta_merger_cache_t;
+
 /* Forward declaration */
 struct _msp_t;
+struct _mutgen_t;
+
+/* An ancestor together with the parent it has drawn in a DTWF generation.
+ * When the draws are made in advance, draws is the offset of its parental
+ * copy and recombination breakpoints in its population's draws, and heads
+ * are the parental copies of its segments once they have been split. */
+typedef struct {
+    uint32_t parent;
+    uint32_t order;
+    avl_node_t *node;
+    size_t draws;
+    segment_t *heads[2];
+} dtwf_offspring_t;
+
+/* The random choices for one population in a DTWF generation, made in
+ * advance from the population's own stream by msp_dtwf_draw_population,
+ * which also splits the segments of the first num_recombined offspring
+ * using segments reserved from the heap beforehand. */
+typedef struct {
+    gsl_rng *rng;
+    size_t num_offspring;
+    size_t max_offspring;
+    dtwf_offspring_t *offspring;
+    size_t num_draws;
+    size_t max_draws;
+    double *draws;
+    size_t num_recombined;
+    size_t num_re_events;
+    size_t num_reserved;
+    size_t max_reserved;
+    size_t reserve_size;
+    segment_t **reserved;
+} dtwf_population_draws_t;
+
+/* Makes the draws for each population by calling msp_dtwf_draw_population,
+ * possibly concurrently, and returns the first error encountered. */
+typedef int (*dtwf_population_runner_t)(
+    struct _msp_t *msp, size_t num_populations, void *arg);
 
 typedef struct {
     /* TODO document these parameters.*/
@@ -204,10 +287,53 @@ typedef struct _sweep_t {
     void (*print_state)(struct _sweep_t *self, FILE *out);
 } sweep_t;
 
+/* The allele frequency trajectory of a sweep going backwards from the
+ * end of the sweep, with times in coalescent units. */
+typedef struct {
+    size_t num_steps;
+    double *time;
+    double *allele_frequency;
+} sweep_trajectory_t;
+
+/* Many genic selection trajectories for the same parameters and population
+ * size, stored one after another. Trajectory j occupies the steps from
+ * offset[j] to offset[j + 1] in time and allele_frequency. The store isn't
+ * changed by the simulations using it, so it can be shared between them. */
+typedef struct {
+    genic_selection_trajectory_t params;
+    double population_size;
+    size_t num_trajectories;
+    size_t max_trajectories;
+    size_t *offset;
+    size_t num_steps;
+    size_t max_steps;
+    double *time;
+    double *allele_frequency;
+} sweep_trajectory_store_t;
+
+/* The progress through a sweep, so that it can be interrupted by the
+ * time and event limits and resumed where it left off. */
+typedef struct {
+    bool active;
+    size_t curr_step;
+    size_t max_steps;
+    /* The absolute simulation time of each step in the trajectory */
+    double *time;
+    /* The state of the event we are waiting for, if we stopped before it */
+    bool event_pending;
+    double event_prob;
+    double event_rand;
+    /* The trajectory in use, which may be owned by a trajectory store */
+    size_t num_steps;
+    const double *trajectory_time;
+    const double *allele_frequency;
+} sweep_state_t;
+
 typedef struct _simulation_model_t {
     int type;
     union {
         smc_k_coalescent_t smc_k_coalescent;
+        dtwf_t dtwf;
         beta_coalescent_t beta_coalescent;
         dirac_coalescent_t dirac_coalescent;
         sweep_t sweep;
@@ -221,6 +347,39 @@ typedef struct {
     uint32_t count;
 } overlap_count_t;
 
+/* Numbers of rows reserved in the output tables */
+typedef struct {
+    tsk_size_t num_nodes;
+    tsk_size_t num_edges;
+    tsk_size_t num_migrations;
+} table_capacity_t;
+
+/* The columns of the output tables that can be spilled to disk */
+#define MSP_SPILL_NODES_FLAGS 0
+#define MSP_SPILL_NODES_TIME 1
+#define MSP_SPILL_NODES_POPULATION 2
+#define MSP_SPILL_NODES_INDIVIDUAL 3
+#define MSP_SPILL_EDGES_LEFT 4
+#define MSP_SPILL_EDGES_RIGHT 5
+#define MSP_SPILL_EDGES_PARENT 6
+#define MSP_SPILL_EDGES_CHILD 7
+#define MSP_SPILL_MIGRATIONS_LEFT 8
+#define MSP_SPILL_MIGRATIONS_RIGHT 9
+#define MSP_SPILL_MIGRATIONS_NODE 10
+#define MSP_SPILL_MIGRATIONS_SOURCE 11
+#define MSP_SPILL_MIGRATIONS_DEST 12
+#define MSP_SPILL_MIGRATIONS_TIME 13
+#define MSP_NUM_SPILL_COLUMNS 14
+
+/* Output rows written to temporary column files during the simulation */
+typedef struct {
+    size_t block_size;
+    tsk_size_t num_nodes;
+    tsk_size_t num_edges;
+    tsk_size_t num_migrations;
+    FILE *files[MSP_NUM_SPILL_COLUMNS];
+} table_spill_t;
+
 typedef struct _msp_t {
     gsl_rng *rng;
     /* input parameters */
@@ -250,6 +409,41 @@ typedef struct _msp_t {
     size_t node_mapping_block_size;
     size_t segment_block_size;
     size_t hull_block_size;
+    /* output table reservations */
+    bool presize_tables;
+    table_capacity_t table_capacity;
+    /* The max_rows of each table once its reservation has been made */
+    table_capacity_t reserved_max_rows;
+    int finalise_mode;
+    table_spill_t spill;
+    /* Pre-generated variates for the event loop; disabled when size is 0 */
+    rng_buffer_t rng_buffer;
+    beta_merger_cache_t beta_merger_cache;
+    /* Scratch space for choosing the lineages in multiple mergers */
+    uint32_t *merger_indexes;
+    size_t max_merger_indexes;
+    uint32_t *merger_pot_size;
+    size_t max_merger_pots;
+    /* Places mutations on edges as they are stored; not used when NULL */
+    struct _mutgen_t *mutgen;
+    int mutgen_flags;
+    /* The time at which the DTWF switched to the coalescent, or -DBL_MAX */
+    double dtwf_switch_time;
+    /* Draws the populations in each DTWF generation from their own streams,
+     * possibly concurrently; not used when NULL */
+    dtwf_population_runner_t dtwf_population_runner;
+    void *dtwf_population_runner_arg;
+    dtwf_population_draws_t *dtwf_draws;
+    /* The population streams are set at the first drawn generation */
+    bool dtwf_streams_set;
+    /* The trajectory used by the current or most recent sweep. If it
+     * was set by the caller it's reused by every sweep. */
+    sweep_trajectory_t sweep_trajectory;
+    bool sweep_trajectory_fixed;
+    sweep_state_t sweep_state;
+    /* Sweeps take successive trajectories from the store if it's set */
+    sweep_trajectory_store_t *sweep_trajectory_store;
+    size_t next_sweep_trajectory;
     /* Counters for statistics */
     size_t num_re_events;
     size_t num_ca_events;
@@ -404,12 +598,28 @@ typedef struct {
     bool new;
 } site_t;
 
+/* Matrix models with at least this many alleles choose alleles with alias
+ * tables and look up the parent allele in a hash table. Below this, a
+ * linear scan is as fast, and keeps the results of earlier versions. */
+#define MSP_MATRIX_ALIAS_MIN_ALLELES 5
+
 typedef struct {
     size_t num_alleles;
     char **alleles;
     tsk_size_t *allele_length;
     double *root_distribution;
     double *transition_matrix;
+    /* Shared storage for the alleles */
+    char *allele_data;
+    /* Open addressing hash table of allele indexes, keyed by the alleles,
+     * or NULL if there are fewer than MSP_MATRIX_ALIAS_MIN_ALLELES */
+    tsk_id_t *allele_hash;
+    size_t allele_hash_size;
+    /* Alias tables for the root distribution and each row of the
+     * transition matrix, or NULL if there are fewer than
+     * MSP_MATRIX_ALIAS_MIN_ALLELES */
+    alias_table_t root_alias;
+    alias_table_t *transition_alias;
 } mutation_matrix_t;
 
 typedef struct {
@@ -442,16 +652,65 @@ typedef struct _mutation_model_t {
         mutation_t *mutation);
 } mutation_model_t;
 
+/* A new mutation, before it is assigned to a site */
+typedef struct {
+    double position;
+    double time;
+    tsk_id_t edge;
+} placed_mutation_t;
+
+/* Mutations placed on a contiguous range of edges, before they are
+ * merged into the sites */
 typedef struct {
+    gsl_rng *rng;
+    size_t edge_start;
+    size_t edge_end;
+    size_t num_mutations;
+    size_t max_mutations;
+    double *position;
+    double *time;
+    double *site_left;
+    double *site_right;
+    tsk_id_t *node;
+} mutgen_chunk_t;
+
+struct _mutgen_t;
+
+/* Places the mutations for each of the chunks by calling mutgen_place_chunk,
+ * possibly concurrently, and returns the first error encountered. */
+typedef int (*mutgen_chunk_runner_t)(
+    struct _mutgen_t *mutgen, size_t num_chunks, void *arg);
+
+typedef struct _mutgen_t {
     gsl_rng *rng;
     tsk_table_collection_t *tables;
     double start_time;
     double end_time;
     size_t block_size;
     rate_map_t rate_map;
+    /* The rate map with each interval rounded to the integers it covers,
+     * used for discrete sites */
+    rate_map_t discrete_rate_map;
     avl_tree_t sites;
     tsk_blkalloc_t allocator;
     mutation_model_t *model;
+    bool discrete_sites;
+    /* All sites in position order, built after placement */
+    site_t **ordered_sites;
+    size_t num_ordered_sites;
+    size_t max_ordered_sites;
+    /* New mutations collected for sorting with MSP_SORT_SITES */
+    placed_mutation_t *placed;
+    size_t num_placed;
+    size_t max_placed;
+    /* Chunked placement; not used when num_chunks is 0 */
+    size_t num_chunks;
+    mutgen_chunk_t *chunks;
+    mutgen_chunk_runner_t chunk_runner;
+    void *chunk_runner_arg;
+    /* The genotypes of each site are written here as it is finished */
+    FILE *genotype_file;
+    int genotype_format;
 } mutgen_t;
 
 int msp_alloc(msp_t *self, tsk_table_collection_t *tables, gsl_rng *rng);
@@ -460,9 +719,19 @@ int msp_set_simulation_model_smc(msp_t *self);
 int msp_set_simulation_model_smc_prime(msp_t *self);
 int msp_set_simulation_model_smc_k(msp_t *self, double hull_offset);
 int msp_set_simulation_model_dtwf(msp_t *self);
+int msp_set_simulation_model_dtwf_hybrid(msp_t *self, double switch_threshold);
+void msp_set_dtwf_population_runner(
+    msp_t *self, dtwf_population_runner_t runner, void *arg);
+int msp_dtwf_draw_population(msp_t *self, size_t population_id);
 int msp_set_simulation_model_fixed_pedigree(msp_t *self);
 int msp_set_simulation_model_dirac(msp_t *self, double psi, double c);
 int msp_set_simulation_model_beta(msp_t *self, double alpha, double truncation_point);
+int msp_set_sweep_trajectory(msp_t *self, size_t num_steps, const double *time,
+    const double *allele_frequency);
+void msp_get_sweep_trajectory(msp_t *self, size_t *num_steps, const double **time,
+    const double **allele_frequency);
+int msp_set_sweep_trajectory_store(msp_t *self, sweep_trajectory_store_t *store);
+int msp_set_next_sweep_trajectory(msp_t *self, size_t index);
 int msp_set_simulation_model_sweep_genic_selection(msp_t *self, double position,
     double start_frequency, double end_frequency, double s, double dt);
 
@@ -487,6 +756,13 @@ int msp_set_hull_block_size(msp_t *self, size_t block_size);
 int msp_set_migration_matrix(msp_t *self, size_t size, double *migration_matrix);
 int msp_set_population_configuration(msp_t *self, int population_id, double initial_size,
     double growth_rate, bool initially_active);
+int msp_set_presize_tables(msp_t *self, bool presize_tables);
+int msp_set_finalise_mode(msp_t *self, int mode);
+int msp_set_spill_block_size(msp_t *self, size_t block_size);
+int msp_set_rng_buffer_size(msp_t *self, size_t size);
+int msp_set_mutation_generator(msp_t *self, mutgen_t *mutgen, int flags);
+int msp_reserve_table_capacity(msp_t *self, tsk_size_t num_nodes, tsk_size_t num_edges,
+    tsk_size_t num_migrations);
 
 int msp_add_population_parameters_change(
     msp_t *self, double time, int population_id, double size, double growth_rate);
@@ -510,6 +786,7 @@ int msp_initialise(msp_t *self);
 int msp_run(msp_t *self, double max_time, unsigned long max_events);
 int msp_debug_demography(msp_t *self, double *end_time);
 int msp_finalise_tables(msp_t *self);
+int msp_finalise_spill(msp_t *self);
 int msp_reset(msp_t *self);
 int msp_print_state(msp_t *self, FILE *out);
 int msp_free(msp_t *self);
@@ -523,6 +800,8 @@ int msp_get_population_configuration(msp_t *self, size_t population_id,
     double *initial_size, double *growth_rate, int *state);
 int msp_compute_population_size(
     msp_t *self, size_t population_id, double time, double *pop_size);
+int msp_estimate_table_capacity(msp_t *self, table_capacity_t *estimate);
+int msp_get_table_capacity(msp_t *self, table_capacity_t *capacity);
 int msp_is_completed(msp_t *self);
 
 simulation_model_t *msp_get_model(msp_t *self);
@@ -549,6 +828,17 @@ size_t msp_get_num_gene_conversion_events(msp_t *self);
 size_t msp_get_num_internal_gene_conversion_events(msp_t *self);
 size_t msp_get_num_noneffective_gene_conversion_events(msp_t *self);
 double msp_get_sum_internal_gc_tract_lengths(msp_t *self);
+double msp_get_dtwf_switch_time(msp_t *self);
+
+int sweep_trajectory_store_alloc(sweep_trajectory_store_t *self,
+    double start_frequency, double end_frequency, double s, double dt,
+    double population_size);
+int sweep_trajectory_store_generate(
+    sweep_trajectory_store_t *self, size_t num_trajectories, gsl_rng *rng);
+int sweep_trajectory_store_get(sweep_trajectory_store_t *self, size_t index,
+    size_t *num_steps, const double **time, const double **allele_frequency);
+int sweep_trajectory_store_free(sweep_trajectory_store_t *self);
+void sweep_trajectory_store_print_state(sweep_trajectory_store_t *self, FILE *out);
 
 int matrix_mutation_model_factory(mutation_model_t *self, int model);
 int matrix_mutation_model_alloc(mutation_model_t *self, size_t num_alleles,
@@ -568,9 +858,19 @@ int mutgen_set_rate(mutgen_t *self, double rate);
 int mutgen_set_rate_map(mutgen_t *self, size_t size, double *position, double *rate);
 int mutgen_free(mutgen_t *self);
 int mutgen_generate(mutgen_t *self, int flags);
+int mutgen_set_num_chunks(mutgen_t *self, size_t num_chunks);
+void mutgen_set_chunk_runner(mutgen_t *self, mutgen_chunk_runner_t runner, void *arg);
+int mutgen_place_chunk(mutgen_t *self, size_t chunk);
+int mutgen_set_genotype_output(mutgen_t *self, FILE *file, int format);
+int mutgen_begin(mutgen_t *self, int flags);
+int mutgen_place_edges(mutgen_t *self, size_t edge_start, size_t edge_end);
+int mutgen_finish(mutgen_t *self);
 void mutgen_print_state(mutgen_t *self, FILE *out);
 
 /* Functions exposed here for unit testing. Not part of public API. */
 int msp_multi_merger_common_ancestor_event(
     msp_t *self, avl_tree_t *ancestors, avl_tree_t *Q, uint32_t k, uint32_t num_pots);
+uint32_t msp_beta_sample_table_merger_size(msp_t *self, uint32_t n);
+uint32_t msp_beta_sample_merger_size(
+    msp_t *self, uint32_t n, double alpha, double truncation_point);
 #endif /*__MSPRIME_H__*/
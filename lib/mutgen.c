@@ -159,23 +159,90 @@ valid_probabilities(size_t num_alleles, double *distribution)
     return doubles_almost_equal(prob, 1.0, 1e-12) && min_prob >= 0.0;
 }
 
+/* FNV-1a hash of the allele's bytes */
+static size_t
+mutation_matrix_hash_allele(const char *allele, size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t j;
+
+    for (j = 0; j < length; j++) {
+        hash ^= (unsigned char) allele[j];
+        hash *= 1099511628211ULL;
+    }
+    return (size_t) hash;
+}
+
+/* Returns the slot in the allele hash table holding this allele, or the
+ * empty slot where it would go. The table is at least twice as large as
+ * the number of alleles, so there is always an empty slot. */
+static size_t
+mutation_matrix_find_allele_slot(
+    const mutation_matrix_t *self, const char *allele, size_t length)
+{
+    const size_t mask = self->allele_hash_size - 1;
+    size_t slot = mutation_matrix_hash_allele(allele, length) & mask;
+    tsk_id_t index;
+
+    while ((index = self->allele_hash[slot]) != TSK_NULL) {
+        if (length == self->allele_length[index]
+            && memcmp(allele, self->alleles[index], length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/* The alleles are stored in a single block. With enough alleles they are
+ * also indexed by a hash table, so that looking up the parent allele of a
+ * mutation doesn't need a scan through all of the alleles. */
 static int MSP_WARN_UNUSED
 mutation_matrix_copy_alleles(
     mutation_matrix_t *self, char **alleles, size_t *allele_length)
 {
     int ret = 0;
-    size_t j;
-    tsk_size_t len;
+    size_t j, size, slot;
+    char *dest;
 
+    size = 0;
     for (j = 0; j < self->num_alleles; j++) {
-        len = (tsk_size_t) allele_length[j];
-        self->allele_length[j] = len;
-        self->alleles[j] = malloc(len);
-        if (self->alleles[j] == NULL) {
-            ret = MSP_ERR_NO_MEMORY;
-            goto out;
+        size += allele_length[j];
+    }
+    /* Alleles can be empty, so make sure the block is never zero sized */
+    self->allele_data = malloc(size + 1);
+    if (self->allele_data == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    dest = self->allele_data;
+    for (j = 0; j < self->num_alleles; j++) {
+        self->alleles[j] = dest;
+        self->allele_length[j] = (tsk_size_t) allele_length[j];
+        memcpy(dest, alleles[j], allele_length[j]);
+        dest += allele_length[j];
+    }
+    if (self->num_alleles < MSP_MATRIX_ALIAS_MIN_ALLELES) {
+        goto out;
+    }
+    self->allele_hash_size = 2;
+    while (self->allele_hash_size < 2 * self->num_alleles) {
+        self->allele_hash_size *= 2;
+    }
+    self->allele_hash = malloc(self->allele_hash_size * sizeof(*self->allele_hash));
+    if (self->allele_hash == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < self->allele_hash_size; j++) {
+        self->allele_hash[j] = TSK_NULL;
+    }
+    for (j = 0; j < self->num_alleles; j++) {
+        /* A repeated allele keeps the index of its first occurrence */
+        slot = mutation_matrix_find_allele_slot(self, alleles[j], allele_length[j]);
+        if (self->allele_hash[slot] == TSK_NULL) {
+            self->allele_hash[slot] = (tsk_id_t) j;
         }
-        memcpy(self->alleles[j], alleles[j], len);
     }
 out:
     return ret;
@@ -187,6 +254,10 @@ mutation_matrix_allele_index(mutation_matrix_t *self, const char *allele, size_t
     tsk_id_t ret = -1;
     tsk_size_t j;
 
+    if (self->allele_hash != NULL) {
+        ret = self->allele_hash[mutation_matrix_find_allele_slot(self, allele, length)];
+        goto out;
+    }
     for (j = 0; j < self->num_alleles; j++) {
         if (length == self->allele_length[j]
             && memcmp(allele, self->alleles[j], length) == 0) {
@@ -194,6 +265,37 @@ mutation_matrix_allele_index(mutation_matrix_t *self, const char *allele, size_t
             break;
         }
     }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutation_matrix_alloc_alias_tables(mutation_matrix_t *self)
+{
+    int ret = 0;
+    size_t j;
+    const size_t n = self->num_alleles;
+
+    if (n < MSP_MATRIX_ALIAS_MIN_ALLELES) {
+        goto out;
+    }
+    ret = alias_table_alloc(&self->root_alias, n, self->root_distribution);
+    if (ret != 0) {
+        goto out;
+    }
+    self->transition_alias = calloc(n, sizeof(*self->transition_alias));
+    if (self->transition_alias == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < n; j++) {
+        ret = alias_table_alloc(
+            &self->transition_alias[j], n, self->transition_matrix + j * n);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
     return ret;
 }
 
@@ -203,7 +305,13 @@ mutation_matrix_choose_root_state(mutation_model_t *self, gsl_rng *rng, site_t *
     int ret = 0;
     mutation_matrix_t params = self->params.mutation_matrix;
     double u = msp_gsl_ran_flat(rng, 0.0, 1.0);
-    size_t j = probability_list_select(u, params.num_alleles, params.root_distribution);
+    size_t j;
+
+    if (params.transition_alias != NULL) {
+        j = alias_table_sample(&params.root_alias, u);
+    } else {
+        j = probability_list_select(u, params.num_alleles, params.root_distribution);
+    }
     tsk_bug_assert(j < params.num_alleles);
     site->ancestral_state = params.alleles[j];
     site->ancestral_state_length = params.allele_length[j];
@@ -228,8 +336,12 @@ mutation_matrix_transition(mutation_model_t *self, gsl_rng *rng,
         ret = MSP_ERR_UNKNOWN_ALLELE;
         goto out;
     }
-    probs = params.transition_matrix + (tsk_size_t) pi * params.num_alleles;
-    j = (tsk_id_t) probability_list_select(u, params.num_alleles, probs);
+    if (params.transition_alias != NULL) {
+        j = (tsk_id_t) alias_table_sample(&params.transition_alias[pi], u);
+    } else {
+        probs = params.transition_matrix + (tsk_size_t) pi * params.num_alleles;
+        j = (tsk_id_t) probability_list_select(u, params.num_alleles, probs);
+    }
     mutation->derived_state = params.alleles[j];
     mutation->derived_state_length = params.allele_length[j];
 out:
@@ -242,11 +354,15 @@ mutation_matrix_free(mutation_model_t *self)
     mutation_matrix_t params = self->params.mutation_matrix;
     tsk_size_t j;
 
-    if (params.alleles != NULL) {
+    if (params.transition_alias != NULL) {
         for (j = 0; j < params.num_alleles; j++) {
-            msp_safe_free(params.alleles[j]);
+            alias_table_free(&params.transition_alias[j]);
         }
     }
+    alias_table_free(&params.root_alias);
+    msp_safe_free(params.transition_alias);
+    msp_safe_free(params.allele_data);
+    msp_safe_free(params.allele_hash);
     msp_safe_free(params.alleles);
     msp_safe_free(params.allele_length);
     msp_safe_free(params.root_distribution);
@@ -254,6 +370,26 @@ mutation_matrix_free(mutation_model_t *self)
     return 0;
 }
 
+/* Returns true if this is the deterministic binary model, in which the
+ * ancestral state is always "0" and every mutation flips the state. */
+static bool
+mutation_matrix_is_binary(mutation_model_t *self)
+{
+    mutation_matrix_t params = self->params.mutation_matrix;
+    bool ret = false;
+
+    if (self->transition == mutation_matrix_transition && params.num_alleles == 2
+        && params.allele_length[0] == 1 && params.alleles[0][0] == '0'
+        && params.allele_length[1] == 1 && params.alleles[1][0] == '1') {
+        ret = params.root_distribution[0] == 1.0
+              && params.transition_matrix[0] == 0.0
+              && params.transition_matrix[1] == 1.0
+              && params.transition_matrix[2] == 1.0
+              && params.transition_matrix[3] == 0.0;
+    }
+    return ret;
+}
+
 /***********************
  * SLiM mutation model */
 
@@ -541,6 +677,10 @@ matrix_mutation_model_alloc(mutation_model_t *self, size_t num_alleles, char **a
     if (ret != 0) {
         goto out;
     }
+    ret = mutation_matrix_alloc_alias_tables(params);
+    if (ret != 0) {
+        goto out;
+    }
     self->choose_root_state = &mutation_matrix_choose_root_state;
     self->transition = &mutation_matrix_transition;
     self->print_state = &mutation_matrix_print_state;
@@ -686,13 +826,15 @@ matrix_mutation_model_factory(mutation_model_t *self, int model)
 static void
 mutgen_check_state(mutgen_t *self)
 {
-    size_t j;
-    avl_node_t *a;
+    size_t j, k;
     site_t *s;
     mutation_t *m;
 
-    for (a = self->sites.head; a != NULL; a = a->next) {
-        s = (site_t *) a->item;
+    for (k = 0; k < self->num_ordered_sites; k++) {
+        s = self->ordered_sites[k];
+        if (k > 0) {
+            tsk_bug_assert(self->ordered_sites[k - 1]->position < s->position);
+        }
         m = s->mutations;
         for (j = 0; j < s->mutations_length; j++) {
             tsk_bug_assert(m != NULL);
@@ -710,7 +852,7 @@ mutgen_check_state(mutgen_t *self)
 void
 mutgen_print_state(mutgen_t *self, FILE *out)
 {
-    avl_node_t *a;
+    size_t j;
     site_t *s;
     mutation_t *m;
     tsk_id_t parent_id;
@@ -720,12 +862,14 @@ mutgen_print_state(mutgen_t *self, FILE *out)
     rate_map_print_state(&self->rate_map, out);
     fprintf(out, "\tstart_time = %f\n", self->start_time);
     fprintf(out, "\tend_time = %f\n", self->end_time);
+    fprintf(out, "\tgenotype_output = %d (format = %d)\n", self->genotype_file != NULL,
+        self->genotype_format);
     fprintf(out, "\tmodel:\n");
     mutation_model_print_state(self->model, out);
     tsk_blkalloc_print_state(&self->allocator, out);
 
-    for (a = self->sites.head; a != NULL; a = a->next) {
-        s = (site_t *) a->item;
+    for (j = 0; j < self->num_ordered_sites; j++) {
+        s = self->ordered_sites[j];
         fprintf(out, "site:\t%f\t'%.*s'\t'%.*s'\t(%d)\t%d\n", s->position,
             (int) s->ancestral_state_length, s->ancestral_state,
             (int) s->metadata_length, s->metadata, s->new, (int) s->mutations_length);
@@ -739,6 +883,29 @@ mutgen_print_state(mutgen_t *self, FILE *out)
     mutgen_check_state(self);
 }
 
+static void
+mutgen_free_chunks(mutgen_t *self)
+{
+    size_t j;
+    mutgen_chunk_t *chunk;
+
+    if (self->chunks != NULL) {
+        for (j = 0; j < self->num_chunks; j++) {
+            chunk = &self->chunks[j];
+            if (chunk->rng != NULL) {
+                gsl_rng_free(chunk->rng);
+            }
+            msp_safe_free(chunk->position);
+            msp_safe_free(chunk->time);
+            msp_safe_free(chunk->site_left);
+            msp_safe_free(chunk->site_right);
+            msp_safe_free(chunk->node);
+        }
+        free(self->chunks);
+        self->chunks = NULL;
+    }
+}
+
 int MSP_WARN_UNUSED
 mutgen_alloc(mutgen_t *self, gsl_rng *rng, tsk_table_collection_t *tables,
     mutation_model_t *model, size_t block_size)
@@ -775,6 +942,10 @@ mutgen_free(mutgen_t *self)
 {
     tsk_blkalloc_free(&self->allocator);
     rate_map_free(&self->rate_map);
+    rate_map_free(&self->discrete_rate_map);
+    mutgen_free_chunks(self);
+    msp_safe_free(self->ordered_sites);
+    msp_safe_free(self->placed);
     return 0;
 }
 
@@ -820,6 +991,21 @@ mutgen_set_rate(mutgen_t *self, double rate)
     return mutgen_set_rate_map(self, 1, position, &rate);
 }
 
+int
+mutgen_set_genotype_output(mutgen_t *self, FILE *file, int format)
+{
+    int ret = 0;
+
+    if (file != NULL && format != MSP_GENOTYPES_VCF && format != MSP_GENOTYPES_PACKED) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->genotype_file = file;
+    self->genotype_format = format;
+out:
+    return ret;
+}
+
 static int MSP_WARN_UNUSED
 mutgen_init_allocator(mutgen_t *self)
 {
@@ -855,22 +1041,40 @@ out:
 }
 
 static int MSP_WARN_UNUSED
-mutgen_add_new_site(mutgen_t *self, double position, site_t **new_site)
+mutgen_alloc_site(mutgen_t *self, double position, site_t **new_site)
 {
     int ret = 0;
-    avl_node_t *avl_node;
     site_t *site;
 
-    avl_node = tsk_blkalloc_get(&self->allocator, sizeof(*avl_node));
     site = tsk_blkalloc_get(&self->allocator, sizeof(*site));
-    if (site == NULL || avl_node == NULL) {
+    if (site == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
     memset(site, 0, sizeof(*site));
     site->position = position;
     site->new = true;
+    *new_site = site;
+out:
+    return ret;
+}
 
+static int MSP_WARN_UNUSED
+mutgen_add_new_site(mutgen_t *self, double position, site_t **new_site)
+{
+    int ret = 0;
+    avl_node_t *avl_node;
+    site_t *site;
+
+    avl_node = tsk_blkalloc_get(&self->allocator, sizeof(*avl_node));
+    if (avl_node == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    ret = mutgen_alloc_site(self, position, &site);
+    if (ret != 0) {
+        goto out;
+    }
     avl_init_node(avl_node, site);
     avl_node = avl_insert_node(&self->sites, avl_node);
     if (avl_node == NULL) {
@@ -882,6 +1086,28 @@ out:
     return ret;
 }
 
+/* Existing states that are alleles of a matrix model refer to the model's
+ * storage, and any others are copied. */
+static int MSP_WARN_UNUSED
+mutgen_intern_state(mutgen_t *self, char *state, tsk_size_t length, char **dest,
+    tsk_size_t *dest_length)
+{
+    int ret = 0;
+    mutation_matrix_t *params = &self->model->params.mutation_matrix;
+    tsk_id_t index = -1;
+
+    if (self->model->transition == mutation_matrix_transition) {
+        index = mutation_matrix_allele_index(params, state, length);
+    }
+    if (index >= 0) {
+        *dest = params->alleles[index];
+        *dest_length = params->allele_length[index];
+    } else {
+        ret = copy_string(&self->allocator, state, length, dest, dest_length);
+    }
+    return ret;
+}
+
 static int MSP_WARN_UNUSED
 mutgen_add_existing_site(mutgen_t *self, double position, char *ancestral_state,
     tsk_size_t ancestral_state_length, char *metadata, tsk_size_t metadata_length,
@@ -897,7 +1123,7 @@ mutgen_add_existing_site(mutgen_t *self, double position, char *ancestral_state,
     site->new = false;
 
     /* We need to copy the ancestral state and metadata  */
-    ret = copy_string(&self->allocator, ancestral_state, ancestral_state_length,
+    ret = mutgen_intern_state(self, ancestral_state, ancestral_state_length,
         &site->ancestral_state, &site->ancestral_state_length);
     if (ret != 0) {
         goto out;
@@ -957,7 +1183,7 @@ mutgen_add_existing_mutation(mutgen_t *self, site_t *site, tsk_id_t id, tsk_id_t
     mutation->new = false;
 
     /* Need to copy the derived state and metadata */
-    ret = copy_string(&self->allocator, derived_state, derived_state_length,
+    ret = mutgen_intern_state(self, derived_state, derived_state_length,
         &mutation->derived_state, &mutation->derived_state_length);
     if (ret != 0) {
         goto out;
@@ -1031,14 +1257,13 @@ mutgen_populate_tables(mutgen_t *self)
     tsk_site_table_t *sites = &self->tables->sites;
     tsk_mutation_table_t *mutations = &self->tables->mutations;
     tsk_id_t site_id, mutation_id, parent_id;
-    avl_node_t *a;
     site_t *site;
     mutation_t *m;
-    size_t num_mutations;
+    size_t j, num_mutations;
 
     site_id = 0;
-    for (a = self->sites.head; a != NULL; a = a->next) {
-        site = (site_t *) a->item;
+    for (j = 0; j < self->num_ordered_sites; j++) {
+        site = self->ordered_sites[j];
         num_mutations = 0;
         for (m = site->mutations; m != NULL; m = m->next) {
             if (m->parent == NULL) {
@@ -1073,8 +1298,163 @@ out:
     return ret;
 }
 
+/* Mutations are placed with one Poisson draw for each edge, from the
+ * mutation mass under the edge, and positions are then drawn by inverting
+ * the cumulative mass. For discrete sites we use a rate map in which each
+ * interval is rounded to the integers it covers, so that drawing a continuous
+ * position from this map and taking the floor chooses each integer with
+ * probability proportional to the rate of the interval it lies in. */
+
+static int MSP_WARN_UNUSED
+mutgen_init_discrete_rate_map(mutgen_t *self)
+{
+    int ret = 0;
+    const rate_map_t *map = &self->rate_map;
+    double *position = malloc((map->size + 1) * sizeof(*position));
+    double *rate = malloc(map->size * sizeof(*rate));
+    double right;
+    size_t j, k;
+
+    rate_map_free(&self->discrete_rate_map);
+    if (position == NULL || rate == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    position[0] = 0;
+    k = 0;
+    for (j = 0; j < map->size; j++) {
+        right = ceil(map->position[j + 1]);
+        /* Intervals that don't contain an integer are dropped */
+        if (right > position[k]) {
+            rate[k] = map->rate[j];
+            position[k + 1] = right;
+            k++;
+        }
+    }
+    ret = rate_map_alloc(&self->discrete_rate_map, k, position, rate);
+out:
+    msp_safe_free(position);
+    msp_safe_free(rate);
+    return ret;
+}
+
+/* The part of the rate map under an edge */
+typedef struct {
+    double left;
+    double right;
+    size_t left_index;
+    size_t right_index;
+} map_segment_t;
+
+static void
+map_segment_init(map_segment_t *self, rate_map_cursor_t *cursor, double left,
+    double right, bool discrete_sites)
+{
+    const rate_map_t *map = cursor->map;
+
+    self->left = discrete_sites ? ceil(left) : left;
+    self->right = discrete_sites ? ceil(right) : right;
+    self->left_index = 0;
+    self->right_index = 0;
+    if (self->left < self->right) {
+        self->left_index = rate_map_cursor_get_index(cursor, self->left);
+        /* The last interval that starts before right */
+        self->right_index = self->left_index
+                            + idx_1st_upper_bound(map->position + self->left_index + 1,
+                                map->size - self->left_index, self->right);
+    }
+}
+
+static double
+map_segment_get_mu(
+    const map_segment_t *self, const rate_map_t *map, double branch_length)
+{
+    const double *position = map->position;
+    const double *rate = map->rate;
+    const double *cumulative_mass = map->cumulative_mass;
+    double mu, left_mass, right_mass;
+
+    if (self->left >= self->right) {
+        mu = 0;
+    } else if (self->left_index == self->right_index) {
+        mu = branch_length * (self->right - self->left) * rate[self->left_index];
+    } else {
+        left_mass = cumulative_mass[self->left_index]
+                    + (self->left - position[self->left_index]) * rate[self->left_index];
+        right_mass
+            = cumulative_mass[self->right_index]
+              + (self->right - position[self->right_index]) * rate[self->right_index];
+        mu = branch_length * (right_mass - left_mass);
+    }
+    return mu;
+}
+
+/* Draws a position in the segment with density proportional to the rate.
+ * The interval containing the position is returned in index. */
+static double
+map_segment_draw_position(
+    const map_segment_t *self, const rate_map_t *map, gsl_rng *rng, size_t *index)
+{
+    const double *position = map->position;
+    const double *rate = map->rate;
+    const double *cumulative_mass = map->cumulative_mass;
+    double left_mass, right_mass, mass;
+    double x = self->left;
+    size_t j = self->left_index;
+
+    if (self->left_index == self->right_index) {
+        x = msp_gsl_ran_flat(rng, self->left, self->right);
+    } else {
+        left_mass = cumulative_mass[self->left_index]
+                    + (self->left - position[self->left_index]) * rate[self->left_index];
+        right_mass
+            = cumulative_mass[self->right_index]
+              + (self->right - position[self->right_index]) * rate[self->right_index];
+        /* Rounding can put the position just outside the segment, or at the
+         * end of an interval with zero rate, in which case we try again. */
+        do {
+            mass = msp_gsl_ran_flat(rng, left_mass, right_mass);
+            j = sub_idx_1st_strict_upper_bound(
+                    cumulative_mass, self->left_index + 1, self->right_index + 1, mass)
+                - 1;
+            if (rate[j] > 0) {
+                x = position[j] + (mass - cumulative_mass[j]) / rate[j];
+            }
+        } while (!(rate[j] > 0 && self->left <= x && x < self->right));
+    }
+    *index = j;
+    return x;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_add_placed_mutation(mutgen_t *self, double position, double time, tsk_id_t edge)
+{
+    int ret = 0;
+    size_t max;
+    placed_mutation_t *p;
+
+    if (self->num_placed == self->max_placed) {
+        max = GSL_MAX(2 * self->max_placed, 1024);
+        p = realloc(self->placed, max * sizeof(*p));
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->placed = p;
+        self->max_placed = max;
+    }
+    p = &self->placed[self->num_placed];
+    p->position = position;
+    p->time = time;
+    p->edge = edge;
+    self->num_placed++;
+out:
+    return ret;
+}
+
 static int MSP_WARN_UNUSED
-mutgen_place_mutations(mutgen_t *self, bool discrete_sites)
+mutgen_place_mutations(mutgen_t *self, bool discrete_sites, bool sort_sites,
+    size_t edge_start, size_t edge_end)
 {
     /* The mutation model for discrete sites is that there is
      * a unit of "mutation mass" on each integer, so that
@@ -1084,25 +1464,24 @@ mutgen_place_mutations(mutgen_t *self, bool discrete_sites)
      * In other words, each interval of the rate map only applies to
      * the integers that fall inside it. */
     int ret = 0;
-    const double *map_position = self->rate_map.position;
-    const double *map_rate = self->rate_map.rate;
+    rate_map_t *map = discrete_sites ? &self->discrete_rate_map : &self->rate_map;
     size_t branch_mutations, map_index;
     size_t j, k;
     const tsk_node_table_t nodes = self->tables->nodes;
     const tsk_edge_table_t edges = self->tables->edges;
     const double start_time = self->start_time;
     const double end_time = self->end_time;
-    double left, right, site_left, site_right, edge_right;
     double time, mu, position;
     double branch_start, branch_end, branch_length;
     tsk_id_t parent, child;
     avl_node_t *avl_node;
     site_t *site;
     site_t search;
+    rate_map_cursor_t cursor;
+    map_segment_t segment;
 
-    for (j = 0; j < edges.num_rows; j++) {
-        left = edges.left[j];
-        edge_right = edges.right[j];
+    rate_map_cursor_init(&cursor, map);
+    for (j = edge_start; j < edge_end; j++) {
         parent = edges.parent[j];
         child = edges.child[j];
         tsk_bug_assert(child >= 0 && child < (tsk_id_t) nodes.num_rows);
@@ -1110,141 +1489,1010 @@ mutgen_place_mutations(mutgen_t *self, bool discrete_sites)
         branch_end = GSL_MIN(end_time, nodes.time[parent]);
         branch_length = branch_end - branch_start;
 
-        map_index = rate_map_get_index(&self->rate_map, left);
-        right = 0;
-        while (right != edge_right) {
-            right = GSL_MIN(edge_right, map_position[map_index + 1]);
-            site_left = discrete_sites ? ceil(left) : left;
-            site_right = discrete_sites ? ceil(right) : right;
-            mu = branch_length * (site_right - site_left) * map_rate[map_index];
-            branch_mutations = gsl_ran_poisson(self->rng, mu);
-            for (k = 0; k < branch_mutations; k++) {
-                /* Rejection sample positions until we get one we haven't seen before,
-                 * unless we are doing discrete sites. Note that in principle this
-                 * could lead to an infinite loop here, but in practise we'd need to
-                 * use up all of the doubles before it could happen and so we'd
-                 * certainly run out of memory first. */
-                do {
-                    position = msp_gsl_ran_flat(self->rng, site_left, site_right);
-                    if (discrete_sites) {
-                        position = floor(position);
-                    }
-                    search.position = position;
-                    avl_node = avl_search(&self->sites, &search);
-                } while (avl_node != NULL && !discrete_sites);
-
+        map_segment_init(
+            &segment, &cursor, edges.left[j], edges.right[j], discrete_sites);
+        mu = map_segment_get_mu(&segment, map, branch_length);
+        branch_mutations = gsl_ran_poisson(self->rng, mu);
+        for (k = 0; k < branch_mutations; k++) {
+            if (sort_sites) {
+                /* Clashing positions are resolved after sorting */
+                position
+                    = map_segment_draw_position(&segment, map, self->rng, &map_index);
+                if (discrete_sites) {
+                    position = floor(position);
+                }
                 time = msp_gsl_ran_flat(self->rng, branch_start, branch_end);
-                tsk_bug_assert(site_left <= position && position < site_right);
-                tsk_bug_assert(branch_start <= time && time < branch_end);
-                if (avl_node != NULL) {
-                    site = (site_t *) avl_node->item;
-                } else {
-                    ret = mutgen_add_new_site(self, position, &site);
-                    if (ret != 0) {
-                        goto out;
-                    }
+                ret = mutgen_add_placed_mutation(self, position, time, (tsk_id_t) j);
+                if (ret != 0) {
+                    goto out;
+                }
+                continue;
+            }
+            /* Rejection sample positions until we get one we haven't seen before,
+             * unless we are doing discrete sites. Note that in principle this
+             * could lead to an infinite loop here, but in practise we'd need to
+             * use up all of the doubles before it could happen and so we'd
+             * certainly run out of memory first. */
+            do {
+                position
+                    = map_segment_draw_position(&segment, map, self->rng, &map_index);
+                if (discrete_sites) {
+                    position = floor(position);
                 }
-                ret = mutgen_add_new_mutation(self, site, child, time);
+                search.position = position;
+                avl_node = avl_search(&self->sites, &search);
+            } while (avl_node != NULL && !discrete_sites);
+
+            time = msp_gsl_ran_flat(self->rng, branch_start, branch_end);
+            tsk_bug_assert(segment.left <= position && position < segment.right);
+            tsk_bug_assert(branch_start <= time && time < branch_end);
+            if (avl_node != NULL) {
+                site = (site_t *) avl_node->item;
+            } else {
+                ret = mutgen_add_new_site(self, position, &site);
                 if (ret != 0) {
                     goto out;
                 }
             }
-            left = right;
-            map_index++;
+            ret = mutgen_add_new_mutation(self, site, child, time);
+            if (ret != 0) {
+                goto out;
+            }
         }
     }
 out:
     return ret;
 }
 
+/* Sorted placement (MSP_SORT_SITES). Rather than looking up each new
+ * mutation in the sites AVL tree, the mutations are appended to a flat
+ * array, radix sorted by position and then merged with the existing sites.
+ * New sites are not inserted into the AVL tree. */
+
+static inline uint64_t
+position_key(double position)
+{
+    uint64_t key;
+
+    /* Positions are non-negative, so the IEEE bit patterns have the same
+     * order as the values. */
+    memcpy(&key, &position, sizeof(key));
+    return key;
+}
+
+/* Stable LSD radix sort of the placed mutations by position. */
 static int MSP_WARN_UNUSED
-mutgen_choose_alleles(mutgen_t *self, tsk_id_t *parent, mutation_t **bottom_mutation,
-    tsk_size_t num_nodes, site_t *site)
+mutgen_sort_placed_mutations(mutgen_t *self)
 {
     int ret = 0;
-    const char *pa, *pm;
-    tsk_size_t palen, pmlen;
-    mutation_t *mut, *parent_mut;
-    tsk_id_t u;
-
-    ret = sort_mutations(site);
-    if (ret != 0) {
+    const size_t n = self->num_placed;
+    placed_mutation_t *src = self->placed;
+    placed_mutation_t *dest, *tmp;
+    placed_mutation_t *scratch = NULL;
+    size_t count[256];
+    size_t j, digit, offset, c;
+    unsigned int shift;
+
+    if (n < 2) {
         goto out;
     }
-    if (site->new) {
-        tsk_bug_assert(site->ancestral_state == NULL);
-        ret = mutation_model_choose_root_state(self->model, self->rng, site);
-        if (ret != 0) {
-            goto out;
-        }
+    scratch = malloc(n * sizeof(*scratch));
+    if (scratch == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
     }
-
-    /* Create a mapping from mutations to nodes in bottom_mutation. If we see
-     * more than one mutation at a node, the previously seen one must be the
-     * parent of the current one since we assume they are in order. */
-    for (mut = site->mutations; mut != NULL; mut = mut->next) {
-        u = mut->node;
-        tsk_bug_assert((tsk_size_t) u < num_nodes);
-        while (u != TSK_NULL && bottom_mutation[u] == NULL) {
-            u = parent[u];
+    dest = scratch;
+    for (shift = 0; shift < 64; shift += 8) {
+        memset(count, 0, sizeof(count));
+        for (j = 0; j < n; j++) {
+            count[(position_key(src[j].position) >> shift) & 0xff]++;
         }
-        if (u == TSK_NULL) {
-            pa = site->ancestral_state;
-            palen = site->ancestral_state_length;
-            pm = site->metadata;
-            pmlen = site->metadata_length;
-            tsk_bug_assert(mut->parent == NULL);
-        } else {
-            parent_mut = bottom_mutation[u];
-            mut->parent = parent_mut;
-            assert(mut->time <= parent_mut->time);
-            if (mut->new) {
-                pa = parent_mut->derived_state;
-                palen = parent_mut->derived_state_length;
-                pm = parent_mut->metadata;
-                pmlen = parent_mut->metadata_length;
-            }
+        if (count[(position_key(src[0].position) >> shift) & 0xff] == n) {
+            /* All keys share this digit */
+            continue;
         }
-        if (mut->new) {
-            tsk_bug_assert(mut->derived_state == NULL);
-            ret = mutation_model_transition(
-                self->model, self->rng, pa, palen, pm, pmlen, mut);
-            if (ret < 0) {
-                goto out;
-            }
+        offset = 0;
+        for (digit = 0; digit < 256; digit++) {
+            c = count[digit];
+            count[digit] = offset;
+            offset += c;
         }
-        bottom_mutation[mut->node] = mut;
+        for (j = 0; j < n; j++) {
+            digit = (position_key(src[j].position) >> shift) & 0xff;
+            dest[count[digit]++] = src[j];
+        }
+        tmp = src;
+        src = dest;
+        dest = tmp;
     }
-    /* Reset the mapping for the next site */
-    for (mut = site->mutations; mut != NULL; mut = mut->next) {
-        bottom_mutation[mut->node] = NULL;
+    if (src == scratch) {
+        scratch = self->placed;
+        self->placed = src;
+        self->max_placed = n;
     }
 out:
+    msp_safe_free(scratch);
     return ret;
 }
 
+/* Draws a new position for a mutation on a continuous genome, from the
+ * same interval that it was originally drawn from. */
+static double
+mutgen_redraw_position(mutgen_t *self, const placed_mutation_t *mutation)
+{
+    const tsk_edge_table_t edges = self->tables->edges;
+    size_t map_index = rate_map_get_index(&self->rate_map, mutation->position);
+    const double *map_position = self->rate_map.position;
+    double left = GSL_MAX(edges.left[mutation->edge], map_position[map_index]);
+    double right = GSL_MIN(edges.right[mutation->edge], map_position[map_index + 1]);
+
+    return msp_gsl_ran_flat(self->rng, left, right);
+}
+
+/* With continuous sites every new mutation must be at a distinct position
+ * that isn't an existing site. Mutations that clash after sorting are
+ * redrawn and the array sorted again; clashes are vanishingly rare, so
+ * this almost always takes a single pass. */
 static int MSP_WARN_UNUSED
-mutgen_apply_mutations(mutgen_t *self)
+mutgen_sort_and_resolve_clashes(mutgen_t *self)
 {
     int ret = 0;
-    const tsk_id_t *I, *O;
-    const tsk_edge_table_t edges = self->tables->edges;
-    const tsk_node_table_t nodes = self->tables->nodes;
-    const tsk_id_t M = (tsk_id_t) edges.num_rows;
-    tsk_id_t tj, tk;
-    tsk_id_t *parent = NULL;
+    bool clash = true;
+    bool have_last;
+    double last = 0;
+    double position;
+    size_t j;
+    avl_node_t *a;
+    placed_mutation_t *mutation;
+
+    while (clash) {
+        ret = mutgen_sort_placed_mutations(self);
+        if (ret != 0) {
+            goto out;
+        }
+        if (self->discrete_sites) {
+            break;
+        }
+        clash = false;
+        have_last = false;
+        a = self->sites.head;
+        for (j = 0; j < self->num_placed; j++) {
+            mutation = &self->placed[j];
+            position = mutation->position;
+            while (a != NULL && ((site_t *) a->item)->position < position) {
+                a = a->next;
+            }
+            if ((have_last && last == position)
+                || (a != NULL && ((site_t *) a->item)->position == position)) {
+                mutation->position = mutgen_redraw_position(self, mutation);
+                clash = true;
+            } else {
+                last = position;
+                have_last = true;
+            }
+        }
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_append_ordered_site(mutgen_t *self, site_t *site)
+{
+    int ret = 0;
+    size_t max;
+    site_t **p;
+
+    if (self->num_ordered_sites == self->max_ordered_sites) {
+        max = GSL_MAX(2 * self->max_ordered_sites, 1024);
+        p = realloc(self->ordered_sites, max * sizeof(*p));
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->ordered_sites = p;
+        self->max_ordered_sites = max;
+    }
+    self->ordered_sites[self->num_ordered_sites] = site;
+    self->num_ordered_sites++;
+out:
+    return ret;
+}
+
+/* Builds the ordered list of sites when all sites are in the AVL tree. */
+static int MSP_WARN_UNUSED
+mutgen_order_sites(mutgen_t *self)
+{
+    int ret = 0;
+    avl_node_t *a;
+
+    for (a = self->sites.head; a != NULL; a = a->next) {
+        ret = mutgen_append_ordered_site(self, (site_t *) a->item);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+/* Merges the sorted placed mutations with the existing sites in the AVL
+ * tree, building the ordered list of sites. */
+static int MSP_WARN_UNUSED
+mutgen_merge_placed_mutations(mutgen_t *self)
+{
+    int ret = 0;
+    const tsk_id_t *child = self->tables->edges.child;
+    avl_node_t *a = self->sites.head;
+    site_t *site = NULL;
+    placed_mutation_t *mutation;
+    size_t j;
+
+    for (j = 0; j < self->num_placed; j++) {
+        mutation = &self->placed[j];
+        while (a != NULL && ((site_t *) a->item)->position <= mutation->position) {
+            site = (site_t *) a->item;
+            ret = mutgen_append_ordered_site(self, site);
+            if (ret != 0) {
+                goto out;
+            }
+            a = a->next;
+        }
+        if (site == NULL || site->position != mutation->position) {
+            ret = mutgen_alloc_site(self, mutation->position, &site);
+            if (ret != 0) {
+                goto out;
+            }
+            ret = mutgen_append_ordered_site(self, site);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+        ret = mutgen_add_new_mutation(
+            self, site, child[mutation->edge], mutation->time);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    for (; a != NULL; a = a->next) {
+        ret = mutgen_append_ordered_site(self, (site_t *) a->item);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+/* Infinite sites binary fast path. On a continuous genome with no existing
+ * sites every new mutation is at a distinct position, and so has no parent.
+ * Under the binary model its site has ancestral state "0" and it has
+ * derived state "1", so we don't need to look at the trees or choose any
+ * alleles, and can write the sorted placed mutations straight into the
+ * tables. The fast path is only taken with MSP_SORT_SITES, and places the
+ * mutations and resolves clashing positions with the same functions as the
+ * general sorted path, so the output is identical to it. */
+
+static bool
+mutgen_use_binary_fast_path(mutgen_t *self, int flags)
+{
+    return (flags & MSP_SORT_SITES) && !self->discrete_sites && self->num_chunks == 0
+           && self->genotype_file == NULL && avl_count(&self->sites) == 0
+           && mutation_matrix_is_binary(self->model);
+}
+
+static int MSP_WARN_UNUSED
+mutgen_populate_binary_tables(mutgen_t *self)
+{
+    int ret = 0;
+    const tsk_id_t *child = self->tables->edges.child;
+    const placed_mutation_t *placed;
+    tsk_id_t site_id, mut_id;
+    size_t j;
+
+    for (j = 0; j < self->num_placed; j++) {
+        placed = &self->placed[j];
+        site_id = tsk_site_table_add_row(
+            &self->tables->sites, placed->position, "0", 1, NULL, 0);
+        if (site_id < 0) {
+            ret = msp_set_tsk_error(site_id);
+            goto out;
+        }
+        mut_id = tsk_mutation_table_add_row(&self->tables->mutations, site_id,
+            child[placed->edge], TSK_NULL, placed->time, "1", 1, NULL, 0);
+        if (mut_id < 0) {
+            ret = msp_set_tsk_error(mut_id);
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_generate_binary(mutgen_t *self)
+{
+    int ret = 0;
+
+    ret = mutgen_place_mutations(self, false, true, 0, self->tables->edges.num_rows);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = mutgen_sort_and_resolve_clashes(self);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = mutgen_populate_binary_tables(self);
+    if (ret != 0) {
+        goto out;
+    }
+    msp_safe_free(self->placed);
+    self->num_placed = 0;
+    self->max_placed = 0;
+out:
+    return ret;
+}
+
+/* Chunked placement. The edges are split into num_chunks contiguous
+ * ranges, each with its own stream of the counter-based generator seeded
+ * from the main generator. Placing the mutations for a chunk only reads
+ * the shared state and writes to the chunk's buffers, so different chunks
+ * can be placed concurrently by the chunk runner. The buffered mutations
+ * are then merged into the sites in chunk order, so that the output
+ * depends only on the seed and the number of chunks. */
+
+int
+mutgen_set_num_chunks(mutgen_t *self, size_t num_chunks)
+{
+    mutgen_free_chunks(self);
+    self->num_chunks = num_chunks;
+    return 0;
+}
+
+/* If no runner is set, the chunks are placed one after the other. */
+void
+mutgen_set_chunk_runner(mutgen_t *self, mutgen_chunk_runner_t runner, void *arg)
+{
+    self->chunk_runner = runner;
+    self->chunk_runner_arg = arg;
+}
+
+static int
+mutgen_run_chunks_serially(mutgen_t *self, size_t num_chunks, void *MSP_UNUSED(arg))
+{
+    int ret = 0;
+    size_t j;
+
+    for (j = 0; j < num_chunks; j++) {
+        ret = mutgen_place_chunk(self, j);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_alloc_chunks(mutgen_t *self)
+{
+    int ret = 0;
+    size_t j;
+    const size_t num_edges = self->tables->edges.num_rows;
+    const unsigned long seed = gsl_rng_get(self->rng);
+    mutgen_chunk_t *chunk;
+
+    mutgen_free_chunks(self);
+    self->chunks = calloc(self->num_chunks, sizeof(*self->chunks));
+    if (self->chunks == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < self->num_chunks; j++) {
+        chunk = &self->chunks[j];
+        chunk->edge_start = (num_edges * j) / self->num_chunks;
+        chunk->edge_end = (num_edges * (j + 1)) / self->num_chunks;
+        chunk->rng = gsl_rng_alloc(msp_rng_philox);
+        if (chunk->rng == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        ret = msp_rng_set_stream(chunk->rng, seed, j);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_chunk_expand(mutgen_chunk_t *self)
+{
+    int ret = 0;
+    size_t max = GSL_MAX(2 * self->max_mutations, 1024);
+    void *p;
+
+    p = realloc(self->position, max * sizeof(*self->position));
+    if (p == NULL) {
+        goto no_memory;
+    }
+    self->position = p;
+    p = realloc(self->time, max * sizeof(*self->time));
+    if (p == NULL) {
+        goto no_memory;
+    }
+    self->time = p;
+    p = realloc(self->site_left, max * sizeof(*self->site_left));
+    if (p == NULL) {
+        goto no_memory;
+    }
+    self->site_left = p;
+    p = realloc(self->site_right, max * sizeof(*self->site_right));
+    if (p == NULL) {
+        goto no_memory;
+    }
+    self->site_right = p;
+    p = realloc(self->node, max * sizeof(*self->node));
+    if (p == NULL) {
+        goto no_memory;
+    }
+    self->node = p;
+    self->max_mutations = max;
+    goto out;
+no_memory:
+    ret = MSP_ERR_NO_MEMORY;
+out:
+    return ret;
+}
+
+/* Places the mutations on the edges of the specified chunk into its
+ * buffers. This is the same algorithm as mutgen_place_mutations, except
+ * that positions are only checked against the sites that existed before
+ * placement; clashes between new positions are resolved when merging. */
+int
+mutgen_place_chunk(mutgen_t *self, size_t chunk_index)
+{
+    int ret = 0;
+    const bool discrete_sites = self->discrete_sites;
+    rate_map_t *map = discrete_sites ? &self->discrete_rate_map : &self->rate_map;
+    size_t branch_mutations, map_index;
+    size_t j, k;
+    const tsk_node_table_t nodes = self->tables->nodes;
+    const tsk_edge_table_t edges = self->tables->edges;
+    const double start_time = self->start_time;
+    const double end_time = self->end_time;
+    double time, mu, position;
+    double branch_start, branch_end, branch_length;
+    tsk_id_t parent, child;
+    avl_node_t *avl_node;
+    site_t search;
+    mutgen_chunk_t *chunk;
+    gsl_rng *rng;
+    rate_map_cursor_t cursor;
+    map_segment_t segment;
+
+    if (self->chunks == NULL || chunk_index >= self->num_chunks) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    chunk = &self->chunks[chunk_index];
+    rng = chunk->rng;
+    chunk->num_mutations = 0;
+
+    rate_map_cursor_init(&cursor, map);
+    for (j = chunk->edge_start; j < chunk->edge_end; j++) {
+        parent = edges.parent[j];
+        child = edges.child[j];
+        tsk_bug_assert(child >= 0 && child < (tsk_id_t) nodes.num_rows);
+        branch_start = GSL_MAX(start_time, nodes.time[child]);
+        branch_end = GSL_MIN(end_time, nodes.time[parent]);
+        branch_length = branch_end - branch_start;
+
+        map_segment_init(
+            &segment, &cursor, edges.left[j], edges.right[j], discrete_sites);
+        mu = map_segment_get_mu(&segment, map, branch_length);
+        branch_mutations = gsl_ran_poisson(rng, mu);
+        for (k = 0; k < branch_mutations; k++) {
+            do {
+                position = map_segment_draw_position(&segment, map, rng, &map_index);
+                if (discrete_sites) {
+                    position = floor(position);
+                }
+                search.position = position;
+                avl_node = avl_search(&self->sites, &search);
+            } while (avl_node != NULL && !discrete_sites);
+
+            time = msp_gsl_ran_flat(rng, branch_start, branch_end);
+            tsk_bug_assert(segment.left <= position && position < segment.right);
+            tsk_bug_assert(branch_start <= time && time < branch_end);
+            if (chunk->num_mutations == chunk->max_mutations) {
+                ret = mutgen_chunk_expand(chunk);
+                if (ret != 0) {
+                    goto out;
+                }
+            }
+            /* Clashing positions are redrawn from the same map interval */
+            chunk->position[chunk->num_mutations] = position;
+            chunk->time[chunk->num_mutations] = time;
+            chunk->site_left[chunk->num_mutations]
+                = GSL_MAX(segment.left, map->position[map_index]);
+            chunk->site_right[chunk->num_mutations]
+                = GSL_MIN(segment.right, map->position[map_index + 1]);
+            chunk->node[chunk->num_mutations] = child;
+            chunk->num_mutations++;
+        }
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_merge_chunks(mutgen_t *self)
+{
+    int ret = 0;
+    size_t j, k;
+    double position;
+    avl_node_t *avl_node;
+    site_t *site;
+    site_t search;
+    mutgen_chunk_t *chunk;
+
+    for (j = 0; j < self->num_chunks; j++) {
+        chunk = &self->chunks[j];
+        for (k = 0; k < chunk->num_mutations; k++) {
+            position = chunk->position[k];
+            search.position = position;
+            avl_node = avl_search(&self->sites, &search);
+            /* With continuous sites, a position drawn by more than one
+             * mutation is redrawn, as in the serial algorithm. */
+            while (avl_node != NULL && !self->discrete_sites) {
+                position = msp_gsl_ran_flat(
+                    chunk->rng, chunk->site_left[k], chunk->site_right[k]);
+                search.position = position;
+                avl_node = avl_search(&self->sites, &search);
+            }
+            if (avl_node != NULL) {
+                site = (site_t *) avl_node->item;
+            } else {
+                ret = mutgen_add_new_site(self, position, &site);
+                if (ret != 0) {
+                    goto out;
+                }
+            }
+            ret = mutgen_add_new_mutation(self, site, chunk->node[k], chunk->time[k]);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_place_mutations_chunked(mutgen_t *self)
+{
+    int ret = 0;
+    mutgen_chunk_runner_t runner = self->chunk_runner;
+
+    if (runner == NULL) {
+        runner = mutgen_run_chunks_serially;
+    }
+    ret = mutgen_alloc_chunks(self);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = runner(self, self->num_chunks, self->chunk_runner_arg);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = mutgen_merge_chunks(self);
+    if (ret != 0) {
+        goto out;
+    }
+out:
+    /* The buffers are only needed until the mutations are merged */
+    mutgen_free_chunks(self);
+    return ret;
+}
+
+/* Genotype output. As mutgen_apply_mutations moves along the trees we keep
+ * the child lists of the current tree as well as the parent array. Once the
+ * alleles at a site have been chosen we set the genotypes of the samples
+ * under each mutation and write out the row, so the genotype matrix is never
+ * held in memory. The sites and mutations for the whole sequence are placed
+ * before this, though, and are held in memory as usual. */
+
+typedef struct {
+    FILE *file;
+    int format;
+    tsk_size_t num_samples;
+    tsk_id_t *sample_index;
+    tsk_id_t *left_child;
+    tsk_id_t *right_child;
+    tsk_id_t *left_sib;
+    tsk_id_t *right_sib;
+    tsk_id_t *stack;
+    int32_t *genotypes;
+    uint8_t *packed;
+    const char **alleles;
+    tsk_size_t *allele_length;
+    size_t max_alleles;
+} genotype_writer_t;
+
+static int MSP_WARN_UNUSED
+genotype_writer_write_header(genotype_writer_t *self, double sequence_length)
+{
+    int ret = 0;
+    FILE *file = self->file;
+    tsk_size_t j;
+
+    if (self->format == MSP_GENOTYPES_VCF) {
+        fprintf(file, "##fileformat=VCFv4.2\n");
+        fprintf(file, "##source=msprime\n");
+        fprintf(file, "##FILTER=<ID=PASS,Description=\"All filters passed\">\n");
+        fprintf(file, "##contig=<ID=1,length=%.0f>\n", ceil(sequence_length));
+        fprintf(file,
+            "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n");
+        fprintf(file, "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT");
+        for (j = 0; j < self->num_samples; j++) {
+            fprintf(file, "\ttsk_%lld", (long long) j);
+        }
+        fprintf(file, "\n");
+    }
+    if (ferror(file)) {
+        ret = MSP_ERR_IO;
+    }
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+genotype_writer_alloc(genotype_writer_t *self, mutgen_t *mutgen)
+{
+    int ret = 0;
+    const tsk_node_table_t nodes = mutgen->tables->nodes;
+    const size_t n = GSL_MAX(nodes.num_rows, 1);
+    tsk_size_t j, num_samples;
+    size_t k;
+    double position;
+
+    memset(self, 0, sizeof(*self));
+    self->file = mutgen->genotype_file;
+    self->format = mutgen->genotype_format;
+    if (self->format == MSP_GENOTYPES_VCF) {
+        /* VCF positions are integers, so we can't write sites at other
+         * positions without several sites sharing a position. */
+        for (k = 0; k < mutgen->num_ordered_sites; k++) {
+            position = mutgen->ordered_sites[k]->position;
+            if (position != floor(position)) {
+                ret = MSP_ERR_VCF_NON_INTEGER_POSITION;
+                goto out;
+            }
+        }
+    }
+    self->max_alleles = 2;
+    self->sample_index = malloc(n * sizeof(*self->sample_index));
+    self->left_child = malloc(n * sizeof(*self->left_child));
+    self->right_child = malloc(n * sizeof(*self->right_child));
+    self->left_sib = malloc(n * sizeof(*self->left_sib));
+    self->right_sib = malloc(n * sizeof(*self->right_sib));
+    self->stack = malloc(n * sizeof(*self->stack));
+    self->alleles = malloc(self->max_alleles * sizeof(*self->alleles));
+    self->allele_length = malloc(self->max_alleles * sizeof(*self->allele_length));
+    if (self->sample_index == NULL || self->left_child == NULL
+        || self->right_child == NULL || self->left_sib == NULL
+        || self->right_sib == NULL || self->stack == NULL || self->alleles == NULL
+        || self->allele_length == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    memset(self->left_child, 0xff, n * sizeof(*self->left_child));
+    memset(self->right_child, 0xff, n * sizeof(*self->right_child));
+    memset(self->left_sib, 0xff, n * sizeof(*self->left_sib));
+    memset(self->right_sib, 0xff, n * sizeof(*self->right_sib));
+
+    num_samples = 0;
+    for (j = 0; j < nodes.num_rows; j++) {
+        self->sample_index[j] = TSK_NULL;
+        if (nodes.flags[j] & TSK_NODE_IS_SAMPLE) {
+            self->sample_index[j] = (tsk_id_t) num_samples;
+            num_samples++;
+        }
+    }
+    self->num_samples = num_samples;
+    self->genotypes = malloc(GSL_MAX(num_samples, 1) * sizeof(*self->genotypes));
+    self->packed = malloc(num_samples / 8 + 1);
+    if (self->genotypes == NULL || self->packed == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    ret = genotype_writer_write_header(self, mutgen->tables->sequence_length);
+out:
+    return ret;
+}
+
+static void
+genotype_writer_free(genotype_writer_t *self)
+{
+    msp_safe_free(self->sample_index);
+    msp_safe_free(self->left_child);
+    msp_safe_free(self->right_child);
+    msp_safe_free(self->left_sib);
+    msp_safe_free(self->right_sib);
+    msp_safe_free(self->stack);
+    msp_safe_free(self->genotypes);
+    msp_safe_free(self->packed);
+    msp_safe_free(self->alleles);
+    msp_safe_free(self->allele_length);
+}
+
+static void
+genotype_writer_remove_edge(genotype_writer_t *self, tsk_id_t p, tsk_id_t c)
+{
+    tsk_id_t lsib = self->left_sib[c];
+    tsk_id_t rsib = self->right_sib[c];
+
+    if (lsib == TSK_NULL) {
+        self->left_child[p] = rsib;
+    } else {
+        self->right_sib[lsib] = rsib;
+    }
+    if (rsib == TSK_NULL) {
+        self->right_child[p] = lsib;
+    } else {
+        self->left_sib[rsib] = lsib;
+    }
+    self->left_sib[c] = TSK_NULL;
+    self->right_sib[c] = TSK_NULL;
+}
+
+static void
+genotype_writer_insert_edge(genotype_writer_t *self, tsk_id_t p, tsk_id_t c)
+{
+    tsk_id_t u = self->right_child[p];
+
+    if (u == TSK_NULL) {
+        self->left_child[p] = c;
+    } else {
+        self->right_sib[u] = c;
+    }
+    self->left_sib[c] = u;
+    self->right_sib[c] = TSK_NULL;
+    self->right_child[p] = c;
+}
+
+/* Returns the index of the allele, adding it to the list for the site if
+ * we haven't seen it before. The ancestral state has index 0. */
+static int MSP_WARN_UNUSED
+genotype_writer_get_allele(genotype_writer_t *self, size_t *num_alleles,
+    const char *allele, tsk_size_t length, int32_t *index)
+{
+    int ret = 0;
+    size_t k, max;
+    const char **alleles;
+    tsk_size_t *allele_length;
+
+    for (k = 0; k < *num_alleles; k++) {
+        if (length == self->allele_length[k]
+            && (allele == self->alleles[k]
+                || memcmp(allele, self->alleles[k], length) == 0)) {
+            break;
+        }
+    }
+    if (k == *num_alleles) {
+        if (k == self->max_alleles) {
+            max = 2 * self->max_alleles;
+            alleles = realloc(self->alleles, max * sizeof(*alleles));
+            if (alleles == NULL) {
+                ret = MSP_ERR_NO_MEMORY;
+                goto out;
+            }
+            self->alleles = alleles;
+            allele_length = realloc(self->allele_length, max * sizeof(*allele_length));
+            if (allele_length == NULL) {
+                ret = MSP_ERR_NO_MEMORY;
+                goto out;
+            }
+            self->allele_length = allele_length;
+            self->max_alleles = max;
+        }
+        self->alleles[k] = allele;
+        self->allele_length[k] = length;
+        (*num_alleles)++;
+    }
+    *index = (int32_t) k;
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+genotype_writer_write_row(genotype_writer_t *self, site_t *site, size_t num_alleles)
+{
+    int ret = 0;
+    FILE *file = self->file;
+    const int32_t *genotypes = self->genotypes;
+    size_t k;
+    tsk_size_t j;
+
+    if (self->format == MSP_GENOTYPES_VCF) {
+        /* VCF positions are one-based, and we have checked that the
+         * positions are integers */
+        fprintf(file, "1\t%lld\t.\t", (long long) site->position + 1);
+        fwrite(self->alleles[0], 1, self->allele_length[0], file);
+        fputc('\t', file);
+        if (num_alleles == 1) {
+            fputc('.', file);
+        }
+        for (k = 1; k < num_alleles; k++) {
+            if (k > 1) {
+                fputc(',', file);
+            }
+            fwrite(self->alleles[k], 1, self->allele_length[k], file);
+        }
+        fprintf(file, "\t.\tPASS\t.\tGT");
+        for (j = 0; j < self->num_samples; j++) {
+            if (genotypes[j] < 10) {
+                fputc('\t', file);
+                fputc('0' + genotypes[j], file);
+            } else {
+                fprintf(file, "\t%d", (int) genotypes[j]);
+            }
+        }
+        fputc('\n', file);
+    } else {
+        /* One bit per sample, set if it doesn't carry the ancestral state */
+        memset(self->packed, 0, self->num_samples / 8 + 1);
+        for (j = 0; j < self->num_samples; j++) {
+            if (genotypes[j] != 0) {
+                self->packed[j / 8] = (uint8_t)(self->packed[j / 8] | (1u << (j % 8)));
+            }
+        }
+        fwrite(self->packed, 1, (self->num_samples + 7) / 8, file);
+    }
+    if (ferror(file)) {
+        ret = MSP_ERR_IO;
+    }
+    return ret;
+}
+
+/* Mutations are in order, with parents before children, so the genotypes
+ * of samples under a mutation are overwritten by any mutations below it. */
+static int MSP_WARN_UNUSED
+genotype_writer_write_site(genotype_writer_t *self, site_t *site)
+{
+    int ret = 0;
+    size_t num_alleles;
+    mutation_t *mut;
+    int32_t allele;
+    tsk_id_t u, v, stack_top;
+
+    memset(self->genotypes, 0, self->num_samples * sizeof(*self->genotypes));
+    self->alleles[0] = site->ancestral_state;
+    self->allele_length[0] = site->ancestral_state_length;
+    num_alleles = 1;
+    for (mut = site->mutations; mut != NULL; mut = mut->next) {
+        ret = genotype_writer_get_allele(self, &num_alleles, mut->derived_state,
+            mut->derived_state_length, &allele);
+        if (ret != 0) {
+            goto out;
+        }
+        stack_top = 0;
+        self->stack[0] = mut->node;
+        while (stack_top >= 0) {
+            u = self->stack[stack_top];
+            stack_top--;
+            if (self->sample_index[u] != TSK_NULL) {
+                self->genotypes[self->sample_index[u]] = allele;
+            }
+            for (v = self->left_child[u]; v != TSK_NULL; v = self->right_sib[v]) {
+                stack_top++;
+                self->stack[stack_top] = v;
+            }
+        }
+    }
+    ret = genotype_writer_write_row(self, site, num_alleles);
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_choose_alleles(mutgen_t *self, tsk_id_t *parent, mutation_t **bottom_mutation,
+    tsk_size_t num_nodes, site_t *site)
+{
+    int ret = 0;
+    const char *pa, *pm;
+    tsk_size_t palen, pmlen;
+    mutation_t *mut, *parent_mut;
+    tsk_id_t u;
+
+    ret = sort_mutations(site);
+    if (ret != 0) {
+        goto out;
+    }
+    if (site->new) {
+        tsk_bug_assert(site->ancestral_state == NULL);
+        ret = mutation_model_choose_root_state(self->model, self->rng, site);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+
+    /* Create a mapping from mutations to nodes in bottom_mutation. If we see
+     * more than one mutation at a node, the previously seen one must be the
+     * parent of the current one since we assume they are in order. */
+    for (mut = site->mutations; mut != NULL; mut = mut->next) {
+        u = mut->node;
+        tsk_bug_assert((tsk_size_t) u < num_nodes);
+        while (u != TSK_NULL && bottom_mutation[u] == NULL) {
+            u = parent[u];
+        }
+        if (u == TSK_NULL) {
+            pa = site->ancestral_state;
+            palen = site->ancestral_state_length;
+            pm = site->metadata;
+            pmlen = site->metadata_length;
+            tsk_bug_assert(mut->parent == NULL);
+        } else {
+            parent_mut = bottom_mutation[u];
+            mut->parent = parent_mut;
+            assert(mut->time <= parent_mut->time);
+            if (mut->new) {
+                pa = parent_mut->derived_state;
+                palen = parent_mut->derived_state_length;
+                pm = parent_mut->metadata;
+                pmlen = parent_mut->metadata_length;
+            }
+        }
+        if (mut->new) {
+            tsk_bug_assert(mut->derived_state == NULL);
+            ret = mutation_model_transition(
+                self->model, self->rng, pa, palen, pm, pmlen, mut);
+            if (ret < 0) {
+                goto out;
+            }
+        }
+        bottom_mutation[mut->node] = mut;
+    }
+    /* Reset the mapping for the next site */
+    for (mut = site->mutations; mut != NULL; mut = mut->next) {
+        bottom_mutation[mut->node] = NULL;
+    }
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+mutgen_apply_mutations(mutgen_t *self)
+{
+    int ret = 0;
+    const tsk_id_t *I, *O;
+    const tsk_edge_table_t edges = self->tables->edges;
+    const tsk_node_table_t nodes = self->tables->nodes;
+    const tsk_id_t M = (tsk_id_t) edges.num_rows;
+    tsk_id_t tj, tk;
+    tsk_id_t *parent = NULL;
     mutation_t **bottom_mutation = NULL;
     double left, right;
     const double sequence_length = self->tables->sequence_length;
-    avl_node_t *avl_node;
+    size_t site_index;
     site_t *site;
+    const bool write_genotypes = self->genotype_file != NULL;
+    genotype_writer_t writer;
 
+    memset(&writer, 0, sizeof(writer));
     parent = malloc(nodes.num_rows * sizeof(*parent));
     bottom_mutation = malloc(nodes.num_rows * sizeof(*bottom_mutation));
     if (parent == NULL || bottom_mutation == NULL) {
         ret = TSK_ERR_NO_MEMORY;
         goto out;
     }
+    if (write_genotypes) {
+        ret = genotype_writer_alloc(&writer, self);
+        if (ret != 0) {
+            goto out;
+        }
+    }
     memset(parent, 0xff, nodes.num_rows * sizeof(*parent));
     memset(bottom_mutation, 0, nodes.num_rows * sizeof(*bottom_mutation));
 
@@ -1260,14 +2508,22 @@ mutgen_apply_mutations(mutgen_t *self)
     tj = 0;
     tk = 0;
     left = 0;
-    avl_node = self->sites.head;
+    site_index = 0;
     while (tj < M || left < sequence_length) {
         while (tk < M && edges.right[O[tk]] == left) {
             parent[edges.child[O[tk]]] = TSK_NULL;
+            if (write_genotypes) {
+                genotype_writer_remove_edge(
+                    &writer, edges.parent[O[tk]], edges.child[O[tk]]);
+            }
             tk++;
         }
         while (tj < M && edges.left[I[tj]] == left) {
             parent[edges.child[I[tj]]] = edges.parent[I[tj]];
+            if (write_genotypes) {
+                genotype_writer_insert_edge(
+                    &writer, edges.parent[I[tj]], edges.child[I[tj]]);
+            }
             tj++;
         }
         right = sequence_length;
@@ -1279,8 +2535,8 @@ mutgen_apply_mutations(mutgen_t *self)
         }
 
         /* Tree is now ready. We look at each site on this tree in turn */
-        while (avl_node != NULL) {
-            site = (site_t *) avl_node->item;
+        while (site_index < self->num_ordered_sites) {
+            site = self->ordered_sites[site_index];
             if (site->position >= right) {
                 break;
             }
@@ -1289,7 +2545,13 @@ mutgen_apply_mutations(mutgen_t *self)
             if (ret != 0) {
                 goto out;
             }
-            avl_node = avl_node->next;
+            if (write_genotypes) {
+                ret = genotype_writer_write_site(&writer, site);
+                if (ret != 0) {
+                    goto out;
+                }
+            }
+            site_index++;
         }
         /* Move on to the next tree */
         left = right;
@@ -1298,16 +2560,25 @@ mutgen_apply_mutations(mutgen_t *self)
 out:
     msp_safe_free(parent);
     msp_safe_free(bottom_mutation);
+    genotype_writer_free(&writer);
     return ret;
 }
 
+/* Incremental placement. mutgen_begin sets up the sites and clears the
+ * site and mutation tables, mutgen_place_edges places mutations on a range
+ * of edges as they are added to the tables, and mutgen_finish chooses the
+ * alleles and writes out the sites and mutations once the tables are
+ * complete and indexed. Mutations are recorded against the child node of
+ * the edge, so the edges may be reordered or merged before finishing. */
+
 int MSP_WARN_UNUSED
-mutgen_generate(mutgen_t *self, int flags)
+mutgen_begin(mutgen_t *self, int flags)
 {
     int ret = 0;
-    bool discrete_sites = flags & MSP_DISCRETE_SITES;
 
     avl_clear_tree(&self->sites);
+    self->num_ordered_sites = 0;
+    self->num_placed = 0;
 
     ret = mutgen_init_allocator(self);
     if (ret != 0) {
@@ -1333,7 +2604,49 @@ mutgen_generate(mutgen_t *self, int flags)
     if (ret != 0) {
         goto out;
     }
-    ret = mutgen_place_mutations(self, discrete_sites);
+    self->discrete_sites = flags & MSP_DISCRETE_SITES;
+    if (self->discrete_sites) {
+        ret = mutgen_init_discrete_rate_map(self);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+out:
+    return ret;
+}
+
+int MSP_WARN_UNUSED
+mutgen_place_edges(mutgen_t *self, size_t edge_start, size_t edge_end)
+{
+    int ret = 0;
+
+    if (edge_start > edge_end || edge_end > self->tables->edges.num_rows) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    ret = mutgen_place_mutations(
+        self, self->discrete_sites, false, edge_start, edge_end);
+out:
+    return ret;
+}
+
+int MSP_WARN_UNUSED
+mutgen_finish(mutgen_t *self)
+{
+    int ret = 0;
+
+    /* Finishing may be repeated as more edges are placed, so we rewrite the
+     * site and mutation tables each time. */
+    ret = tsk_site_table_clear(&self->tables->sites);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = tsk_mutation_table_clear(&self->tables->mutations);
+    if (ret != 0) {
+        goto out;
+    }
+    self->num_ordered_sites = 0;
+    ret = mutgen_order_sites(self);
     if (ret != 0) {
         goto out;
     }
@@ -1348,3 +2661,58 @@ mutgen_generate(mutgen_t *self, int flags)
 out:
     return ret;
 }
+
+int MSP_WARN_UNUSED
+mutgen_generate(mutgen_t *self, int flags)
+{
+    int ret = 0;
+    /* Chunked placement always merges through the AVL tree */
+    bool sort_sites = (flags & MSP_SORT_SITES) && self->num_chunks == 0;
+
+    ret = mutgen_begin(self, flags);
+    if (ret != 0) {
+        goto out;
+    }
+    if (mutgen_use_binary_fast_path(self, flags)) {
+        ret = mutgen_generate_binary(self);
+        goto out;
+    }
+    if (self->num_chunks > 0) {
+        ret = mutgen_place_mutations_chunked(self);
+    } else {
+        ret = mutgen_place_mutations(self, self->discrete_sites, sort_sites, 0,
+            self->tables->edges.num_rows);
+    }
+    if (ret != 0) {
+        goto out;
+    }
+    if (sort_sites) {
+        ret = mutgen_sort_and_resolve_clashes(self);
+        if (ret != 0) {
+            goto out;
+        }
+        ret = mutgen_merge_placed_mutations(self);
+        if (ret != 0) {
+            goto out;
+        }
+        /* Release the placed mutations, which are now in the sites */
+        msp_safe_free(self->placed);
+        self->num_placed = 0;
+        self->max_placed = 0;
+    } else {
+        ret = mutgen_order_sites(self);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    ret = mutgen_apply_mutations(self);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = mutgen_populate_tables(self);
+    if (ret != 0) {
+        goto out;
+    }
+out:
+    return ret;
+}
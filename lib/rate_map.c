@@ -210,3 +210,31 @@ rate_map_shift_by_mass(rate_map_t *self, double pos, double mass)
     double result_mass = rate_map_position_to_mass(self, pos) + mass;
     return rate_map_mass_to_position(self, result_mass);
 }
+
+void
+rate_map_cursor_init(rate_map_cursor_t *self, rate_map_t *map)
+{
+    self->map = map;
+    self->index = 0;
+}
+
+/* Returns the index of the interval containing 0 <= x < sequence_length,
+ * checking the current and next intervals before searching. */
+size_t
+rate_map_cursor_get_index(rate_map_cursor_t *self, double x)
+{
+    const double *position = self->map->position;
+    const size_t size = self->map->size;
+    size_t index = self->index;
+
+    if (!(position[index] <= x && x < position[index + 1])) {
+        if (index + 1 < size && position[index + 1] <= x && x < position[index + 2]) {
+            index++;
+        } else {
+            index = rate_map_get_index(self->map, x);
+            index = TSK_MIN(index, size - 1);
+        }
+    }
+    self->index = index;
+    return index;
+}
@@ -33,6 +33,13 @@ typedef struct {
     fast_search_t position_lookup;
 } rate_map_t;
 
+/* Remembers the interval of the last lookup, so that runs of lookups at
+ * nearby increasing positions don't need to search the map. */
+typedef struct {
+    rate_map_t *map;
+    size_t index;
+} rate_map_cursor_t;
+
 int rate_map_alloc(rate_map_t *self, size_t size, double *position, double *value);
 int rate_map_alloc_single(rate_map_t *self, double sequence_length, double value);
 int rate_map_copy(rate_map_t *to, rate_map_t *from);
@@ -48,4 +55,7 @@ double rate_map_mass_to_position(rate_map_t *self, double mass);
 double rate_map_position_to_mass(rate_map_t *self, double position);
 double rate_map_shift_by_mass(rate_map_t *self, double pos, double mass);
 
+void rate_map_cursor_init(rate_map_cursor_t *self, rate_map_t *map);
+size_t rate_map_cursor_get_index(rate_map_cursor_t *self, double x);
+
 #endif /*__RATE_MAP_H__*/
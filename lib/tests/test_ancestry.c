@@ -629,6 +629,105 @@ test_multi_locus_simulation(void)
     gsl_rng_free(rng);
 }
 
+static void
+test_mutations_during_simulation(void)
+{
+    int ret;
+    uint32_t n = 20;
+    uint32_t m = 100;
+    size_t j;
+    msp_t msp;
+    mutgen_t mutgen, other_mutgen;
+    mutation_model_t mut_model;
+    gsl_rng *rng = safe_rng_alloc();
+    gsl_rng *mut_rng = safe_rng_alloc();
+    tsk_table_collection_t tables, other_tables;
+
+    ret = build_sim(&msp, &tables, rng, m, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_NUCLEOTIDE);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_alloc(&mutgen, mut_rng, &tables, &mut_model, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_set_rate(&mutgen, 0.1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = msp_set_mutation_generator(&msp, &mutgen, MSP_KEEP_SITES);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    ret = msp_set_mutation_generator(&msp, &mutgen, MSP_SORT_SITES);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    ret = tsk_table_collection_copy(&tables, &other_tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    mutgen.tables = &other_tables;
+    ret = msp_set_mutation_generator(&msp, &mutgen, 0);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    mutgen.tables = &tables;
+    tsk_table_collection_free(&other_tables);
+
+    ret = msp_set_mutation_generator(&msp, &mutgen, MSP_DISCRETE_SITES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* Provoke the spilling of edges */
+    ret = msp_set_spill_block_size(&msp, 16);
+    CU_ASSERT_EQUAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < 2; j++) {
+        /* Stop early the first time to get the unary edges to the roots */
+        ret = msp_run(&msp, j == 0 ? 0.5 : DBL_MAX, UINT32_MAX);
+        CU_ASSERT_TRUE(ret >= 0);
+        msp_verify(&msp, 0);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = tsk_table_collection_check_integrity(&tables, TSK_CHECK_TREES);
+        CU_ASSERT_TRUE(ret >= 0);
+        CU_ASSERT_TRUE(tables.sites.num_rows > 0);
+        CU_ASSERT_TRUE(tables.mutations.num_rows >= tables.sites.num_rows);
+        msp_print_state(&msp, _devnull);
+
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(tables.sites.num_rows, 0);
+        CU_ASSERT_EQUAL(tables.mutations.num_rows, 0);
+    }
+
+    /* When the simulation runs to the end the edges aren't reordered, so
+     * the mutations are placed in the same order as by mutgen afterwards. */
+    gsl_rng_set(mut_rng, 7);
+    ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(tables.mutations.num_rows > 0);
+    ret = tsk_table_collection_copy(&tables, &other_tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_site_table_clear(&other_tables.sites);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_mutation_table_clear(&other_tables.mutations);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    gsl_rng_set(mut_rng, 7);
+    ret = mutgen_alloc(&other_mutgen, mut_rng, &other_tables, &mut_model, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_set_rate(&other_mutgen, 0.1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = mutgen_generate(&other_mutgen, MSP_DISCRETE_SITES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(tsk_site_table_equals(&tables.sites, &other_tables.sites, 0));
+    CU_ASSERT_TRUE(
+        tsk_mutation_table_equals(&tables.mutations, &other_tables.mutations, 0));
+    mutgen_free(&other_mutgen);
+    tsk_table_collection_free(&other_tables);
+
+    ret = msp_free(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    mutgen_free(&mutgen);
+    mutation_model_free(&mut_model);
+    gsl_rng_free(rng);
+    gsl_rng_free(mut_rng);
+    tsk_table_collection_free(&tables);
+}
+
 static void
 test_multi_locus_bottleneck_arg(void)
 {
@@ -750,6 +849,206 @@ test_dtwf_single_locus_simulation(void)
     tsk_table_collection_free(&tables);
 }
 
+static void
+test_dtwf_large_population(void)
+{
+    int ret;
+    uint32_t n = 10;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+
+    /* Parents are not allocated per individual, so this must not need
+     * memory proportional to the population size */
+    ret = build_sim(&msp, &tables, rng, 100, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_population_configuration(&msp, 0, 1e9, 0, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1e-3), 0);
+    ret = msp_set_simulation_model_dtwf(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = msp_run(&msp, 1000, UINT32_MAX);
+    CU_ASSERT_EQUAL(ret, MSP_EXIT_MAX_TIME);
+    msp_verify(&msp, 0);
+    CU_ASSERT_TRUE(msp_get_num_ancestors(&msp) >= n);
+
+    ret = msp_free(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_dtwf_hybrid_switch(void)
+{
+    int ret;
+    int replicate;
+    uint32_t n = 100;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    double switch_time;
+
+    ret = build_sim(&msp, &tables, rng, 10, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_population_configuration(&msp, 0, 100, 0, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.01), 0);
+    CU_ASSERT_EQUAL(
+        msp_set_simulation_model_dtwf_hybrid(&msp, -1), MSP_ERR_BAD_PARAM_VALUE);
+    CU_ASSERT_EQUAL(
+        msp_set_simulation_model_dtwf_hybrid(&msp, INFINITY), MSP_ERR_BAD_PARAM_VALUE);
+    ret = msp_set_simulation_model_dtwf_hybrid(&msp, 0.1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    msp_print_state(&msp, _devnull);
+
+    for (replicate = 0; replicate < 2; replicate++) {
+        CU_ASSERT_STRING_EQUAL(msp_get_model_name(&msp), "dtwf");
+        CU_ASSERT_EQUAL(msp_get_dtwf_switch_time(&msp), -DBL_MAX);
+        ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+        /* Lineages start at one per individual, so the DTWF must run for at
+         * least a generation before switching at an integer time. */
+        switch_time = msp_get_dtwf_switch_time(&msp);
+        CU_ASSERT_TRUE(switch_time >= 1);
+        CU_ASSERT_EQUAL(switch_time, floor(switch_time));
+        CU_ASSERT_TRUE(msp.time > switch_time);
+        CU_ASSERT_STRING_EQUAL(msp_get_model_name(&msp), "hudson");
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+
+    /* The coalescent only gets the events left over from the DTWF, so a
+     * budget of one event stops after the first generation whether or not
+     * the model switches. */
+    ret = msp_run(&msp, DBL_MAX, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_EVENTS);
+    CU_ASSERT_EQUAL(msp.time, 1);
+    ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_STRING_EQUAL(msp_get_model_name(&msp), "hudson");
+    msp_verify(&msp, 0);
+
+    ret = msp_free(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+}
+
+static int
+draw_dtwf_populations_forward(msp_t *msp, size_t num_populations, void *arg)
+{
+    int ret = 0;
+    size_t j;
+
+    *((int *) arg) += 1;
+    for (j = 0; j < num_populations && ret == 0; j++) {
+        ret = msp_dtwf_draw_population(msp, j);
+    }
+    return ret;
+}
+
+static int
+draw_dtwf_populations_reverse(msp_t *msp, size_t num_populations, void *arg)
+{
+    int ret = 0;
+    size_t j;
+
+    *((int *) arg) += 1;
+    for (j = num_populations; j > 0 && ret == 0; j--) {
+        ret = msp_dtwf_draw_population(msp, j - 1);
+    }
+    return ret;
+}
+
+static int
+draw_dtwf_populations_unreserved(msp_t *msp, size_t num_populations, void *arg)
+{
+    int ret = 0;
+    size_t j;
+    size_t num_reserved[3];
+
+    /* Hide the reserved segments, so that the offspring are all split when
+     * the populations are merged rather than when they are drawn. */
+    CU_ASSERT_FATAL(num_populations <= 3);
+    for (j = 0; j < num_populations; j++) {
+        num_reserved[j] = msp->dtwf_draws[j].num_reserved;
+        msp->dtwf_draws[j].num_reserved = 0;
+    }
+    ret = draw_dtwf_populations_forward(msp, num_populations, arg);
+    for (j = 0; j < num_populations; j++) {
+        CU_ASSERT_EQUAL(msp->dtwf_draws[j].num_recombined, 0);
+        msp->dtwf_draws[j].num_reserved = num_reserved[j];
+    }
+    return ret;
+}
+
+static void
+test_dtwf_population_runner(void)
+{
+    int ret;
+    int j;
+    int num_calls[3] = { 0, 0, 0 };
+    uint32_t n = 50;
+    double migration_matrix[] = { 0, 0.1, 0.1, 0.1, 0, 0.1, 0.1, 0.1, 0 };
+    dtwf_population_runner_t runners[] = { draw_dtwf_populations_forward,
+        draw_dtwf_populations_reverse, draw_dtwf_populations_unreserved };
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables[3];
+
+    for (j = 0; j < 3; j++) {
+        gsl_rng_set(rng, 5);
+        ret = build_sim(&msp, &tables[j], rng, 10, 3, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_simulation_model_dtwf(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.05), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_population_configuration(&msp, 0, n, 0, true), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_population_configuration(&msp, 1, n, 0, true), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_population_configuration(&msp, 2, n, 0, true), 0);
+        ret = msp_set_migration_matrix(&msp, 9, migration_matrix);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_set_dtwf_population_runner(&msp, runners[j], &num_calls[j]);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        /* Drawing before the first generation is an error */
+        CU_ASSERT_EQUAL(msp_dtwf_draw_population(&msp, 0), MSP_ERR_BAD_PARAM_VALUE);
+
+        ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+        CU_ASSERT_TRUE(msp_get_num_recombination_events(&msp) > 0);
+        CU_ASSERT_EQUAL(msp_dtwf_draw_population(&msp, 3), MSP_ERR_BAD_PARAM_VALUE);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    /* The order in which the populations are drawn, and whether the segments
+     * are split when drawing or when merging, makes no difference */
+    CU_ASSERT_TRUE(num_calls[0] > 0);
+    CU_ASSERT_EQUAL(num_calls[0], num_calls[1]);
+    CU_ASSERT_EQUAL(num_calls[0], num_calls[2]);
+    CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+    CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[2], 0));
+
+    gsl_rng_free(rng);
+    for (j = 0; j < 3; j++) {
+        tsk_table_collection_free(&tables[j]);
+    }
+}
+
 static void
 test_dtwf_multi_locus_simulation(void)
 {
@@ -1702,6 +2001,159 @@ test_multiple_mergers_unary_nodes(void)
     gsl_rng_free(rng);
 }
 
+static void
+test_beta_coalescent_large_mergers(void)
+{
+    int ret;
+    size_t j, k;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    /* Sample sizes either side of the cached merger table limit */
+    uint32_t sample_sizes[] = { 10, 500, 1500 };
+    double beta_params[][2] = { { 1.01, 1 }, { 1.01, 0.1 }, { 1.5, 0.5 } };
+
+    for (j = 0; j < sizeof(sample_sizes) / sizeof(*sample_sizes); j++) {
+        for (k = 0; k < sizeof(beta_params) / sizeof(*beta_params); k++) {
+            gsl_rng_set(rng, (unsigned long) (j + 1) * 13 + k);
+            ret = build_sim(&msp, &tables, rng, 10, 1, NULL, sample_sizes[j]);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+            ret = msp_set_simulation_model_beta(
+                &msp, beta_params[k][0], beta_params[k][1]);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_initialise(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            msp_verify(&msp, 0);
+            CU_ASSERT_EQUAL(msp_get_num_ancestors(&msp), 0);
+            ret = msp_finalise_tables(&msp);
+            CU_ASSERT_EQUAL(ret, 0);
+            CU_ASSERT_TRUE(msp_get_num_common_ancestor_events(&msp) > 0);
+            msp_free(&msp);
+            tsk_table_collection_free(&tables);
+        }
+    }
+    gsl_rng_free(rng);
+}
+
+static void
+test_beta_merger_size_samplers(void)
+{
+    int ret;
+    size_t j, k;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    const uint32_t n = 20;
+    const size_t num_samples = 100000;
+    double table_freq[21], rejection_freq[21];
+    double beta_params[][2] = { { 1.01, 1 }, { 1.1, 0.5 }, { 1.8, 1 } };
+    double truncation_point, total_rate;
+    uint32_t size;
+    size_t num_proposals;
+
+    for (k = 0; k < sizeof(beta_params) / sizeof(*beta_params); k++) {
+        gsl_rng_set(rng, 17 + k);
+        ret = build_sim(&msp, &tables, rng, 1, 1, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_simulation_model_beta(&msp, beta_params[k][0], beta_params[k][1]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        memset(table_freq, 0, sizeof(table_freq));
+        memset(rejection_freq, 0, sizeof(rejection_freq));
+
+        for (j = 0; j < num_samples; j++) {
+            size = msp_beta_sample_table_merger_size(&msp, n);
+            CU_ASSERT_FATAL(size >= 2 && size <= n);
+            table_freq[size] += 1.0 / (double) num_samples;
+        }
+        truncation_point = msp.beta_merger_cache.truncation_point;
+        total_rate = msp.beta_merger_cache.tables[n].total_rate;
+        num_proposals = 0;
+        for (j = 0; j < num_samples; j++) {
+            do {
+                size = msp_beta_sample_merger_size(
+                    &msp, n, beta_params[k][0], truncation_point);
+                num_proposals++;
+            } while (size == 0);
+            CU_ASSERT_FATAL(size >= 2 && size <= n);
+            rejection_freq[size] += 1.0 / (double) num_samples;
+        }
+        /* The table's total rate is the rate at which proposals made at
+         * rate n choose 2 are accepted */
+        CU_ASSERT_DOUBLE_EQUAL((double) num_samples / (double) num_proposals,
+            total_rate / (n * (n - 1) / 2.0), 0.01);
+        for (size = 2; size <= n; size++) {
+            CU_ASSERT_DOUBLE_EQUAL(table_freq[size], rejection_freq[size], 0.01);
+        }
+        msp_free(&msp);
+        tsk_table_collection_free(&tables);
+    }
+    gsl_rng_free(rng);
+}
+
+static void
+test_multiple_merger_rate_cache(void)
+{
+    int ret;
+    int model;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    merger_rate_cache_t *cache;
+
+    for (model = 0; model < 2; model++) {
+        ret = build_sim(&msp, &tables, rng, 1, 1, NULL, 20);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_population_configuration(&msp, 0, 10, 0, true);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        if (model == 0) {
+            ret = msp_set_simulation_model_dirac(&msp, 0.5, 1);
+        } else {
+            ret = msp_set_simulation_model_beta(&msp, 1.5, 10);
+        }
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        cache = &msp.populations[0].merger_rates;
+        CU_ASSERT_FALSE(cache->timescale_valid);
+        CU_ASSERT_FALSE(cache->rate_valid);
+
+        ret = msp_run(&msp, DBL_MAX, 1);
+        CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_EVENTS);
+        CU_ASSERT_TRUE(cache->timescale_valid);
+        CU_ASSERT_TRUE(cache->rate_valid);
+        CU_ASSERT_TRUE(cache->num_lineages > 1);
+        CU_ASSERT_TRUE(cache->rate > 0);
+        if (model == 0) {
+            CU_ASSERT_DOUBLE_EQUAL(cache->timescale, 100, 1e-9);
+        }
+
+        /* The Beta timescale depends on the ploidy */
+        ret = msp_set_ploidy(&msp, 1);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_FALSE(cache->timescale_valid);
+        CU_ASSERT_FALSE(cache->rate_valid);
+        ret = msp_run(&msp, DBL_MAX, 1);
+        CU_ASSERT_TRUE(ret >= 0);
+        msp_verify(&msp, 0);
+
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_FALSE(cache->timescale_valid);
+        ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_verify(&msp, 0);
+
+        msp_free(&msp);
+        tsk_table_collection_free(&tables);
+    }
+    gsl_rng_free(rng);
+}
+
 static void
 test_simulator_getters_setters(void)
 {
@@ -2881,6 +3333,511 @@ test_time_travel_error(void)
     tsk_table_collection_free(&tables);
 }
 
+static void
+test_table_presizing_cap(void)
+{
+    int ret;
+    uint32_t n = 10;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    table_capacity_t estimate;
+    msp_t msp;
+
+    ret = build_sim(&msp, &tables, rng, 100, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1e9), 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* Extreme estimates are capped at a multiple of the input table size */
+    ret = msp_estimate_table_capacity(&msp, &estimate);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(estimate.num_nodes, 1024 * n);
+    CU_ASSERT_EQUAL(estimate.num_edges, 1024 * n);
+    CU_ASSERT_EQUAL(estimate.num_migrations, 0);
+
+    msp_free(&msp);
+    tsk_table_collection_free(&tables);
+    gsl_rng_free(rng);
+}
+
+static void
+test_table_presizing(void)
+{
+    int ret;
+    uint32_t n = 100;
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    table_capacity_t estimate, capacity;
+    msp_t msp;
+
+    ret = build_sim(&msp, &tables, rng, 100, 2, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.01), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_migration_matrix(&msp, 4, migration_matrix), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_store_migrations(&msp, true), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_presize_tables(&msp, true), 0);
+    /* We can't estimate before the sampling events are known */
+    ret = msp_estimate_table_capacity(&msp, &estimate);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_STATE);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = msp_estimate_table_capacity(&msp, &estimate);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(estimate.num_nodes >= n - 1);
+    CU_ASSERT_TRUE(estimate.num_edges >= 2 * (n - 1));
+    CU_ASSERT_TRUE(estimate.num_migrations > 0);
+    ret = msp_get_table_capacity(&msp, &capacity);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(capacity.num_nodes, estimate.num_nodes);
+    CU_ASSERT_EQUAL(capacity.num_edges, estimate.num_edges);
+    CU_ASSERT_EQUAL(capacity.num_migrations, estimate.num_migrations);
+
+    ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* The first expansion of each table must reach the reserved capacity */
+    CU_ASSERT_TRUE(tables.nodes.max_rows >= n + capacity.num_nodes);
+    CU_ASSERT_TRUE(tables.edges.max_rows >= capacity.num_edges);
+    CU_ASSERT_TRUE(tables.migrations.max_rows >= capacity.num_migrations);
+    msp_print_state(&msp, _devnull);
+
+    /* Explicit reservations are kept across replicates */
+    ret = msp_reserve_table_capacity(&msp, 10, 20000, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_reset(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_get_table_capacity(&msp, &capacity);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(capacity.num_nodes, 10);
+    CU_ASSERT_EQUAL(capacity.num_edges, 20000);
+    CU_ASSERT_EQUAL(capacity.num_migrations, 0);
+    CU_ASSERT_TRUE(tables.edges.max_rows + tables.edges.max_rows_increment >= 20000);
+    CU_ASSERT_EQUAL(tables.migrations.max_rows_increment, 0);
+    ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_table_capacity_overshoot(void)
+{
+    int ret;
+    uint32_t n = 100;
+    tsk_size_t max_rows, num_expansions;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    msp_t msp;
+
+    ret = build_sim(&msp, &tables, rng, 100, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* Far fewer edges than the simulation needs */
+    ret = msp_reserve_table_capacity(&msp, 0, tables.edges.max_rows + 16, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_NOT_EQUAL(tables.edges.max_rows_increment, 0);
+
+    max_rows = tables.edges.max_rows;
+    num_expansions = 0;
+    do {
+        ret = msp_run(&msp, DBL_MAX, 1);
+        CU_ASSERT_FATAL(ret >= 0);
+        if (tables.edges.max_rows != max_rows) {
+            /* Past the reservation, the table doubles when it's expanded */
+            if (num_expansions > 0) {
+                CU_ASSERT_TRUE(tables.edges.max_rows >= 2 * max_rows);
+            }
+            max_rows = tables.edges.max_rows;
+            num_expansions++;
+        }
+    } while (ret != 0);
+    CU_ASSERT_TRUE(tables.edges.num_rows > 1000);
+    CU_ASSERT_TRUE(num_expansions > 2);
+    CU_ASSERT_EQUAL(tables.edges.max_rows_increment, 0);
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_finalise_modes(void)
+{
+    int ret;
+    int j;
+    uint32_t n = 50;
+    double max_time = 0.5;
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    int modes[] = { MSP_FINALISE_SORT, MSP_FINALISE_MERGE };
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables[2];
+    msp_t msp;
+
+    for (j = 0; j < 2; j++) {
+        gsl_rng_set(rng, 5);
+        ret = build_sim(&msp, &tables[j], rng, 100, 2, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_migration_matrix(&msp, 4, migration_matrix), 0);
+        CU_ASSERT_EQUAL(msp_set_finalise_mode(&msp, -1), MSP_ERR_BAD_PARAM_VALUE);
+        CU_ASSERT_EQUAL(msp_set_finalise_mode(&msp, 2), MSP_ERR_BAD_PARAM_VALUE);
+        CU_ASSERT_EQUAL_FATAL(msp_set_finalise_mode(&msp, modes[j]), 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, max_time, ULONG_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_TIME);
+        CU_ASSERT_TRUE(msp_get_num_ancestors(&msp) > 1);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(tsk_table_collection_has_index(&tables[j], 0));
+        msp_free(&msp);
+    }
+    /* Merging the sorted runs must give the same order as the full sort */
+    CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+
+    gsl_rng_free(rng);
+    for (j = 0; j < 2; j++) {
+        tsk_table_collection_free(&tables[j]);
+    }
+}
+
+static void
+verify_edge_index(tsk_table_collection_t *tables)
+{
+    int ret;
+    tsk_size_t num_edges = tables->edges.num_rows;
+    tsk_id_t *insertion_order = malloc((num_edges + 1) * sizeof(tsk_id_t));
+    tsk_id_t *removal_order = malloc((num_edges + 1) * sizeof(tsk_id_t));
+
+    CU_ASSERT_FATAL(insertion_order != NULL && removal_order != NULL);
+    CU_ASSERT_FATAL(tsk_table_collection_has_index(tables, 0));
+    memcpy(insertion_order, tables->indexes.edge_insertion_order,
+        num_edges * sizeof(tsk_id_t));
+    memcpy(removal_order, tables->indexes.edge_removal_order,
+        num_edges * sizeof(tsk_id_t));
+    ret = tsk_table_collection_build_index(tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(memcmp(insertion_order, tables->indexes.edge_insertion_order,
+                        num_edges * sizeof(tsk_id_t)),
+        0);
+    CU_ASSERT_EQUAL(memcmp(removal_order, tables->indexes.edge_removal_order,
+                        num_edges * sizeof(tsk_id_t)),
+        0);
+    free(insertion_order);
+    free(removal_order);
+}
+
+static void
+test_edge_index(void)
+{
+    int ret;
+    uint32_t n = 20;
+    double max_time[] = { 0.1, DBL_MAX };
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    msp_t msp;
+    int j;
+
+    ret = build_sim(&msp, &tables, rng, 100, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.5), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_discrete_genome(&msp, true), 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < 2; j++) {
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, max_time[j], ULONG_MAX);
+        CU_ASSERT_FATAL(ret >= 0);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        /* Discrete coordinates give many ties, which must be broken by time */
+        verify_edge_index(&tables);
+    }
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_spill_tables(void)
+{
+    int ret;
+    int j;
+    uint32_t n = 20;
+    size_t block_size = 16;
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables[2];
+    size_t num_edges, num_migrations;
+    msp_t msp;
+
+    for (j = 0; j < 2; j++) {
+        gsl_rng_set(rng, 5);
+        ret = build_sim(&msp, &tables[j], rng, 100, 2, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_migration_matrix(&msp, 4, migration_matrix), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_store_migrations(&msp, true), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_store_full_arg(&msp, true), 0);
+        if (j == 1) {
+            CU_ASSERT_EQUAL_FATAL(msp_set_spill_block_size(&msp, block_size), 0);
+        }
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_set_spill_block_size(&msp, block_size), MSP_ERR_BAD_STATE);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        num_edges = msp_get_num_edges(&msp);
+        num_migrations = msp_get_num_migrations(&msp);
+        if (j == 1) {
+            /* Only a partial block is left in memory */
+            CU_ASSERT_TRUE(tables[j].nodes.num_rows - n < block_size);
+            CU_ASSERT_TRUE(tables[j].edges.num_rows < block_size);
+            CU_ASSERT_TRUE(tables[j].migrations.num_rows < block_size);
+            CU_ASSERT_TRUE(msp.spill.num_nodes > 0);
+            CU_ASSERT_TRUE(num_edges > block_size);
+            CU_ASSERT_TRUE(num_migrations > block_size);
+        }
+        msp_print_state(&msp, _devnull);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(tables[j].edges.num_rows, num_edges);
+        CU_ASSERT_EQUAL(tables[j].migrations.num_rows, num_migrations);
+        CU_ASSERT_EQUAL(msp_get_num_edges(&msp), num_edges);
+        msp_free(&msp);
+    }
+    CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+
+    gsl_rng_free(rng);
+    for (j = 0; j < 2; j++) {
+        tsk_table_collection_free(&tables[j]);
+    }
+}
+
+static void
+test_spill_tables_bounded_memory(void)
+{
+    int ret;
+    uint32_t n = 20;
+    size_t block_size = 64;
+    tsk_size_t max_edge_rows = 0;
+    tsk_size_t max_migration_rows = 0;
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    size_t num_edges;
+    msp_t msp;
+
+    gsl_rng_set(rng, 5);
+    ret = build_sim(&msp, &tables, rng, 1000, 2, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_migration_matrix(&msp, 4, migration_matrix), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_store_migrations(&msp, true), 0);
+    /* Presizing would otherwise reserve room for all the rows up front */
+    CU_ASSERT_EQUAL_FATAL(msp_set_presize_tables(&msp, true), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_spill_block_size(&msp, block_size), 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* Stop before the end so that uncoalesced edges are added */
+    do {
+        ret = msp_run(&msp, DBL_MAX, 1);
+        CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_EVENTS);
+        max_edge_rows = TSK_MAX(max_edge_rows, tables.edges.max_rows);
+        max_migration_rows = TSK_MAX(max_migration_rows, tables.migrations.max_rows);
+        num_edges = msp_get_num_edges(&msp);
+    } while (num_edges < 16 * block_size);
+    /* The in-memory tables stay within a small multiple of the block size */
+    CU_ASSERT_TRUE(max_edge_rows <= 4 * block_size);
+    CU_ASSERT_TRUE(max_migration_rows <= 2 * block_size);
+
+    ret = msp_finalise_tables(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(tables.edges.num_rows > num_edges);
+    /* The edge table is grown once, to hold the spilled and uncoalesced
+     * edges, and is not expanded again afterwards. */
+    CU_ASSERT_TRUE(tables.edges.max_rows < 2 * tables.edges.num_rows);
+
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+verify_spilled_column(msp_t *msp, int column, const void *expected, size_t size,
+    size_t num_rows)
+{
+    void *buff = malloc(num_rows * size + 1);
+    size_t num_read;
+
+    CU_ASSERT_FATAL(buff != NULL);
+    num_read = fread(buff, size, num_rows, msp->spill.files[column]);
+    CU_ASSERT_EQUAL_FATAL(num_read, num_rows);
+    CU_ASSERT_EQUAL(memcmp(buff, expected, num_rows * size), 0);
+    free(buff);
+}
+
+static void
+test_spill_finalise(void)
+{
+    int ret;
+    int j, k;
+    uint32_t n = 20;
+    size_t block_size = 32;
+    size_t num_events = 2000;
+    tsk_size_t num_nodes, num_edges, num_migrations;
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables[2];
+    msp_t msp[2];
+
+    for (j = 0; j < 2; j++) {
+        gsl_rng_set(rng, 5);
+        ret = build_sim(&msp[j], &tables[j], rng, 1000, 2, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp[j], 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(
+            msp_set_migration_matrix(&msp[j], 4, migration_matrix), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_store_migrations(&msp[j], true), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_store_full_arg(&msp[j], true), 0);
+        if (j == 1) {
+            CU_ASSERT_EQUAL_FATAL(msp_set_spill_block_size(&msp[j], block_size), 0);
+        }
+        ret = msp_initialise(&msp[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        if (j == 0) {
+            CU_ASSERT_EQUAL(msp_finalise_spill(&msp[j]), MSP_ERR_BAD_PARAM_VALUE);
+        }
+        /* Stop before the end so that uncoalesced edges are added */
+        for (k = 0; k < (int) num_events; k++) {
+            ret = msp_run(&msp[j], DBL_MAX, 1);
+            CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_EVENTS);
+            if (j == 1) {
+                CU_ASSERT_TRUE(tables[j].nodes.num_rows - n <= block_size);
+                CU_ASSERT_TRUE(tables[j].edges.num_rows <= block_size);
+                CU_ASSERT_TRUE(tables[j].migrations.num_rows <= block_size);
+            }
+        }
+    }
+    CU_ASSERT_TRUE(msp[1].spill.num_nodes > 0);
+    CU_ASSERT_EQUAL(msp_get_num_nodes(&msp[0]), msp_get_num_nodes(&msp[1]));
+    CU_ASSERT_EQUAL(msp_get_num_edges(&msp[0]), msp_get_num_edges(&msp[1]));
+
+    ret = msp_finalise_tables(&msp[0]);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_finalise_spill(&msp[1]);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* Only the input rows are left in memory; the uncoalesced rows, which
+     * are bounded by the live segments, have been spilled too. */
+    CU_ASSERT_EQUAL(tables[1].nodes.num_rows, n);
+    CU_ASSERT_EQUAL(tables[1].edges.num_rows, 0);
+    CU_ASSERT_EQUAL(tables[1].migrations.num_rows, 0);
+
+    num_nodes = tables[0].nodes.num_rows - n;
+    num_edges = tables[0].edges.num_rows;
+    num_migrations = tables[0].migrations.num_rows;
+    CU_ASSERT_EQUAL_FATAL(msp[1].spill.num_nodes, num_nodes);
+    CU_ASSERT_EQUAL_FATAL(msp[1].spill.num_edges, num_edges);
+    CU_ASSERT_EQUAL_FATAL(msp[1].spill.num_migrations, num_migrations);
+    verify_spilled_column(&msp[1], MSP_SPILL_NODES_FLAGS, tables[0].nodes.flags + n,
+        sizeof(tsk_flags_t), num_nodes);
+    verify_spilled_column(&msp[1], MSP_SPILL_NODES_TIME, tables[0].nodes.time + n,
+        sizeof(double), num_nodes);
+    verify_spilled_column(&msp[1], MSP_SPILL_NODES_POPULATION,
+        tables[0].nodes.population + n, sizeof(tsk_id_t), num_nodes);
+    verify_spilled_column(&msp[1], MSP_SPILL_NODES_INDIVIDUAL,
+        tables[0].nodes.individual + n, sizeof(tsk_id_t), num_nodes);
+    verify_spilled_column(&msp[1], MSP_SPILL_EDGES_LEFT, tables[0].edges.left,
+        sizeof(double), num_edges);
+    verify_spilled_column(&msp[1], MSP_SPILL_EDGES_RIGHT, tables[0].edges.right,
+        sizeof(double), num_edges);
+    verify_spilled_column(&msp[1], MSP_SPILL_EDGES_PARENT, tables[0].edges.parent,
+        sizeof(tsk_id_t), num_edges);
+    verify_spilled_column(&msp[1], MSP_SPILL_EDGES_CHILD, tables[0].edges.child,
+        sizeof(tsk_id_t), num_edges);
+    verify_spilled_column(&msp[1], MSP_SPILL_MIGRATIONS_LEFT,
+        tables[0].migrations.left, sizeof(double), num_migrations);
+    verify_spilled_column(&msp[1], MSP_SPILL_MIGRATIONS_NODE,
+        tables[0].migrations.node, sizeof(tsk_id_t), num_migrations);
+    verify_spilled_column(&msp[1], MSP_SPILL_MIGRATIONS_TIME,
+        tables[0].migrations.time, sizeof(double), num_migrations);
+
+    /* Resetting discards the spilled rows */
+    ret = msp_reset(&msp[1]);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(msp[1].spill.num_nodes, 0);
+    CU_ASSERT_EQUAL(msp_get_num_nodes(&msp[1]), n);
+
+    gsl_rng_free(rng);
+    for (j = 0; j < 2; j++) {
+        msp_free(&msp[j]);
+        tsk_table_collection_free(&tables[j]);
+    }
+}
+
+static void
+test_rng_buffer(void)
+{
+    int ret;
+    int j;
+    uint32_t n = 20;
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables[2];
+    msp_t msp;
+
+    for (j = 0; j < 2; j++) {
+        gsl_rng_set(rng, 5);
+        ret = build_sim(&msp, &tables[j], rng, 100, 2, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_migration_matrix(&msp, 4, migration_matrix), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_tract_length(&msp, 5), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_rng_buffer_size(&msp, 64), 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_print_state(&msp, _devnull);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = tsk_table_collection_check_integrity(&tables[j], 0);
+        CU_ASSERT_EQUAL(ret, 0);
+        if (j == 1) {
+            /* Any variates left over in the buffer are discarded on reset */
+            gsl_rng_set(rng, 5);
+            ret = msp_reset(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_finalise_tables(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        msp_free(&msp);
+    }
+    CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+
+    gsl_rng_free(rng);
+    for (j = 0; j < 2; j++) {
+        tsk_table_collection_free(&tables[j]);
+    }
+}
+
 static void
 test_floating_point_extremes(void)
 {
@@ -4322,10 +5279,14 @@ main(int argc, char **argv)
 
         { "test_multi_locus_simulation", test_multi_locus_simulation },
         { "test_multi_locus_bottleneck_arg", test_multi_locus_bottleneck_arg },
+        { "test_mutations_during_simulation", test_mutations_during_simulation },
         { "test_multi_locus_store_unary_simple", test_multi_locus_store_unary_simple },
 
         { "test_dtwf_single_locus_simulation", test_dtwf_single_locus_simulation },
         { "test_dtwf_multi_locus_simulation", test_dtwf_multi_locus_simulation },
+        { "test_dtwf_large_population", test_dtwf_large_population },
+        { "test_dtwf_hybrid_switch", test_dtwf_hybrid_switch },
+        { "test_dtwf_population_runner", test_dtwf_population_runner },
         { "test_dtwf_deterministic", test_dtwf_deterministic },
         { "test_dtwf_simultaneous_historical_samples",
             test_dtwf_simultaneous_historical_samples },
@@ -4350,6 +5311,9 @@ main(int argc, char **argv)
         { "test_multiple_mergers_growth_rate", test_multiple_mergers_growth_rate },
         { "test_dirac_coalescent_bad_parameters", test_dirac_coalescent_bad_parameters },
         { "test_beta_coalescent_bad_parameters", test_beta_coalescent_bad_parameters },
+        { "test_beta_coalescent_large_mergers", test_beta_coalescent_large_mergers },
+        { "test_beta_merger_size_samplers", test_beta_merger_size_samplers },
+        { "test_multiple_merger_rate_cache", test_multiple_merger_rate_cache },
         { "test_multiple_mergers_unary_nodes", test_multiple_mergers_unary_nodes },
 
         { "test_simulator_getters_setters", test_simulator_getters_setters },
@@ -4370,6 +5334,15 @@ main(int argc, char **argv)
         { "test_deactivate_population_event_errors",
             test_deactivate_population_event_errors },
         { "test_time_travel_error", test_time_travel_error },
+        { "test_table_presizing", test_table_presizing },
+        { "test_table_capacity_overshoot", test_table_capacity_overshoot },
+        { "test_table_presizing_cap", test_table_presizing_cap },
+        { "test_finalise_modes", test_finalise_modes },
+        { "test_edge_index", test_edge_index },
+        { "test_spill_tables", test_spill_tables },
+        { "test_spill_tables_bounded_memory", test_spill_tables_bounded_memory },
+        { "test_spill_finalise", test_spill_finalise },
+        { "test_rng_buffer", test_rng_buffer },
         { "test_floating_point_extremes", test_floating_point_extremes },
         { "test_simulation_replicates", test_simulation_replicates },
         { "test_bottleneck_simulation", test_bottleneck_simulation },
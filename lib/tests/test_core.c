@@ -163,6 +163,132 @@ test_gsl_ran_flat_patch(void)
     gsl_rng_free(rng);
 }
 
+static void
+test_philox_rng(void)
+{
+    /* Known answer for a zero counter and key, from Random123 */
+    unsigned long expected[] = { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 };
+    unsigned long stream0[8], x;
+    double u;
+    int j, ret;
+    bool differs;
+    gsl_rng *rng = gsl_rng_alloc(msp_rng_philox);
+    gsl_rng *mt = gsl_rng_alloc(gsl_rng_mt19937);
+
+    CU_ASSERT_FATAL(rng != NULL);
+    CU_ASSERT_FATAL(mt != NULL);
+    gsl_rng_set(rng, 0);
+    for (j = 0; j < 4; j++) {
+        CU_ASSERT_EQUAL(gsl_rng_get(rng), expected[j]);
+    }
+
+    gsl_rng_set(rng, 1234);
+    for (j = 0; j < 8; j++) {
+        stream0[j] = gsl_rng_get(rng);
+    }
+    ret = msp_rng_set_stream(rng, 1234, 0);
+    CU_ASSERT_EQUAL(ret, 0);
+    for (j = 0; j < 8; j++) {
+        CU_ASSERT_EQUAL(gsl_rng_get(rng), stream0[j]);
+    }
+    ret = msp_rng_set_stream(rng, 1234, 1);
+    CU_ASSERT_EQUAL(ret, 0);
+    differs = false;
+    for (j = 0; j < 8; j++) {
+        x = gsl_rng_get(rng);
+        differs = differs || x != stream0[j];
+    }
+    CU_ASSERT_TRUE(differs);
+
+    for (j = 0; j < 1000; j++) {
+        u = gsl_rng_uniform(rng);
+        CU_ASSERT(u >= 0 && u < 1);
+    }
+
+    ret = msp_rng_set_stream(mt, 1234, 1);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+
+    gsl_rng_free(rng);
+    gsl_rng_free(mt);
+}
+
+static void
+test_alias_table(void)
+{
+    double probs[] = { 0.1, 0.0, 0.4, 0.25, 0.0, 0.25 };
+    size_t n = sizeof(probs) / sizeof(*probs);
+    size_t counts[6];
+    size_t num_points = 100000;
+    double zero = 0;
+    alias_table_t table;
+    size_t j, k;
+    int ret;
+
+    ret = alias_table_alloc(&table, n, probs);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    memset(counts, 0, sizeof(counts));
+    /* An evenly spaced grid of variates hits each outcome in proportion
+     * to its probability */
+    for (j = 0; j < num_points; j++) {
+        k = alias_table_sample(&table, ((double) j + 0.5) / (double) num_points);
+        CU_ASSERT_FATAL(k < n);
+        counts[k]++;
+    }
+    for (k = 0; k < n; k++) {
+        CU_ASSERT_DOUBLE_EQUAL(
+            (double) counts[k] / (double) num_points, probs[k], 1e-4);
+    }
+    CU_ASSERT_EQUAL(counts[1], 0);
+    CU_ASSERT_EQUAL(counts[4], 0);
+    CU_ASSERT(alias_table_sample(&table, 0) < n);
+    CU_ASSERT(alias_table_sample(&table, nextafter(1, 0)) < n);
+    alias_table_free(&table);
+
+    ret = alias_table_alloc(&table, 1, &zero);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    alias_table_free(&table);
+    ret = alias_table_alloc(&table, 0, probs);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    alias_table_free(&table);
+}
+
+static void
+test_rng_buffer_uniform_int(void)
+{
+    unsigned long n[] = { 1, 3, 10, (1UL << 31) + 1, 1UL << 32 };
+    unsigned long k;
+    size_t j, l;
+    int ret;
+    rng_buffer_t buffer;
+    gsl_rng *rng = gsl_rng_alloc(msp_rng_philox);
+
+    CU_ASSERT_FATAL(rng != NULL);
+    gsl_rng_set(rng, 42);
+    ret = rng_buffer_alloc(&buffer, rng, 16);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* For n = 3, 2^32 mod 3 = 1 value must be rejected, which is zero. The
+     * largest uniform maps to n - 1, and never to n. */
+    buffer.uniforms[0] = 0;
+    buffer.uniforms[1] = 0.5;
+    buffer.uniforms[2] = 4294967295.0 / 4294967296.0;
+    buffer.uniform_position = 0;
+    CU_ASSERT_EQUAL(rng_buffer_uniform_int(&buffer, 3), 1);
+    CU_ASSERT_EQUAL(buffer.uniform_position, 2);
+    CU_ASSERT_EQUAL(rng_buffer_uniform_int(&buffer, 3), 2);
+
+    rng_buffer_clear(&buffer);
+    for (l = 0; l < sizeof(n) / sizeof(*n); l++) {
+        for (j = 0; j < 1000; j++) {
+            k = rng_buffer_uniform_int(&buffer, n[l]);
+            CU_ASSERT_FATAL(k < n[l]);
+        }
+    }
+
+    rng_buffer_free(&buffer);
+    gsl_rng_free(rng);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -172,6 +298,9 @@ main(int argc, char **argv)
         { "test_probability_list_select", test_probability_list_select },
         { "test_tskit_version", test_tskit_version },
         { "test_gsl_ran_flat_patch", test_gsl_ran_flat_patch },
+        { "test_philox_rng", test_philox_rng },
+        { "test_alias_table", test_alias_table },
+        { "test_rng_buffer_uniform_int", test_rng_buffer_uniform_int },
         CU_TEST_INFO_NULL,
     };
 
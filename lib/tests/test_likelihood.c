@@ -144,6 +144,13 @@ test_likelihood_three_leaves(void)
     int ret;
     double rho[] = { 0.1, 1, 10 };
     double theta[] = { 0.1, 1, 10 };
+    double rho_vec[] = { 0.1, 1, 10, 2 };
+    double Ne_vec[] = { 0.5, 0.5, 2, 100 };
+    double lik_vec[4], grad_r_vec[4], grad_Ne_vec[4];
+    size_t num_windows;
+    double lik_plus, lik_minus;
+    double h = 1e-6;
+    arg_likelihood_stats_t stats;
     double ll_exact;
     double lik = 0;
     double tree_length = 19.0 / 8;
@@ -237,6 +244,43 @@ test_likelihood_three_leaves(void)
         CU_ASSERT_EQUAL_FATAL(ret, 0);
         CU_ASSERT_DOUBLE_EQUAL(ll_exact, lik, tol);
     }
+
+    ret = msp_arg_likelihood_stats(&ts, &stats);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(stats.num_recombination_events, 1);
+    CU_ASSERT_EQUAL(stats.num_common_ancestor_events, 3);
+    ret = msp_log_likelihood_arg_stats(&stats, 4, rho_vec, Ne_vec, lik_vec, NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_log_likelihood_arg_stats(
+        &stats, 4, rho_vec, Ne_vec, lik_vec, grad_r_vec, grad_Ne_vec);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (i = 0; i < 4; i++) {
+        ret = msp_log_likelihood_arg(&ts, rho_vec[i], Ne_vec[i], &lik);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_DOUBLE_EQUAL(lik_vec[i], lik, tol);
+        /* Compare the gradients against central differences */
+        ret = msp_log_likelihood_arg(&ts, rho_vec[i] + h, Ne_vec[i], &lik_plus);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_log_likelihood_arg(&ts, rho_vec[i] - h, Ne_vec[i], &lik_minus);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_DOUBLE_EQUAL(grad_r_vec[i], (lik_plus - lik_minus) / (2 * h), 1e-4);
+        ret = msp_log_likelihood_arg(&ts, rho_vec[i], Ne_vec[i] + h, &lik_plus);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_log_likelihood_arg(&ts, rho_vec[i], Ne_vec[i] - h, &lik_minus);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_DOUBLE_EQUAL(grad_Ne_vec[i], (lik_plus - lik_minus) / (2 * h), 1e-4);
+    }
+    rho_vec[0] = 0;
+    ret = msp_log_likelihood_arg_stats(
+        &stats, 4, rho_vec, Ne_vec, lik_vec, grad_r_vec, grad_Ne_vec);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(lik_vec[0], -DBL_MAX);
+    CU_ASSERT_TRUE(isnan(grad_r_vec[0]));
+    CU_ASSERT_TRUE(isnan(grad_Ne_vec[0]));
+    Ne_vec[3] = 0;
+    ret = msp_log_likelihood_arg_stats(&stats, 4, rho_vec, Ne_vec, lik_vec, NULL, NULL);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_POPULATION_SIZE);
+
     for (i = 0; i < 3; i++) {
         ll_exact = (5 * log(tree_length * theta[i]) - tree_length * theta[i]);
         ll_exact -= 2 * log(4 * tree_length);
@@ -246,6 +290,17 @@ test_likelihood_three_leaves(void)
         CU_ASSERT_EQUAL_FATAL(ret, 0);
         CU_ASSERT_DOUBLE_EQUAL(ll_exact, lik, tol);
     }
+    /* The number of windows is capped at the number of trees */
+    for (num_windows = 1; num_windows < 4; num_windows++) {
+        ret = msp_unnormalised_log_likelihood_mut_vector(
+            &ts, 3, theta, lik_vec, num_windows, NULL, NULL);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        for (i = 0; i < 3; i++) {
+            ret = msp_unnormalised_log_likelihood_mut(&ts, theta[i], &lik);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_DOUBLE_EQUAL(lik_vec[i], lik, tol);
+        }
+    }
 
     tsk_treeseq_free(&ts);
     tsk_table_collection_free(&tables);
@@ -590,114 +645,124 @@ test_likelihood_material_gap(void)
     tsk_table_collection_free(&tables);
 }
 
+/* An ARG with two samples and a recombination at time 0.4 in a gap of
+ * length 0.2 in the ancestral material. */
 static void
-test_likelihood_recombination_in_material_gap(void)
+build_material_gap_arg(tsk_table_collection_t *tables)
 {
-    int i;
     int ret;
-    double rho[] = { 0.1, 1, 10 };
-    double theta[] = { 0.1, 1, 10 };
-    double ll_exact;
-    double lik = 0;
-    double tree_length = 1.34;
-    double tol = 1e-9;
-    tsk_table_collection_t tables;
-    tsk_treeseq_t ts;
-    ret = tsk_table_collection_init(&tables, 0);
+
+    ret = tsk_table_collection_init(tables, 0);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
-    tables.sequence_length = 1;
+    tables->sequence_length = 1;
 
     ret = tsk_node_table_add_row(
-        &tables.nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
+        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_node_table_add_row(
-        &tables.nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
+        &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
-    ret = tsk_edge_table_add_row(&tables.edges, 0, 0.3, 2, 0, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 0.3, 2, 0, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables.edges, 0.3, 1, 3, 0, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0.3, 1, 3, 0, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_node_table_add_row(
-        &tables.nodes, MSP_NODE_IS_RE_EVENT, 0.1, 0, TSK_NULL, NULL, 0);
+        &tables->nodes, MSP_NODE_IS_RE_EVENT, 0.1, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_node_table_add_row(
-        &tables.nodes, MSP_NODE_IS_RE_EVENT, 0.1, 0, TSK_NULL, NULL, 0);
+        &tables->nodes, MSP_NODE_IS_RE_EVENT, 0.1, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
-    ret = tsk_edge_table_add_row(&tables.edges, 0.3, 0.5, 4, 3, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0.3, 0.5, 4, 3, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables.edges, 0.5, 1, 5, 3, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0.5, 1, 5, 3, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_node_table_add_row(
-        &tables.nodes, MSP_NODE_IS_RE_EVENT, 0.2, 0, TSK_NULL, NULL, 0);
+        &tables->nodes, MSP_NODE_IS_RE_EVENT, 0.2, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_node_table_add_row(
-        &tables.nodes, MSP_NODE_IS_RE_EVENT, 0.2, 0, TSK_NULL, NULL, 0);
+        &tables->nodes, MSP_NODE_IS_RE_EVENT, 0.2, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
-    ret = tsk_edge_table_add_row(&tables.edges, 0, 0.3, 6, 2, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 0.3, 6, 2, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables.edges, 0.5, 1, 6, 5, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0.5, 1, 6, 5, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(&tables.nodes, 0, 0.3, 0, TSK_NULL, NULL, 0);
+    ret = tsk_node_table_add_row(&tables->nodes, 0, 0.3, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
-    ret = tsk_edge_table_add_row(&tables.edges, 0, 0.3, 7, 6, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 0.3, 7, 6, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables.edges, 0.5, 1, 8, 6, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0.5, 1, 8, 6, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_node_table_add_row(
-        &tables.nodes, MSP_NODE_IS_RE_EVENT, 0.4, 0, TSK_NULL, NULL, 0);
+        &tables->nodes, MSP_NODE_IS_RE_EVENT, 0.4, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_node_table_add_row(
-        &tables.nodes, MSP_NODE_IS_RE_EVENT, 0.4, 0, TSK_NULL, NULL, 0);
+        &tables->nodes, MSP_NODE_IS_RE_EVENT, 0.4, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
-    ret = tsk_edge_table_add_row(&tables.edges, 0.3, 0.5, 9, 4, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0.3, 0.5, 9, 4, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables.edges, 0.5, 1, 9, 8, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0.5, 1, 9, 8, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(&tables.nodes, 0, 0.5, 0, TSK_NULL, NULL, 0);
+    ret = tsk_node_table_add_row(&tables->nodes, 0, 0.5, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
-    ret = tsk_edge_table_add_row(&tables.edges, 0, 1, 10, 1, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 10, 1, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables.edges, 0, 0.3, 10, 7, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 0.3, 10, 7, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(&tables.nodes, 0, 0.6, 0, TSK_NULL, NULL, 0);
+    ret = tsk_node_table_add_row(&tables->nodes, 0, 0.6, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
-    ret = tsk_edge_table_add_row(&tables.edges, 0.3, 1, 11, 9, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0.3, 1, 11, 9, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_edge_table_add_row(&tables.edges, 0.3, 1, 11, 10, NULL, 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0.3, 1, 11, 10, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_node_table_add_row(&tables.nodes, 0, 0.7, 0, TSK_NULL, NULL, 0);
+    ret = tsk_node_table_add_row(&tables->nodes, 0, 0.7, 0, TSK_NULL, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
     ret = tsk_mutation_table_add_row(
-        &tables.mutations, 0, 2, -1, TSK_UNKNOWN_TIME, "C", 1, NULL, 0);
+        &tables->mutations, 0, 2, -1, TSK_UNKNOWN_TIME, "C", 1, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_mutation_table_add_row(
-        &tables.mutations, 1, 3, -1, TSK_UNKNOWN_TIME, "C", 1, NULL, 0);
+        &tables->mutations, 1, 3, -1, TSK_UNKNOWN_TIME, "C", 1, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_mutation_table_add_row(
-        &tables.mutations, 2, 6, -1, TSK_UNKNOWN_TIME, "C", 1, NULL, 0);
+        &tables->mutations, 2, 6, -1, TSK_UNKNOWN_TIME, "C", 1, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
     ret = tsk_mutation_table_add_row(
-        &tables.mutations, 3, 5, -1, TSK_UNKNOWN_TIME, "C", 1, NULL, 0);
+        &tables->mutations, 3, 5, -1, TSK_UNKNOWN_TIME, "C", 1, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
-    ret = tsk_site_table_add_row(&tables.sites, 0.1, "A", 1, NULL, 0);
+    ret = tsk_site_table_add_row(&tables->sites, 0.1, "A", 1, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_site_table_add_row(&tables.sites, 0.35, "A", 1, NULL, 0);
+    ret = tsk_site_table_add_row(&tables->sites, 0.35, "A", 1, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_site_table_add_row(&tables.sites, 0.6, "A", 1, NULL, 0);
+    ret = tsk_site_table_add_row(&tables->sites, 0.6, "A", 1, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
-    ret = tsk_site_table_add_row(&tables.sites, 0.8, "A", 1, NULL, 0);
+    ret = tsk_site_table_add_row(&tables->sites, 0.8, "A", 1, NULL, 0);
     CU_ASSERT_FATAL(ret >= 0);
 
-    tsk_population_table_add_row(&tables.populations, NULL, 0);
+    tsk_population_table_add_row(&tables->populations, NULL, 0);
+}
+
+static void
+test_likelihood_recombination_in_material_gap(void)
+{
+    int i;
+    int ret;
+    double rho[] = { 0.1, 1, 10 };
+    double theta[] = { 0.1, 1, 10 };
+    double ll_exact;
+    double lik = 0;
+    double tree_length = 1.34;
+    double tol = 1e-9;
+    tsk_table_collection_t tables;
+    tsk_treeseq_t ts;
+    build_material_gap_arg(&tables);
     ret = tsk_treeseq_init(&ts, &tables, TSK_TS_INIT_BUILD_INDEXES);
     CU_ASSERT_EQUAL_FATAL(ret, 0);
 
@@ -726,6 +791,318 @@ test_likelihood_recombination_in_material_gap(void)
     tsk_table_collection_free(&tables);
 }
 
+static void
+test_likelihood_incremental(void)
+{
+    int ret;
+    size_t j, num_moves;
+    tsk_id_t u;
+    double lik, lik_direct, lik_initial, t, new_time, lower, upper;
+    double r = 0.05;
+    double Ne = 2;
+    double tol = 1e-8;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables, moved_tables;
+    tsk_treeseq_t ts, moved_ts;
+    arg_likelihood_t engine;
+    arg_event_t *event, *moved;
+
+    gsl_rng_set(rng, 5);
+    ret = build_sim(&msp, &tables, rng, 10, 1, NULL, 8);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, r), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_store_full_arg(&msp, true), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_initialise(&msp), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_run(&msp, DBL_MAX, UINT32_MAX), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_finalise_tables(&msp), 0);
+    ret = tsk_treeseq_init(&ts, &tables, TSK_TS_INIT_BUILD_INDEXES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = arg_likelihood_alloc(&engine, &ts, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_log_likelihood_arg(&ts, r, Ne, &lik_initial);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_DOUBLE_EQUAL(lik, lik_initial, tol);
+    arg_likelihood_print_state(&engine, _devnull);
+
+    /* Move each common ancestor node to a random time between its children
+     * and its parents, and compare with the likelihood of the edited ARG */
+    num_moves = 0;
+    for (u = 0; u < (tsk_id_t) tables.nodes.num_rows; u++) {
+        if (tables.nodes.flags[u] & (TSK_NODE_IS_SAMPLE | MSP_NODE_IS_RE_EVENT)) {
+            continue;
+        }
+        t = tables.nodes.time[u];
+        lower = 0;
+        upper = DBL_MAX;
+        for (j = 0; j < tables.edges.num_rows; j++) {
+            if (tables.edges.parent[j] == u) {
+                lower = GSL_MAX(lower, tables.nodes.time[tables.edges.child[j]]);
+            }
+            if (tables.edges.child[j] == u) {
+                upper = GSL_MIN(upper, tables.nodes.time[tables.edges.parent[j]]);
+            }
+        }
+        if (upper == DBL_MAX) {
+            continue;
+        }
+        new_time = lower + gsl_rng_uniform_pos(rng) * (upper - lower);
+
+        ret = tsk_table_collection_copy(&tables, &moved_tables, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        moved_tables.nodes.time[u] = new_time;
+        ret = tsk_table_collection_sort(&moved_tables, NULL, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = tsk_treeseq_init(&moved_ts, &moved_tables, TSK_TS_INIT_BUILD_INDEXES);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_log_likelihood_arg(&moved_ts, r, Ne, &lik_direct);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        event = arg_likelihood_find_event(&engine, t);
+        CU_ASSERT_FATAL(event != NULL);
+        CU_ASSERT_EQUAL_FATAL(event->time, t);
+        CU_ASSERT_FALSE(event->recombination);
+        ret = arg_likelihood_move_event(&engine, event, new_time, &moved);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(moved->time, new_time);
+        ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_DOUBLE_EQUAL(lik, lik_direct, tol);
+
+        /* Rolling back restores the original ARG exactly */
+        arg_likelihood_rollback(&engine);
+        ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(lik, lik_initial);
+        CU_ASSERT_EQUAL(arg_likelihood_find_event(&engine, t)->time, t);
+
+        tsk_treeseq_free(&moved_ts);
+        tsk_table_collection_free(&moved_tables);
+        num_moves++;
+    }
+    CU_ASSERT_TRUE(num_moves > 5);
+
+    /* Committed edits are kept, and moving back returns to the start */
+    event = arg_likelihood_find_event(&engine, 0);
+    while (event->recombination) {
+        event = arg_likelihood_find_event(&engine, event->time + 1e-12);
+    }
+    t = event->time;
+    ret = arg_likelihood_move_event(&engine, event, t / 2, &moved);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    arg_likelihood_commit(&engine);
+    arg_likelihood_rollback(&engine);
+    ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_NOT_EQUAL(lik, lik_initial);
+    ret = arg_likelihood_move_event(&engine, moved, t, &event);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    arg_likelihood_commit(&engine);
+    ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_DOUBLE_EQUAL(lik, lik_initial, tol);
+
+    /* Inserting an event and then removing it changes nothing */
+    ret = arg_likelihood_insert_event(&engine, t / 3, true, 0.5, &event);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_DOUBLE_EQUAL(lik, lik_initial + log(r * 0.5), tol);
+    ret = arg_likelihood_remove_event(&engine, event);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_DOUBLE_EQUAL(lik, lik_initial, tol);
+    arg_likelihood_commit(&engine);
+
+    /* Errors */
+    ret = arg_likelihood_insert_event(&engine, -1, false, 0, &event);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    ret = arg_likelihood_insert_event(&engine, INFINITY, false, 0, &event);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    event = arg_likelihood_find_event(&engine, 0);
+    ret = arg_likelihood_remove_event(&engine, event);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    ret = arg_likelihood_shift(&engine, event, event, 1, 0);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    CU_ASSERT_EQUAL(arg_likelihood_find_event(&engine, DBL_MAX), NULL);
+
+    arg_likelihood_free(&engine);
+    tsk_treeseq_free(&ts);
+    msp_free(&msp);
+    tsk_table_collection_free(&tables);
+    gsl_rng_free(rng);
+}
+
+static void
+test_likelihood_incremental_move_recombination(void)
+{
+    int ret;
+    size_t j;
+    double lik, lik_direct, lik_initial;
+    double new_times[] = { 0.35, 0.45 };
+    double r = 0.5;
+    double Ne = 0.5;
+    double tol = 1e-9;
+    tsk_table_collection_t tables, moved_tables;
+    tsk_treeseq_t ts, moved_ts;
+    arg_likelihood_t engine;
+    arg_event_t *event, *moved;
+
+    build_material_gap_arg(&tables);
+    ret = tsk_treeseq_init(&ts, &tables, TSK_TS_INIT_BUILD_INDEXES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = arg_likelihood_alloc(&engine, &ts, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_log_likelihood_arg(&ts, r, Ne, &lik_initial);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < 2; j++) {
+        /* The recombination at time 0.4 falls in a gap of length 0.2, so
+         * its log(0.2) term must move with it */
+        ret = tsk_table_collection_copy(&tables, &moved_tables, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        moved_tables.nodes.time[7] = new_times[j];
+        moved_tables.nodes.time[8] = new_times[j];
+        ret = tsk_treeseq_init(&moved_ts, &moved_tables, TSK_TS_INIT_BUILD_INDEXES);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_log_likelihood_arg(&moved_ts, r, Ne, &lik_direct);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        event = arg_likelihood_find_event(&engine, 0.4);
+        CU_ASSERT_FATAL(event != NULL);
+        CU_ASSERT_TRUE(event->recombination);
+        CU_ASSERT_DOUBLE_EQUAL(event->log_gap, log(0.2), tol);
+        ret = arg_likelihood_move_event(&engine, event, new_times[j], &moved);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_DOUBLE_EQUAL(moved->log_gap, log(0.2), tol);
+        ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_DOUBLE_EQUAL(lik, lik_direct, tol);
+
+        /* Committing keeps the term; moving back returns to the start */
+        arg_likelihood_commit(&engine);
+        ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_DOUBLE_EQUAL(lik, lik_direct, tol);
+        ret = arg_likelihood_move_event(&engine, moved, 0.4, &event);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        arg_likelihood_commit(&engine);
+        ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_DOUBLE_EQUAL(lik, lik_initial, tol);
+
+        tsk_treeseq_free(&moved_ts);
+        tsk_table_collection_free(&moved_tables);
+    }
+
+    arg_likelihood_free(&engine);
+    tsk_treeseq_free(&ts);
+    tsk_table_collection_free(&tables);
+}
+
+/* A tree on three samples over [0, 1), in which node 3 at time t3 is the
+ * parent of samples 0 and 1, and the root 4 at time t4 is the parent of
+ * node 3 and sample 2. */
+static void
+build_three_leaf_tree(tsk_table_collection_t *tables, double t3, double t4)
+{
+    int ret;
+    int j;
+
+    ret = tsk_table_collection_init(tables, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    tables->sequence_length = 1;
+    for (j = 0; j < 3; j++) {
+        ret = tsk_node_table_add_row(
+            &tables->nodes, TSK_NODE_IS_SAMPLE, 0.0, 0, TSK_NULL, NULL, 0);
+        CU_ASSERT_FATAL(ret >= 0);
+    }
+    ret = tsk_node_table_add_row(&tables->nodes, 0, t3, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_node_table_add_row(&tables->nodes, 0, t4, 0, TSK_NULL, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 3, 0, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 3, 1, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 4, 2, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    ret = tsk_edge_table_add_row(&tables->edges, 0, 1, 4, 3, NULL, 0);
+    CU_ASSERT_FATAL(ret >= 0);
+    tsk_population_table_add_row(&tables->populations, NULL, 0);
+}
+
+static void
+test_likelihood_incremental_prune_regraft(void)
+{
+    int ret;
+    size_t j;
+    double lik, lik_direct, lik_initial;
+    double regraft_times[] = { 0.5, 1.5 };
+    double r = 0.1;
+    double Ne = 2;
+    double tol = 1e-9;
+    tsk_table_collection_t tables, spr_tables;
+    tsk_treeseq_t ts, spr_ts;
+    arg_likelihood_t engine;
+    arg_event_t *event, *regraft;
+
+    build_three_leaf_tree(&tables, 1, 2);
+    ret = tsk_treeseq_init(&ts, &tables, TSK_TS_INIT_BUILD_INDEXES);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = arg_likelihood_alloc(&engine, &ts, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_log_likelihood_arg(&ts, r, Ne, &lik_initial);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < 2; j++) {
+        /* Prune sample 1 from node 3 and regraft it onto the branch above
+         * sample 0 or sample 2 at the new time. Either way the tree has
+         * the same coalescence times and so the same likelihood. */
+        build_three_leaf_tree(&spr_tables, regraft_times[j], 2);
+        ret = tsk_treeseq_init(&spr_ts, &spr_tables, TSK_TS_INIT_BUILD_INDEXES);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_log_likelihood_arg(&spr_ts, r, Ne, &lik_direct);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        event = arg_likelihood_find_event(&engine, 1);
+        CU_ASSERT_FATAL(event != NULL);
+        ret = arg_likelihood_prune_regraft(
+            &engine, event, regraft_times[j], 1, 0, &regraft);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(regraft->time, regraft_times[j]);
+        CU_ASSERT_FALSE(regraft->recombination);
+        CU_ASSERT_NOT_EQUAL(arg_likelihood_find_event(&engine, 1)->time, 1);
+        ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_DOUBLE_EQUAL(lik, lik_direct, tol);
+
+        arg_likelihood_rollback(&engine);
+        ret = arg_likelihood_get_log_likelihood(&engine, r, Ne, &lik);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(lik, lik_initial);
+        CU_ASSERT_EQUAL(arg_likelihood_find_event(&engine, 0)->time, 1);
+
+        tsk_treeseq_free(&spr_ts);
+        tsk_table_collection_free(&spr_tables);
+    }
+
+    /* Recombination events can't be pruned */
+    ret = arg_likelihood_insert_event(&engine, 0.5, true, 0, &event);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = arg_likelihood_prune_regraft(&engine, event, 0.75, 1, 0, &regraft);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    arg_likelihood_rollback(&engine);
+
+    arg_likelihood_free(&engine);
+    tsk_treeseq_free(&ts);
+    tsk_table_collection_free(&tables);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -738,6 +1115,11 @@ main(int argc, char **argv)
         { "test_likelihood_material_gap", test_likelihood_material_gap },
         { "test_likelihood_recombination_in_material_gap",
             test_likelihood_recombination_in_material_gap },
+        { "test_likelihood_incremental", test_likelihood_incremental },
+        { "test_likelihood_incremental_move_recombination",
+            test_likelihood_incremental_move_recombination },
+        { "test_likelihood_incremental_prune_regraft",
+            test_likelihood_incremental_prune_regraft },
         CU_TEST_INFO_NULL,
     };
 
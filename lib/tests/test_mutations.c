@@ -138,6 +138,75 @@ test_mutgen_simple_map(void)
     gsl_rng_free(rng);
 }
 
+static void
+test_mutgen_fine_scale_map(void)
+{
+    int ret = 0;
+    mutgen_t mutgen;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    mutation_model_t mut_model;
+    tsk_table_collection_t tables;
+    double pos[201];
+    double rate[200];
+    double x;
+    tsk_size_t j;
+    size_t k, phase;
+
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_BINARY);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* Half unit intervals, alternating between zero and non-zero rates,
+     * starting with a zero rate at the integers when phase is 0. */
+    for (phase = 0; phase < 2; phase++) {
+        for (k = 0; k < 200; k++) {
+            pos[k] = 0.5 * (double) k;
+            rate[k] = (k % 2 == phase) ? 0.0 : 1.0;
+        }
+        pos[200] = 100;
+        ret = tsk_table_collection_init(&tables, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        insert_single_tree(&tables, ALPHABET_BINARY);
+        tables.sequence_length = 100;
+        for (j = 0; j < tables.edges.num_rows; j++) {
+            tables.edges.right[j] = 100;
+        }
+
+        ret = mutgen_alloc(&mutgen, rng, &tables, &mut_model, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = mutgen_set_rate_map(&mutgen, 200, pos, rate);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        ret = mutgen_generate(&mutgen, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(tables.sites.num_rows > 10);
+        for (j = 0; j < tables.sites.num_rows; j++) {
+            x = tables.sites.position[j];
+            CU_ASSERT_EQUAL(rate[(size_t) (2 * x)], 1.0);
+        }
+
+        /* Each integer gets the rate of the interval it's in */
+        ret = mutgen_generate(&mutgen, MSP_DISCRETE_SITES);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        if (phase == 0) {
+            CU_ASSERT_EQUAL(tables.sites.num_rows, 0);
+        } else {
+            CU_ASSERT_TRUE(tables.sites.num_rows > 10);
+        }
+        for (j = 0; j < tables.sites.num_rows; j++) {
+            x = tables.sites.position[j];
+            CU_ASSERT_EQUAL(x, floor(x));
+            CU_ASSERT_EQUAL(rate[(size_t) (2 * x)], 1.0);
+        }
+        mutgen_print_state(&mutgen, _devnull);
+        mutgen_free(&mutgen);
+        tsk_table_collection_free(&tables);
+    }
+
+    mutation_model_free(&mut_model);
+    gsl_rng_free(rng);
+}
+
 static void
 test_mutgen_errors(void)
 {
@@ -746,6 +815,337 @@ test_single_tree_mutgen_do_nothing_mutations(void)
     gsl_rng_free(rng);
 }
 
+static int
+run_chunks_in_reverse(mutgen_t *mutgen, size_t num_chunks, void *arg)
+{
+    int ret = 0;
+    size_t j;
+    size_t *num_calls = (size_t *) arg;
+
+    for (j = num_chunks; j > 0; j--) {
+        ret = mutgen_place_chunk(mutgen, j - 1);
+        if (ret != 0) {
+            break;
+        }
+        (*num_calls)++;
+    }
+    return ret;
+}
+
+static void
+test_mutgen_chunks(void)
+{
+    int ret = 0;
+    mutgen_t mutgen;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t tables[2];
+    mutation_model_t mut_model;
+    int flags[] = { 0, MSP_DISCRETE_SITES, MSP_KEEP_SITES,
+        MSP_DISCRETE_SITES | MSP_KEEP_SITES };
+    size_t num_chunks[] = { 1, 4, 10 };
+    size_t num_calls;
+    size_t j, k, l;
+
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_BINARY);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < sizeof(flags) / sizeof(*flags); j++) {
+        for (k = 0; k < sizeof(num_chunks) / sizeof(*num_chunks); k++) {
+            for (l = 0; l < 2; l++) {
+                ret = tsk_table_collection_init(&tables[l], 0);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                insert_single_tree(&tables[l], ALPHABET_BINARY);
+                gsl_rng_set(rng, 1);
+                ret = mutgen_alloc(&mutgen, rng, &tables[l], &mut_model, 0);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                ret = mutgen_set_rate(&mutgen, 10);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                ret = mutgen_set_num_chunks(&mutgen, num_chunks[k]);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                CU_ASSERT_EQUAL(mutgen_place_chunk(&mutgen, 0), MSP_ERR_BAD_PARAM_VALUE);
+                num_calls = 0;
+                if (l == 1) {
+                    /* The order the chunks are placed in doesn't matter */
+                    mutgen_set_chunk_runner(&mutgen, run_chunks_in_reverse, &num_calls);
+                }
+                ret = mutgen_generate(&mutgen, flags[j]);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                CU_ASSERT_EQUAL(num_calls, l == 1 ? num_chunks[k] : 0);
+                mutgen_print_state(&mutgen, _devnull);
+                mutgen_free(&mutgen);
+                ret = tsk_table_collection_check_integrity(&tables[l], 0);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                CU_ASSERT_TRUE(tables[l].mutations.num_rows > 1);
+            }
+            CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+            for (l = 0; l < 2; l++) {
+                tsk_table_collection_free(&tables[l]);
+            }
+        }
+    }
+
+    mutation_model_free(&mut_model);
+    gsl_rng_free(rng);
+}
+
+static void
+test_mutgen_sort_sites(void)
+{
+    int ret = 0;
+    mutgen_t mutgen;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t tables[2];
+    mutation_model_t mut_model;
+    int flags[] = { 0, MSP_DISCRETE_SITES, MSP_KEEP_SITES,
+        MSP_DISCRETE_SITES | MSP_KEEP_SITES };
+    size_t j, l;
+
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_BINARY);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < sizeof(flags) / sizeof(*flags); j++) {
+        for (l = 0; l < 2; l++) {
+            ret = tsk_table_collection_init(&tables[l], 0);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            insert_single_tree(&tables[l], ALPHABET_BINARY);
+            gsl_rng_set(rng, 1);
+            ret = mutgen_alloc(&mutgen, rng, &tables[l], &mut_model, 0);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = mutgen_set_rate(&mutgen, 10);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            /* Sorting the sites gives the same result as the AVL tree */
+            ret = mutgen_generate(&mutgen, flags[j] | (l == 1 ? MSP_SORT_SITES : 0));
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            mutgen_print_state(&mutgen, _devnull);
+            mutgen_free(&mutgen);
+            ret = tsk_table_collection_check_integrity(&tables[l], 0);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_TRUE(tables[l].mutations.num_rows > 1);
+        }
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+        for (l = 0; l < 2; l++) {
+            tsk_table_collection_free(&tables[l]);
+        }
+    }
+
+    mutation_model_free(&mut_model);
+    gsl_rng_free(rng);
+}
+
+static void
+test_mutgen_binary_fast_path(void)
+{
+    int ret = 0;
+    mutgen_t mutgen;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t tables[2];
+    mutation_model_t mut_model[2];
+    /* The third allele is unreachable, so this model gives the same
+     * output as the binary model but takes the general path. The fast path
+     * is only taken with MSP_SORT_SITES; without it both models take the
+     * general path. */
+    size_t lengths[] = { 1, 1, 1 };
+    const char *alleles[] = { "0", "1", "2" };
+    double root_distribution[] = { 1.0, 0.0, 0.0 };
+    double transition_matrix[] = { 0.0, 1.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0 };
+    double start_time[] = { 0, 0.5 };
+    int flags[] = { 0, MSP_SORT_SITES };
+    tsk_size_t j;
+    size_t k, l, m;
+
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = matrix_mutation_model_factory(&mut_model[0], ALPHABET_BINARY);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = matrix_mutation_model_alloc(&mut_model[1], 3, (char **) (uintptr_t *) alleles,
+        lengths, root_distribution, transition_matrix);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (m = 0; m < sizeof(flags) / sizeof(*flags); m++) {
+        for (k = 0; k < sizeof(start_time) / sizeof(*start_time); k++) {
+            for (l = 0; l < 2; l++) {
+                ret = tsk_table_collection_init(&tables[l], 0);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                insert_single_tree(&tables[l], ALPHABET_BINARY);
+                gsl_rng_set(rng, 1);
+                ret = mutgen_alloc(&mutgen, rng, &tables[l], &mut_model[l], 0);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                ret = mutgen_set_rate(&mutgen, 10);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                ret = mutgen_set_time_interval(&mutgen, start_time[k], 10.0);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                ret = mutgen_generate(&mutgen, flags[m]);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                mutgen_print_state(&mutgen, _devnull);
+                mutgen_free(&mutgen);
+                ret = tsk_table_collection_check_integrity(&tables[l], 0);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                CU_ASSERT_TRUE(tables[l].mutations.num_rows > 1);
+                CU_ASSERT_EQUAL(tables[l].sites.num_rows, tables[l].mutations.num_rows);
+            }
+            for (j = 0; j < tables[0].mutations.num_rows; j++) {
+                CU_ASSERT_EQUAL(tables[0].mutations.parent[j], TSK_NULL);
+                CU_ASSERT_EQUAL(tables[0].mutations.derived_state[j], '1');
+                CU_ASSERT_EQUAL(tables[0].sites.ancestral_state[j], '0');
+            }
+            CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+            for (l = 0; l < 2; l++) {
+                tsk_table_collection_free(&tables[l]);
+            }
+        }
+    }
+
+    mutation_model_free(&mut_model[0]);
+    mutation_model_free(&mut_model[1]);
+    gsl_rng_free(rng);
+}
+
+/* Returns true if the sample carries a state other than the ancestral state
+ * at the site, for the tree from insert_single_tree. */
+static bool
+single_tree_sample_is_derived(
+    tsk_table_collection_t *tables, tsk_id_t site, tsk_id_t sample)
+{
+    tsk_id_t parent[] = { 4, 4, 5, 5, 6, 6, TSK_NULL };
+    const tsk_mutation_table_t *mutations = &tables->mutations;
+    const tsk_site_table_t *sites = &tables->sites;
+    const char *state = sites->ancestral_state + sites->ancestral_state_offset[site];
+    tsk_size_t length = sites->ancestral_state_offset[site + 1]
+                        - sites->ancestral_state_offset[site];
+    const char *ancestral_state = state;
+    tsk_size_t ancestral_state_length = length;
+    tsk_size_t j;
+    tsk_id_t u;
+
+    for (j = 0; j < mutations->num_rows; j++) {
+        if (mutations->site[j] != site) {
+            continue;
+        }
+        for (u = sample; u != TSK_NULL; u = parent[u]) {
+            if (u == mutations->node[j]) {
+                state = mutations->derived_state + mutations->derived_state_offset[j];
+                length = mutations->derived_state_offset[j + 1]
+                         - mutations->derived_state_offset[j];
+                break;
+            }
+        }
+    }
+    return length != ancestral_state_length
+           || memcmp(state, ancestral_state, length) != 0;
+}
+
+static void
+test_mutgen_genotype_output(void)
+{
+    int ret = 0;
+    mutgen_t mutgen;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t tables;
+    mutation_model_t mut_model;
+    int models[] = { ALPHABET_BINARY, ALPHABET_NUCLEOTIDE };
+    int flags[] = { 0, MSP_DISCRETE_SITES, MSP_KEEP_SITES };
+    FILE *file = tmpfile();
+    char line[1024];
+    unsigned char row;
+    size_t j, k, num_rows;
+    tsk_size_t l;
+    tsk_id_t site, sample;
+    char *token;
+
+    CU_ASSERT_FATAL(rng != NULL);
+    CU_ASSERT_FATAL(file != NULL);
+
+    for (j = 0; j < sizeof(models) / sizeof(*models); j++) {
+        ret = matrix_mutation_model_factory(&mut_model, models[j]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        for (k = 0; k < sizeof(flags) / sizeof(*flags); k++) {
+            ret = tsk_table_collection_init(&tables, 0);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            insert_single_tree(&tables, models[j]);
+            tables.sequence_length = 10;
+            for (l = 0; l < tables.edges.num_rows; l++) {
+                tables.edges.right[l] = 10;
+            }
+            ret = mutgen_alloc(&mutgen, rng, &tables, &mut_model, 0);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = mutgen_set_rate(&mutgen, 2);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_EQUAL(mutgen_set_genotype_output(&mutgen, file, 0),
+                MSP_ERR_BAD_PARAM_VALUE);
+
+            /* Packed bits */
+            rewind(file);
+            ret = mutgen_set_genotype_output(&mutgen, file, MSP_GENOTYPES_PACKED);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = mutgen_generate(&mutgen, flags[k]);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_TRUE(tables.sites.num_rows > 0);
+            CU_ASSERT_EQUAL(ftell(file), (long) tables.sites.num_rows);
+            rewind(file);
+            for (site = 0; site < (tsk_id_t) tables.sites.num_rows; site++) {
+                CU_ASSERT_EQUAL_FATAL(fread(&row, 1, 1, file), 1);
+                for (sample = 0; sample < 4; sample++) {
+                    CU_ASSERT_EQUAL(((row >> sample) & 1) == 1,
+                        single_tree_sample_is_derived(&tables, site, sample));
+                }
+                CU_ASSERT_EQUAL(row >> 4, 0);
+            }
+
+            /* VCF */
+            rewind(file);
+            ret = mutgen_set_genotype_output(&mutgen, file, MSP_GENOTYPES_VCF);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = mutgen_generate(&mutgen, flags[k]);
+            if (!(flags[k] & MSP_DISCRETE_SITES)) {
+                /* Sites at non-integer positions can't be written as VCF */
+                CU_ASSERT_EQUAL_FATAL(ret, MSP_ERR_VCF_NON_INTEGER_POSITION);
+                CU_ASSERT_EQUAL(ftell(file), 0);
+                mutgen_free(&mutgen);
+                tsk_table_collection_free(&tables);
+                continue;
+            }
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            fflush(file);
+            rewind(file);
+            num_rows = 0;
+            while (fgets(line, sizeof(line), file) != NULL
+                   && num_rows < tables.sites.num_rows) {
+                if (line[0] == '#') {
+                    continue;
+                }
+                site = (tsk_id_t) num_rows;
+                token = strtok(line, "\t\n");
+                CU_ASSERT_STRING_EQUAL(token, "1");
+                token = strtok(NULL, "\t\n");
+                CU_ASSERT_EQUAL(atol(token), (long) tables.sites.position[site] + 1);
+                /* Skip ID, REF, ALT, QUAL, FILTER, INFO and FORMAT */
+                for (sample = 0; sample < 7; sample++) {
+                    token = strtok(NULL, "\t\n");
+                }
+                CU_ASSERT_STRING_EQUAL(token, "GT");
+                for (sample = 0; sample < 4; sample++) {
+                    token = strtok(NULL, "\t\n");
+                    CU_ASSERT_FATAL(token != NULL);
+                    CU_ASSERT_EQUAL(strcmp(token, "0") != 0,
+                        single_tree_sample_is_derived(&tables, site, sample));
+                }
+                num_rows++;
+            }
+            CU_ASSERT_EQUAL(num_rows, tables.sites.num_rows);
+
+            ret = tsk_table_collection_check_integrity(&tables, 0);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            mutgen_free(&mutgen);
+            tsk_table_collection_free(&tables);
+        }
+        mutation_model_free(&mut_model);
+    }
+
+    fclose(file);
+    gsl_rng_free(rng);
+}
+
 static void
 test_single_tree_mutgen_many_mutations(void)
 {
@@ -1260,10 +1660,55 @@ test_matrix_mutation_model_properties(void)
     CU_ASSERT_EQUAL_FATAL(model.params.mutation_matrix.allele_length[1], 5);
     CU_ASSERT_NSTRING_EQUAL(model.params.mutation_matrix.alleles[0], "", 0);
     CU_ASSERT_NSTRING_EQUAL(model.params.mutation_matrix.alleles[1], "BBBBB", 5);
+    /* Small alphabets use a linear scan */
+    CU_ASSERT_EQUAL(model.params.mutation_matrix.allele_hash, NULL);
+    CU_ASSERT_EQUAL(model.params.mutation_matrix.transition_alias, NULL);
 
     mutation_model_free(&model);
 }
 
+static void
+test_matrix_mutation_model_alias_tables(void)
+{
+    int ret;
+    size_t j, k, n;
+    mutation_model_t model;
+    const char *alleles[] = { "A", "B", "C", "D", "E", "F" };
+    size_t lengths[] = { 1, 1, 1, 1, 1, 1 };
+    double dist[6];
+    double matrix[36];
+    mutation_t mutation;
+    gsl_rng *rng = safe_rng_alloc();
+
+    for (n = MSP_MATRIX_ALIAS_MIN_ALLELES - 1; n <= 6; n++) {
+        for (j = 0; j < n; j++) {
+            dist[j] = 1.0 / (double) n;
+            for (k = 0; k < n; k++) {
+                /* Every allele mutates to the next one */
+                matrix[j * n + k] = k == (j + 1) % n ? 1.0 : 0.0;
+            }
+        }
+        ret = matrix_mutation_model_alloc(
+            &model, n, (char **) (uintptr_t) alleles, lengths, dist, matrix);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(model.params.mutation_matrix.transition_alias != NULL,
+            n >= MSP_MATRIX_ALIAS_MIN_ALLELES);
+        CU_ASSERT_EQUAL(model.params.mutation_matrix.allele_hash != NULL,
+            n >= MSP_MATRIX_ALIAS_MIN_ALLELES);
+        for (j = 0; j < n; j++) {
+            /* Look up alleles that don't point at the model's storage */
+            ret = model.transition(&model, rng, alleles[j], 1, NULL, 0, &mutation);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_EQUAL(mutation.derived_state_length, 1);
+            CU_ASSERT_EQUAL(mutation.derived_state[0], alleles[(j + 1) % n][0]);
+        }
+        ret = model.transition(&model, rng, "X", 1, NULL, 0, &mutation);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_UNKNOWN_ALLELE);
+        mutation_model_free(&model);
+    }
+    gsl_rng_free(rng);
+}
+
 static void
 test_slim_mutation_model_errors(void)
 {
@@ -1311,6 +1756,7 @@ main(int argc, char **argv)
 {
     CU_TestInfo tests[] = {
         { "test_mutgen_simple_map", test_mutgen_simple_map },
+        { "test_mutgen_fine_scale_map", test_mutgen_fine_scale_map },
         { "test_mutgen_errors", test_mutgen_errors },
         { "test_mutgen_backwards_mutation_order", test_mutgen_backwards_mutation_order },
         { "test_single_tree_mutgen", test_single_tree_mutgen },
@@ -1324,6 +1770,10 @@ main(int argc, char **argv)
         { "test_single_tree_mutgen_empty_site", test_single_tree_mutgen_empty_site },
         { "test_single_tree_mutgen_do_nothing_mutations",
             test_single_tree_mutgen_do_nothing_mutations },
+        { "test_mutgen_chunks", test_mutgen_chunks },
+        { "test_mutgen_sort_sites", test_mutgen_sort_sites },
+        { "test_mutgen_binary_fast_path", test_mutgen_binary_fast_path },
+        { "test_mutgen_genotype_output", test_mutgen_genotype_output },
         { "test_single_tree_mutgen_many_mutations",
             test_single_tree_mutgen_many_mutations },
         { "test_jukes_cantor_has_silent_mutations",
@@ -1337,6 +1787,8 @@ main(int argc, char **argv)
         { "test_matrix_mutation_model_errors", test_matrix_mutation_model_errors },
         { "test_matrix_mutation_model_properties",
             test_matrix_mutation_model_properties },
+        { "test_matrix_mutation_model_alias_tables",
+            test_matrix_mutation_model_alias_tables },
         { "test_slim_mutation_model_errors", test_slim_mutation_model_errors },
         { "test_slim_mutation_model_properties", test_slim_mutation_model_properties },
         CU_TEST_INFO_NULL,
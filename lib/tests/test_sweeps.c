@@ -315,6 +315,362 @@ test_sweep_genic_selection_time_change(void)
     tsk_table_collection_free(&tables);
 }
 
+static void
+test_sweep_genic_selection_interrupted(void)
+{
+    int j, ret;
+    uint32_t n = 10;
+    unsigned long seed = 1234;
+    double max_time;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables[3];
+
+    for (j = 0; j < 3; j++) {
+        gsl_rng_set(rng, seed);
+        ret = build_sim(&msp, &tables[j], rng, 10, 1, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1), 0);
+        ret = msp_set_num_labels(&msp, 2);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_simulation_model_sweep_genic_selection(
+            &msp, 5, 0.1, 0.9, 0.1, 1e-4);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        if (j == 0) {
+            ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+        } else if (j == 1) {
+            /* One event at a time */
+            while ((ret = msp_run(&msp, DBL_MAX, 1)) == MSP_EXIT_MAX_EVENTS) {
+                CU_ASSERT_TRUE(msp.sweep_state.active);
+                msp_verify(&msp, 0);
+            }
+        } else {
+            /* Stop at increasing times */
+            max_time = 1e-3;
+            while ((ret = msp_run(&msp, max_time, UINT32_MAX)) == MSP_EXIT_MAX_TIME) {
+                CU_ASSERT_EQUAL(msp_get_time(&msp), max_time);
+                msp_verify(&msp, 0);
+                max_time *= 2;
+            }
+        }
+        CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MODEL_COMPLETE);
+        CU_ASSERT_FALSE(msp.sweep_state.active);
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_free(&msp);
+    }
+    for (j = 1; j < 3; j++) {
+        CU_ASSERT_TRUE(tsk_node_table_equals(&tables[0].nodes, &tables[j].nodes, 0));
+        CU_ASSERT_TRUE(tsk_edge_table_equals(&tables[0].edges, &tables[j].edges, 0));
+    }
+
+    /* Changing the model in the middle of a sweep puts the lineages back
+     * into label 0. */
+    ret = build_sim(&msp, &tables[0], rng, 10, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_num_labels(&msp, 2), 0);
+    ret = msp_set_simulation_model_sweep_genic_selection(&msp, 5, 0.1, 0.9, 0.1, 1e-4);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run(&msp, DBL_MAX, 2);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_EVENTS);
+    CU_ASSERT_TRUE(msp.sweep_state.active);
+    ret = msp_set_simulation_model_hudson(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_FALSE(msp.sweep_state.active);
+    CU_ASSERT_EQUAL(avl_count(&msp.populations[0].ancestors[1]), 0);
+    ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+    CU_ASSERT_EQUAL(ret, 0);
+    msp_verify(&msp, 0);
+    msp_free(&msp);
+
+    gsl_rng_free(rng);
+    for (j = 0; j < 3; j++) {
+        tsk_table_collection_free(&tables[j]);
+    }
+}
+
+static void
+test_sweep_genic_selection_fixed_trajectory(void)
+{
+    int j, ret;
+    uint32_t n = 10;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    size_t num_steps, generated_num_steps;
+    const double *time, *allele_frequency;
+    double *generated_time, *generated_allele_frequency;
+    double bad_time[] = { 0, 0.1, 0.05 };
+    double bad_frequency[] = { 0.9, 0.5, 0 };
+
+    ret = build_sim(&msp, &tables, rng, 10, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_num_labels(&msp, 2), 0);
+    ret = msp_set_simulation_model_sweep_genic_selection(&msp, 5, 0.1, 0.9, 0.1, 1e-3);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    msp_get_sweep_trajectory(&msp, &num_steps, &time, &allele_frequency);
+    CU_ASSERT_EQUAL(num_steps, 0);
+    CU_ASSERT_EQUAL(time, NULL);
+
+    CU_ASSERT_EQUAL(msp_set_sweep_trajectory(&msp, 3, bad_time, bad_frequency),
+        MSP_ERR_BAD_TIME_DELTA);
+    bad_time[2] = 0.2;
+    CU_ASSERT_EQUAL(msp_set_sweep_trajectory(&msp, 3, bad_time, bad_frequency),
+        MSP_ERR_BAD_ALLELE_FREQUENCY);
+    bad_frequency[2] = 1;
+    CU_ASSERT_EQUAL(msp_set_sweep_trajectory(&msp, 3, bad_time, bad_frequency),
+        MSP_ERR_BAD_ALLELE_FREQUENCY);
+
+    /* Keep the trajectory generated for the first sweep and reuse it */
+    ret = msp.model.params.sweep.generate_trajectory(&msp.model.params.sweep, &msp,
+        &generated_num_steps, &generated_time, &generated_allele_frequency);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_sweep_trajectory(
+        &msp, generated_num_steps, generated_time, generated_allele_frequency);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < 3; j++) {
+        ret = msp_run(&msp, DBL_MAX, 1);
+        CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_EVENTS);
+        ret = msp_set_sweep_trajectory(&msp, 0, NULL, NULL);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_STATE);
+        ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MODEL_COMPLETE);
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+
+        msp_get_sweep_trajectory(&msp, &num_steps, &time, &allele_frequency);
+        CU_ASSERT_EQUAL_FATAL(num_steps, generated_num_steps);
+        CU_ASSERT_NOT_EQUAL(time, generated_time);
+        CU_ASSERT_EQUAL(memcmp(time, generated_time, num_steps * sizeof(*time)), 0);
+        CU_ASSERT_EQUAL(memcmp(allele_frequency, generated_allele_frequency,
+                            num_steps * sizeof(*allele_frequency)),
+            0);
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+
+    /* Clearing the trajectory means each sweep generates its own */
+    ret = msp_set_sweep_trajectory(&msp, 0, NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    msp_get_sweep_trajectory(&msp, &num_steps, &time, &allele_frequency);
+    CU_ASSERT_EQUAL(num_steps, 0);
+    ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MODEL_COMPLETE);
+    msp_get_sweep_trajectory(&msp, &num_steps, &time, &allele_frequency);
+    CU_ASSERT_TRUE(num_steps > 1);
+    CU_ASSERT_EQUAL(time[0], 0);
+    CU_ASSERT_EQUAL(allele_frequency[0], 0.9);
+    CU_ASSERT_EQUAL(allele_frequency[num_steps - 1], 0.1);
+
+    free(generated_time);
+    free(generated_allele_frequency);
+    msp_free(&msp);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+}
+
+static void
+test_sweep_trajectory_store(void)
+{
+    int ret;
+    sweep_trajectory_store_t store;
+    gsl_rng *rng = safe_rng_alloc();
+    size_t j, k, num_steps;
+    const double *time, *allele_frequency;
+    double dt = 1e-3;
+
+    ret = sweep_trajectory_store_alloc(&store, 0, 0.9, 0.1, dt, 1);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_ALLELE_FREQUENCY);
+    sweep_trajectory_store_free(&store);
+    ret = sweep_trajectory_store_alloc(&store, 0.9, 0.1, 0.1, dt, 1);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_TRAJECTORY_START_END);
+    sweep_trajectory_store_free(&store);
+    ret = sweep_trajectory_store_alloc(&store, 0.1, 0.9, 0.1, 0, 1);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_TIME_DELTA);
+    sweep_trajectory_store_free(&store);
+    ret = sweep_trajectory_store_alloc(&store, 0.1, 0.9, 0, dt, 1);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_SWEEP_GENIC_SELECTION_S);
+    sweep_trajectory_store_free(&store);
+    ret = sweep_trajectory_store_alloc(&store, 0.1, 0.9, 0.1, dt, 0);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    sweep_trajectory_store_free(&store);
+
+    ret = sweep_trajectory_store_alloc(&store, 0.1, 0.9, 0.1, dt, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(store.num_trajectories, 0);
+    ret = sweep_trajectory_store_get(&store, 0, &num_steps, &time, &allele_frequency);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    /* Generate more than one batch, and then add some more */
+    ret = sweep_trajectory_store_generate(&store, 100, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = sweep_trajectory_store_generate(&store, 3, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = sweep_trajectory_store_generate(&store, 0, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(store.num_trajectories, 103);
+    CU_ASSERT_EQUAL(store.offset[0], 0);
+    CU_ASSERT_EQUAL(store.offset[store.num_trajectories], store.num_steps);
+    sweep_trajectory_store_print_state(&store, _devnull);
+
+    for (j = 0; j < store.num_trajectories; j++) {
+        ret = sweep_trajectory_store_get(
+            &store, j, &num_steps, &time, &allele_frequency);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_FATAL(num_steps > 1);
+        CU_ASSERT_EQUAL(time, store.time + store.offset[j]);
+        CU_ASSERT_EQUAL(time[0], 0);
+        CU_ASSERT_EQUAL(allele_frequency[0], 0.9);
+        CU_ASSERT_EQUAL(allele_frequency[num_steps - 1], 0.1);
+        for (k = 1; k < num_steps; k++) {
+            CU_ASSERT_DOUBLE_EQUAL_FATAL(time[k], time[k - 1] + dt, 1e-9);
+            CU_ASSERT_TRUE(allele_frequency[k] < 1);
+            if (k < num_steps - 1) {
+                CU_ASSERT_TRUE(allele_frequency[k] > 0.1);
+            }
+        }
+    }
+    ret = sweep_trajectory_store_get(&store, 103, &num_steps, &time, &allele_frequency);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+    sweep_trajectory_store_free(&store);
+
+    /* With a large time step, trajectories finish part way through the
+     * first block of steps and are removed from the batch at its end. */
+    ret = sweep_trajectory_store_alloc(&store, 0.1, 0.9, 0.1, 0.05, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = sweep_trajectory_store_generate(&store, 64, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < store.num_trajectories; j++) {
+        ret = sweep_trajectory_store_get(
+            &store, j, &num_steps, &time, &allele_frequency);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_FATAL(num_steps > 1);
+        CU_ASSERT_EQUAL(allele_frequency[0], 0.9);
+        CU_ASSERT_EQUAL(allele_frequency[num_steps - 1], 0.1);
+        for (k = 1; k < num_steps - 1; k++) {
+            CU_ASSERT_TRUE(allele_frequency[k] > 0.1);
+            CU_ASSERT_TRUE(allele_frequency[k] < 1);
+        }
+    }
+    sweep_trajectory_store_free(&store);
+    gsl_rng_free(rng);
+}
+
+static void
+test_sweep_genic_selection_trajectory_store(void)
+{
+    int j, ret;
+    uint32_t n = 10;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    tsk_table_collection_t tables;
+    sweep_trajectory_store_t store, other_store;
+    size_t num_steps;
+    const double *time, *allele_frequency;
+
+    ret = sweep_trajectory_store_alloc(&store, 0.1, 0.9, 0.1, 1e-3, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = sweep_trajectory_store_generate(&store, 3, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = sweep_trajectory_store_alloc(&other_store, 0.1, 0.9, 0.1, 1e-3, 2);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = sweep_trajectory_store_generate(&other_store, 1, rng);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = build_sim(&msp, &tables, rng, 10, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_population_configuration(&msp, 0, 1, 0, true), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_num_labels(&msp, 2), 0);
+    ret = msp_set_simulation_model_sweep_genic_selection(&msp, 5, 0.1, 0.9, 0.1, 1e-3);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    CU_ASSERT_EQUAL(msp_set_next_sweep_trajectory(&msp, 0), MSP_ERR_BAD_PARAM_VALUE);
+
+    /* The store must match the population size */
+    ret = msp_set_sweep_trajectory_store(&msp, &other_store);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_SWEEP_TRAJECTORY_STORE_MISMATCH);
+    ret = msp_reset(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = msp_set_sweep_trajectory_store(&msp, &store);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < 3; j++) {
+        ret = msp_run(&msp, DBL_MAX, 1);
+        CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_EVENTS);
+        CU_ASSERT_EQUAL(msp_set_sweep_trajectory_store(&msp, NULL), MSP_ERR_BAD_STATE);
+        ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MODEL_COMPLETE);
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+        /* Each replicate uses the next trajectory in the store by reference */
+        msp_get_sweep_trajectory(&msp, &num_steps, &time, &allele_frequency);
+        CU_ASSERT_EQUAL(num_steps, store.offset[j + 1] - store.offset[j]);
+        CU_ASSERT_EQUAL(time, store.time + store.offset[j]);
+        CU_ASSERT_EQUAL(allele_frequency, store.allele_frequency + store.offset[j]);
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_SWEEP_TRAJECTORIES_EXHAUSTED);
+    ret = msp_reset(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* A replicate can take the trajectory for its own index */
+    ret = msp_set_next_sweep_trajectory(&msp, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run(&msp, DBL_MAX, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MAX_EVENTS);
+    CU_ASSERT_EQUAL(msp_set_next_sweep_trajectory(&msp, 0), MSP_ERR_BAD_STATE);
+    ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MODEL_COMPLETE);
+    msp_get_sweep_trajectory(&msp, &num_steps, &time, &allele_frequency);
+    CU_ASSERT_EQUAL(time, store.time + store.offset[1]);
+    CU_ASSERT_EQUAL(msp.next_sweep_trajectory, 2);
+    ret = msp_reset(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* Going back to generating trajectories */
+    ret = msp_set_sweep_trajectory_store(&msp, NULL);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    msp_get_sweep_trajectory(&msp, &num_steps, &time, &allele_frequency);
+    CU_ASSERT_EQUAL(num_steps, 0);
+    ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, MSP_EXIT_MODEL_COMPLETE);
+    msp_get_sweep_trajectory(&msp, &num_steps, &time, &allele_frequency);
+    CU_ASSERT_TRUE(num_steps > 1);
+    CU_ASSERT_EQUAL(time, msp.sweep_trajectory.time);
+
+    /* A store for different sweep parameters can't be used */
+    ret = msp_reset(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_simulation_model_sweep_genic_selection(&msp, 5, 0.1, 0.9, 0.2, 1e-3);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_sweep_trajectory_store(&msp, &store);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_run(&msp, DBL_MAX, UINT32_MAX);
+    CU_ASSERT_EQUAL(ret, MSP_ERR_SWEEP_TRAJECTORY_STORE_MISMATCH);
+
+    msp_free(&msp);
+    sweep_trajectory_store_free(&store);
+    sweep_trajectory_store_free(&other_store);
+    gsl_rng_free(rng);
+    tsk_table_collection_free(&tables);
+}
+
 static void
 sweep_genic_selection_mimic_msms_single_run(unsigned long int seed)
 {
@@ -393,6 +749,13 @@ main(int argc, char **argv)
         { "test_sweep_genic_selection_gc", test_sweep_genic_selection_gc },
         { "test_sweep_genic_selection_time_change",
             test_sweep_genic_selection_time_change },
+        { "test_sweep_genic_selection_interrupted",
+            test_sweep_genic_selection_interrupted },
+        { "test_sweep_genic_selection_fixed_trajectory",
+            test_sweep_genic_selection_fixed_trajectory },
+        { "test_sweep_trajectory_store", test_sweep_trajectory_store },
+        { "test_sweep_genic_selection_trajectory_store",
+            test_sweep_genic_selection_trajectory_store },
         { "test_sweep_genic_selection_mimic_msms",
             test_sweep_genic_selection_mimic_msms },
         CU_TEST_INFO_NULL,
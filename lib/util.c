@@ -325,6 +325,25 @@ msp_strerror_internal(int err)
         case MSP_ERR_POP_SIZE_ZERO_SAMPLE:
             ret = "Attempt to sample lineage in a population with size=0";
             break;
+        case MSP_ERR_IO:
+            if (errno != 0) {
+                ret = strerror(errno);
+            } else {
+                ret = "Unspecified IO error";
+            }
+            break;
+        case MSP_ERR_SWEEP_TRAJECTORIES_EXHAUSTED:
+            ret = "All the trajectories in the sweep trajectory store have "
+                  "been used";
+            break;
+        case MSP_ERR_SWEEP_TRAJECTORY_STORE_MISMATCH:
+            ret = "The sweep trajectory store was generated for different sweep "
+                  "parameters or a different population size";
+            break;
+        case MSP_ERR_VCF_NON_INTEGER_POSITION:
+            ret = "VCF output requires all sites to be at integer positions, "
+                  "which can be ensured by using a discrete genome";
+            break;
         default:
             ret = "Error occurred generating error string. Please file a bug "
                   "report!";
@@ -698,6 +717,91 @@ fast_search_free(fast_search_t *self)
     return 0;
 }
 
+/* Walker's alias method, using Vose's construction. The probabilities are
+ * normalised by their sum, and an outcome is chosen with a single uniform
+ * variate: the integer part of u * size selects a column and the fractional
+ * part decides between the column and its alias. */
+int
+alias_table_alloc(alias_table_t *self, size_t size, const double *probs)
+{
+    int ret = 0;
+    double *scaled = NULL;
+    size_t *small = NULL;
+    size_t *large = NULL;
+    size_t num_small, num_large, j, s, l;
+    double total = 0;
+
+    memset(self, 0, sizeof(*self));
+    if (size == 0) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->probability = malloc(size * sizeof(*self->probability));
+    self->alias = malloc(size * sizeof(*self->alias));
+    scaled = malloc(size * sizeof(*scaled));
+    small = malloc(size * sizeof(*small));
+    large = malloc(size * sizeof(*large));
+    if (self->probability == NULL || self->alias == NULL || scaled == NULL
+        || small == NULL || large == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    self->size = size;
+    for (j = 0; j < size; j++) {
+        total += probs[j];
+    }
+    if (!(total > 0)) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    num_small = 0;
+    num_large = 0;
+    for (j = 0; j < size; j++) {
+        scaled[j] = probs[j] * (double) size / total;
+        if (scaled[j] < 1.0) {
+            small[num_small++] = j;
+        } else {
+            large[num_large++] = j;
+        }
+    }
+    while (num_small > 0 && num_large > 0) {
+        s = small[--num_small];
+        l = large[--num_large];
+        self->probability[s] = scaled[s];
+        self->alias[s] = l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+        if (scaled[l] < 1.0) {
+            small[num_small++] = l;
+        } else {
+            large[num_large++] = l;
+        }
+    }
+    /* Anything left over is within rounding error of 1 */
+    while (num_large > 0) {
+        l = large[--num_large];
+        self->probability[l] = 1.0;
+        self->alias[l] = l;
+    }
+    while (num_small > 0) {
+        s = small[--num_small];
+        self->probability[s] = 1.0;
+        self->alias[s] = s;
+    }
+out:
+    msp_safe_free(scaled);
+    msp_safe_free(small);
+    msp_safe_free(large);
+    return ret;
+}
+
+int
+alias_table_free(alias_table_t *self)
+{
+    msp_safe_free(self->probability);
+    msp_safe_free(self->alias);
+    return 0;
+}
+
 /*******************************
  *  `extern inline` declarations
  *  Due to compiler/linker limitations of C99, `inline` function declarations
@@ -708,6 +812,10 @@ fast_search_free(fast_search_t *self)
 extern inline size_t sub_idx_1st_strict_upper_bound(
     const double *base, size_t start, size_t stop, double query);
 extern inline size_t fast_search_idx_strict_upper(fast_search_t *self, double query);
+extern inline double rng_buffer_uniform(rng_buffer_t *self);
+extern inline double rng_buffer_exponential(rng_buffer_t *self, double mu);
+extern inline unsigned long rng_buffer_uniform_int(rng_buffer_t *self, unsigned long n);
+extern inline size_t alias_table_sample(const alias_table_t *self, double u);
 
 /*   The gsl_ran_flat() function is supposed to output lo<=x<hi, but
  *   sometimes (with probability <1e-9) we find x=hi.
@@ -733,3 +841,204 @@ msp_gsl_ran_flat(gsl_rng *rng, double lo, double hi)
     }
     return x;
 }
+
+/* A counter-based generator (Philox4x32-10, Salmon et al. 2011) exposed
+ * as a gsl_rng_type. The output is a pure function of a 128 bit counter
+ * and a 64 bit key, so independent streams can be set up in O(1) by
+ * placing a stream index in the upper half of the counter: the key is
+ * derived from the seed and the lower half of the counter steps through
+ * the stream. gsl_rng_set selects stream 0.
+ */
+
+#define PHILOX_M0 0xD2511F53UL
+#define PHILOX_M1 0xCD9E8D57UL
+#define PHILOX_W0 0x9E3779B9UL
+#define PHILOX_W1 0xBB67AE85UL
+#define PHILOX_ROUNDS 10
+
+typedef struct {
+    uint32_t counter[4];
+    uint32_t key[2];
+    uint32_t output[4];
+    unsigned int position;
+} philox_state_t;
+
+static void
+philox_block(const uint32_t *counter, const uint32_t *key, uint32_t *output)
+{
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    uint64_t p0, p1;
+    int j;
+
+    for (j = 0; j < PHILOX_ROUNDS; j++) {
+        p0 = (uint64_t) PHILOX_M0 * c0;
+        p1 = (uint64_t) PHILOX_M1 * c2;
+        c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t) p1;
+        c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t) p0;
+        k0 += (uint32_t) PHILOX_W0;
+        k1 += (uint32_t) PHILOX_W1;
+    }
+    output[0] = c0;
+    output[1] = c1;
+    output[2] = c2;
+    output[3] = c3;
+}
+
+static void
+philox_set_key(philox_state_t *state, unsigned long seed, uint64_t stream)
+{
+    uint64_t s = (uint64_t) seed;
+
+    state->key[0] = (uint32_t) s;
+    state->key[1] = (uint32_t)(s >> 32);
+    state->counter[0] = 0;
+    state->counter[1] = 0;
+    state->counter[2] = (uint32_t) stream;
+    state->counter[3] = (uint32_t)(stream >> 32);
+    /* Force a new block to be generated on the next call */
+    state->position = 4;
+}
+
+static void
+philox_set(void *vstate, unsigned long seed)
+{
+    philox_set_key((philox_state_t *) vstate, seed, 0);
+}
+
+static unsigned long
+philox_get(void *vstate)
+{
+    philox_state_t *state = (philox_state_t *) vstate;
+
+    if (state->position == 4) {
+        philox_block(state->counter, state->key, state->output);
+        state->counter[0]++;
+        if (state->counter[0] == 0) {
+            state->counter[1]++;
+        }
+        state->position = 0;
+    }
+    return state->output[state->position++];
+}
+
+static double
+philox_get_double(void *vstate)
+{
+    return (double) philox_get(vstate) / 4294967296.0;
+}
+
+static const gsl_rng_type philox_type = {
+    "msp_philox4x32",
+    0xffffffffUL,
+    0,
+    sizeof(philox_state_t),
+    &philox_set,
+    &philox_get,
+    &philox_get_double,
+};
+
+const gsl_rng_type *msp_rng_philox = &philox_type;
+
+/* Sets the specified counter-based generator to the start of the given
+ * stream for this seed. Distinct (seed, stream) pairs give independent
+ * sequences. */
+int
+msp_rng_set_stream(gsl_rng *rng, unsigned long seed, uint64_t stream)
+{
+    int ret = 0;
+
+    if (rng->type != msp_rng_philox) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    philox_set_key((philox_state_t *) rng->state, seed, stream);
+out:
+    return ret;
+}
+
+/* Fills the array with uniform variates on [0, 1), exactly as successive
+ * calls to gsl_rng_uniform would. For the counter-based generator the
+ * block is produced directly, avoiding the per-variate dispatch through
+ * the gsl_rng_type. */
+void
+msp_rng_fill_uniform(gsl_rng *rng, double *values, size_t n)
+{
+    philox_state_t *state;
+    size_t j;
+
+    if (rng->type == msp_rng_philox) {
+        state = (philox_state_t *) rng->state;
+        for (j = 0; j < n; j++) {
+            values[j] = (double) philox_get(state) / 4294967296.0;
+        }
+    } else {
+        for (j = 0; j < n; j++) {
+            values[j] = gsl_rng_uniform(rng);
+        }
+    }
+}
+
+/* A size of zero gives an empty buffer, which must not be consumed from. */
+int
+rng_buffer_alloc(rng_buffer_t *self, gsl_rng *rng, size_t size)
+{
+    int ret = 0;
+
+    memset(self, 0, sizeof(*self));
+    self->rng = rng;
+    if (size > 0) {
+        self->uniforms = malloc(size * sizeof(*self->uniforms));
+        self->exponentials = malloc(size * sizeof(*self->exponentials));
+        if (self->uniforms == NULL || self->exponentials == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+    self->size = size;
+    rng_buffer_clear(self);
+out:
+    return ret;
+}
+
+int
+rng_buffer_free(rng_buffer_t *self)
+{
+    msp_safe_free(self->uniforms);
+    msp_safe_free(self->exponentials);
+    return 0;
+}
+
+/* Discards any variates left in the buffer, so that the next values are
+ * drawn from the current state of the generator. */
+void
+rng_buffer_clear(rng_buffer_t *self)
+{
+    self->uniform_position = self->size;
+    self->exponential_position = self->size;
+}
+
+void
+rng_buffer_fill_uniforms(rng_buffer_t *self)
+{
+    msp_rng_fill_uniform(self->rng, self->uniforms, self->size);
+    self->uniform_position = 0;
+}
+
+/* Exponentials are transformed from a block of uniforms in a separate
+ * pass, which keeps the log computation in a tight loop. */
+void
+rng_buffer_fill_exponentials(rng_buffer_t *self)
+{
+    double *restrict x = self->exponentials;
+    const size_t n = self->size;
+    size_t j;
+
+    msp_rng_fill_uniform(self->rng, x, n);
+    for (j = 0; j < n; j++) {
+        x[j] = -log1p(-x[j]);
+    }
+    self->exponential_position = 0;
+}
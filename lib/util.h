@@ -134,6 +134,10 @@
 #define MSP_ERR_PEDIGREE_TIME_TRAVEL                                -88
 #define MSP_ERR_PEDIGREE_IND_NOT_DIPLOID                            -89
 #define MSP_ERR_PEDIGREE_IND_NOT_TWO_PARENTS                        -90
+#define MSP_ERR_IO                                                  -91
+#define MSP_ERR_SWEEP_TRAJECTORIES_EXHAUSTED                        -92
+#define MSP_ERR_SWEEP_TRAJECTORY_STORE_MISMATCH                     -93
+#define MSP_ERR_VCF_NON_INTEGER_POSITION                            -94
 
 /* clang-format on */
 /* This bit is 0 for any errors originating from tskit */
@@ -168,12 +172,100 @@ int fast_search_alloc(fast_search_t *self, const double *values, size_t n_values
 int fast_search_free(fast_search_t *self);
 inline size_t fast_search_idx_strict_upper(fast_search_t *self, double query);
 
+/* Alias table for constant time sampling from a discrete distribution */
+typedef struct {
+    size_t size;
+    double *probability;
+    size_t *alias;
+} alias_table_t;
+
+int alias_table_alloc(alias_table_t *self, size_t size, const double *probs);
+int alias_table_free(alias_table_t *self);
+inline size_t alias_table_sample(const alias_table_t *self, double u);
+
 double msp_gsl_ran_flat(gsl_rng *rng, double lo, double hi);
 
+/* Counter-based random generator supporting independent streams */
+extern const gsl_rng_type *msp_rng_philox;
+int msp_rng_set_stream(gsl_rng *rng, unsigned long seed, uint64_t stream);
+void msp_rng_fill_uniform(gsl_rng *rng, double *values, size_t n);
+
+/* Blocks of pre-generated uniform and standard exponential variates,
+ * consumed in order. */
+typedef struct {
+    gsl_rng *rng;
+    size_t size;
+    size_t uniform_position;
+    size_t exponential_position;
+    double *uniforms;
+    double *exponentials;
+} rng_buffer_t;
+
+int rng_buffer_alloc(rng_buffer_t *self, gsl_rng *rng, size_t size);
+int rng_buffer_free(rng_buffer_t *self);
+void rng_buffer_clear(rng_buffer_t *self);
+void rng_buffer_fill_uniforms(rng_buffer_t *self);
+void rng_buffer_fill_exponentials(rng_buffer_t *self);
+inline double rng_buffer_uniform(rng_buffer_t *self);
+inline double rng_buffer_exponential(rng_buffer_t *self, double mu);
+inline unsigned long rng_buffer_uniform_int(rng_buffer_t *self, unsigned long n);
+
 /***********************************
  * INLINE FUNCTION IMPLEMENTATIONS *
  ***********************************/
 
+inline double
+rng_buffer_uniform(rng_buffer_t *self)
+{
+    if (self->uniform_position == self->size) {
+        rng_buffer_fill_uniforms(self);
+    }
+    return self->uniforms[self->uniform_position++];
+}
+
+inline double
+rng_buffer_exponential(rng_buffer_t *self, double mu)
+{
+    if (self->exponential_position == self->size) {
+        rng_buffer_fill_exponentials(self);
+    }
+    return mu * self->exponentials[self->exponential_position++];
+}
+
+/* Returns an integer uniformly distributed on 0, ..., n - 1, for
+ * 0 < n <= 2^32. The buffered uniforms are the 32-bit outputs of the
+ * generator divided by 2^32, so we recover these bits, map them to the
+ * range with a multiply and shift, and reject the few values that would
+ * make the low outcomes more likely (Lemire, 2019). */
+inline unsigned long
+rng_buffer_uniform_int(rng_buffer_t *self, unsigned long n)
+{
+    const uint64_t range = (uint64_t) n;
+    uint64_t m = (uint64_t) (rng_buffer_uniform(self) * 4294967296.0) * range;
+    uint64_t threshold;
+
+    if ((m & 0xFFFFFFFF) < range) {
+        threshold = (((uint64_t) 1 << 32) - range) % range;
+        while ((m & 0xFFFFFFFF) < threshold) {
+            m = (uint64_t) (rng_buffer_uniform(self) * 4294967296.0) * range;
+        }
+    }
+    return (unsigned long) (m >> 32);
+}
+
+/* Returns the outcome for the uniform variate 0 <= u < 1 */
+inline size_t
+alias_table_sample(const alias_table_t *self, double u)
+{
+    double x = u * (double) self->size;
+    size_t j = (size_t) x;
+
+    if (j >= self->size) {
+        j = self->size - 1;
+    }
+    return (x - (double) j < self->probability[j]) ? j : self->alias[j];
+}
+
 inline size_t
 sub_idx_1st_strict_upper_bound(
     const double *base, size_t start, size_t stop, double query)
@@ -39,6 +39,7 @@ from msprime.ancestry import (
     BetaCoalescent,
     DiracCoalescent,
     DiscreteTimeWrightFisher,
+    HybridWrightFisher,
     SampleSet,
     sim_ancestry,
     SmcApproxCoalescent,
@@ -62,7 +63,11 @@ from msprime.demography import (
 
 from msprime.pedigrees import PedigreeBuilder, parse_pedigree, write_pedigree
 from msprime.intervals import RateMap
-from msprime.likelihood import log_arg_likelihood, log_mutation_likelihood
+from msprime.likelihood import (
+    ArgLikelihood,
+    log_arg_likelihood,
+    log_mutation_likelihood,
+)
 
 from msprime.mutations import (
     BinaryMutationModel,
@@ -120,6 +125,7 @@ __all__ = [
     "DemographyDebugger",
     "DiracCoalescent",
     "DiscreteTimeWrightFisher",
+    "HybridWrightFisher",
     "F84",
     "GTR",
     "HKY",
@@ -161,6 +167,7 @@ __all__ = [
     "StandardCoalescent",
     "SweepGenicSelection",
     "FixedPedigree",
+    "ArgLikelihood",
     "log_arg_likelihood",
     "log_mutation_likelihood",
     "mutate",
@@ -45,9 +45,15 @@ static PyObject *MsprimeLibraryError;
 typedef struct {
     PyObject_HEAD
     unsigned long seed;
+    unsigned long long stream;
     gsl_rng* rng;
 } RandomGenerator;
 
+typedef struct {
+    PyObject_HEAD
+    sweep_trajectory_store_t *store;
+} SweepTrajectoryStore;
+
 /* TODO we should refactor some of the code for dealing with the
  * mutation_model in this base class (which currently does nothing).
  */
@@ -70,13 +76,42 @@ typedef struct {
     mutation_model_t *mutation_model;
 } InfiniteAllelesMutationModel;
 
+typedef struct {
+    msp_t *msp;
+    size_t thread;
+    size_t num_threads;
+    size_t num_populations;
+    int err;
+    /* Set if the worker thread could not be started, so that the runner
+     * draws this task's populations itself. */
+    bool run_inline;
+    bool quit;
+    PyThread_type_lock start;
+    PyThread_type_lock done;
+} dtwf_population_task_t;
+
+/* Worker threads for the DTWF population draws, started on the first
+ * generation and kept until the simulator is freed. */
+typedef struct {
+    size_t max_threads;
+    size_t num_threads;
+    dtwf_population_task_t *tasks;
+} dtwf_thread_pool_t;
+
 typedef struct {
     PyObject_HEAD
     msp_t *sim;
     RandomGenerator *random_generator;
     LightweightTableCollection *tables;
+    dtwf_thread_pool_t dtwf_thread_pool;
+    mutgen_t *mutgen;
+    PyObject *mutation_model;
+    RandomGenerator *mutation_random_generator;
+    SweepTrajectoryStore *sweep_trajectory_store;
 } Simulator;
 
+mutation_model_t *parse_mutation_model(PyObject *py_model);
+
 static void
 handle_library_error(int err)
 {
@@ -244,7 +279,27 @@ RandomGenerator_parse_seed(RandomGenerator *self, PyObject *py_seed)
         goto out;
     }
     self->seed = seed;
-    gsl_rng_set(self->rng, self->seed);
+    if (self->rng->type == msp_rng_philox) {
+        msp_rng_set_stream(self->rng, self->seed, self->stream);
+    } else {
+        gsl_rng_set(self->rng, self->seed);
+    }
+    ret = 0;
+out:
+    return ret;
+}
+
+static int
+RandomGenerator_parse_stream(RandomGenerator *self, PyObject *py_stream)
+{
+    int ret = -1;
+    unsigned long long stream = PyLong_AsUnsignedLongLong(py_stream);
+
+    if (PyErr_Occurred()) {
+        goto out;
+    }
+    self->stream = stream;
+    msp_rng_set_stream(self->rng, self->seed, self->stream);
     ret = 0;
 out:
     return ret;
@@ -254,19 +309,37 @@ static int
 RandomGenerator_init(RandomGenerator *self, PyObject *args, PyObject *kwds)
 {
     int ret = -1;
-    static char *kwlist[] = {"seed", NULL};
+    static char *kwlist[] = {"seed", "stream", NULL};
     PyObject *py_seed = NULL;
+    PyObject *py_stream = Py_None;
 
     self->rng = NULL;
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &py_seed)) {
+    self->seed = 0;
+    self->stream = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO", kwlist,
+                &py_seed, &py_stream)) {
+        goto out;
+    }
+    /* Specifying a stream selects the counter-based generator */
+    if (py_stream == Py_None) {
+        self->rng = gsl_rng_alloc(gsl_rng_default);
+    } else {
+        self->rng = gsl_rng_alloc(msp_rng_philox);
+    }
+    if (self->rng == NULL) {
+        PyErr_NoMemory();
         goto out;
     }
-    self->rng = gsl_rng_alloc(gsl_rng_default);
     if (py_seed != NULL) {
         if (RandomGenerator_parse_seed(self, py_seed) != 0) {
             goto out;
         }
     }
+    if (py_stream != Py_None) {
+        if (RandomGenerator_parse_stream(self, py_stream) != 0) {
+            goto out;
+        }
+    }
     ret = 0;
 out:
     return ret;
@@ -306,6 +379,50 @@ out:
     return ret;
 }
 
+static PyObject *
+RandomGenerator_get_stream(RandomGenerator *self, void *closure)
+{
+    PyObject *ret = NULL;
+
+    if (RandomGenerator_check_state(self) != 0) {
+        goto out;
+    }
+    if (self->rng->type != msp_rng_philox) {
+        ret = Py_None;
+        Py_INCREF(ret);
+        goto out;
+    }
+    ret = Py_BuildValue("K", self->stream);
+out:
+    return ret;
+}
+
+static int
+RandomGenerator_set_stream(RandomGenerator *self, PyObject *args, void *closure)
+{
+    int ret = -1;
+    PyObject *py_stream = args;
+
+    if (py_stream == NULL) {
+        PyErr_SetString(PyExc_AttributeError, "can't delete attribute");
+        goto out;
+    }
+    if (RandomGenerator_check_state(self) != 0) {
+        goto out;
+    }
+    if (self->rng->type != msp_rng_philox) {
+        PyErr_SetString(PyExc_ValueError,
+            "Streams are only supported by counter-based generators");
+        goto out;
+    }
+    if (RandomGenerator_parse_stream(self, py_stream) != 0) {
+        goto out;
+    }
+    ret = 0;
+out:
+    return ret;
+}
+
 static PyObject *
 RandomGenerator_flat(RandomGenerator *self, PyObject *args)
 {
@@ -419,6 +536,9 @@ static PyGetSetDef RandomGenerator_getsetters[] = {
     {"seed", (getter) RandomGenerator_get_seed,
         (setter) RandomGenerator_set_seed,
             "The initial seed for this random generator" },
+    {"stream", (getter) RandomGenerator_get_stream,
+        (setter) RandomGenerator_set_stream,
+            "The stream of a counter-based random generator, or None" },
     {NULL}  /* Sentinel */
 };
 
@@ -435,6 +555,183 @@ static PyTypeObject RandomGeneratorType = {
     .tp_new = PyType_GenericNew,
 };
 
+/*===================================================================
+ * SweepTrajectoryStore
+ *===================================================================
+ */
+
+static int
+SweepTrajectoryStore_check_state(SweepTrajectoryStore *self)
+{
+    int ret = 0;
+    if (self->store == NULL) {
+        PyErr_SetString(PyExc_SystemError, "SweepTrajectoryStore not initialised");
+        ret = -1;
+    }
+    return ret;
+}
+
+static void
+SweepTrajectoryStore_dealloc(SweepTrajectoryStore* self)
+{
+    if (self->store != NULL) {
+        sweep_trajectory_store_free(self->store);
+        PyMem_Free(self->store);
+        self->store = NULL;
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int
+SweepTrajectoryStore_init(SweepTrajectoryStore *self, PyObject *args, PyObject *kwds)
+{
+    int ret = -1;
+    int err;
+    static char *kwlist[] = {"start_frequency", "end_frequency", "s", "dt",
+        "population_size", NULL};
+    double start_frequency, end_frequency, s, dt, population_size;
+
+    self->store = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ddddd", kwlist,
+                &start_frequency, &end_frequency, &s, &dt, &population_size)) {
+        goto out;
+    }
+    self->store = PyMem_Malloc(sizeof(*self->store));
+    if (self->store == NULL) {
+        PyErr_NoMemory();
+        goto out;
+    }
+    err = sweep_trajectory_store_alloc(self->store, start_frequency,
+            end_frequency, s, dt, population_size);
+    if (err != 0) {
+        handle_input_error("sweep trajectory store", err);
+        goto out;
+    }
+    ret = 0;
+out:
+    return ret;
+}
+
+static PyObject *
+SweepTrajectoryStore_generate(SweepTrajectoryStore *self, PyObject *args)
+{
+    PyObject *ret = NULL;
+    Py_ssize_t num_trajectories;
+    RandomGenerator *random_generator = NULL;
+    int err;
+
+    if (SweepTrajectoryStore_check_state(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTuple(args, "nO!", &num_trajectories,
+                &RandomGeneratorType, &random_generator)) {
+        goto out;
+    }
+    if (num_trajectories < 0) {
+        PyErr_SetString(PyExc_ValueError, "num_trajectories must be >= 0");
+        goto out;
+    }
+    if (RandomGenerator_check_state(random_generator) != 0) {
+        goto out;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    err = sweep_trajectory_store_generate(
+            self->store, (size_t) num_trajectories, random_generator->rng);
+    Py_END_ALLOW_THREADS
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    ret = Py_BuildValue("");
+out:
+    return ret;
+}
+
+static PyObject *
+SweepTrajectoryStore_get_trajectory(SweepTrajectoryStore *self, PyObject *args)
+{
+    PyObject *ret = NULL;
+    PyObject *time_array = NULL;
+    PyObject *allele_frequency_array = NULL;
+    Py_ssize_t index;
+    size_t num_steps;
+    const double *time, *allele_frequency;
+    npy_intp size;
+    int err;
+
+    if (SweepTrajectoryStore_check_state(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTuple(args, "n", &index)) {
+        goto out;
+    }
+    if (index < 0) {
+        PyErr_SetString(PyExc_IndexError, "trajectory index out of bounds");
+        goto out;
+    }
+    err = sweep_trajectory_store_get(
+            self->store, (size_t) index, &num_steps, &time, &allele_frequency);
+    if (err != 0) {
+        PyErr_SetString(PyExc_IndexError, "trajectory index out of bounds");
+        goto out;
+    }
+    size = (npy_intp) num_steps;
+    time_array = PyArray_SimpleNew(1, &size, NPY_FLOAT64);
+    allele_frequency_array = PyArray_SimpleNew(1, &size, NPY_FLOAT64);
+    if (time_array == NULL || allele_frequency_array == NULL) {
+        goto out;
+    }
+    memcpy(PyArray_DATA((PyArrayObject *) time_array), time,
+            num_steps * sizeof(*time));
+    memcpy(PyArray_DATA((PyArrayObject *) allele_frequency_array), allele_frequency,
+            num_steps * sizeof(*allele_frequency));
+    ret = Py_BuildValue("OO", time_array, allele_frequency_array);
+out:
+    Py_XDECREF(time_array);
+    Py_XDECREF(allele_frequency_array);
+    return ret;
+}
+
+static PyObject *
+SweepTrajectoryStore_get_num_trajectories(SweepTrajectoryStore *self, void *closure)
+{
+    PyObject *ret = NULL;
+
+    if (SweepTrajectoryStore_check_state(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("n", (Py_ssize_t) self->store->num_trajectories);
+out:
+    return ret;
+}
+
+static PyMethodDef SweepTrajectoryStore_methods[] = {
+    {"generate", (PyCFunction) SweepTrajectoryStore_generate,
+        METH_VARARGS, "Appends the specified number of trajectories"},
+    {"get_trajectory", (PyCFunction) SweepTrajectoryStore_get_trajectory,
+        METH_VARARGS, "Returns the (time, allele_frequency) of a trajectory"},
+    {NULL}  /* Sentinel */
+};
+
+static PyGetSetDef SweepTrajectoryStore_getsetters[] = {
+    {"num_trajectories", (getter) SweepTrajectoryStore_get_num_trajectories, NULL,
+            "The number of trajectories in the store" },
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject SweepTrajectoryStoreType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "_msprime.SweepTrajectoryStore",
+    .tp_basicsize = sizeof(SweepTrajectoryStore),
+    .tp_dealloc = (destructor)SweepTrajectoryStore_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "SweepTrajectoryStore objects",
+    .tp_methods = SweepTrajectoryStore_methods,
+    .tp_getset = SweepTrajectoryStore_getsetters,
+    .tp_init = (initproc)SweepTrajectoryStore_init,
+    .tp_new = PyType_GenericNew,
+};
+
 /*===================================================================
  * Base mutation model
  *===================================================================
@@ -1081,7 +1378,7 @@ Simulator_parse_simulation_model(Simulator *self, PyObject *py_model)
     PyObject *value;
     int is_hudson, is_dtwf, is_smc, is_smc_prime, is_smc_k, is_dirac, is_beta,
         is_sweep_genic_selection, is_fixed_pedigree;
-    double psi, c, alpha, truncation_point, hull_offset;
+    double psi, c, alpha, truncation_point, hull_offset, switch_threshold;
 
     hudson_s = Py_BuildValue("s", "hudson");
     if (hudson_s == NULL) {
@@ -1141,7 +1438,21 @@ Simulator_parse_simulation_model(Simulator *self, PyObject *py_model)
         goto out;
     }
     if (is_dtwf) {
-        err = msp_set_simulation_model_dtwf(self->sim);
+        switch_threshold = 0;
+        /* The switch_threshold is optional, and None for the plain DTWF */
+        value = PyDict_GetItemString(py_model, "switch_threshold");
+        if (value != NULL && value != Py_None) {
+            value = get_dict_number(py_model, "switch_threshold");
+            if (value == NULL) {
+                goto out;
+            }
+            switch_threshold = PyFloat_AsDouble(value);
+            if (switch_threshold < 0.0) {
+                PyErr_SetString(PyExc_ValueError, "Must have switch_threshold >= 0");
+                goto out;
+            }
+        }
+        err = msp_set_simulation_model_dtwf_hybrid(self->sim, switch_threshold);
     }
     is_fixed_pedigree = PyObject_RichCompareBool(py_name, fixed_pedigree_s, Py_EQ);
     if (is_fixed_pedigree == -1) {
@@ -1766,58 +2077,289 @@ out:
     return ret;
 }
 
+static void
+dtwf_population_task_draw(dtwf_population_task_t *task)
+{
+    size_t j;
+
+    task->err = 0;
+    for (j = task->thread; j < task->num_populations && task->err == 0;
+            j += task->num_threads) {
+        task->err = msp_dtwf_draw_population(task->msp, j);
+    }
+}
+
+static void
+dtwf_population_worker(void *arg)
+{
+    dtwf_population_task_t *task = (dtwf_population_task_t *) arg;
+
+    while (true) {
+        PyThread_acquire_lock(task->start, WAIT_LOCK);
+        if (task->quit) {
+            break;
+        }
+        dtwf_population_task_draw(task);
+        PyThread_release_lock(task->done);
+    }
+    PyThread_release_lock(task->done);
+}
+
+static void
+dtwf_thread_pool_free(dtwf_thread_pool_t *self)
+{
+    size_t j;
+    dtwf_population_task_t *task;
+
+    if (self->tasks != NULL) {
+        for (j = 0; j < self->num_threads; j++) {
+            task = &self->tasks[j];
+            if (j > 0 && !task->run_inline) {
+                task->quit = true;
+                PyThread_release_lock(task->start);
+                PyThread_acquire_lock(task->done, WAIT_LOCK);
+            }
+            if (task->start != NULL) {
+                PyThread_free_lock(task->start);
+            }
+            if (task->done != NULL) {
+                PyThread_free_lock(task->done);
+            }
+        }
+        free(self->tasks);
+        self->tasks = NULL;
+    }
+    self->num_threads = 0;
+}
+
+/* Starts one worker for each of the threads after the first, which is the
+ * caller's. Each worker waits on its start lock until it's given a
+ * generation, and releases its done lock when the draws are made. */
+static int
+dtwf_thread_pool_start(dtwf_thread_pool_t *self, size_t num_populations)
+{
+    int ret = 0;
+    size_t j;
+    size_t num_threads = GSL_MIN(self->max_threads, num_populations);
+    dtwf_population_task_t *task;
+
+    self->tasks = calloc(num_threads, sizeof(*self->tasks));
+    if (self->tasks == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < num_threads; j++) {
+        task = &self->tasks[j];
+        task->thread = j;
+        task->num_threads = num_threads;
+        task->num_populations = num_populations;
+        /* Tasks without a running thread are drawn inline, and are skipped
+         * when the pool is freed. */
+        task->run_inline = true;
+        self->num_threads = j + 1;
+        task->start = PyThread_allocate_lock();
+        task->done = PyThread_allocate_lock();
+        if (task->start == NULL || task->done == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        PyThread_acquire_lock(task->start, WAIT_LOCK);
+        PyThread_acquire_lock(task->done, WAIT_LOCK);
+        if (j > 0) {
+            task->run_inline = PyThread_start_new_thread(dtwf_population_worker, task)
+                == PYTHREAD_INVALID_THREAD_ID;
+        }
+    }
+out:
+    if (ret != 0) {
+        dtwf_thread_pool_free(self);
+    }
+    return ret;
+}
+
+/* DTWF population runner that draws the populations on the pool's threads,
+ * each taking every num_threads-th population. The caller draws the first
+ * share itself. This is called from msp_run with the GIL released, in the
+ * same way as run_mutgen_chunks_threaded. */
+static int
+run_dtwf_populations_threaded(msp_t *msp, size_t num_populations, void *arg)
+{
+    int ret = 0;
+    size_t j;
+    dtwf_thread_pool_t *pool = (dtwf_thread_pool_t *) arg;
+    dtwf_population_task_t *task;
+
+    if (pool->tasks == NULL) {
+        ret = dtwf_thread_pool_start(pool, num_populations);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    for (j = 0; j < pool->num_threads; j++) {
+        task = &pool->tasks[j];
+        task->msp = msp;
+        if (j > 0 && !task->run_inline) {
+            PyThread_release_lock(task->start);
+        }
+    }
+    for (j = 0; j < pool->num_threads; j++) {
+        task = &pool->tasks[j];
+        if (j == 0 || task->run_inline) {
+            dtwf_population_task_draw(task);
+        }
+    }
+    for (j = 0; j < pool->num_threads; j++) {
+        task = &pool->tasks[j];
+        if (j > 0 && !task->run_inline) {
+            PyThread_acquire_lock(task->done, WAIT_LOCK);
+        }
+        if (ret == 0) {
+            ret = task->err;
+        }
+    }
+out:
+    return ret;
+}
+
 static void
 Simulator_dealloc(Simulator* self)
 {
+    dtwf_thread_pool_free(&self->dtwf_thread_pool);
     if (self->sim != NULL) {
         msp_free(self->sim);
         PyMem_Free(self->sim);
         self->sim = NULL;
     }
+    if (self->mutgen != NULL) {
+        mutgen_free(self->mutgen);
+        PyMem_Free(self->mutgen);
+        self->mutgen = NULL;
+    }
     Py_XDECREF(self->random_generator);
     Py_XDECREF(self->tables);
+    Py_XDECREF(self->mutation_model);
+    Py_XDECREF(self->mutation_random_generator);
+    Py_XDECREF(self->sweep_trajectory_store);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
+/* Places mutations on the edges as they are stored during the simulation.
+ * The mutations are drawn from their own random generator, so that the
+ * ancestry is the same as it would be without them. This is not exposed
+ * through sim_ancestry, which has no mutation parameters; it is used
+ * directly by the tests and benchmarks. */
 static int
-Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
+Simulator_parse_mutation_generator(Simulator *self, PyObject *rate_map,
+        PyObject *py_model, RandomGenerator *random_generator, int discrete_genome)
 {
     int ret = -1;
-    int sim_ret;
-    static char *kwlist[] = {
-        "tables", "random_generator", "recombination_map",
-        "population_configuration", "migration_matrix",
-        "demographic_events", "model", "avl_node_block_size", "segment_block_size",
-        "node_mapping_block_size", "store_migrations", "start_time",
-        "additional_nodes", "coalescing_segments_only",
-        "num_labels", "gene_conversion_rate", "gene_conversion_tract_length", 
-        "discrete_genome", "ploidy", NULL};
-    PyObject *migration_matrix = NULL;
-    PyObject *population_configuration = NULL;
-    PyObject *demographic_events = NULL;
-    PyObject *py_model = NULL;
-    LightweightTableCollection *tables = NULL;
-    RandomGenerator *random_generator = NULL;
-    PyObject *recombination_map = NULL;
-    /* parameter defaults */
-    Py_ssize_t avl_node_block_size = 10;
-    Py_ssize_t segment_block_size = 10;
-    Py_ssize_t node_mapping_block_size = 10;
-    Py_ssize_t num_labels = 1;
-    Py_ssize_t num_populations = 1;
-    int store_migrations = false;
-    unsigned long additional_nodes = 0;
+    int err;
+    size_t size;
+    PyArrayObject *position_array = NULL;
+    PyArrayObject *rate_array = NULL;
+    mutation_model_t *model;
+
+    if (rate_map == NULL || py_model == NULL || random_generator == NULL) {
+        PyErr_SetString(PyExc_ValueError,
+            "mutation_rate_map, mutation_model and mutation_random_generator "
+            "must be specified together");
+        goto out;
+    }
+    if (RandomGenerator_check_state(random_generator) != 0) {
+        goto out;
+    }
+    model = parse_mutation_model(py_model);
+    if (model == NULL) {
+        goto out;
+    }
+    self->mutation_model = py_model;
+    self->mutation_random_generator = random_generator;
+    Py_INCREF(self->mutation_model);
+    Py_INCREF(self->mutation_random_generator);
+    self->mutgen = PyMem_Calloc(1, sizeof(*self->mutgen));
+    if (self->mutgen == NULL) {
+        PyErr_NoMemory();
+        goto out;
+    }
+    err = mutgen_alloc(self->mutgen, random_generator->rng, self->tables->tables,
+            model, 0);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    if (parse_rate_map(rate_map, &size, &position_array, &rate_array) != 0) {
+        goto out;
+    }
+    err = mutgen_set_rate_map(self->mutgen, size,
+            PyArray_DATA(position_array), PyArray_DATA(rate_array));
+    if (err != 0) {
+        handle_input_error("mutation rate map", err);
+        goto out;
+    }
+    err = msp_set_mutation_generator(self->sim, self->mutgen,
+            discrete_genome ? MSP_DISCRETE_SITES : 0);
+    if (err != 0) {
+        handle_input_error("mutation generator", err);
+        goto out;
+    }
+    ret = 0;
+out:
+    Py_XDECREF(position_array);
+    Py_XDECREF(rate_array);
+    return ret;
+}
+
+static int
+Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
+{
+    int ret = -1;
+    int sim_ret;
+    static char *kwlist[] = {
+        "tables", "random_generator", "recombination_map",
+        "population_configuration", "migration_matrix",
+        "demographic_events", "model", "avl_node_block_size", "segment_block_size",
+        "node_mapping_block_size", "store_migrations", "start_time",
+        "additional_nodes", "coalescing_segments_only",
+        "num_labels", "gene_conversion_rate", "gene_conversion_tract_length", 
+        "discrete_genome", "ploidy", "presize_tables", "rng_buffer_size",
+        "dtwf_num_threads", "mutation_rate_map", "mutation_model",
+        "mutation_random_generator", NULL};
+    PyObject *migration_matrix = NULL;
+    PyObject *population_configuration = NULL;
+    PyObject *demographic_events = NULL;
+    PyObject *py_model = NULL;
+    LightweightTableCollection *tables = NULL;
+    RandomGenerator *random_generator = NULL;
+    PyObject *recombination_map = NULL;
+    PyObject *mutation_rate_map = NULL;
+    PyObject *mutation_model = NULL;
+    RandomGenerator *mutation_random_generator = NULL;
+    /* parameter defaults */
+    Py_ssize_t avl_node_block_size = 10;
+    Py_ssize_t segment_block_size = 10;
+    Py_ssize_t node_mapping_block_size = 10;
+    Py_ssize_t num_labels = 1;
+    Py_ssize_t num_populations = 1;
+    int store_migrations = false;
+    unsigned long additional_nodes = 0;
     int coalescing_segments_only = true;
     int discrete_genome = true;
     double start_time = -1;
     double gene_conversion_rate = 0;
     double gene_conversion_tract_length = 1.0;
     int ploidy = 2;
+    int presize_tables = false;
+    Py_ssize_t rng_buffer_size = 0;
+    Py_ssize_t dtwf_num_threads = 0;
 
     self->sim = NULL;
     self->random_generator = NULL;
+    self->mutgen = NULL;
+    self->mutation_model = NULL;
+    self->mutation_random_generator = NULL;
+    self->sweep_trajectory_store = NULL;
     if (!PyArg_ParseTupleAndKeywords(args, kwds,
-            "O!O!|O!O!OO!O!nnnidkinddii", kwlist,
+            "O!O!|O!O!OO!O!nnnidkinddiiinnO!OO!", kwlist,
             &LightweightTableCollectionType, &tables,
             &RandomGeneratorType, &random_generator,
             /* optional */
@@ -1830,7 +2372,10 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
             &node_mapping_block_size, &store_migrations, &start_time,
             &additional_nodes, &coalescing_segments_only, &num_labels,
             &gene_conversion_rate, &gene_conversion_tract_length,
-            &discrete_genome, &ploidy)) {
+            &discrete_genome, &ploidy, &presize_tables, &rng_buffer_size,
+            &dtwf_num_threads,
+            &PyDict_Type, &mutation_rate_map, &mutation_model,
+            &RandomGeneratorType, &mutation_random_generator)) {
         goto out;
     }
     self->random_generator = random_generator;
@@ -1951,7 +2496,36 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
     }
     msp_set_additional_nodes(self->sim, (uint32_t) additional_nodes);
     msp_set_coalescing_segments_only(self->sim, coalescing_segments_only);
-    
+    msp_set_presize_tables(self->sim, (bool) presize_tables);
+    if (rng_buffer_size < 0) {
+        PyErr_SetString(PyExc_ValueError, "rng_buffer_size must be >= 0");
+        goto out;
+    }
+    sim_ret = msp_set_rng_buffer_size(self->sim, (size_t) rng_buffer_size);
+    if (sim_ret != 0) {
+        handle_input_error("rng_buffer_size", sim_ret);
+        goto out;
+    }
+    if (dtwf_num_threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "dtwf_num_threads must be >= 0");
+        goto out;
+    }
+    /* With zero threads, the DTWF draws from the simulation's stream as it
+     * goes; otherwise each population draws from its own stream. */
+    self->dtwf_thread_pool.max_threads = (size_t) dtwf_num_threads;
+    if (dtwf_num_threads > 0) {
+        msp_set_dtwf_population_runner(
+            self->sim, run_dtwf_populations_threaded, &self->dtwf_thread_pool);
+    }
+    if (mutation_rate_map != NULL || mutation_model != NULL
+            || mutation_random_generator != NULL) {
+        if (Simulator_parse_mutation_generator(self, mutation_rate_map,
+                    mutation_model, mutation_random_generator,
+                    discrete_genome) != 0) {
+            goto out;
+        }
+    }
+
     sim_ret = msp_initialise(self->sim);
     if (sim_ret != 0) {
         handle_input_error("initialise", sim_ret);
@@ -2024,6 +2598,17 @@ Simulator_get_model(Simulator *self, void *closure)
         Py_DECREF(value);
         value = NULL;
         /* TODO fill in the parameters for the different types of trajectories. */
+    } else if (model->type == MSP_MODEL_DTWF
+            && model->params.dtwf.switch_threshold > 0) {
+        value = Py_BuildValue("d", model->params.dtwf.switch_threshold);
+        if (value == NULL) {
+            goto out;
+        }
+        if (PyDict_SetItemString(d, "switch_threshold", value) != 0) {
+            goto out;
+        }
+        Py_DECREF(value);
+        value = NULL;
     } else if (model->type == MSP_MODEL_SMC_K) {
         value = Py_BuildValue("d", model->params.smc_k_coalescent.hull_offset);
         if (value == NULL) {
@@ -2221,6 +2806,62 @@ out:
     return ret;
 }
 
+static PyObject *
+Simulator_get_sweep_trajectory(Simulator *self, void *closure)
+{
+    PyObject *ret = NULL;
+    PyObject *time_array = NULL;
+    PyObject *allele_frequency_array = NULL;
+    size_t num_steps;
+    const double *time, *allele_frequency;
+    npy_intp size;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    msp_get_sweep_trajectory(self->sim, &num_steps, &time, &allele_frequency);
+    if (num_steps == 0) {
+        Py_INCREF(Py_None);
+        ret = Py_None;
+        goto out;
+    }
+    size = (npy_intp) num_steps;
+    time_array = PyArray_SimpleNew(1, &size, NPY_FLOAT64);
+    allele_frequency_array = PyArray_SimpleNew(1, &size, NPY_FLOAT64);
+    if (time_array == NULL || allele_frequency_array == NULL) {
+        goto out;
+    }
+    memcpy(PyArray_DATA((PyArrayObject *) time_array), time,
+            num_steps * sizeof(*time));
+    memcpy(PyArray_DATA((PyArrayObject *) allele_frequency_array), allele_frequency,
+            num_steps * sizeof(*allele_frequency));
+    ret = Py_BuildValue("OO", time_array, allele_frequency_array);
+out:
+    Py_XDECREF(time_array);
+    Py_XDECREF(allele_frequency_array);
+    return ret;
+}
+
+static PyObject *
+Simulator_get_dtwf_switch_time(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    double switch_time;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    switch_time = msp_get_dtwf_switch_time(self->sim);
+    if (switch_time == -DBL_MAX) {
+        Py_INCREF(Py_None);
+        ret = Py_None;
+    } else {
+        ret = Py_BuildValue("d", switch_time);
+    }
+out:
+    return ret;
+}
+
 static PyObject *
 Simulator_get_num_ancestors(Simulator *self, void *closure)
 {
@@ -2462,6 +3103,29 @@ out:
     return ret;
 }
 
+static PyObject *
+Simulator_get_table_capacity(Simulator *self, void *closure)
+{
+    PyObject *ret = NULL;
+    table_capacity_t capacity;
+    int err;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    err = msp_get_table_capacity(self->sim, &capacity);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    ret = Py_BuildValue("{s:n,s:n,s:n}",
+            "num_nodes", (Py_ssize_t) capacity.num_nodes,
+            "num_edges", (Py_ssize_t) capacity.num_edges,
+            "num_migrations", (Py_ssize_t) capacity.num_migrations);
+out:
+    return ret;
+}
+
 static PyObject *
 Simulator_individual_to_python(Simulator *self, segment_t *ind)
 {
@@ -2732,7 +3396,9 @@ Simulator_finalise_tables(Simulator *self)
         goto out;
     }
     /* finalise the tables so that any uncoalesced segments are recorded */
+    Py_BEGIN_ALLOW_THREADS
     status = msp_finalise_tables(self->sim);
+    Py_END_ALLOW_THREADS
     if (status != 0) {
         handle_library_error(status);
         goto out;
@@ -2751,7 +3417,9 @@ Simulator_reset(Simulator *self)
     if (Simulator_check_sim(self) != 0) {
         goto out;
     }
+    Py_BEGIN_ALLOW_THREADS
     status = msp_reset(self->sim);
+    Py_END_ALLOW_THREADS
     if (status < 0) {
         handle_library_error(status);
         goto out;
@@ -2761,107 +3429,577 @@ out:
     return ret;
 }
 
+static void
+owned_array_capsule_destructor(PyObject *capsule)
+{
+    free(PyCapsule_GetPointer(capsule, NULL));
+}
+
+/* Returns a 1D array that takes ownership of the specified malloc'd buffer,
+ * which is freed on error. A NULL buffer gives an array of zeros. */
 static PyObject *
-Simulator_debug_demography(Simulator *self)
+make_owned_array(void *data, npy_intp size, int type)
 {
     PyObject *ret = NULL;
-    int status;
-    double end_time;
+    PyObject *array = NULL;
+    PyObject *capsule = NULL;
 
-    if (Simulator_check_sim(self) != 0) {
+    if (data == NULL) {
+        ret = PyArray_ZEROS(1, &size, type, 0);
         goto out;
     }
-    status = msp_debug_demography(self->sim, &end_time);
-    if (status < 0) {
-        handle_library_error(status);
+    capsule = PyCapsule_New(data, NULL, owned_array_capsule_destructor);
+    if (capsule == NULL) {
+        free(data);
         goto out;
     }
-    ret = Py_BuildValue("d", end_time);
+    array = PyArray_SimpleNewFromData(1, &size, type, data);
+    if (array == NULL) {
+        goto out;
+    }
+    /* The array steals the reference to the capsule, even on failure */
+    if (PyArray_SetBaseObject((PyArrayObject *) array, capsule) != 0) {
+        capsule = NULL;
+        goto out;
+    }
+    capsule = NULL;
+    ret = array;
+    array = NULL;
 out:
+    Py_XDECREF(capsule);
+    Py_XDECREF(array);
     return ret;
 }
 
-static PyObject *
-Simulator_compute_population_size(Simulator *self, PyObject *args)
-{
+typedef struct {
+    const char *name;
+    void *data;
+    npy_intp size;
+    int type;
+} owned_column_t;
 
-    PyObject *ret = NULL;
-    int sim_ret, population_id;
-    double time, size;
+/* Moves the specified column buffers into arrays in the dict. All of the
+ * buffers are owned by arrays or freed on return. */
+static int
+move_columns(PyObject *dict, owned_column_t *columns, size_t num_columns)
+{
+    int ret = -1;
+    int err;
+    size_t j;
+    PyObject *array;
 
-    if (Simulator_check_sim(self) != 0) {
-        goto out;
-    }
-    if (!PyArg_ParseTuple(args, "id", &population_id, &time)) {
-        goto out;
-    }
-    sim_ret = msp_compute_population_size(self->sim, population_id, time, &size);
-    if (sim_ret != 0) {
-        handle_library_error(sim_ret);
-        goto out;
+    for (j = 0; j < num_columns; j++) {
+        array = make_owned_array(columns[j].data, columns[j].size, columns[j].type);
+        columns[j].data = NULL;
+        if (array == NULL) {
+            goto out;
+        }
+        err = PyDict_SetItemString(dict, columns[j].name, array);
+        Py_DECREF(array);
+        if (err != 0) {
+            goto out;
+        }
     }
-    ret = Py_BuildValue("d", size);
+    ret = 0;
 out:
+    for (; j < num_columns; j++) {
+        free(columns[j].data);
+    }
     return ret;
 }
 
 static PyObject *
-Simulator_fenwick_drift(Simulator *self, PyObject *args)
+get_table_dict(PyObject *dict, const char *name)
 {
+    PyObject *table_dict = PyDict_GetItemString(dict, name);
 
-    PyObject *ret = NULL;
-    int label;
-    double drift = 0;
+    if (table_dict == NULL || !PyDict_Check(table_dict)) {
+        PyErr_Format(PyExc_SystemError, "No '%s' table in tables dict", name);
+        table_dict = NULL;
+    }
+    return table_dict;
+}
 
-    if (Simulator_check_sim(self) != 0) {
+static int
+move_node_columns(PyObject *dict, tsk_node_table_t *nodes)
+{
+    npy_intp n = (npy_intp) nodes->num_rows;
+    owned_column_t columns[] = {
+        { "flags", nodes->flags, n, NPY_UINT32 },
+        { "time", nodes->time, n, NPY_FLOAT64 },
+        { "population", nodes->population, n, NPY_INT32 },
+        { "individual", nodes->individual, n, NPY_INT32 },
+        { "metadata", nodes->metadata, (npy_intp) nodes->metadata_length, NPY_INT8 },
+        { "metadata_offset", nodes->metadata_offset, n + 1, NPY_UINT64 },
+    };
+
+    nodes->flags = NULL;
+    nodes->time = NULL;
+    nodes->population = NULL;
+    nodes->individual = NULL;
+    nodes->metadata = NULL;
+    nodes->metadata_offset = NULL;
+    return move_columns(dict, columns, sizeof(columns) / sizeof(*columns));
+}
+
+static int
+move_edge_columns(PyObject *dict, tsk_edge_table_t *edges)
+{
+    npy_intp n = (npy_intp) edges->num_rows;
+    owned_column_t columns[] = {
+        { "left", edges->left, n, NPY_FLOAT64 },
+        { "right", edges->right, n, NPY_FLOAT64 },
+        { "parent", edges->parent, n, NPY_INT32 },
+        { "child", edges->child, n, NPY_INT32 },
+        { "metadata", edges->metadata, (npy_intp) edges->metadata_length, NPY_INT8 },
+        { "metadata_offset", edges->metadata_offset, n + 1, NPY_UINT64 },
+    };
+
+    edges->left = NULL;
+    edges->right = NULL;
+    edges->parent = NULL;
+    edges->child = NULL;
+    edges->metadata = NULL;
+    edges->metadata_offset = NULL;
+    return move_columns(dict, columns, sizeof(columns) / sizeof(*columns));
+}
+
+static int
+move_migration_columns(PyObject *dict, tsk_migration_table_t *migrations)
+{
+    npy_intp n = (npy_intp) migrations->num_rows;
+    owned_column_t columns[] = {
+        { "left", migrations->left, n, NPY_FLOAT64 },
+        { "right", migrations->right, n, NPY_FLOAT64 },
+        { "node", migrations->node, n, NPY_INT32 },
+        { "source", migrations->source, n, NPY_INT32 },
+        { "dest", migrations->dest, n, NPY_INT32 },
+        { "time", migrations->time, n, NPY_FLOAT64 },
+        { "metadata", migrations->metadata, (npy_intp) migrations->metadata_length,
+            NPY_INT8 },
+        { "metadata_offset", migrations->metadata_offset, n + 1, NPY_UINT64 },
+    };
+
+    migrations->left = NULL;
+    migrations->right = NULL;
+    migrations->node = NULL;
+    migrations->source = NULL;
+    migrations->dest = NULL;
+    migrations->time = NULL;
+    migrations->metadata = NULL;
+    migrations->metadata_offset = NULL;
+    return move_columns(dict, columns, sizeof(columns) / sizeof(*columns));
+}
+
+/* Initialises the specified tables with copies of the input rows of the
+ * simulator's node, edge and migration tables. */
+static int
+Simulator_copy_input_rows(Simulator *self, tsk_node_table_t *nodes,
+        tsk_edge_table_t *edges, tsk_migration_table_t *migrations)
+{
+    int err;
+    tsk_table_collection_t *tables = self->tables->tables;
+    const tsk_bookmark_t *input = &self->sim->input_position;
+
+    err = tsk_node_table_init(nodes, 0);
+    if (err != 0) {
         goto out;
     }
-    if (!PyArg_ParseTuple(args, "i", &label)) {
+    err = tsk_node_table_append_columns(nodes, input->nodes, tables->nodes.flags,
+            tables->nodes.time, tables->nodes.population, tables->nodes.individual,
+            tables->nodes.metadata, tables->nodes.metadata_offset);
+    if (err != 0) {
         goto out;
     }
-    if (label < 0 || label >= (int) msp_get_num_labels(self->sim)) {
-        PyErr_SetString(PyExc_ValueError, "bad label ID");
+    err = tsk_node_table_set_metadata_schema(nodes, tables->nodes.metadata_schema,
+            tables->nodes.metadata_schema_length);
+    if (err != 0) {
         goto out;
     }
-    /* TODO need a better API for this, as we should also think about the
-     * drift in the GC map. */
-    if (self->sim->recomb_mass_index != NULL) {
-        drift = fenwick_get_numerical_drift(&self->sim->recomb_mass_index[label]);
+    err = tsk_edge_table_init(edges, tables->edges.options);
+    if (err != 0) {
+        goto out;
     }
-    ret = Py_BuildValue("d", drift);
-out:
-    return ret;
-}
-
-static FILE *
-make_file(PyObject *fileobj, const char *mode)
-{
-    FILE *ret = NULL;
-    FILE *file = NULL;
-    int fileobj_fd, new_fd;
-
-    fileobj_fd = PyObject_AsFileDescriptor(fileobj);
-    if (fileobj_fd == -1) {
+    err = tsk_edge_table_append_columns(edges, input->edges, tables->edges.left,
+            tables->edges.right, tables->edges.parent, tables->edges.child,
+            tables->edges.metadata, tables->edges.metadata_offset);
+    if (err != 0) {
         goto out;
     }
-    new_fd = dup(fileobj_fd);
-    if (new_fd == -1) {
-        PyErr_SetFromErrno(PyExc_OSError);
+    err = tsk_edge_table_set_metadata_schema(edges, tables->edges.metadata_schema,
+            tables->edges.metadata_schema_length);
+    if (err != 0) {
         goto out;
     }
-    file = fdopen(new_fd, mode);
-    if (file == NULL) {
-        (void) close(new_fd);
-        PyErr_SetFromErrno(PyExc_OSError);
+    err = tsk_migration_table_init(migrations, 0);
+    if (err != 0) {
         goto out;
     }
-    ret = file;
+    err = tsk_migration_table_append_columns(migrations, input->migrations,
+            tables->migrations.left, tables->migrations.right,
+            tables->migrations.node, tables->migrations.source,
+            tables->migrations.dest, tables->migrations.time,
+            tables->migrations.metadata, tables->migrations.metadata_offset);
+    if (err != 0) {
+        goto out;
+    }
+    err = tsk_migration_table_set_metadata_schema(migrations,
+            tables->migrations.metadata_schema,
+            tables->migrations.metadata_schema_length);
 out:
-    return ret;
+    return err;
+}
+
+static void
+Simulator_swap_output_tables(Simulator *self, tsk_node_table_t *nodes,
+        tsk_edge_table_t *edges, tsk_migration_table_t *migrations)
+{
+    tsk_table_collection_t *tables = self->tables->tables;
+    tsk_node_table_t tmp_nodes = tables->nodes;
+    tsk_edge_table_t tmp_edges = tables->edges;
+    tsk_migration_table_t tmp_migrations = tables->migrations;
+
+    tables->nodes = *nodes;
+    tables->edges = *edges;
+    tables->migrations = *migrations;
+    *nodes = tmp_nodes;
+    *edges = tmp_edges;
+    *migrations = tmp_migrations;
 }
 
+/* Returns the simulated tables in the same dict format as tables.asdict().
+ * The buffers of the node, edge and migration tables and the edge indexes
+ * are moved into the returned arrays rather than copied out of the simulator,
+ * and the simulator's tables are left holding only their input rows, ready
+ * for reset. tskit's TableCollection.fromdict copies the arrays into its
+ * own tables, so the columns are still copied once on the way to tskit. */
 static PyObject *
-Simulator_print_state(Simulator *self, PyObject *args)
+Simulator_take_tables(Simulator *self)
+{
+    PyObject *ret = NULL;
+    PyObject *dict = NULL;
+    PyObject *table_dict;
+    PyObject *indexes_dict = NULL;
+    tsk_table_collection_t *tables;
+    tsk_node_table_t nodes;
+    tsk_edge_table_t edges;
+    tsk_migration_table_t migrations;
+    tsk_id_t *insertion_order = NULL;
+    tsk_id_t *removal_order = NULL;
+    npy_intp num_indexed_edges = 0;
+    bool has_index;
+    int err;
+
+    memset(&nodes, 0, sizeof(nodes));
+    memset(&edges, 0, sizeof(edges));
+    memset(&migrations, 0, sizeof(migrations));
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    tables = self->tables->tables;
+    err = Simulator_copy_input_rows(self, &nodes, &edges, &migrations);
+    if (err != 0) {
+        handle_tskit_library_error(err);
+        goto out;
+    }
+    has_index = tsk_table_collection_has_index(tables, 0);
+    if (has_index) {
+        insertion_order = tables->indexes.edge_insertion_order;
+        removal_order = tables->indexes.edge_removal_order;
+        num_indexed_edges = (npy_intp) tables->indexes.num_edges;
+        tables->indexes.edge_insertion_order = NULL;
+        tables->indexes.edge_removal_order = NULL;
+        tables->indexes.num_edges = 0;
+    } else {
+        /* Any index buffers left over from earlier are stale, and would
+         * otherwise be left pointing at edges we're about to take. */
+        err = tsk_table_collection_drop_index(tables, 0);
+        if (err != 0) {
+            handle_tskit_library_error(err);
+            goto out;
+        }
+    }
+    Simulator_swap_output_tables(self, &nodes, &edges, &migrations);
+
+    /* The remaining tables are small, so we copy them as usual. */
+    dict = PyObject_CallMethod((PyObject *) self->tables, "asdict", NULL);
+    if (dict == NULL) {
+        Simulator_swap_output_tables(self, &nodes, &edges, &migrations);
+        if (has_index) {
+            tables->indexes.edge_insertion_order = insertion_order;
+            tables->indexes.edge_removal_order = removal_order;
+            tables->indexes.num_edges = (tsk_size_t) num_indexed_edges;
+            insertion_order = NULL;
+            removal_order = NULL;
+        }
+        goto out;
+    }
+    table_dict = get_table_dict(dict, "nodes");
+    if (table_dict == NULL || move_node_columns(table_dict, &nodes) != 0) {
+        goto out;
+    }
+    table_dict = get_table_dict(dict, "edges");
+    if (table_dict == NULL || move_edge_columns(table_dict, &edges) != 0) {
+        goto out;
+    }
+    table_dict = get_table_dict(dict, "migrations");
+    if (table_dict == NULL || move_migration_columns(table_dict, &migrations) != 0) {
+        goto out;
+    }
+    if (has_index) {
+        owned_column_t columns[] = {
+            { "edge_insertion_order", insertion_order, num_indexed_edges, NPY_INT32 },
+            { "edge_removal_order", removal_order, num_indexed_edges, NPY_INT32 },
+        };
+        insertion_order = NULL;
+        removal_order = NULL;
+        indexes_dict = PyDict_New();
+        if (indexes_dict == NULL) {
+            free(columns[0].data);
+            free(columns[1].data);
+            goto out;
+        }
+        if (move_columns(indexes_dict, columns, 2) != 0) {
+            goto out;
+        }
+        if (PyDict_SetItemString(dict, "indexes", indexes_dict) != 0) {
+            goto out;
+        }
+    }
+    ret = dict;
+    dict = NULL;
+out:
+    tsk_node_table_free(&nodes);
+    tsk_edge_table_free(&edges);
+    tsk_migration_table_free(&migrations);
+    free(insertion_order);
+    free(removal_order);
+    Py_XDECREF(indexes_dict);
+    Py_XDECREF(dict);
+    return ret;
+}
+
+static PyObject *
+Simulator_debug_demography(Simulator *self)
+{
+    PyObject *ret = NULL;
+    int status;
+    double end_time;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    status = msp_debug_demography(self->sim, &end_time);
+    if (status < 0) {
+        handle_library_error(status);
+        goto out;
+    }
+    ret = Py_BuildValue("d", end_time);
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_compute_population_size(Simulator *self, PyObject *args)
+{
+
+    PyObject *ret = NULL;
+    int sim_ret, population_id;
+    double time, size;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTuple(args, "id", &population_id, &time)) {
+        goto out;
+    }
+    sim_ret = msp_compute_population_size(self->sim, population_id, time, &size);
+    if (sim_ret != 0) {
+        handle_library_error(sim_ret);
+        goto out;
+    }
+    ret = Py_BuildValue("d", size);
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_fenwick_drift(Simulator *self, PyObject *args)
+{
+
+    PyObject *ret = NULL;
+    int label;
+    double drift = 0;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTuple(args, "i", &label)) {
+        goto out;
+    }
+    if (label < 0 || label >= (int) msp_get_num_labels(self->sim)) {
+        PyErr_SetString(PyExc_ValueError, "bad label ID");
+        goto out;
+    }
+    /* TODO need a better API for this, as we should also think about the
+     * drift in the GC map. */
+    if (self->sim->recomb_mass_index != NULL) {
+        drift = fenwick_get_numerical_drift(&self->sim->recomb_mass_index[label]);
+    }
+    ret = Py_BuildValue("d", drift);
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_reserve_table_capacity(Simulator *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    static char *kwlist[] = {"num_nodes", "num_edges", "num_migrations", NULL};
+    Py_ssize_t num_nodes = 0;
+    Py_ssize_t num_edges = 0;
+    Py_ssize_t num_migrations = 0;
+    int err;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|nnn", kwlist,
+                &num_nodes, &num_edges, &num_migrations)) {
+        goto out;
+    }
+    if (num_nodes < 0 || num_edges < 0 || num_migrations < 0) {
+        PyErr_SetString(PyExc_ValueError, "Table capacities must be >= 0");
+        goto out;
+    }
+    err = msp_reserve_table_capacity(self->sim, (tsk_size_t) num_nodes,
+            (tsk_size_t) num_edges, (tsk_size_t) num_migrations);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    ret = Py_BuildValue("");
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_set_sweep_trajectory(Simulator *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    static char *kwlist[] = {"time", "allele_frequency", NULL};
+    PyArrayObject *time_array = NULL;
+    PyArrayObject *allele_frequency_array = NULL;
+    size_t num_steps;
+    int err;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&O&", kwlist,
+                double_PyArray_converter, &time_array,
+                double_PyArray_converter, &allele_frequency_array)) {
+        goto out;
+    }
+    num_steps = (size_t) PyArray_DIMS(time_array)[0];
+    if (num_steps != (size_t) PyArray_DIMS(allele_frequency_array)[0]) {
+        PyErr_SetString(PyExc_ValueError,
+            "time and allele_frequency must have the same length");
+        goto out;
+    }
+    err = msp_set_sweep_trajectory(self->sim, num_steps,
+            PyArray_DATA(time_array), PyArray_DATA(allele_frequency_array));
+    if (err != 0) {
+        handle_input_error("sweep trajectory", err);
+        goto out;
+    }
+    ret = Py_BuildValue("");
+out:
+    Py_XDECREF(time_array);
+    Py_XDECREF(allele_frequency_array);
+    return ret;
+}
+
+static PyObject *
+Simulator_set_sweep_trajectory_store(Simulator *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    static char *kwlist[] = {"store", "next_trajectory", NULL};
+    PyObject *py_store = NULL;
+    SweepTrajectoryStore *store = NULL;
+    Py_ssize_t next_trajectory = 0;
+    int err;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|n", kwlist,
+                &py_store, &next_trajectory)) {
+        goto out;
+    }
+    if (py_store != Py_None) {
+        if (!PyObject_TypeCheck(py_store, &SweepTrajectoryStoreType)) {
+            PyErr_SetString(PyExc_TypeError,
+                "store must be a SweepTrajectoryStore or None");
+            goto out;
+        }
+        store = (SweepTrajectoryStore *) py_store;
+        if (SweepTrajectoryStore_check_state(store) != 0) {
+            goto out;
+        }
+    }
+    if (next_trajectory < 0) {
+        PyErr_SetString(PyExc_ValueError, "next_trajectory must be >= 0");
+        goto out;
+    }
+    err = msp_set_sweep_trajectory_store(
+            self->sim, store == NULL ? NULL : store->store);
+    if (err == 0 && store != NULL) {
+        err = msp_set_next_sweep_trajectory(self->sim, (size_t) next_trajectory);
+    }
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    /* The simulator refers to the store's trajectories, so keep it alive */
+    Py_XINCREF(store);
+    Py_XDECREF(self->sweep_trajectory_store);
+    self->sweep_trajectory_store = store;
+    ret = Py_BuildValue("");
+out:
+    return ret;
+}
+
+static FILE *
+make_file(PyObject *fileobj, const char *mode)
+{
+    FILE *ret = NULL;
+    FILE *file = NULL;
+    int fileobj_fd, new_fd;
+
+    fileobj_fd = PyObject_AsFileDescriptor(fileobj);
+    if (fileobj_fd == -1) {
+        goto out;
+    }
+    new_fd = dup(fileobj_fd);
+    if (new_fd == -1) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        goto out;
+    }
+    file = fdopen(new_fd, mode);
+    if (file == NULL) {
+        (void) close(new_fd);
+        PyErr_SetFromErrno(PyExc_OSError);
+        goto out;
+    }
+    ret = file;
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_print_state(Simulator *self, PyObject *args)
 {
     PyObject *ret = NULL;
     PyObject *fileobj;
@@ -2914,8 +4052,21 @@ static PyMethodDef Simulator_methods[] = {
             "if sample has coalesced and False otherwise." },
     {"reset", (PyCFunction) Simulator_reset, METH_NOARGS,
             "Resets the simulation so it's ready for another replicate."},
+    {"take_tables", (PyCFunction) Simulator_take_tables, METH_NOARGS,
+            "Returns the simulated tables as a dict, moving the node, edge and "
+            "migration columns out of the simulator into the returned arrays." },
     {"finalise_tables", (PyCFunction) Simulator_finalise_tables, METH_NOARGS,
             "Finalises the tables so they're ready for export."},
+    {"set_sweep_trajectory",
+            (PyCFunction) Simulator_set_sweep_trajectory,
+            METH_VARARGS|METH_KEYWORDS,
+            "Sets the trajectory used by all subsequent sweeps. Empty arrays "
+            "mean each sweep generates its own trajectory."},
+    {"set_sweep_trajectory_store",
+            (PyCFunction) Simulator_set_sweep_trajectory_store,
+            METH_VARARGS|METH_KEYWORDS,
+            "Sets the store that subsequent sweeps take their trajectories from, "
+            "starting at next_trajectory, or None to generate them." },
     {"debug_demography", (PyCFunction) Simulator_debug_demography, METH_NOARGS,
             "Runs the state of the simulator forward for one demographic event."},
     {"compute_population_size",
@@ -2925,6 +4076,11 @@ static PyMethodDef Simulator_methods[] = {
             (PyCFunction) Simulator_fenwick_drift, METH_VARARGS,
             "Return the numerical drift in the specified label's recombination tree. "
             "Debug method."},
+    {"reserve_table_capacity",
+            (PyCFunction) Simulator_reserve_table_capacity,
+            METH_VARARGS|METH_KEYWORDS,
+            "Reserves space for the specified numbers of rows in the output "
+            "node, edge and migration tables."},
     {"print_state",
             (PyCFunction) Simulator_print_state, METH_VARARGS,
             "Prints out the state of the low-level simulator. Debug method."},
@@ -3053,11 +4209,20 @@ static PyGetSetDef Simulator_getsetters[] = {
     {"ploidy",
             (getter) Simulator_get_ploidy, NULL,
             "Returns the simulation ploidy." },
+    {"table_capacity",
+            (getter) Simulator_get_table_capacity, NULL,
+            "The numbers of rows reserved in the output tables." },
     {"tables",
             (getter) Simulator_get_tables, NULL,
             "The tables"},
     {"time", (getter) Simulator_get_time, NULL,
             "The current simulation time" },
+    {"sweep_trajectory", (getter) Simulator_get_sweep_trajectory, NULL,
+            "The (time, allele_frequency) trajectory of the current or most "
+            "recent sweep, or None." },
+    {"dtwf_switch_time", (getter) Simulator_get_dtwf_switch_time, NULL,
+            "The time at which the hybrid DTWF switched to the coalescent, "
+            "or None" },
     {NULL}  /* Sentinel */
 };
 
@@ -3118,6 +4283,71 @@ out:
     return model;
 }
 
+typedef struct {
+    mutgen_t *mutgen;
+    size_t chunk;
+    int err;
+    PyThread_type_lock done;
+} mutgen_chunk_task_t;
+
+static void
+mutgen_chunk_task_run(void *arg)
+{
+    mutgen_chunk_task_t *task = (mutgen_chunk_task_t *) arg;
+
+    task->err = mutgen_place_chunk(task->mutgen, task->chunk);
+    PyThread_release_lock(task->done);
+}
+
+/* Chunk runner that places each chunk on its own thread. This is called
+ * with the GIL released and the threads do not touch any Python objects.
+ * If a thread can't be started, its chunk is placed on the calling thread. */
+static int
+run_mutgen_chunks_threaded(mutgen_t *mutgen, size_t num_chunks, void *MSP_UNUSED(arg))
+{
+    int ret = 0;
+    size_t j;
+    mutgen_chunk_task_t *tasks = calloc(num_chunks, sizeof(*tasks));
+
+    if (tasks == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < num_chunks; j++) {
+        tasks[j].mutgen = mutgen;
+        tasks[j].chunk = j;
+        tasks[j].done = PyThread_allocate_lock();
+        if (tasks[j].done == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        PyThread_acquire_lock(tasks[j].done, WAIT_LOCK);
+    }
+    for (j = 1; j < num_chunks; j++) {
+        if (PyThread_start_new_thread(mutgen_chunk_task_run, &tasks[j])
+                == PYTHREAD_INVALID_THREAD_ID) {
+            mutgen_chunk_task_run(&tasks[j]);
+        }
+    }
+    mutgen_chunk_task_run(&tasks[0]);
+    for (j = 0; j < num_chunks; j++) {
+        PyThread_acquire_lock(tasks[j].done, WAIT_LOCK);
+        if (ret == 0) {
+            ret = tasks[j].err;
+        }
+    }
+out:
+    if (tasks != NULL) {
+        for (j = 0; j < num_chunks; j++) {
+            if (tasks[j].done != NULL) {
+                PyThread_free_lock(tasks[j].done);
+            }
+        }
+        free(tasks);
+    }
+    return ret;
+}
+
 static PyObject *
 msprime_sim_mutations(PyObject *self, PyObject *args, PyObject *kwds)
 {
@@ -3135,20 +4365,25 @@ msprime_sim_mutations(PyObject *self, PyObject *args, PyObject *kwds)
     size_t size;
     mutation_model_t *model = NULL;
     int discrete_genome = false;
+    Py_ssize_t num_threads = 0;
     static char *kwlist[] = {
         "tables", "random_generator", "rate_map", "model",
         "discrete_genome", "keep",
-        "start_time", "end_time", NULL};
+        "start_time", "end_time", "num_threads", NULL};
     mutgen_t mutgen;
     int err;
 
     memset(&mutgen, 0, sizeof(mutgen));
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O!O|iidd", kwlist,
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O!O|iiddn", kwlist,
             &LightweightTableCollectionType, &tables,
             &RandomGeneratorType, &random_generator,
             &PyDict_Type, &rate_map,
             &py_model, &discrete_genome, &keep,
-            &start_time, &end_time)) {
+            &start_time, &end_time, &num_threads)) {
+        goto out;
+    }
+    if (num_threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "num_threads must be >= 0");
         goto out;
     }
     if (LightweightTableCollection_check_state(tables) != 0
@@ -3189,7 +4424,16 @@ msprime_sim_mutations(PyObject *self, PyObject *args, PyObject *kwds)
     if (keep) {
         flags |= MSP_KEEP_SITES;
     }
-    err = mutgen_generate(&mutgen, flags);
+    if (num_threads == 0) {
+        err = mutgen_generate(&mutgen, flags);
+    } else {
+        /* Mutations are placed in one chunk of edges per thread */
+        mutgen_set_num_chunks(&mutgen, (size_t) num_threads);
+        mutgen_set_chunk_runner(&mutgen, run_mutgen_chunks_threaded, NULL);
+        Py_BEGIN_ALLOW_THREADS
+        err = mutgen_generate(&mutgen, flags);
+        Py_END_ALLOW_THREADS
+    }
     if (err != 0) {
         handle_library_error(err);
         goto out;
@@ -3242,6 +4486,279 @@ out:
     return ret;
 }
 
+/* Evaluates the log-likelihood of an ARG with the specified statistics and
+ * its gradient for arrays of parameters, returning a tuple of arrays. */
+static PyObject *
+build_log_likelihood_arg_arrays(const arg_likelihood_stats_t *stats,
+        PyArrayObject *Ne_array, PyArrayObject *rate_array)
+{
+    PyObject *ret = NULL;
+    int err;
+    PyArrayObject *lik_array = NULL;
+    PyArrayObject *grad_r_array = NULL;
+    PyArrayObject *grad_Ne_array = NULL;
+    const double *rate;
+    npy_intp num_params;
+    npy_intp j;
+
+    num_params = PyArray_DIMS(Ne_array)[0];
+    if (PyArray_DIMS(rate_array)[0] != num_params) {
+        PyErr_SetString(PyExc_ValueError,
+            "Ne and recombination_rate must have the same length");
+        goto out;
+    }
+    rate = PyArray_DATA(rate_array);
+    for (j = 0; j < num_params; j++) {
+        if (rate[j] < 0) {
+            PyErr_SetString(PyExc_ValueError, "recombination_rate must be >= 0");
+            goto out;
+        }
+    }
+    lik_array = (PyArrayObject *) PyArray_SimpleNew(1, &num_params, NPY_FLOAT64);
+    grad_r_array = (PyArrayObject *) PyArray_SimpleNew(1, &num_params, NPY_FLOAT64);
+    grad_Ne_array = (PyArrayObject *) PyArray_SimpleNew(1, &num_params, NPY_FLOAT64);
+    if (lik_array == NULL || grad_r_array == NULL || grad_Ne_array == NULL) {
+        goto out;
+    }
+    err = msp_log_likelihood_arg_stats(stats, (size_t) num_params, rate,
+            PyArray_DATA(Ne_array), PyArray_DATA(lik_array),
+            PyArray_DATA(grad_r_array), PyArray_DATA(grad_Ne_array));
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    ret = Py_BuildValue("OOO", lik_array, grad_r_array, grad_Ne_array);
+out:
+    Py_XDECREF(lik_array);
+    Py_XDECREF(grad_r_array);
+    Py_XDECREF(grad_Ne_array);
+    return ret;
+}
+
+static PyObject *
+msprime_log_likelihood_arg_vector(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    int err;
+    LightweightTableCollection *tables = NULL;
+    PyArrayObject *Ne_array = NULL;
+    PyArrayObject *rate_array = NULL;
+    static char *kwlist[] = {"tables", "Ne", "recombination_rate", NULL};
+    arg_likelihood_stats_t stats;
+    tsk_treeseq_t ts;
+
+    memset(&ts, 0, sizeof(ts));
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O&O&", kwlist,
+            &LightweightTableCollectionType, &tables,
+            double_PyArray_converter, &Ne_array,
+            double_PyArray_converter, &rate_array)) {
+        goto out;
+    }
+    err = tsk_treeseq_init(&ts, tables->tables, TSK_TS_INIT_BUILD_INDEXES);
+    if (err != 0) {
+        handle_tskit_library_error(err);
+        goto out;
+    }
+    /* The edges are only walked once, however many parameters there are */
+    err = msp_arg_likelihood_stats(&ts, &stats);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    ret = build_log_likelihood_arg_arrays(&stats, Ne_array, rate_array);
+out:
+    tsk_treeseq_free(&ts);
+    Py_XDECREF(Ne_array);
+    Py_XDECREF(rate_array);
+    return ret;
+}
+
+static PyObject *
+msprime_arg_likelihood_stats(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    int err;
+    LightweightTableCollection *tables = NULL;
+    static char *kwlist[] = {"tables", NULL};
+    arg_likelihood_stats_t stats;
+    tsk_treeseq_t ts;
+
+    memset(&ts, 0, sizeof(ts));
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!", kwlist,
+            &LightweightTableCollectionType, &tables)) {
+        goto out;
+    }
+    err = tsk_treeseq_init(&ts, tables->tables, TSK_TS_INIT_BUILD_INDEXES);
+    if (err != 0) {
+        handle_tskit_library_error(err);
+        goto out;
+    }
+    err = msp_arg_likelihood_stats(&ts, &stats);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    ret = Py_BuildValue("(ddddd)", stats.coalescence_exposure,
+            stats.recombination_exposure, stats.log_gaps,
+            stats.num_recombination_events, stats.num_common_ancestor_events);
+out:
+    tsk_treeseq_free(&ts);
+    return ret;
+}
+
+static PyObject *
+msprime_log_likelihood_arg_stats(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    PyArrayObject *Ne_array = NULL;
+    PyArrayObject *rate_array = NULL;
+    static char *kwlist[] = {"stats", "Ne", "recombination_rate", NULL};
+    arg_likelihood_stats_t stats;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "(ddddd)O&O&", kwlist,
+            &stats.coalescence_exposure, &stats.recombination_exposure,
+            &stats.log_gaps, &stats.num_recombination_events,
+            &stats.num_common_ancestor_events,
+            double_PyArray_converter, &Ne_array,
+            double_PyArray_converter, &rate_array)) {
+        goto out;
+    }
+    ret = build_log_likelihood_arg_arrays(&stats, Ne_array, rate_array);
+out:
+    Py_XDECREF(Ne_array);
+    Py_XDECREF(rate_array);
+    return ret;
+}
+
+typedef struct {
+    tsk_treeseq_t *ts;
+    mut_likelihood_window_t *window;
+    int err;
+    PyThread_type_lock done;
+} mut_likelihood_task_t;
+
+static void
+mut_likelihood_task_run(void *arg)
+{
+    mut_likelihood_task_t *task = (mut_likelihood_task_t *) arg;
+
+    task->err = msp_mut_likelihood_window_run(task->ts, task->window);
+    PyThread_release_lock(task->done);
+}
+
+/* Window runner that processes each window on its own thread, in the same
+ * way as run_mutgen_chunks_threaded. */
+static int
+run_mut_likelihood_windows_threaded(tsk_treeseq_t *ts,
+        mut_likelihood_window_t *windows, size_t num_windows, void *MSP_UNUSED(arg))
+{
+    int ret = 0;
+    size_t j;
+    mut_likelihood_task_t *tasks = calloc(num_windows, sizeof(*tasks));
+
+    if (tasks == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < num_windows; j++) {
+        tasks[j].ts = ts;
+        tasks[j].window = &windows[j];
+        tasks[j].done = PyThread_allocate_lock();
+        if (tasks[j].done == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        PyThread_acquire_lock(tasks[j].done, WAIT_LOCK);
+    }
+    for (j = 1; j < num_windows; j++) {
+        if (PyThread_start_new_thread(mut_likelihood_task_run, &tasks[j])
+                == PYTHREAD_INVALID_THREAD_ID) {
+            mut_likelihood_task_run(&tasks[j]);
+        }
+    }
+    mut_likelihood_task_run(&tasks[0]);
+    for (j = 0; j < num_windows; j++) {
+        PyThread_acquire_lock(tasks[j].done, WAIT_LOCK);
+        if (ret == 0) {
+            ret = tasks[j].err;
+        }
+    }
+out:
+    if (tasks != NULL) {
+        for (j = 0; j < num_windows; j++) {
+            if (tasks[j].done != NULL) {
+                PyThread_free_lock(tasks[j].done);
+            }
+        }
+        free(tasks);
+    }
+    return ret;
+}
+
+static PyObject *
+msprime_log_likelihood_mut(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    int err;
+    LightweightTableCollection *tables = NULL;
+    PyArrayObject *mu_array = NULL;
+    PyArrayObject *lik_array = NULL;
+    static char *kwlist[] = {"tables", "mutation_rate", "num_threads", NULL};
+    const double *mu;
+    npy_intp num_params, j;
+    int num_threads = 0;
+    tsk_treeseq_t ts;
+
+    memset(&ts, 0, sizeof(ts));
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O&|i", kwlist,
+            &LightweightTableCollectionType, &tables,
+            double_PyArray_converter, &mu_array, &num_threads)) {
+        goto out;
+    }
+    if (num_threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "num_threads must be >= 0");
+        goto out;
+    }
+    num_params = PyArray_DIMS(mu_array)[0];
+    mu = PyArray_DATA(mu_array);
+    for (j = 0; j < num_params; j++) {
+        if (mu[j] < 0) {
+            PyErr_SetString(PyExc_ValueError, "mutation_rate must be >= 0");
+            goto out;
+        }
+    }
+    err = tsk_treeseq_init(&ts, tables->tables, TSK_TS_INIT_BUILD_INDEXES);
+    if (err != 0) {
+        handle_tskit_library_error(err);
+        goto out;
+    }
+    lik_array = (PyArrayObject *) PyArray_SimpleNew(1, &num_params, NPY_FLOAT64);
+    if (lik_array == NULL) {
+        goto out;
+    }
+    if (num_threads == 0) {
+        err = msp_unnormalised_log_likelihood_mut_vector(&ts, (size_t) num_params, mu,
+                PyArray_DATA(lik_array), 1, NULL, NULL);
+    } else {
+        Py_BEGIN_ALLOW_THREADS
+        err = msp_unnormalised_log_likelihood_mut_vector(&ts, (size_t) num_params, mu,
+                PyArray_DATA(lik_array), (size_t) num_threads,
+                run_mut_likelihood_windows_threaded, NULL);
+        Py_END_ALLOW_THREADS
+    }
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    ret = (PyObject *) lik_array;
+    lik_array = NULL;
+out:
+    tsk_treeseq_free(&ts);
+    Py_XDECREF(mu_array);
+    Py_XDECREF(lik_array);
+    return ret;
+}
+
 static PyObject *
 msprime_get_gsl_version(PyObject *self)
 {
@@ -3278,6 +4795,21 @@ static PyMethodDef msprime_methods[] = {
     {"log_likelihood_arg", (PyCFunction) msprime_log_likelihood_arg,
             METH_VARARGS|METH_KEYWORDS,
             "Computes the log-likelihood of an ARG." },
+    {"log_likelihood_arg_vector", (PyCFunction) msprime_log_likelihood_arg_vector,
+            METH_VARARGS|METH_KEYWORDS,
+            "Computes the log-likelihood of an ARG and its gradient for arrays "
+            "of parameters." },
+    {"arg_likelihood_stats", (PyCFunction) msprime_arg_likelihood_stats,
+            METH_VARARGS|METH_KEYWORDS,
+            "Returns the statistics of an ARG that its log-likelihood depends on." },
+    {"log_likelihood_arg_stats", (PyCFunction) msprime_log_likelihood_arg_stats,
+            METH_VARARGS|METH_KEYWORDS,
+            "Computes the log-likelihood of an ARG and its gradient from its "
+            "statistics for arrays of parameters." },
+    {"log_likelihood_mut", (PyCFunction) msprime_log_likelihood_mut,
+            METH_VARARGS|METH_KEYWORDS,
+            "Computes the unnormalised log-likelihood of the mutations on an ARG "
+            "for an array of mutation rates." },
     {"get_gsl_version", (PyCFunction) msprime_get_gsl_version, METH_NOARGS,
             "Returns the version of GSL we are linking against." },
     {"get_tskit_c_version", (PyCFunction) msprime_get_tskit_c_version, METH_NOARGS,
@@ -3316,6 +4848,14 @@ PyInit__msprime(void)
     Py_INCREF(&RandomGeneratorType);
     PyModule_AddObject(module, "RandomGenerator", (PyObject *) &RandomGeneratorType);
 
+    /* SweepTrajectoryStore type */
+    if (PyType_Ready(&SweepTrajectoryStoreType) < 0) {
+        return NULL;
+    }
+    Py_INCREF(&SweepTrajectoryStoreType);
+    PyModule_AddObject(module, "SweepTrajectoryStore",
+            (PyObject *) &SweepTrajectoryStoreType);
+
     /* Simulator type */
     if (PyType_Ready(&SimulatorType) < 0) {
         return NULL;
@@ -22,12 +22,14 @@ Module responsible for defining and running ancestry simulations.
 from __future__ import annotations
 
 import collections.abc
+import concurrent.futures
 import copy
 import dataclasses
 import enum
 import json
 import logging
 import math
+import queue
 import sys
 import tempfile
 import warnings
@@ -409,6 +411,15 @@ def _parse_random_seed(seed):
     return seed
 
 
+def _parse_num_threads(num_threads):
+    if num_threads is None:
+        return None
+    num_threads = int(num_threads)
+    if num_threads < 1:
+        raise ValueError("num_threads must be >= 1")
+    return num_threads
+
+
 def _parse_replicate_index(*, replicate_index, random_seed, num_replicates):
     """
     Parse the replicate_index value, and ensure that its value makes sense
@@ -662,20 +673,26 @@ def _wrap_replicates(
     replicate_index,
     provenance_dict,
     mutation_rate=None,
+    num_threads=None,
+    replicate_streams=False,
 ):
     """
     Wrapper for the logic used to run replicate simulations for the two
-    frontends.
+    frontends. If replicate_streams is True and replicates are requested,
+    each replicate draws from its own stream of the random seed.
     """
     if num_replicates is None and replicate_index is None:
         # Default single-replicate case.
         replicate_index = 0
+        replicate_streams = False
     if replicate_index is not None:
         num_replicates = replicate_index + 1
     iterator = simulator.run_replicates(
         num_replicates,
         mutation_rate=mutation_rate,
         provenance_dict=provenance_dict,
+        num_threads=num_threads,
+        replicate_streams=replicate_streams,
     )
     if replicate_index is not None:
         deque = collections.deque(iterator, maxlen=1)
@@ -1121,6 +1138,7 @@ def sim_ancestry(
     num_replicates=None,
     replicate_index=None,
     record_provenance=None,
+    num_threads=None,
 ):
     """
     Simulates an ancestral process described by the specified model, demography and
@@ -1194,6 +1212,13 @@ def sim_ancestry(
         number of replicates is performed, and an iterator over the
         resulting :class:`tskit.TreeSequence` objects returned.
         See the :ref:`sec_randomness_replication` section for examples.
+    :param int num_threads: If specified, run replicates concurrently on
+        this many threads. When ``num_replicates`` or ``replicate_index``
+        is given, each replicate draws from an independent stream
+        determined by the ``random_seed`` and its index, so the results
+        are the same for any number of threads, and when ``num_threads``
+        is not specified. Replicates are returned in order. A single
+        simulation without replicates is always run on the calling thread.
     :param bool record_full_arg: If True, record all intermediate nodes
         arising from common ancestor and recombination events in the output
         tree sequence. This will result in unary nodes (i.e., nodes in marginal
@@ -1260,6 +1285,7 @@ def sim_ancestry(
         replicate_index=replicate_index,
     )
     random_seed = _parse_random_seed(random_seed)
+    num_threads = _parse_num_threads(num_threads)
     provenance_dict = None
     if record_provenance:
         parameters = dict(
@@ -1283,6 +1309,7 @@ def sim_ancestry(
             coalescing_segments_only=coalescing_segments_only,
             num_labels=num_labels,
             random_seed=random_seed,
+            num_threads=num_threads,
             # num_replicates is excluded as provenance is per replicate
             # replicate index is excluded as it is inserted for each replicate
         )
@@ -1313,6 +1340,8 @@ def sim_ancestry(
         num_replicates=num_replicates,
         replicate_index=replicate_index,
         provenance_dict=provenance_dict,
+        num_threads=num_threads,
+        replicate_streams=True,
     )
 
 
@@ -1392,7 +1421,29 @@ class Simulator(_msprime.Simulator):
         start_time=None,
         end_time=None,
         num_labels=None,
+        presize_tables=False,
+        dtwf_num_threads=0,
     ):
+        # Keep the configuration so that we can make copies for running
+        # replicates concurrently.
+        self._config = dict(
+            tables=tables,
+            recombination_map=recombination_map,
+            gene_conversion_map=gene_conversion_map,
+            gene_conversion_tract_length=gene_conversion_tract_length,
+            discrete_genome=discrete_genome,
+            ploidy=ploidy,
+            demography=demography,
+            models=models,
+            store_migrations=store_migrations,
+            additional_nodes=additional_nodes,
+            coalescing_segments_only=coalescing_segments_only,
+            start_time=start_time,
+            end_time=end_time,
+            num_labels=num_labels,
+            presize_tables=presize_tables,
+            dtwf_num_threads=dtwf_num_threads,
+        )
         # We always need at least n segments, so no point in making
         # allocation any smaller than this.
         num_samples = len(tables.nodes)
@@ -1442,6 +1493,8 @@ class Simulator(_msprime.Simulator):
             gene_conversion_tract_length=gene_conversion_tract_length,
             discrete_genome=discrete_genome,
             ploidy=ploidy,
+            presize_tables=presize_tables,
+            dtwf_num_threads=dtwf_num_threads,
         )
         # Highlevel attributes used externally that have no lowlevel equivalent
         self.end_time = np.inf if end_time is None else end_time
@@ -1450,6 +1503,17 @@ class Simulator(_msprime.Simulator):
         # Temporary, until we add the low-level infrastructure for the gc map
         # when we'll take the same approach as the recombination map.
         self.gene_conversion_map = gene_conversion_map
+        # The pre-generated trajectories for each sweep model, keyed by the
+        # model's index, and the index of the replicate being run.
+        self._sweep_trajectory_stores = None
+        self._replicate_index = 0
+
+    def copy(self, random_generator):
+        """
+        Returns a new simulator with the same configuration as this one,
+        using the specified random generator.
+        """
+        return type(self)(**self._config, random_generator=random_generator)
 
     def copy_tables(self):
         """
@@ -1535,8 +1599,8 @@ class Simulator(_msprime.Simulator):
         while ret == ExitReason.MAX_EVENTS:
             ret = ExitReason(super().run(end_time, event_chunk))
             if self.time > end_time:
-                # Currently the Pedigree and Sweeps models are "non-reentrant"
-                # We can change this to an assertion once these have been fixed.
+                # Currently the Pedigree model is "non-reentrant"
+                # We can change this to an assertion once this has been fixed.
                 raise RuntimeError(
                     f"Model {self.model['name']} does not support interruption. "
                     "Please open an issue on GitHub"
@@ -1568,7 +1632,23 @@ class Simulator(_msprime.Simulator):
             if model_duration < 0:
                 raise ValueError("Model durations must be >= 0")
             end_time = min(self.time + model_duration, self.end_time)
+            if self._sweep_trajectory_stores is not None:
+                store = self._sweep_trajectory_stores.get(j)
+                if store is not None:
+                    self.set_sweep_trajectory_store(store, self._replicate_index)
+            previous_switch_time = self.dtwf_switch_time
             exit_reason = self._run_until(end_time, event_chunk, debug_func)
+            switch_time = self.dtwf_switch_time
+            # The switch time is kept for later models, so only log it for
+            # the model that made the switch.
+            if switch_time is not None and switch_time != previous_switch_time:
+                logger.info(
+                    "model[%d] switched from dtwf to hudson at time=%g; "
+                    "%g generations simulated in continuous time",
+                    j,
+                    switch_time,
+                    self.time - switch_time,
+                )
             if exit_reason == ExitReason.COALESCENCE or self.time == self.end_time:
                 logger.debug("Skipping remaining %d models", len(self.models) - j - 1)
                 break
@@ -1579,6 +1659,46 @@ class Simulator(_msprime.Simulator):
             self.num_nodes,
             self.num_edges,
         )
+        capacity = self.table_capacity
+        if capacity["num_nodes"] + capacity["num_edges"] > 0:
+            logger.info(
+                "Reserved table capacity nodes=%d/%d edges=%d/%d migrations=%d/%d",
+                capacity["num_nodes"],
+                self.num_nodes,
+                capacity["num_edges"],
+                self.num_edges,
+                capacity["num_migrations"],
+                self.num_migrations,
+            )
+
+    def _make_sweep_trajectory_stores(self, num_replicates):
+        """
+        Generates the trajectories of each sweep model for all the replicates
+        up front, in batches, so that each replicate takes the trajectory for
+        its index rather than generating its own. The trajectories depend on
+        the size of population 0 when the sweep starts, so this is only done
+        when that size is constant.
+        """
+        population = self.demography.populations[0]
+        if (
+            num_replicates < 2
+            or len(self.demography.events) > 0
+            or population.growth_rate != 0
+        ):
+            return None
+        stores = {}
+        for j, model in enumerate(self.models):
+            if isinstance(model, SweepGenicSelection):
+                store = _msprime.SweepTrajectoryStore(
+                    start_frequency=model.start_frequency,
+                    end_frequency=model.end_frequency,
+                    s=model.s,
+                    dt=model.dt,
+                    population_size=population.initial_size,
+                )
+                store.generate(num_replicates, self.random_generator)
+                stores[j] = store
+        return stores if len(stores) > 0 else None
 
     def run_replicates(
         self,
@@ -1586,9 +1706,16 @@ class Simulator(_msprime.Simulator):
         *,
         mutation_rate=None,
         provenance_dict=None,
+        num_threads=None,
+        replicate_streams=False,
     ):
         """
         Sequentially yield the specified number of simulation replicates.
+        If replicate_streams is True, each replicate uses the stream of a
+        counter-based generator given by its index, and the replicates are
+        run on copies of this simulator, concurrently on num_threads threads
+        if specified. Otherwise, the replicates are run one after another
+        on this simulator, and num_threads is ignored.
         """
         encoded_provenance = None
         # The JSON is modified for each replicate to insert the replicate number.
@@ -1601,19 +1728,16 @@ class Simulator(_msprime.Simulator):
                 provenance_dict, num_replicates
             )
 
-        for replicate_index in range(num_replicates):
-            logger.info("Starting replicate %d", replicate_index)
-            self.run()
-            if mutation_rate is not None:
-                # This is only called from simulate() or the ms interface,
-                # so does not need any further parameters.
-                mutations._simple_mutate(
-                    tables=self.tables,
-                    random_generator=self.random_generator,
-                    sequence_length=self.sequence_length,
-                    rate=mutation_rate,
-                )
-            tables = tskit.TableCollection.fromdict(self.tables.asdict())
+        self._sweep_trajectory_stores = self._make_sweep_trajectory_stores(
+            num_replicates
+        )
+        if replicate_streams:
+            replicates = self._run_stream_replicates(
+                num_replicates, mutation_rate, 1 if num_threads is None else num_threads
+            )
+        else:
+            replicates = self._run_sequential_replicates(num_replicates, mutation_rate)
+        for replicate_index, tables in enumerate(replicates):
             if len(self.missing_intervals) > 0:
                 tables.delete_intervals(
                     self.missing_intervals, simplify=False, record_provenance=False
@@ -1626,8 +1750,66 @@ class Simulator(_msprime.Simulator):
                 tables.provenances.add_row(replicate_provenance)
             ts = tables.tree_sequence()
             yield ts
+
+    def _run_replicate(self, mutation_rate):
+        self.run()
+        if mutation_rate is not None:
+            # This is only called from simulate() or the ms interface,
+            # so does not need any further parameters.
+            mutations._simple_mutate(
+                tables=self.tables,
+                random_generator=self.random_generator,
+                sequence_length=self.sequence_length,
+                rate=mutation_rate,
+            )
+        # The large columns are moved out of the simulator into the dict,
+        # and fromdict then copies them once into the returned tables.
+        return tskit.TableCollection.fromdict(self.take_tables())
+
+    def _run_sequential_replicates(self, num_replicates, mutation_rate):
+        for replicate_index in range(num_replicates):
+            logger.info("Starting replicate %d", replicate_index)
+            self._replicate_index = replicate_index
+            yield self._run_replicate(mutation_rate)
             self.reset()
 
+    def _run_stream_replicates(self, num_replicates, mutation_rate, num_threads):
+        # The low-level simulator releases the GIL while running, so
+        # replicates on different simulators run in parallel. Each replicate
+        # uses its own stream of a counter-based generator, which makes the
+        # results independent of the number of threads and of which
+        # simulator runs it. With one thread this is the sequential case.
+        base_seed = self.random_generator.seed
+        num_simulators = max(1, min(num_threads, num_replicates))
+        simulators = queue.SimpleQueue()
+        for _ in range(num_simulators):
+            rng = _msprime.RandomGenerator(base_seed, stream=0)
+            sim = self.copy(rng)
+            sim._sweep_trajectory_stores = self._sweep_trajectory_stores
+            simulators.put(sim)
+
+        def run_replicate(replicate_index):
+            sim = simulators.get()
+            try:
+                logger.info("Starting replicate %d", replicate_index)
+                sim.random_generator.stream = replicate_index
+                sim._replicate_index = replicate_index
+                sim.reset()
+                return sim._run_replicate(mutation_rate)
+            finally:
+                simulators.put(sim)
+
+        with concurrent.futures.ThreadPoolExecutor(num_simulators) as executor:
+            # Bound the number of replicates in flight so that finished
+            # tables don't pile up while waiting to be returned in order.
+            futures = collections.deque()
+            next_index = 0
+            for _ in range(num_replicates):
+                while next_index < num_replicates and len(futures) < 2 * num_simulators:
+                    futures.append(executor.submit(run_replicate, next_index))
+                    next_index += 1
+                yield futures.popleft().result()
+
     def __str__(self):
         # Warning! This can be very big as it's a direct dump of the low-level
         # data structures. If you want to debug a large simulation use
@@ -1846,6 +2028,33 @@ class DiscreteTimeWrightFisher(AncestryModel):
     name = "dtwf"
 
 
+@dataclasses.dataclass
+class HybridWrightFisher(DiscreteTimeWrightFisher, ParametricAncestryModel):
+    """
+    A :class:`.DiscreteTimeWrightFisher` model that switches to the
+    :class:`.StandardCoalescent` once lineages have become sparse relative to
+    the population size.
+
+    Multiple and simultaneous mergers, which the coalescent does not allow,
+    only matter when the number of lineages is an appreciable fraction of the
+    population size. This model simulates the DTWF until there are fewer than
+    ``switch_threshold`` lineages per individual in every population, and then
+    continues with the much cheaper continuous-time coalescent, without the
+    duration of the DTWF phase having to be chosen in advance. The time of the
+    switch is reported in the log.
+
+    :param float switch_threshold: The number of lineages per individual below
+        which the simulation switches to the coalescent. Defaults to 0.01.
+    """
+
+    switch_threshold: float
+
+    # We have to define an __init__ to enforce keyword-only behaviour
+    def __init__(self, *, duration=None, switch_threshold=0.01):
+        self.duration = duration
+        self.switch_threshold = switch_threshold
+
+
 class FixedPedigree(AncestryModel):
     """
     Backwards-time simulations through a pre-specified pedigree, with diploid
@@ -26,7 +26,7 @@ import numpy as np
 from msprime import _msprime
 
 
-def log_mutation_likelihood(ts, mutation_rate):
+def log_mutation_likelihood(ts, mutation_rate, *, num_threads=None):
     """
     Returns the unnormalised log probability of the stored pattern of mutations
     on the stored tree sequence, assuming infinite sites mutation. In particular,
@@ -64,13 +64,34 @@ def log_mutation_likelihood(ts, mutation_rate):
         but rather on any edge which would yield the same configuration of SNPs at the
         leaves of the tree sequence.
 
+    If ``mutation_rate`` is an array, or ``num_threads`` is specified, the
+    probability is computed for all of the mutation rates with a single pass
+    over the trees, which may be split across ``num_threads`` threads.
+
     :param tskit.TreeSequence ts: The tree sequence object with mutations.
     :param float mutation_rate: The per-site, per-generation mutation probability.
         Must be non-negative.
+    :param int num_threads: The number of threads to use. Each thread processes
+        a window of contiguous trees.
     :return: The unnormalised log probability of the observed SNPs given the tree
         sequence. If the mutation rate is set to zero and the tree sequence contains
-        at least one mutation, then returns `-float("inf")`.
+        at least one mutation, then returns `-float("inf")`. This is an array if
+        ``mutation_rate`` is an array.
     """
+    if np.ndim(mutation_rate) > 0 or num_threads is not None:
+        mutation_rate = np.asarray(mutation_rate, dtype=np.float64)
+        lw_tables = _msprime.LightweightTableCollection()
+        lw_tables.fromdict(ts.tables.asdict())
+        ret = _msprime.log_likelihood_mut(
+            lw_tables,
+            mutation_rate.ravel(),
+            num_threads=0 if num_threads is None else num_threads,
+        )
+        ret[ret == -np.finfo(np.float64).max] = -np.inf
+        if mutation_rate.ndim == 0:
+            return float(ret[0])
+        return ret.reshape(mutation_rate.shape)
+
     tables = ts.tables
     time = tables.nodes.time
     total_material = 0
@@ -107,7 +128,104 @@ def log_mutation_likelihood(ts, mutation_rate):
     return ret
 
 
-def log_arg_likelihood(ts, recombination_rate, Ne=1):
+def _check_arg(ts):
+    for tree in ts.trees():
+        if np.any(tree.num_children_array[:-1] > 2):
+            raise ValueError(
+                "ARG likelihood encountered a polytomy."
+                " Tree sequences must contain binary mergers only for"
+                " valid likelihood evaluation."
+            )
+        if tree.num_children_array[-1] > 1:
+            if ts.num_edges > 1:
+                # num_edges check is here because to avoid breaking the expected
+                # result of the TestOddToplogies tests.
+                raise ValueError(
+                    "ARG likelihood encountered a tree with multiple roots."
+                    " All local trees must have a single mrca for"
+                    " valid likelihood evaluation."
+                )
+    if ts.num_trees > 1 and not np.any(ts.nodes_flags & _msprime.NODE_IS_RE_EVENT):
+        raise ValueError(
+            "ARG likelihood only valid for tree sequences where recombinations"
+            " have been recorded via nodes flagged with `NODE_IS_RE_EVENT`."
+        )
+
+
+def _lightweight_tables(ts):
+    # Get the tables into the format we need to interchange with the low-level code.
+    lw_tables = _msprime.LightweightTableCollection()
+    lw_tables.fromdict(ts.tables.asdict())
+    return lw_tables
+
+
+class ArgLikelihood:
+    """
+    The log probability of a tree sequence under the Hudson ARG, as a
+    function of the recombination rate and the effective population size.
+    The tree sequence is only walked once, when this object is created, to
+    find the quantities the likelihood depends on. Each evaluation of the
+    likelihood or its gradient then takes constant time per parameter
+    value, which makes this suitable for maximum likelihood estimation or
+    MCMC over the parameters.
+
+    The same requirements on the tree sequence apply as for
+    :func:`.log_arg_likelihood`, which gives the details of the model.
+    The ``recombination_rate`` and ``Ne`` arguments of the methods may be
+    arrays, which are broadcast against each other.
+
+    :param tskit.TreeSequence ts: The tree sequence object.
+    """
+
+    def __init__(self, ts):
+        _check_arg(ts)
+        self._stats = _msprime.arg_likelihood_stats(_lightweight_tables(ts))
+
+    def _evaluate(self, recombination_rate, Ne):
+        recombination_rate, Ne = np.broadcast_arrays(
+            np.asarray(recombination_rate, dtype=np.float64),
+            np.asarray(Ne, dtype=np.float64),
+        )
+        shape = recombination_rate.shape
+        ret = _msprime.log_likelihood_arg_stats(
+            self._stats,
+            Ne=Ne.ravel(),
+            recombination_rate=recombination_rate.ravel(),
+        )
+        if len(shape) == 0:
+            return tuple(float(x[0]) for x in ret)
+        return tuple(x.reshape(shape) for x in ret)
+
+    def log_likelihood(self, recombination_rate, Ne=1):
+        """
+        Returns the log probability of the tree sequence for the specified
+        parameters, as :func:`.log_arg_likelihood` would.
+
+        :param float recombination_rate: The per-link, per-generation
+            recombination probability. Must be non-negative.
+        :param float Ne: The diploid effective population size.
+        :return: The log probability, which is an array if either parameter
+            is an array.
+        """
+        return self._evaluate(recombination_rate, Ne)[0]
+
+    def gradient(self, recombination_rate, Ne=1):
+        """
+        Returns the partial derivatives of the log probability of the tree
+        sequence with respect to the recombination rate and ``Ne`` at the
+        specified parameters. The derivatives are NaN where the probability
+        is zero.
+
+        :param float recombination_rate: The per-link, per-generation
+            recombination probability. Must be non-negative.
+        :param float Ne: The diploid effective population size.
+        :return: A tuple ``(d_recombination_rate, d_Ne)``, whose elements
+            are arrays if either parameter is an array.
+        """
+        return self._evaluate(recombination_rate, Ne)[1:]
+
+
+def log_arg_likelihood(ts, recombination_rate, Ne=1, *, gradient=False):
     """
     Returns the log probability of the stored tree sequence under the Hudson ARG.
     An exact expression for this probability is given in equation (1) of
@@ -129,40 +247,30 @@ def log_arg_likelihood(ts, recombination_rate, Ne=1):
         See :ref:`sec_ancestry_discrete_genome` for how these can be specified
         when simulating tree sequences using ``msprime``.
 
+    The ``recombination_rate`` and ``Ne`` parameters may also be arrays, which
+    are broadcast against each other. The quantities the likelihood depends
+    on are then computed from the tree sequence once and the likelihood is
+    evaluated for all parameter values together, which is much faster than
+    calling this function for each value in turn. To evaluate the likelihood
+    repeatedly for the same tree sequence, use :class:`.ArgLikelihood`.
+
     :param tskit.TreeSequence ts: The tree sequence object.
     :param float recombination_rate: The per-link, per-generation recombination
         probability. Must be non-negative.
     :param float Ne: The diploid effective population size.
+    :param bool gradient: If True, also return the partial derivatives of the
+        log probability with respect to ``recombination_rate`` and ``Ne``.
     :return: The log probability of the tree sequence under the Hudson ancestral
         recombination graph model. If the recombination rate is zero and the tree
         sequence contains at least one recombination event, then returns
-        `-DBL_MAX`.
+        `-DBL_MAX` (and the gradients are NaN). This is an array if either
+        parameter is an array. If ``gradient`` is True, a tuple
+        ``(log_lik, d_recombination_rate, d_Ne)`` is returned.
     """
-    for tree in ts.trees():
-        if np.any(tree.num_children_array[:-1] > 2):
-            raise ValueError(
-                "ARG likelihood encountered a polytomy."
-                " Tree sequences must contain binary mergers only for"
-                " valid likelihood evaluation."
-            )
-        if tree.num_children_array[-1] > 1:
-            if ts.num_edges > 1:
-                # num_edges check is here because to avoid breaking the expected
-                # result of the TestOddToplogies tests.
-                raise ValueError(
-                    "ARG likelihood encountered a tree with multiple roots."
-                    " All local trees must have a single mrca for"
-                    " valid likelihood evaluation."
-                )
-    if ts.num_trees > 1 and not np.any(ts.nodes_flags & _msprime.NODE_IS_RE_EVENT):
-        raise ValueError(
-            "ARG likelihood only valid for tree sequences where recombinations"
-            " have been recorded via nodes flagged with `NODE_IS_RE_EVENT`."
+    if np.ndim(recombination_rate) == 0 and np.ndim(Ne) == 0 and not gradient:
+        _check_arg(ts)
+        return _msprime.log_likelihood_arg(
+            _lightweight_tables(ts), Ne=Ne, recombination_rate=recombination_rate
         )
-
-    # Get the tables into the format we need to interchange with the low-level code.
-    lw_tables = _msprime.LightweightTableCollection()
-    lw_tables.fromdict(ts.tables.asdict())
-    return _msprime.log_likelihood_arg(
-        lw_tables, Ne=Ne, recombination_rate=recombination_rate
-    )
+    ret = ArgLikelihood(ts)._evaluate(recombination_rate, Ne)
+    return ret if gradient else ret[0]
@@ -1563,6 +1563,7 @@ def sim_mutations(
     discrete_genome=None,
     keep=None,
     record_provenance=True,
+    num_threads=None,
 ):
     """
     Simulates mutations on the specified ancestry and returns the resulting
@@ -1634,6 +1635,11 @@ def sim_mutations(
     :param bool keep: Whether to keep existing mutations. (default: True)
     :param bool record_provenance: If True, record all input parameters
         in the tree sequence :ref:`tskit:sec_provenance`.
+    :param int num_threads: If specified, place mutations on this many
+        threads, each handling a contiguous chunk of the edges with its own
+        random stream. The results are deterministic for a given seed and
+        number of threads, but differ between numbers of threads and from
+        those obtained when ``num_threads`` is not specified.
     :return: The :class:`tskit.TreeSequence` object resulting from overlaying
         mutations on the input tree sequence.
     :rtype: :class:`tskit.TreeSequence`
@@ -1660,6 +1666,7 @@ def sim_mutations(
             discrete_genome=discrete_genome,
             keep=keep,
             random_seed=seed,
+            num_threads=num_threads,
         )
         provenance_dict = provenance.get_provenance_dict(parameters)
 
@@ -1684,6 +1691,12 @@ def sim_mutations(
         raise ValueError("start_time must be <= end_time")
     discrete_genome = core._parse_flag(discrete_genome, default=True)
     keep = core._parse_flag(keep, default=True)
+    if num_threads is None:
+        num_threads = 0
+    else:
+        num_threads = int(num_threads)
+        if num_threads < 1:
+            raise ValueError("num_threads must be >= 1")
 
     model = mutation_model_factory(model)
     rng = _msprime.RandomGenerator(seed)
@@ -1698,6 +1711,7 @@ def sim_mutations(
         keep=keep,
         start_time=start_time,
         end_time=end_time,
+        num_threads=num_threads,
     )
 
     tables = tskit.TableCollection.fromdict(lwt.asdict())
@@ -2523,6 +2523,41 @@ class TestSimAncestryInterface:
             t2.provenances.clear()
             assert t1 == t2
 
+    def test_num_threads(self):
+        results = []
+        for num_threads in [None, 1, 3]:
+            reps = msprime.sim_ancestry(
+                12,
+                sequence_length=10,
+                recombination_rate=0.1,
+                random_seed=52,
+                num_replicates=5,
+                num_threads=num_threads,
+            )
+            tables = [ts.dump_tables() for ts in reps]
+            for t in tables:
+                t.provenances.clear()
+            results.append(tables)
+        assert len(results[0]) == 5
+        assert results[0] == results[1]
+        assert results[0] == results[2]
+        # Replicates are seeded independently.
+        assert results[0][0] != results[0][1]
+
+    def test_num_threads_single_replicate(self):
+        ts1 = msprime.sim_ancestry(12, random_seed=52)
+        ts2 = msprime.sim_ancestry(12, random_seed=52, num_threads=3)
+        t1 = ts1.dump_tables()
+        t2 = ts2.dump_tables()
+        t1.provenances.clear()
+        t2.provenances.clear()
+        assert t1 == t2
+
+    def test_bad_num_threads(self):
+        for bad_value in [0, -1]:
+            with pytest.raises(ValueError):
+                msprime.sim_ancestry(2, num_replicates=2, num_threads=bad_value)
+
     def test_bad_additional_node_flag(self):
         with pytest.raises(ValueError):
             msprime.sim_ancestry(
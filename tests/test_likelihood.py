@@ -28,6 +28,7 @@ import pytest
 import tskit
 
 import msprime
+from msprime import _msprime
 
 # Python implementations of the likelihood calculations
 
@@ -576,6 +577,97 @@ class TestSimulatedExamples(unittest.TestCase):
         with pytest.raises(ValueError):
             log_arg_likelihood(ts, recombination_rate=-1)
 
+    def test_vectorised_arg_likelihood(self):
+        ts = msprime.simulate(
+            5, recombination_rate=1, random_seed=12, record_full_arg=True
+        )
+        rates = np.array([0.5, 1, 2, 4])
+        Nes = np.array([0.5, 1, 2, 10])
+        lik, d_rate, d_Ne = msprime.log_arg_likelihood(
+            ts, rates, Nes, gradient=True
+        )
+        assert lik.shape == (4,)
+        h = 1e-6
+        for j in range(len(rates)):
+            self.assertAlmostEqual(
+                lik[j], log_arg_likelihood(ts, rates[j], Nes[j])
+            )
+            up = msprime.log_arg_likelihood(ts, rates[j] + h, Nes[j])
+            down = msprime.log_arg_likelihood(ts, rates[j] - h, Nes[j])
+            self.assertAlmostEqual(d_rate[j], (up - down) / (2 * h), places=4)
+            up = msprime.log_arg_likelihood(ts, rates[j], Nes[j] + h)
+            down = msprime.log_arg_likelihood(ts, rates[j], Nes[j] - h)
+            self.assertAlmostEqual(d_Ne[j], (up - down) / (2 * h), places=4)
+        # Parameters are broadcast against each other
+        grid = msprime.log_arg_likelihood(ts, rates[:, np.newaxis], Nes)
+        assert grid.shape == (4, 4)
+        self.assertAlmostEqual(grid[1, 2], log_arg_likelihood(ts, rates[1], Nes[2]))
+        lik, d_rate, d_Ne = msprime.log_arg_likelihood(ts, 0, 1, gradient=True)
+        assert lik == -np.finfo(float).max
+        assert np.isnan(d_rate)
+        with pytest.raises(ValueError):
+            msprime.log_arg_likelihood(ts, [1, -1])
+        with pytest.raises(_msprime.LibraryError):
+            msprime.log_arg_likelihood(ts, [1, 1], [1, 0])
+
+    def test_arg_likelihood_object(self):
+        ts = msprime.simulate(
+            5, recombination_rate=1, random_seed=12, record_full_arg=True
+        )
+        arg_lik = msprime.ArgLikelihood(ts)
+        for rate, Ne in [(0.5, 0.5), (1, 1), (4, 10)]:
+            lik = arg_lik.log_likelihood(rate, Ne)
+            assert isinstance(lik, float)
+            self.assertAlmostEqual(lik, log_arg_likelihood(ts, rate, Ne))
+            d_rate, d_Ne = arg_lik.gradient(rate, Ne)
+            _, expected_d_rate, expected_d_Ne = msprime.log_arg_likelihood(
+                ts, rate, Ne, gradient=True
+            )
+            assert d_rate == expected_d_rate
+            assert d_Ne == expected_d_Ne
+        rates = np.array([0.5, 1, 2])
+        lik = arg_lik.log_likelihood(rates[:, np.newaxis], [1, 2])
+        assert lik.shape == (3, 2)
+        self.assertAlmostEqual(lik[2, 1], log_arg_likelihood(ts, rates[2], 2))
+        d_rate, d_Ne = arg_lik.gradient(rates)
+        assert d_rate.shape == (3,)
+        assert d_Ne.shape == (3,)
+        assert arg_lik.log_likelihood(0) == -np.finfo(float).max
+        assert all(np.isnan(arg_lik.gradient(0)))
+        with pytest.raises(ValueError):
+            arg_lik.log_likelihood(-1)
+        with pytest.raises(_msprime.LibraryError):
+            arg_lik.gradient(1, 0)
+
+    def test_arg_likelihood_object_checks_arg(self):
+        ts = msprime.simulate(5, recombination_rate=1, random_seed=12)
+        assert ts.num_trees > 1
+        with pytest.raises(ValueError):
+            msprime.ArgLikelihood(ts)
+
+    def test_vectorised_mutation_likelihood(self):
+        ts = msprime.simulate(
+            5,
+            recombination_rate=1,
+            mutation_rate=1,
+            random_seed=12,
+            record_full_arg=True,
+        )
+        assert ts.num_trees > 4
+        rates = np.array([0, 0.5, 1, 2])
+        for num_threads in [None, 1, 2, 3, 100]:
+            lik = msprime.log_mutation_likelihood(ts, rates, num_threads=num_threads)
+            assert lik.shape == (4,)
+            assert lik[0] == float("-inf")
+            for j in range(1, len(rates)):
+                self.assertAlmostEqual(
+                    lik[j], msprime.log_mutation_likelihood(ts, rates[j])
+                )
+        lik = msprime.log_mutation_likelihood(ts, 1, num_threads=2)
+        self.assertAlmostEqual(lik, msprime.log_mutation_likelihood(ts, 1))
+        with pytest.raises(ValueError):
+            msprime.log_mutation_likelihood(ts, [-1])
+
     def test_zero_mut_rate(self):
         # No mutations
         ts = msprime.simulate(
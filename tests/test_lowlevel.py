@@ -1343,6 +1343,43 @@ class TestSimulator(LowLevelTestCase):
             sim.model = model
             assert sim.model == model
 
+    def test_dtwf_hybrid_simulation_model(self):
+        for bad_type in [str, "sdf"]:
+            model = get_simulation_model("dtwf", switch_threshold=bad_type)
+            sim = make_sim(model=get_simulation_model())
+            with pytest.raises(TypeError):
+                sim.model = model
+        for bad_threshold in [-1, -1e-6]:
+            sim = make_sim(model=get_simulation_model())
+            model = get_simulation_model("dtwf", switch_threshold=bad_threshold)
+            with pytest.raises(ValueError):
+                sim.model = model
+        # A threshold of None or zero is the plain DTWF
+        for threshold in [None, 0]:
+            model = get_simulation_model("dtwf", switch_threshold=threshold)
+            sim = make_sim(model=model)
+            assert sim.model == get_simulation_model("dtwf")
+        for threshold in [1e-3, 0.5, 2]:
+            model = get_simulation_model("dtwf", switch_threshold=threshold)
+            sim = make_sim(model=model)
+            assert sim.model == model
+            assert sim.dtwf_switch_time is None
+
+    def test_dtwf_hybrid_switch(self):
+        sim = make_sim(
+            10,
+            model=get_simulation_model("dtwf", switch_threshold=0.25),
+            population_configuration=[get_population_configuration(initial_size=20)],
+        )
+        assert sim.dtwf_switch_time is None
+        sim.run()
+        assert sim.num_ancestors == 0
+        assert sim.dtwf_switch_time >= 1
+        assert sim.model == get_simulation_model("hudson")
+        sim.reset()
+        assert sim.dtwf_switch_time is None
+        assert sim.model == get_simulation_model("dtwf", switch_threshold=0.25)
+
     def test_dirac_simulation_model(self):
         for bad_type in [None, str, "sdf"]:
             model = get_simulation_model("dirac", psi=bad_type, c=1.0)
@@ -1516,6 +1553,106 @@ class TestSimulator(LowLevelTestCase):
             assert sim.run() == _msprime.EXIT_COALESCENCE
             assert t_before == sim.time
 
+    def test_sweep_trajectory(self):
+        def f(**kwargs):
+            return make_sim(
+                10,
+                sequence_length=10,
+                recombination_map=uniform_rate_map(L=10, rate=1),
+                num_labels=2,
+                model=get_sweep_genic_selection_model(position=5, dt=1e-3),
+                **kwargs,
+            )
+
+        sim = f()
+        assert sim.sweep_trajectory is None
+        for bad_type in [None, "x", [[0, 1]]]:
+            with pytest.raises((TypeError, ValueError)):
+                sim.set_sweep_trajectory(bad_type, [0.5])
+        with pytest.raises(ValueError):
+            sim.set_sweep_trajectory([0, 1], [0.5])
+        with pytest.raises(_msprime.InputError):
+            sim.set_sweep_trajectory([0, 1], [0.5, 1])
+        with pytest.raises(_msprime.InputError):
+            sim.set_sweep_trajectory([1, 0], [0.5, 0.5])
+
+        # The sweep can be interrupted and resumed.
+        assert sim.run(max_events=1) == _msprime.EXIT_MAX_EVENTS
+        with pytest.raises(_msprime.InputError):
+            sim.set_sweep_trajectory([], [])
+        sim.run()
+        time, allele_frequency = sim.sweep_trajectory
+        assert time[0] == 0
+        assert allele_frequency[0] == 0.9
+        assert allele_frequency[-1] == 0.1
+        assert np.all(np.diff(time) >= 0)
+
+        # Reuse the trajectory in another simulator
+        other = f(random_seed=5)
+        other.set_sweep_trajectory(time, allele_frequency)
+        for _ in range(2):
+            other.run()
+            other_time, other_allele_frequency = other.sweep_trajectory
+            assert np.array_equal(time, other_time)
+            assert np.array_equal(allele_frequency, other_allele_frequency)
+            other.reset()
+        other.set_sweep_trajectory([], [])
+        assert other.sweep_trajectory is None
+
+    def test_sweep_trajectory_store(self):
+        params = dict(start_frequency=0.1, end_frequency=0.9, s=0.1, dt=1e-3)
+        for bad_type in [None, "x", []]:
+            with pytest.raises(TypeError):
+                _msprime.SweepTrajectoryStore(**params, population_size=bad_type)
+        with pytest.raises(_msprime.InputError):
+            _msprime.SweepTrajectoryStore(**{**params, "dt": 0}, population_size=1)
+        with pytest.raises(_msprime.InputError):
+            _msprime.SweepTrajectoryStore(**params, population_size=0)
+        store = _msprime.SweepTrajectoryStore(**params, population_size=1)
+        assert store.num_trajectories == 0
+        with pytest.raises(TypeError):
+            store.generate(2, None)
+        with pytest.raises(ValueError):
+            store.generate(-1, _msprime.RandomGenerator(1))
+        store.generate(3, _msprime.RandomGenerator(1))
+        assert store.num_trajectories == 3
+        for index in [-1, 3]:
+            with pytest.raises(IndexError):
+                store.get_trajectory(index)
+        trajectories = [store.get_trajectory(j) for j in range(3)]
+        for time, allele_frequency in trajectories:
+            assert time[0] == 0
+            assert allele_frequency[0] == 0.9
+            assert allele_frequency[-1] == 0.1
+
+        sim = make_sim(
+            10,
+            sequence_length=10,
+            recombination_map=uniform_rate_map(L=10, rate=1),
+            num_labels=2,
+            model=get_sweep_genic_selection_model(position=5, **params),
+        )
+        for bad_type in ["x", 1]:
+            with pytest.raises(TypeError):
+                sim.set_sweep_trajectory_store(bad_type)
+        with pytest.raises(ValueError):
+            sim.set_sweep_trajectory_store(store, -1)
+        # Replicates take successive trajectories from the specified one
+        sim.set_sweep_trajectory_store(store, 1)
+        del store
+        for j in [1, 2]:
+            sim.run()
+            time, allele_frequency = sim.sweep_trajectory
+            assert np.array_equal(time, trajectories[j][0])
+            assert np.array_equal(allele_frequency, trajectories[j][1])
+            sim.reset()
+        with pytest.raises(_msprime.LibraryError):
+            sim.run()
+        sim.reset()
+        sim.set_sweep_trajectory_store(None)
+        sim.run()
+        assert sim.sweep_trajectory is not None
+
     def test_store_migrations(self):
         def f(num_samples=10, **kwargs):
             samples = [(j % 2, 0) for j in range(num_samples)]
@@ -1555,6 +1692,212 @@ class TestSimulator(LowLevelTestCase):
         sim = f()
         assert not sim.record_migrations
 
+    def test_presize_tables(self):
+        samples = [(j % 2, 0) for j in range(10)]
+        population_configuration = [get_population_configuration() for _ in range(2)]
+
+        def f(**kwargs):
+            return make_sim(
+                samples,
+                sequence_length=10,
+                num_populations=2,
+                population_configuration=population_configuration,
+                migration_matrix=[[0, 1], [1, 0]],
+                recombination_map=uniform_rate_map(10, 1),
+                store_migrations=True,
+                **kwargs,
+            )
+
+        for bad_type in [[], "False", None, {}, str]:
+            with pytest.raises(TypeError):
+                f(presize_tables=bad_type)
+        sim = f()
+        assert sim.table_capacity == {
+            "num_nodes": 0,
+            "num_edges": 0,
+            "num_migrations": 0,
+        }
+        sim = f(presize_tables=True)
+        capacity = sim.table_capacity
+        assert capacity["num_nodes"] >= len(samples) - 1
+        assert capacity["num_edges"] >= 2 * (len(samples) - 1)
+        assert capacity["num_migrations"] > 0
+        sim.run()
+        assert sim.table_capacity == capacity
+
+        sim.reserve_table_capacity(num_nodes=5, num_edges=10, num_migrations=15)
+        capacity = sim.table_capacity
+        assert capacity == {"num_nodes": 5, "num_edges": 10, "num_migrations": 15}
+        sim.reset()
+        sim.run()
+        assert sim.table_capacity == capacity
+        for bad_type in ["x", None, 1.5]:
+            with pytest.raises(TypeError):
+                sim.reserve_table_capacity(num_nodes=bad_type)
+        with pytest.raises(ValueError):
+            sim.reserve_table_capacity(num_edges=-1)
+
+    def test_take_tables(self):
+        sim = get_example_simulator(10, num_populations=2, store_migrations=True)
+        for _ in range(2):
+            sim.run()
+            sim.finalise_tables()
+            expected = tskit.TableCollection.fromdict(sim.tables.asdict())
+            assert expected.has_index()
+            assert len(expected.migrations) > 0
+            tables = tskit.TableCollection.fromdict(sim.take_tables())
+            assert tables == expected
+            assert tables.has_index()
+            assert np.array_equal(
+                tables.indexes.edge_insertion_order,
+                expected.indexes.edge_insertion_order,
+            )
+            assert np.array_equal(
+                tables.indexes.edge_removal_order, expected.indexes.edge_removal_order
+            )
+            # Only the input rows are left behind.
+            assert sim.num_nodes == 10
+            assert sim.num_edges == 0
+            assert sim.num_migrations == 0
+            sim.reset()
+
+    def test_take_tables_unindexed(self):
+        sim = get_example_simulator(10)
+        sim.run(end_time=0.01)
+        sim.finalise_tables()
+        num_edges = sim.num_edges
+        # Edges stored after finalising leave the index stale, so
+        # take_tables must not hand it back.
+        sim.run()
+        assert sim.num_edges > num_edges
+        tables = tskit.TableCollection.fromdict(sim.take_tables())
+        assert not tables.has_index()
+        assert len(tables.edges) > num_edges
+        assert sim.num_edges == 0
+        sim.reset()
+        sim.run()
+        sim.finalise_tables()
+        tables = tskit.TableCollection.fromdict(sim.take_tables())
+        assert tables.has_index()
+
+    def test_rng_buffer_size(self):
+        for bad_type in ["x", None, 1.5]:
+            with pytest.raises(TypeError):
+                make_sim(10, rng_buffer_size=bad_type)
+        with pytest.raises(ValueError):
+            make_sim(10, rng_buffer_size=-1)
+
+        def run(seed):
+            sim = make_sim(
+                10,
+                sequence_length=10,
+                recombination_map=uniform_rate_map(10, 1),
+                random_seed=seed,
+                rng_buffer_size=32,
+            )
+            sim.run()
+            sim.finalise_tables()
+            return tskit.TableCollection.fromdict(sim.tables.asdict())
+
+        tables = run(5)
+        assert tables == run(5)
+        assert tables != run(6)
+        assert tables.tree_sequence().num_trees > 1
+
+    def test_dtwf_num_threads(self):
+        for bad_type in ["x", None, 1.5]:
+            with pytest.raises(TypeError):
+                make_sim(10, dtwf_num_threads=bad_type)
+        with pytest.raises(ValueError):
+            make_sim(10, dtwf_num_threads=-1)
+
+        def run(num_threads):
+            num_populations = 4
+            sim = make_sim(
+                [(j % num_populations, 0) for j in range(20)],
+                sequence_length=10,
+                num_populations=num_populations,
+                recombination_map=uniform_rate_map(10, 0.01),
+                population_configuration=[
+                    get_population_configuration(initial_size=20)
+                    for _ in range(num_populations)
+                ],
+                migration_matrix=get_migration_matrix(num_populations, 0.1),
+                model=get_simulation_model("dtwf"),
+                dtwf_num_threads=num_threads,
+            )
+            replicates = []
+            # The worker threads are kept for the next replicate
+            for _ in range(2):
+                sim.run()
+                assert sim.num_ancestors == 0
+                sim.finalise_tables()
+                replicates.append(tskit.TableCollection.fromdict(sim.tables.asdict()))
+                sim.reset()
+            return replicates
+
+        # The populations draw from their own streams when there are threads,
+        # so the result doesn't depend on how many there are.
+        replicates = run(1)
+        for num_threads in [2, 3, 4, 8]:
+            assert replicates == run(num_threads)
+        assert replicates[0] != replicates[1]
+        assert replicates[0].tree_sequence().num_trees > 1
+
+    def test_mutation_generator(self):
+        model = get_mutation_model(1)
+        rate_map = uniform_rate_map(10, 0.5)
+        with pytest.raises(ValueError):
+            make_sim(10, mutation_rate_map=rate_map)
+        with pytest.raises(ValueError):
+            make_sim(10, mutation_rate_map=rate_map, mutation_model=model)
+        for bad_type in ["x", None, 1.5]:
+            with pytest.raises(TypeError):
+                make_sim(
+                    10,
+                    mutation_rate_map=rate_map,
+                    mutation_model=model,
+                    mutation_random_generator=bad_type,
+                )
+            with pytest.raises(TypeError):
+                make_sim(
+                    10,
+                    mutation_rate_map=rate_map,
+                    mutation_model=bad_type,
+                    mutation_random_generator=_msprime.RandomGenerator(1),
+                )
+
+        def run(**kwargs):
+            sim = make_sim(
+                10,
+                sequence_length=10,
+                recombination_map=uniform_rate_map(10, 0.1),
+                random_seed=3,
+                **kwargs,
+            )
+            sim.run()
+            sim.finalise_tables()
+            return tskit.TableCollection.fromdict(sim.tables.asdict())
+
+        tables = run(
+            mutation_rate_map=rate_map,
+            mutation_model=model,
+            mutation_random_generator=_msprime.RandomGenerator(5),
+        )
+        assert len(tables.sites) > 0
+        # The ancestry is unchanged, and the sites and mutations are the
+        # same as those from placing mutations after the simulation.
+        ll_tables = _msprime.LightweightTableCollection(10)
+        ll_tables.fromdict(run().asdict())
+        _msprime.sim_mutations(
+            ll_tables,
+            _msprime.RandomGenerator(5),
+            rate_map,
+            model,
+            discrete_genome=True,
+        )
+        tables.assert_equals(tskit.TableCollection.fromdict(ll_tables.asdict()))
+
     def test_deleting_tables(self):
         rng = _msprime.RandomGenerator(1)
         tables = make_minimal_tables()
@@ -2491,6 +2834,35 @@ class TestRandomGenerator:
         with pytest.raises(AttributeError):
             del rng.seed
 
+    def test_stream(self):
+        rng = _msprime.RandomGenerator(1)
+        assert rng.stream is None
+        with pytest.raises(ValueError):
+            rng.stream = 1
+        rng = _msprime.RandomGenerator(1, stream=0)
+        assert rng.stream == 0
+        x0 = rng.flat(0, 1, 10)
+        rng.stream = 2**64 - 1
+        assert rng.stream == 2**64 - 1
+        rng.stream = 0
+        assert np.array_equal(rng.flat(0, 1, 10), x0)
+        rng.stream = 1
+        assert not np.array_equal(rng.flat(0, 1, 10), x0)
+        other = _msprime.RandomGenerator(2, stream=0)
+        assert not np.array_equal(other.flat(0, 1, 10), x0)
+        # Reseeding keeps the stream
+        other.seed = 1
+        other.stream = 1
+        rng.seed = 1
+        assert np.array_equal(other.flat(0, 1, 10), rng.flat(0, 1, 10))
+        for bad_value in [-1, 2**64]:
+            with pytest.raises(OverflowError):
+                rng.stream = bad_value
+        with pytest.raises(TypeError):
+            _msprime.RandomGenerator(1, stream="x")
+        with pytest.raises(AttributeError):
+            del rng.stream
+
     def test_uninitialised(self):
         uninitialised_rng = _msprime.RandomGenerator.__new__(_msprime.RandomGenerator)
         with pytest.raises(SystemError):
@@ -2916,6 +3288,12 @@ class TestSimMutations:
                 generate(start_time=bad_type)
             with pytest.raises(TypeError):
                 generate(end_time=bad_type)
+            with pytest.raises(TypeError):
+                generate(num_threads=bad_type)
+        with pytest.raises(ValueError):
+            generate(num_threads=-1)
+        generate(num_threads=0)
+        generate(num_threads=4)
 
     def test_tables(self):
         imap = uniform_rate_map(1)
@@ -3165,6 +3543,71 @@ class TestLikelihood:
         with pytest.raises(_msprime.LibraryError):
             _msprime.log_likelihood_arg(lw_tables, 1, 1)
 
+    def test_vector_interface(self):
+        tables = self.get_arg()
+        Ne = np.array([1, 2], dtype=float)
+        rate = np.array([0.5, 1], dtype=float)
+        lik, grad_r, grad_Ne = _msprime.log_likelihood_arg_vector(tables, Ne, rate)
+        for j in range(2):
+            assert lik[j] == pytest.approx(
+                _msprime.log_likelihood_arg(tables, Ne[j], rate[j])
+            )
+        assert grad_r.shape == (2,)
+        assert grad_Ne.shape == (2,)
+        with pytest.raises(TypeError):
+            _msprime.log_likelihood_arg_vector(tables, Ne)
+        with pytest.raises(ValueError):
+            _msprime.log_likelihood_arg_vector(tables, Ne, rate[:1])
+        with pytest.raises(ValueError):
+            _msprime.log_likelihood_arg_vector(tables, Ne, -rate)
+        with pytest.raises(ValueError):
+            _msprime.log_likelihood_arg_vector(tables, [[1]], [[1]])
+        with pytest.raises(_msprime.LibraryError):
+            _msprime.log_likelihood_arg_vector(tables, -Ne, rate)
+
+    def test_stats_interface(self):
+        tables = self.get_arg()
+        stats = _msprime.arg_likelihood_stats(tables)
+        assert len(stats) == 5
+        assert all(isinstance(x, float) for x in stats)
+        Ne = np.array([1, 2], dtype=float)
+        rate = np.array([0.5, 1], dtype=float)
+        expected = _msprime.log_likelihood_arg_vector(tables, Ne, rate)
+        ret = _msprime.log_likelihood_arg_stats(stats, Ne, rate)
+        for x, y in zip(ret, expected):
+            np.testing.assert_array_equal(x, y)
+        with pytest.raises(TypeError):
+            _msprime.arg_likelihood_stats()
+        with pytest.raises(TypeError):
+            _msprime.arg_likelihood_stats(None)
+        with pytest.raises(_msprime.LibraryError):
+            _msprime.arg_likelihood_stats(_msprime.LightweightTableCollection(0))
+        with pytest.raises(TypeError):
+            _msprime.log_likelihood_arg_stats(stats[:4], Ne, rate)
+        with pytest.raises(TypeError):
+            _msprime.log_likelihood_arg_stats(stats, Ne)
+        with pytest.raises(ValueError):
+            _msprime.log_likelihood_arg_stats(stats, Ne, rate[:1])
+        with pytest.raises(ValueError):
+            _msprime.log_likelihood_arg_stats(stats, Ne, -rate)
+        with pytest.raises(_msprime.LibraryError):
+            _msprime.log_likelihood_arg_stats(stats, -Ne, rate)
+
+    def test_mutation_likelihood_interface(self):
+        tables = self.get_arg()
+        mu = np.array([0.5, 1, 2])
+        lik = _msprime.log_likelihood_mut(tables, mu)
+        assert lik.shape == (3,)
+        for num_threads in [1, 2, 5]:
+            other = _msprime.log_likelihood_mut(tables, mu, num_threads=num_threads)
+            assert np.allclose(lik, other)
+        with pytest.raises(TypeError):
+            _msprime.log_likelihood_mut(tables)
+        with pytest.raises(ValueError):
+            _msprime.log_likelihood_mut(tables, -mu)
+        with pytest.raises(ValueError):
+            _msprime.log_likelihood_mut(tables, mu, num_threads=-1)
+
 
 def test_pickle_exceptions():
     exception = _msprime.LibraryError("xyz")
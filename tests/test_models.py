@@ -20,8 +20,11 @@
 Test cases for simulation models to see if they have the correct
 basic properties.
 """
+import logging
+
 import numpy as np
 import pytest
+import tskit
 
 import msprime
 from msprime import _msprime
@@ -71,6 +74,12 @@ class TestIntrospectionInterface:
         assert repr(model) == repr_s
         assert str(model) == repr_s
 
+    def test_hybrid_wright_fisher(self):
+        model = msprime.HybridWrightFisher()
+        repr_s = "HybridWrightFisher(duration=None, switch_threshold=0.01)"
+        assert repr(model) == repr_s
+        assert str(model) == repr_s
+
     def test_fixed_pedigreeigree(self):
         model = msprime.FixedPedigree()
         repr_s = "FixedPedigree(duration=None)"
@@ -636,6 +645,63 @@ class TestMixedModels:
         assert coalescent_times.shape[0] > 0
         assert np.all(coalescent_times != np.floor(coalescent_times))
 
+    @pytest.mark.parametrize("recombination_rate", [0, 0.1])
+    def test_hybrid_wright_fisher(self, recombination_rate):
+        sim = ancestry._parse_sim_ancestry(
+            50,
+            population_size=100,
+            model=msprime.HybridWrightFisher(switch_threshold=0.05),
+            recombination_rate=recombination_rate,
+            sequence_length=10,
+            random_seed=2,
+        )
+        sim.run()
+        t = sim.dtwf_switch_time
+        assert t is not None and t > 0
+        assert sim.model["name"] == "hudson"
+        ts = tskit.TableCollection.fromdict(sim.tables.asdict()).tree_sequence()
+        assert all(tree.num_roots == 1 for tree in ts.trees())
+        times = ts.tables.nodes.time
+        dtwf_times = times[np.logical_and(times > 0, times <= t)]
+        assert dtwf_times.shape[0] > 0
+        assert np.all(dtwf_times == np.floor(dtwf_times))
+        coalescent_times = times[times > t]
+        assert coalescent_times.shape[0] > 0
+        assert np.all(coalescent_times != np.floor(coalescent_times))
+
+    def test_hybrid_wright_fisher_logging(self, caplog):
+        with caplog.at_level(logging.INFO):
+            msprime.sim_ancestry(
+                20,
+                population_size=50,
+                model=msprime.HybridWrightFisher(switch_threshold=0.1),
+                random_seed=5,
+            )
+        assert any("switched from dtwf to hudson" in m for m in caplog.messages)
+
+    def test_hybrid_wright_fisher_logging_later_models(self, caplog):
+        with caplog.at_level(logging.INFO):
+            msprime.sim_ancestry(
+                20,
+                population_size=50,
+                model=[
+                    msprime.HybridWrightFisher(duration=100, switch_threshold=0.1),
+                    msprime.StandardCoalescent(),
+                ],
+                random_seed=5,
+            )
+        messages = [m for m in caplog.messages if "switched from dtwf" in m]
+        assert len(messages) == 1
+        assert messages[0].startswith("model[0]")
+
+    def test_hybrid_wright_fisher_bad_threshold(self):
+        with pytest.raises(ValueError, match="switch_threshold"):
+            msprime.sim_ancestry(
+                2,
+                population_size=10,
+                model=msprime.HybridWrightFisher(switch_threshold=-1),
+            )
+
     def test_wf_hudson_different_specifications(self):
         Ne = 100
         t = 100
@@ -783,14 +849,34 @@ class TestSweepGenicSelection:
     Tests for the single sweep model.
     """
 
-    def test_model_end_broken(self):
-        # Checking that we're correctly detecting the fact that
-        # sweeps are non renentrant.
+    def test_model_end_time(self):
+        # Sweeps can be interrupted, so we stop at the end time.
         model = msprime.SweepGenicSelection(
             position=0.5, start_frequency=0.1, end_frequency=0.9, s=0.01, dt=0.01
         )
-        with pytest.raises(RuntimeError, match="does not support interruption"):
-            msprime.sim_ancestry(10, model=model, end_time=0.0001)
+        ts = msprime.sim_ancestry(10, model=model, end_time=0.0001, random_seed=1)
+        assert np.max(ts.tables.nodes.time) <= 0.0001
+        assert ts.first().num_roots > 1
+
+    def test_event_chunks(self):
+        # Running one event at a time gives the same result as running
+        # the sweep in one go.
+        model = msprime.SweepGenicSelection(
+            position=5, start_frequency=0.1, end_frequency=0.9, s=0.1, dt=1e-4
+        )
+        kwargs = dict(
+            samples=5,
+            model=model,
+            sequence_length=10,
+            recombination_rate=1,
+            random_seed=3,
+        )
+        ts = msprime.sim_ancestry(**kwargs)
+        sim = ancestry._parse_sim_ancestry(**kwargs)
+        sim.run(event_chunk=1)
+        tables = tskit.TableCollection.fromdict(sim.tables.asdict())
+        assert tables.nodes == ts.tables.nodes
+        assert tables.edges == ts.tables.edges
 
     def test_incorrect_num_labels(self):
         model = msprime.SweepGenicSelection(
@@ -919,6 +1005,51 @@ class TestSweepGenicSelection:
         )
         assert any(tree.num_roots > 1 for tree in ts.trees())
 
+    def test_replicates_trajectory_store(self):
+        # Replicates take their trajectories from a store generated up front,
+        # so the results don't depend on how the replicates are run.
+        model = msprime.SweepGenicSelection(
+            position=5, start_frequency=0.1, end_frequency=0.9, s=0.1, dt=1e-3
+        )
+        kwargs = dict(
+            samples=5,
+            model=[model, "hudson"],
+            population_size=1,
+            sequence_length=10,
+            recombination_rate=0.1,
+            num_replicates=4,
+            random_seed=3,
+        )
+        sim = msprime.ancestry._parse_sim_ancestry(
+            **{k: v for k, v in kwargs.items() if k != "num_replicates"}
+        )
+        stores = sim._make_sweep_trajectory_stores(4)
+        assert list(stores.keys()) == [0]
+        assert stores[0].num_trajectories == 4
+        assert sim._make_sweep_trajectory_stores(1) is None
+        replicates = list(msprime.sim_ancestry(**kwargs))
+        assert len({ts.num_edges for ts in replicates}) > 1
+        threaded = [
+            list(msprime.sim_ancestry(**kwargs, num_threads=num_threads))
+            for num_threads in [2, 3]
+        ]
+        for ts1, ts2 in zip(*threaded):
+            ts1.tables.assert_equals(ts2.tables, ignore_provenance=True)
+
+    def test_replicates_no_trajectory_store(self):
+        model = msprime.SweepGenicSelection(
+            position=5, start_frequency=0.1, end_frequency=0.9, s=0.1, dt=1e-3
+        )
+        demography = msprime.Demography.isolated_model([1], growth_rate=[0.1])
+        sim = msprime.ancestry._parse_sim_ancestry(
+            samples=5, model=model, demography=demography, sequence_length=10
+        )
+        assert sim._make_sweep_trajectory_stores(4) is None
+        sim = msprime.ancestry._parse_sim_ancestry(
+            samples=5, population_size=1, sequence_length=10
+        )
+        assert sim._make_sweep_trajectory_stores(4) is None
+
     def test_many_sweeps(self):
         sweep_models = [
             msprime.SweepGenicSelection(
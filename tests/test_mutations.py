@@ -814,6 +814,35 @@ class TestSimMutations(MutateMixin):
         assert all(tables[0].sites == t.sites for t in tables[1:])
         assert all(tables[0].mutations == t.mutations for t in tables[1:])
 
+    @pytest.mark.parametrize("discrete_genome", [True, False])
+    def test_num_threads(self, discrete_genome):
+        ts = msprime.sim_ancestry(
+            10, sequence_length=100, recombination_rate=0.1, random_seed=2
+        )
+        for num_threads in [1, 4]:
+            mutated = [
+                msprime.sim_mutations(
+                    ts,
+                    rate=0.1,
+                    random_seed=5,
+                    discrete_genome=discrete_genome,
+                    num_threads=num_threads,
+                )
+                for _ in range(2)
+            ]
+            assert mutated[0].num_mutations > 0
+            t1 = mutated[0].dump_tables()
+            t2 = mutated[1].dump_tables()
+            self.verify_topology(ts.dump_tables(), t1)
+            assert t1.sites == t2.sites
+            assert t1.mutations == t2.mutations
+
+    def test_bad_num_threads(self):
+        ts = msprime.sim_ancestry(2, random_seed=2)
+        for bad_value in [0, -1]:
+            with pytest.raises(ValueError):
+                msprime.sim_mutations(ts, rate=1, num_threads=bad_value)
+
     def test_numpy_inputs(self):
         ts = msprime.sim_ancestry(10, sequence_length=10, random_seed=2)
         values = np.array([0, 1, 2.5])
@@ -2043,10 +2072,19 @@ class PythonMutationMatrixModel(PythonMutationModel):
 
     def choose_allele(self, rng, distribution):
         u = rng.flat(0, 1)
-        j = 0
-        while u > distribution[j]:
-            u -= distribution[j]
-            j += 1
+        if len(distribution) < MATRIX_ALIAS_MIN_ALLELES:
+            j = 0
+            while u > distribution[j]:
+                u -= distribution[j]
+                j += 1
+            return self.alleles[j]
+        # Same alias table construction and lookup as alias_table_alloc
+        # and alias_table_sample in the C library.
+        probability, alias = alias_table(distribution)
+        x = u * len(probability)
+        j = min(int(x), len(probability) - 1)
+        if x - j >= probability[j]:
+            j = alias[j]
         return self.alleles[j]
 
     def root_allele(self, rng):
@@ -2057,6 +2095,48 @@ class PythonMutationMatrixModel(PythonMutationModel):
         return self.choose_allele(rng, self.transition_matrix[j])
 
 
+def discrete_rate_map(position, rate):
+    # Same as mutgen_init_discrete_rate_map in the C library.
+    discrete_position = [0.0]
+    discrete_rate = []
+    for j in range(len(rate)):
+        right = float(np.ceil(position[j + 1]))
+        if right > discrete_position[-1]:
+            discrete_rate.append(rate[j])
+            discrete_position.append(right)
+    return discrete_position, discrete_rate
+
+
+# Same as MSP_MATRIX_ALIAS_MIN_ALLELES in the C library
+MATRIX_ALIAS_MIN_ALLELES = 5
+
+
+def alias_table(distribution):
+    n = len(distribution)
+    total = 0.0
+    for p in distribution:
+        total += float(p)
+    scaled = [float(p) * n / total for p in distribution]
+    probability = [0.0] * n
+    alias = [0] * n
+    small = [j for j in range(n) if scaled[j] < 1]
+    large = [j for j in range(n) if scaled[j] >= 1]
+    while len(small) > 0 and len(large) > 0:
+        s = small.pop()
+        g = large.pop()
+        probability[s] = scaled[s]
+        alias[s] = g
+        scaled[g] = (scaled[g] + scaled[s]) - 1
+        if scaled[g] < 1:
+            small.append(g)
+        else:
+            large.append(g)
+    for j in large + small:
+        probability[j] = 1.0
+        alias[j] = j
+    return probability, alias
+
+
 def cmp_mutation(a, b):
     # Sort mutations by decreasing time and increasing parent,
     # but preserving order of any kept mutations (assumed to be
@@ -2157,42 +2237,68 @@ class PythonMutationGenerator:
                 site_id += 1
 
     def place_mutations(self, tables, discrete_genome=False):
-        # Insert a sentinel into the map for convenience.
-        map_position = np.hstack([self.rate_map.position, [tables.sequence_length]])
+        # One Poisson draw per edge, with positions drawn by inverting the
+        # cumulative mass. For discrete genomes each interval of the map is
+        # rounded to the integers it covers.
+        position = list(self.rate_map.position)
+        rate = list(self.rate_map.rate)
+        if discrete_genome:
+            position, rate = discrete_rate_map(position, rate)
+        cumulative_mass = [0.0]
+        for j in range(len(rate)):
+            mass = (position[j + 1] - position[j]) * rate[j]
+            cumulative_mass.append(cumulative_mass[-1] + mass)
         node_times = tables.nodes.time
         for edge in tables.edges:
             branch_start = node_times[edge.child]
             branch_end = node_times[edge.parent]
             branch_length = branch_end - branch_start
-            index = np.searchsorted(map_position, edge.left)
-            if map_position[index] > edge.left:
-                index -= 1
-            left = edge.left
-            right = 0
-            while right != edge.right:
-                right = min(edge.right, map_position[index + 1])
-                site_left = np.ceil(left) if discrete_genome else left
-                site_right = np.ceil(right) if discrete_genome else right
-                assert site_left <= site_right
-                assert map_position[index] <= left
-                assert right <= map_position[index + 1]
-                assert right <= edge.right
-                # Generate the mutations.
-                rate = self.rate_map.rate[index]
-                mu = rate * (site_right - site_left) * branch_length
-                for _ in range(self.rng.poisson(mu)[0]):
-                    position = self.rng.flat(site_left, site_right)[0]
-                    if discrete_genome:
-                        position = np.floor(position)
-                    assert edge.left <= position
-                    assert position < edge.right
-                    if position not in self.sites:
-                        self.add_site(position=position, new=True)
-                    site = self.sites[position]
-                    time = self.rng.flat(branch_start, branch_end)
-                    site.add_mutation(node=edge.child, time=time, new=True)
-                index += 1
-                left = right
+            left = np.ceil(edge.left) if discrete_genome else edge.left
+            right = np.ceil(edge.right) if discrete_genome else edge.right
+            left_index = right_index = 0
+            if left < right:
+                left_index = np.searchsorted(position, left, side="right") - 1
+                right_index = np.searchsorted(position, right, side="left") - 1
+            if left >= right:
+                mu = 0
+            elif left_index == right_index:
+                mu = branch_length * (right - left) * rate[left_index]
+            else:
+                left_mass = (
+                    cumulative_mass[left_index]
+                    + (left - position[left_index]) * rate[left_index]
+                )
+                right_mass = (
+                    cumulative_mass[right_index]
+                    + (right - position[right_index]) * rate[right_index]
+                )
+                mu = branch_length * (right_mass - left_mass)
+            for _ in range(self.rng.poisson(mu)[0]):
+                if left_index == right_index:
+                    x = self.rng.flat(left, right)[0]
+                else:
+                    while True:
+                        mass = self.rng.flat(left_mass, right_mass)[0]
+                        j = (
+                            np.searchsorted(
+                                cumulative_mass[left_index + 1 : right_index + 1],
+                                mass,
+                                side="right",
+                            )
+                            + left_index
+                        )
+                        if rate[j] > 0:
+                            x = position[j] + (mass - cumulative_mass[j]) / rate[j]
+                            if left <= x < right:
+                                break
+                if discrete_genome:
+                    x = np.floor(x)
+                assert left <= x < right
+                if x not in self.sites:
+                    self.add_site(position=x, new=True)
+                site = self.sites[x]
+                time = self.rng.flat(branch_start, branch_end)
+                site.add_mutation(node=edge.child, time=time, new=True)
 
     def choose_alleles(self, tree_parent, site, mutation_id_offset):
         if site.new: